@@ -1,4 +1,5 @@
 #include "drtaint.h"
+#include "drtaint_opcode_table.h"
 #include "dr_api.h"
 #include "drmgr.h"
 #include "drreg.h"
@@ -184,22 +185,18 @@ event_bb(void *drcontext, void *tag, instrlist_t *ilist, instr_t *where,
     if (instr_is_meta(where))
         return DR_EMIT_DEFAULT;
 
-    int opcode = instr_get_opcode(where);
-
-    // no simd instructions supported
-    if (opcode >= 315)
+    // nothing can be tainted before the first read
+    if (!drtaint_is_active())
         return DR_EMIT_DEFAULT;
 
-    // no coproc instructions supported
-    if (opcode >= OP_mcr && opcode <= OP_mcrr2)
-        return DR_EMIT_DEFAULT;
-    if (opcode >= OP_mrc && opcode <= OP_mrrc2)
+    // taint isn't tracked in excluded modules
+    if (drtaint_is_excluded(instr_get_app_pc(where)))
         return DR_EMIT_DEFAULT;
-    if (opcode == OP_cdp || opcode == OP_cdp2)
-        return DR_EMIT_DEFAULT;
-    if (opcode >= OP_ldc && opcode <= OP_ldcl)
-        return DR_EMIT_DEFAULT;
-    if (opcode >= OP_stc && opcode <= OP_stcl)
+
+    int opcode = instr_get_opcode(where);
+
+    // no simd and coproc instructions supported
+    if (TESTANY(OPCODE_VECTOR | OPCODE_COPROC, opcode_info(opcode).flags))
         return DR_EMIT_DEFAULT;
 
     per_thread_t *tls = (per_thread_t *)drmgr_get_tls_field(drcontext, tls_index);
@@ -216,8 +213,17 @@ event_bb(void *drcontext, void *tag, instrlist_t *ilist, instr_t *where,
 DR_EXPORT void
 dr_client_main(client_id_t id, int argc, const char *argv[])
 {
+    // the loader and libc init run before any input is read
+    drtaint_options_t ops = {sizeof(ops), DRTAINT_OPTION_LAZY_ACTIVATION};
     bool ok;
-    ok = drtaint_init(id);
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (!drtaint_parse_option(argc, argv, &i, &ops))
+            dr_printf("Unknown option: %s\n", argv[i]);
+    }
+
+    ok = drtaint_init_ex(id, &ops);
     DR_ASSERT(ok);
 
     // We want to add our instrumentation before drtaint's one
@@ -14,7 +14,19 @@ exit_event(void);
 DR_EXPORT void
 dr_client_main(client_id_t id, int argc, const char *argv[])
 {
-    drtaint_init(id);
+    drtaint_options_t ops = {sizeof(ops), 0};
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (!drtaint_parse_option(argc, argv, &i, &ops))
+            dr_printf("Unknown option: %s\n", argv[i]);
+    }
+
+    // the clean page hit rate is what -page_summary is measured by
+    if (TEST(DRTAINT_OPTION_PAGE_SUMMARY, ops.flags))
+        ops.flags |= DRTAINT_OPTION_SUMMARY_COUNTERS | DRTAINT_OPTION_STATS_REPORT;
+
+    drtaint_init_ex(id, &ops);
     dr_register_exit_event(exit_event);
 }
 
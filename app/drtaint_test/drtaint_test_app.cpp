@@ -1,8 +1,15 @@
 #include "drtaint_test_app.h"
 
 #include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
 #include <stdio.h>
 #include <string.h>
+#include <time.h>
+#include <alloca.h>
 
 // #TODO: add __FILE__, __LINE__, __FUNCTION__ to TEST_ASSERT
 
@@ -46,6 +53,9 @@ usage();
 static void
 run_tests_with_prefix(char *prefix, size_t len);
 
+static void
+run_benchmarks();
+
 Test g_tests[] = {
 
     {"simple", test_simple},
@@ -54,11 +64,25 @@ Test g_tests[] = {
     {"bitwise", test_bitwise},
     {"struct", test_struct},
     {"func_call", test_func_call},
+    {"profile", test_profile},
     {"array", test_array},
+    {"libc", test_libc},
+    {"copy_loop", test_copy_loop},
+    {"copy_taint", test_copy_taint},
+    {"find_tainted", test_find_tainted},
     {"condex_op", test_condex_op},
     {"assign_ex", test_assign_ex},
     {"untaint", test_untaint},
     {"untaint_stack", test_untaint_stack},
+    {"untaint_stack_alloca", test_untaint_stack_alloca},
+    {"reclaim_munmap", test_reclaim_munmap},
+    {"reclaim_mremap", test_reclaim_mremap},
+    {"reclaim_brk", test_reclaim_brk},
+    {"untaint_read", test_untaint_read},
+    {"untaint_readv", test_untaint_readv},
+    {"untaint_recvmsg", test_untaint_recvmsg},
+    {"untaint_recvfrom", test_untaint_recvfrom},
+    {"untaint_fstat", test_untaint_fstat},
 
     // asm
     {"ldr_imm", test_asm_ldr_imm},
@@ -101,6 +125,18 @@ Test g_tests[] = {
 
 const int g_tests_sz = sizeof(g_tests) / sizeof(g_tests[0]);
 
+// run with --bench or by name, --all skips them
+Test g_benches[] = {
+
+    {"bench_call", bench_call},
+    {"bench_arith", bench_arith},
+    {"bench_clean", bench_clean},
+    {"bench_memcpy", bench_memcpy},
+    {"bench_copy_loop", bench_copy_loop},
+};
+
+const int g_benches_sz = sizeof(g_benches) / sizeof(g_benches[0]);
+
 int main(int argc, char *argv[])
 {
     if (argc == 1)
@@ -115,6 +151,12 @@ int main(int argc, char *argv[])
         return 0;
     }
 
+    if (!strcmp(argv[1], "--bench"))
+    {
+        run_benchmarks();
+        return 0;
+    }
+
     if (!strcmp(argv[1], "--show"))
     {
         show_all_tests();
@@ -174,6 +216,14 @@ Test *find_test(const char *name)
             return pt;
     }
 
+    for (int i = 0; i < g_benches_sz; i++)
+    {
+        pt = &g_benches[i];
+
+        if (!strcmp(name, pt->name))
+            return pt;
+    }
+
     return NULL;
 }
 
@@ -227,12 +277,26 @@ void run_tests_with_prefix(char *prefix, size_t len)
            count_passed, count_failed);
 }
 
+void run_benchmarks()
+{
+    for (int i = 0; i < g_benches_sz; i++)
+    {
+        printf("\n\n--- Running benchmark %s--- \n\n", g_benches[i].name);
+        g_benches[i].run();
+    }
+}
+
 void show_all_tests()
 {
     printf("Available tests:\n");
 
     for (int i = 0; i < g_tests_sz; i++)
         printf("  %-3d %s\n", i + 1, g_tests[i].name);
+
+    printf("Available benchmarks:\n");
+
+    for (int i = 0; i < g_benches_sz; i++)
+        printf("  %-3d %s\n", i + 1, g_benches[i].name);
 }
 
 void usage()
@@ -241,6 +305,7 @@ void usage()
     printf("Run tests: file.exe <test1> <test2> ...\n");
     printf("Run tests with prefix: file.exe --prefix <prefix>\n");
     printf("Run all tests: file.exe --all\n");
+    printf("Run all benchmarks: file.exe --bench\n");
     printf("Show all tests: file.exe --show\n");
 }
 
@@ -475,6 +540,178 @@ bool test_array()
 
 #pragma endregion array
 
+#pragma region libc
+
+// called through volatile pointers, so that the compiler can't inline them
+static char *(*volatile libc_strcpy)(char *, const char *) = strcpy;
+static size_t (*volatile libc_strlen)(const char *) = strlen;
+
+bool test_libc()
+/*
+    The sizes are volatile, so that the compiler calls libc
+    instead of inlining the copies. Run with and without
+    -libc_summaries client option.
+    Whether strlen's result of a tainted string is tainted depends
+    on the option, only the result of a clean one is checked
+*/
+{
+    TEST_START;
+    char src[256], dst[256], buf[64];
+    volatile unsigned n = sizeof(src), n_buf = 16;
+    int c = 'x';
+
+    MAKE_TAINTED(src, sizeof(src));
+    memcpy(dst, src, n);
+    TEST_ASSERT(IS_TAINTED(dst, sizeof(dst)));
+
+    memset(dst, 0, n);
+    TEST_ASSERT(!IS_TAINTED(dst, 1));
+    TEST_ASSERT(!IS_TAINTED(dst + sizeof(dst) - 1, 1));
+
+    MAKE_TAINTED(&c, sizeof(c));
+    memset(dst, c, n);
+    TEST_ASSERT(IS_TAINTED(dst, sizeof(dst)));
+
+    CLEAR(buf, sizeof(buf));
+    MAKE_TAINTED(buf, 16);
+    memmove(buf + 8, buf, n_buf);
+    TEST_ASSERT(IS_TAINTED(buf + 8, 16));
+    TEST_ASSERT(!IS_TAINTED(buf + 24, 1));
+
+    // the terminator is copied, the bytes after it aren't
+    memset(src, 'a', 15);
+    src[15] = 0;
+    CLEAR(src, sizeof(src));
+    CLEAR(dst, sizeof(dst));
+    MAKE_TAINTED(src, 16);
+    MAKE_TAINTED(src + 32, 32);
+    libc_strcpy(dst, src);
+    TEST_ASSERT(IS_TAINTED(dst, 16));
+    TEST_ASSERT(!IS_TAINTED(dst + 16, 1));
+
+    // tainted bytes past the terminator don't taint the length
+    size_t len;
+    CLEAR(src, 16);
+    len = libc_strlen(src);
+    TEST_ASSERT(len == 15);
+    TEST_ASSERT(!IS_TAINTED(&len, sizeof(len)));
+
+    TEST_END;
+}
+
+static void
+copy_loop(char *dst, const char *src, unsigned n)
+{
+    // a loop the compiler can't replace with a memcpy call
+    asm volatile("1: ldrb r3, [%1], #1;"
+                 "strb r3, [%0], #1;"
+                 "subs %2, %2, #1;"
+                 "bne 1b;"
+                 : "+r"(dst), "+r"(src), "+r"(n)
+                 :
+                 : "r3", "cc", "memory");
+}
+
+bool test_copy_loop()
+/*
+    Run with and without -loop_summaries client option
+*/
+{
+    TEST_START;
+    char src[256], dst[256], buf[64];
+
+    CLEAR(src, sizeof(src));
+    CLEAR(dst, sizeof(dst));
+    MAKE_TAINTED(src + 64, 64);
+    copy_loop(dst, src, sizeof(src));
+    TEST_ASSERT(!IS_TAINTED(dst, 64));
+    TEST_ASSERT(IS_TAINTED(dst + 64, 64));
+    TEST_ASSERT(!IS_TAINTED(dst + 128, 128));
+
+    // the loop smears the first byte over the rest
+    CLEAR(buf, sizeof(buf));
+    MAKE_TAINTED(buf, 1);
+    copy_loop(buf + 1, buf, 32);
+    TEST_ASSERT(IS_TAINTED(buf, 33));
+    TEST_ASSERT(!IS_TAINTED(buf + 33, 1));
+
+    TEST_END;
+}
+
+static char copy_src[3 * 4096 + 64];
+static char copy_dst[3 * 4096 + 64];
+
+bool test_copy_taint()
+/*
+    drtaint_copy_app_taint and drtaint_move_app_taint,
+    only the taint is copied, not the data
+*/
+{
+    TEST_START;
+    char buf[64];
+
+    CLEAR(copy_src, sizeof(copy_src));
+    MAKE_TAINTED(copy_dst, sizeof(copy_dst));
+    MAKE_TAINTED(copy_src + 100, 3 * 4096);
+    COPY_TAINT(copy_dst, copy_src, sizeof(copy_src));
+    TEST_ASSERT(!IS_TAINTED(copy_dst + 99, 1));
+    TEST_ASSERT(IS_TAINTED(copy_dst + 100, 3 * 4096));
+    TEST_ASSERT(!IS_TAINTED(copy_dst + 100 + 3 * 4096, 1));
+
+    // a clean source clears the destination
+    CLEAR(copy_src, sizeof(copy_src));
+    COPY_TAINT(copy_dst, copy_src, sizeof(copy_src));
+    TEST_ASSERT(!IS_TAINTED(copy_dst + 100, 1));
+    TEST_ASSERT(!IS_TAINTED(copy_dst + 2 * 4096, 1));
+
+    // overlapping ranges, forwards
+    CLEAR(buf, sizeof(buf));
+    MAKE_TAINTED(buf, 16);
+    MOVE_TAINT(buf + 8, buf, 16);
+    TEST_ASSERT(IS_TAINTED(buf, 24));
+    TEST_ASSERT(!IS_TAINTED(buf + 24, 1));
+
+    // and backwards, the source's tail keeps its taint
+    CLEAR(buf, sizeof(buf));
+    MAKE_TAINTED(buf + 32, 16);
+    MOVE_TAINT(buf + 24, buf + 32, 16);
+    TEST_ASSERT(!IS_TAINTED(buf + 23, 1));
+    TEST_ASSERT(IS_TAINTED(buf + 24, 24));
+    TEST_ASSERT(!IS_TAINTED(buf + 48, 1));
+
+    TEST_END;
+}
+
+static char scan_buf[2 * 4096 + 64];
+
+bool test_find_tainted()
+/*
+    drtaint_find_tainted and drtaint_is_area_clean
+    over page boundaries and unaligned ranges
+*/
+{
+    TEST_START;
+
+    CLEAR(scan_buf, sizeof(scan_buf));
+    TEST_ASSERT(IS_CLEAN(scan_buf, sizeof(scan_buf)));
+    TEST_ASSERT(FIND_TAINTED(scan_buf, sizeof(scan_buf)) == -1);
+
+    MAKE_TAINTED(scan_buf + 4096 + 7, 1);
+    MAKE_TAINTED(scan_buf + 2 * 4096, 4);
+    TEST_ASSERT(!IS_CLEAN(scan_buf, sizeof(scan_buf)));
+    TEST_ASSERT(FIND_TAINTED(scan_buf, sizeof(scan_buf)) == 4096 + 7);
+    TEST_ASSERT(FIND_TAINTED(scan_buf + 4096 + 7, 1) == 0);
+    TEST_ASSERT(FIND_TAINTED(scan_buf + 4096 + 8, 4096) == 4096 - 8);
+
+    // the ranges end right before a tainted byte
+    TEST_ASSERT(IS_CLEAN(scan_buf + 1, 4096 + 6));
+    TEST_ASSERT(IS_CLEAN(scan_buf + 4096 + 8, 4096 - 8));
+
+    TEST_END;
+}
+
+#pragma endregion libc
+
 #pragma region func_call
 
 static int cube_cp(int x)
@@ -509,6 +746,43 @@ bool test_func_call()
 
 #pragma endregion func_call
 
+#pragma region profile
+
+static __attribute__((noinline)) void
+profile_copy(int *dst, const int *src)
+{
+    *dst = *src + 1;
+}
+
+bool test_profile()
+/*
+    Run with -profile of a missing or empty file: the copy's block
+    is only guarded until a tainted source trips the guard, then
+    it is rebuilt with propagation and resumes at the load
+*/
+{
+    TEST_START;
+    int src = 1, dst = 0;
+
+    CLEAR(&src, sizeof(src));
+    CLEAR(&dst, sizeof(dst));
+    profile_copy(&dst, &src);
+    TEST_ASSERT(!IS_TAINTED(&dst, sizeof(dst)));
+
+    MAKE_TAINTED(&src, sizeof(src));
+    profile_copy(&dst, &src);
+    TEST_ASSERT(IS_TAINTED(&dst, sizeof(dst)));
+
+    // the rebuilt block
+    CLEAR(&dst, sizeof(dst));
+    profile_copy(&dst, &src);
+    TEST_ASSERT(IS_TAINTED(&dst, sizeof(dst)));
+
+    TEST_END;
+}
+
+#pragma endregion profile
+
 #pragma region condex_op
 
 bool test_condex_op()
@@ -622,8 +896,295 @@ bool test_untaint_stack()
     TEST_END;
 }
 
+bool func_help_us3(volatile uint size)
+{
+    TEST_START;
+
+    // sub sp, sp, reg
+    char *buf = (char *)alloca(size);
+
+    printf("func_help_us3: checking alloca buf\n");
+    TEST_ASSERT(!IS_TAINTED(buf, size));
+    TEST_END;
+}
+
+bool test_untaint_stack_alloca()
+/*
+    The same for frames allocated with a register size
+*/
+{
+    TEST_START;
+    func_help_us1();
+    TEST_ASSERT(func_help_us3(256));
+    TEST_END;
+}
+
 #pragma endregion untaint_stack
 
+#pragma region reclaim
+
+#define TEST_PAGE_SIZE 4096
+
+bool test_reclaim_munmap()
+/*
+    Unmapped memory loses its taint, whole shadow
+    blocks of it are given back to the system
+*/
+{
+    TEST_START;
+    size_t size = 1 << 20;
+    char *p, *q;
+    unsigned reclaimed;
+
+    p = (char *)mmap(NULL, size, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    TEST_ASSERT(p != MAP_FAILED);
+    if (p == MAP_FAILED)
+        TEST_END;
+
+    reclaimed = RECLAIMED_BYTES();
+    MAKE_TAINTED(p, size);
+    TEST_ASSERT(IS_TAINTED(p, size));
+
+    munmap(p, size);
+    TEST_ASSERT(RECLAIMED_BYTES() > reclaimed);
+
+    // most likely the same range again
+    q = (char *)mmap(p, size, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    TEST_ASSERT(q != MAP_FAILED);
+    if (q == MAP_FAILED)
+        TEST_END;
+
+    printf("mapped again %s\n", p == q ? "at the same address" : "elsewhere");
+    TEST_ASSERT(IS_CLEAN(q, size));
+    munmap(q, size);
+
+    TEST_END;
+}
+
+bool test_reclaim_mremap()
+/*
+    Taint follows moved memory, the pages
+    a mapping grows or shrinks by are clean
+*/
+{
+    TEST_START;
+    char *p, *q;
+
+    p = (char *)mmap(NULL, 2 * TEST_PAGE_SIZE, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    TEST_ASSERT(p != MAP_FAILED);
+    if (p == MAP_FAILED)
+        TEST_END;
+
+    MAKE_TAINTED(p, 2 * TEST_PAGE_SIZE);
+    q = (char *)mremap(p, 2 * TEST_PAGE_SIZE, 64 * TEST_PAGE_SIZE, MREMAP_MAYMOVE);
+    TEST_ASSERT(q != MAP_FAILED);
+    if (q == MAP_FAILED)
+        TEST_END;
+
+    printf("grown %s\n", p == q ? "in place" : "by a move");
+    TEST_ASSERT(IS_TAINTED(q, 2 * TEST_PAGE_SIZE));
+    TEST_ASSERT(IS_CLEAN(q + 2 * TEST_PAGE_SIZE, 62 * TEST_PAGE_SIZE));
+
+    // shrinking is done in place, the page is new after growing again
+    q = (char *)mremap(q, 64 * TEST_PAGE_SIZE, TEST_PAGE_SIZE, 0);
+    TEST_ASSERT(q != MAP_FAILED);
+    if (q == MAP_FAILED)
+        TEST_END;
+
+    q = (char *)mremap(q, TEST_PAGE_SIZE, 2 * TEST_PAGE_SIZE, MREMAP_MAYMOVE);
+    TEST_ASSERT(q != MAP_FAILED);
+    if (q == MAP_FAILED)
+        TEST_END;
+
+    TEST_ASSERT(IS_TAINTED(q, TEST_PAGE_SIZE));
+    TEST_ASSERT(IS_CLEAN(q + TEST_PAGE_SIZE, TEST_PAGE_SIZE));
+    munmap(q, 2 * TEST_PAGE_SIZE);
+
+    TEST_END;
+}
+
+bool test_reclaim_brk()
+/*
+    The heap shrinks and grows back over a tainted page.
+    Nothing may allocate in between, so the result
+    is only checked after the heap is restored
+*/
+{
+    TEST_START;
+    char *brk_start = (char *)sbrk(0);
+    bool clean = false;
+
+    if (sbrk(TEST_PAGE_SIZE) != (void *)-1)
+    {
+        MAKE_TAINTED(brk_start, TEST_PAGE_SIZE);
+        sbrk(-TEST_PAGE_SIZE);
+        if (sbrk(TEST_PAGE_SIZE) != (void *)-1)
+        {
+            clean = IS_CLEAN(brk_start, TEST_PAGE_SIZE);
+            sbrk(-TEST_PAGE_SIZE);
+        }
+    }
+
+    TEST_ASSERT(clean);
+    TEST_END;
+}
+
+#pragma endregion reclaim
+
+#pragma region untaint_syscall
+
+// the data the kernel writes in the tests
+static const char sys_data[] = "0123456789abcdef";
+#define SYS_DATA_SIZE 16
+
+bool test_untaint_read()
+/*
+    Only the bytes read are untainted
+*/
+{
+    TEST_START;
+    char buf[64];
+    int fds[2];
+
+    TEST_ASSERT(pipe(fds) == 0);
+    TEST_ASSERT(write(fds[1], sys_data, SYS_DATA_SIZE) == SYS_DATA_SIZE);
+
+    MAKE_TAINTED(buf, sizeof(buf));
+    TEST_ASSERT(read(fds[0], buf, sizeof(buf)) == SYS_DATA_SIZE);
+    TEST_ASSERT(IS_CLEAN(buf, SYS_DATA_SIZE));
+    TEST_ASSERT(IS_TAINTED(buf + SYS_DATA_SIZE, sizeof(buf) - SYS_DATA_SIZE));
+
+    close(fds[0]);
+    close(fds[1]);
+    TEST_END;
+}
+
+bool test_untaint_readv()
+/*
+    The data spans both buffers, the second one only partly
+*/
+{
+    TEST_START;
+    char buf1[8], buf2[32];
+    struct iovec iov[2] = {{buf1, sizeof(buf1)}, {buf2, sizeof(buf2)}};
+    size_t rest = SYS_DATA_SIZE - sizeof(buf1);
+    int fds[2];
+
+    TEST_ASSERT(pipe(fds) == 0);
+    TEST_ASSERT(write(fds[1], sys_data, SYS_DATA_SIZE) == SYS_DATA_SIZE);
+
+    MAKE_TAINTED(buf1, sizeof(buf1));
+    MAKE_TAINTED(buf2, sizeof(buf2));
+    TEST_ASSERT(readv(fds[0], iov, 2) == SYS_DATA_SIZE);
+    TEST_ASSERT(IS_CLEAN(buf1, sizeof(buf1)));
+    TEST_ASSERT(IS_CLEAN(buf2, rest));
+    TEST_ASSERT(IS_TAINTED(buf2 + rest, sizeof(buf2) - rest));
+
+    close(fds[0]);
+    close(fds[1]);
+    TEST_END;
+}
+
+bool test_untaint_recvmsg()
+/*
+    The data and the header fields the kernel updates
+*/
+{
+    TEST_START;
+    char buf[64];
+    struct iovec iov = {buf, sizeof(buf)};
+    struct msghdr msg;
+    int fds[2];
+
+    TEST_ASSERT(socketpair(AF_UNIX, SOCK_DGRAM, 0, fds) == 0);
+    TEST_ASSERT(send(fds[1], sys_data, SYS_DATA_SIZE, 0) == SYS_DATA_SIZE);
+
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+
+    MAKE_TAINTED(buf, sizeof(buf));
+    MAKE_TAINTED(&msg.msg_flags, sizeof(msg.msg_flags));
+    TEST_ASSERT(recvmsg(fds[0], &msg, 0) == SYS_DATA_SIZE);
+    TEST_ASSERT(IS_CLEAN(buf, SYS_DATA_SIZE));
+    TEST_ASSERT(IS_TAINTED(buf + SYS_DATA_SIZE, sizeof(buf) - SYS_DATA_SIZE));
+    TEST_ASSERT(IS_CLEAN(&msg.msg_flags, sizeof(msg.msg_flags)));
+
+    close(fds[0]);
+    close(fds[1]);
+    TEST_END;
+}
+
+bool test_untaint_recvfrom()
+/*
+    The peer address is truncated to a buffer smaller than it,
+    the bytes after the buffer keep their taint
+*/
+{
+    TEST_START;
+    struct sockaddr_in self, from;
+    socklen_t len = sizeof(self);
+    char buf[64];
+    int fd;
+
+    fd = socket(AF_INET, SOCK_DGRAM, 0);
+    TEST_ASSERT(fd >= 0);
+    if (fd < 0)
+        TEST_END;
+
+    // recvfrom would block without the datagram
+    memset(&self, 0, sizeof(self));
+    self.sin_family = AF_INET;
+    self.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(fd, (struct sockaddr *)&self, sizeof(self)) != 0 ||
+        getsockname(fd, (struct sockaddr *)&self, &len) != 0 ||
+        sendto(fd, sys_data, SYS_DATA_SIZE, 0,
+               (struct sockaddr *)&self, sizeof(self)) != SYS_DATA_SIZE)
+    {
+        printf("loopback is not available\n");
+        close(fd);
+        return false;
+    }
+
+    MAKE_TAINTED(buf, sizeof(buf));
+    MAKE_TAINTED(&from, sizeof(from));
+    len = 4;
+    TEST_ASSERT(recvfrom(fd, buf, sizeof(buf), 0,
+                         (struct sockaddr *)&from, &len) == SYS_DATA_SIZE);
+    TEST_ASSERT(len == sizeof(from));
+    TEST_ASSERT(IS_CLEAN(buf, SYS_DATA_SIZE));
+    TEST_ASSERT(IS_CLEAN(&from, 4));
+    TEST_ASSERT(IS_TAINTED((char *)&from + 4, sizeof(from) - 4));
+
+    close(fd);
+    TEST_END;
+}
+
+bool test_untaint_fstat()
+/*
+    Called directly, libc may use statx instead
+*/
+{
+    TEST_START;
+    unsigned long long st[13]; // kernel's struct stat64
+    int fds[2];
+
+    TEST_ASSERT(pipe(fds) == 0);
+
+    MAKE_TAINTED(st, sizeof(st));
+    TEST_ASSERT(syscall(SYS_fstat64, fds[0], st) == 0);
+    TEST_ASSERT(IS_CLEAN(st, sizeof(st)));
+
+    close(fds[0]);
+    close(fds[1]);
+    TEST_END;
+}
+
+#pragma endregion untaint_syscall
+
 #pragma region asm_ldr_imm
 
 #define INL_LDR(com, r0, r1)                \
@@ -2540,4 +3101,162 @@ bool test_asm_cond()
     TEST_END;
 }
 
-#pragma endregion conditional
\ No newline at end of file
+#pragma endregion conditional
+
+#pragma region bench
+
+static long
+bench_elapsed_ms(const struct timespec *start, const struct timespec *end)
+{
+    return (end->tv_sec - start->tv_sec) * 1000 +
+           (end->tv_nsec - start->tv_nsec) / 1000000;
+}
+
+static int __attribute__((noinline))
+bench_call_fib(int n)
+{
+    if (n < 2)
+        return n;
+
+    return bench_call_fib(n - 1) + bench_call_fib(n - 2);
+}
+
+bool bench_call()
+/*
+    Call-heavy kernel: every call pushes and pops a frame with stm/ldm,
+    so it shows the cost of ldm/stm taint propagation.
+    Compare runs with and without -ldm_stm_clean_call client option
+*/
+{
+    TEST_START;
+    struct timespec start, end;
+    int n = 25, res;
+
+    MAKE_TAINTED(&n, sizeof(int));
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    res = bench_call_fib(n);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    printf("fib(%d) = %d, elapsed: %ld ms\n", n, res, bench_elapsed_ms(&start, &end));
+    TEST_ASSERT(IS_TAINTED(&res, sizeof(int)));
+    TEST_END;
+}
+
+static unsigned __attribute__((noinline))
+bench_arith_mix(unsigned seed, int n)
+{
+    unsigned a = seed, b = seed ^ 0x9e3779b9, c = 0;
+
+    for (int i = 0; i < n; i++)
+    {
+        a += b;
+        b ^= a << 7;
+        a = (a >> 3) + b;
+        b -= a ^ c;
+        c += a + (b >> 11);
+    }
+
+    return a ^ b ^ c;
+}
+
+bool bench_arith()
+/*
+    Register-only kernel: the loop body is a single block of
+    dependent arithmetic on a few registers, so it shows the cost of
+    shadow register accesses. Compare runs with and without
+    -resident_shadows client option
+*/
+{
+    TEST_START;
+    struct timespec start, end;
+    unsigned seed = 12345, res;
+    int n = 10000000;
+
+    MAKE_TAINTED(&seed, sizeof(seed));
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    res = bench_arith_mix(seed, n);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    printf("mix(%d) = %u, elapsed: %ld ms\n", n, res, bench_elapsed_ms(&start, &end));
+    TEST_ASSERT(IS_TAINTED(&res, sizeof(res)));
+    TEST_END;
+}
+
+bool bench_clean()
+/*
+    The same kernels with clean inputs while unrelated memory is tainted,
+    no register ever holds taint. Compare runs with and without
+    -dual_blocks client option
+*/
+{
+    TEST_START;
+    struct timespec start, end;
+    char secret[64] = {0};
+    unsigned seed = 12345, mix;
+    int n = 25, fib;
+
+    MAKE_TAINTED(secret, sizeof(secret));
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    fib = bench_call_fib(n);
+    mix = bench_arith_mix(seed, 10000000);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    printf("fib(%d) = %d, mix = %u, elapsed: %ld ms\n", n, fib, mix, bench_elapsed_ms(&start, &end));
+    TEST_ASSERT(!IS_TAINTED(&fib, sizeof(fib)));
+    TEST_ASSERT(!IS_TAINTED(&mix, sizeof(mix)));
+    TEST_END;
+}
+
+static char bench_src[1 << 20];
+static char bench_dst[1 << 20];
+
+bool bench_memcpy()
+/*
+    Copies of a large tainted buffer by libc memcpy.
+    Compare runs with and without -libc_summaries client option
+*/
+{
+    TEST_START;
+    struct timespec start, end;
+    volatile unsigned n = sizeof(bench_src);
+    int count = 64;
+
+    MAKE_TAINTED(bench_src, sizeof(bench_src));
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < count; i++)
+        memcpy(bench_dst, bench_src, n);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    printf("memcpy %d x %u bytes, elapsed: %ld ms\n", count, n, bench_elapsed_ms(&start, &end));
+    TEST_ASSERT(IS_TAINTED(bench_dst, sizeof(bench_dst)));
+    TEST_END;
+}
+
+bool bench_copy_loop()
+/*
+    Copies of a large tainted buffer by an inlined byte loop.
+    Compare runs with and without -loop_summaries client option
+*/
+{
+    TEST_START;
+    struct timespec start, end;
+    int count = 16;
+
+    MAKE_TAINTED(bench_src, sizeof(bench_src));
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < count; i++)
+        copy_loop(bench_dst, bench_src, sizeof(bench_src));
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    printf("copy loop %d x %u bytes, elapsed: %ld ms\n", count, (unsigned)sizeof(bench_src),
+           bench_elapsed_ms(&start, &end));
+    TEST_ASSERT(IS_TAINTED(bench_dst, sizeof(bench_dst)));
+    TEST_END;
+}
+
+#pragma endregion bench
@@ -5,6 +5,11 @@
 #define FD_APP_START_TRACE 0xFFFFEEEE
 #define FD_APP_STOP_TRACE 0xFFFFEEED
 #define FD_APP_IS_TRACED 0xFFFFEEEF
+#define FD_APP_COPY_TRACE 0xFFFFEEEC
+#define FD_APP_MOVE_TRACE 0xFFFFEEEB
+#define FD_APP_IS_CLEAN 0xFFFFEEEA
+#define FD_APP_FIND_TRACE 0xFFFFEEE9
+#define FD_APP_RECLAIMED 0xFFFFEEE8
 
 #define MAKE_TAINTED(mem, mem_sz)                        \
     do                                                   \
@@ -28,6 +33,35 @@
 #define IS_NOT_TAINTED(mem, mem_sz) \
     ((mem_sz) == 0 ? true : !IS_TAINTED(mem, mem_sz))
 
+// no byte is tainted, unlike !IS_TAINTED which means some byte isn't
+#define IS_CLEAN(mem, mem_sz) \
+    (write(FD_APP_IS_CLEAN, mem, mem_sz) == DRTAINT_SUCCESS)
+
+// offset of the first tainted byte or -1
+#define FIND_TAINTED(mem, mem_sz) \
+    ((int)write(FD_APP_FIND_TRACE, mem, mem_sz))
+
+// drtaint_stats_t.reclaimed_bytes
+#define RECLAIMED_BYTES() \
+    ((unsigned)write(FD_APP_RECLAIMED, NULL, 0))
+
+// copy taint of mem_sz bytes, the buffer passes both addresses
+#define COPY_TAINT(dst, src, mem_sz)                               \
+    do                                                             \
+    {                                                              \
+        const void *range[2] = {(dst), (src)};                     \
+        unsigned status = write(FD_APP_COPY_TRACE, range, mem_sz); \
+        assert(status == DRTAINT_SUCCESS);                         \
+    } while (0)
+
+#define MOVE_TAINT(dst, src, mem_sz)                               \
+    do                                                             \
+    {                                                              \
+        const void *range[2] = {(dst), (src)};                     \
+        unsigned status = write(FD_APP_MOVE_TRACE, range, mem_sz); \
+        assert(status == DRTAINT_SUCCESS);                         \
+    } while (0)
+
 
 #define TEST_START bool _status_ = true
 
@@ -62,8 +96,22 @@ bool test_assign_ex();
 bool test_struct();
 bool test_func_call();
 bool test_array();
+bool test_libc();
+bool test_copy_loop();
+bool test_copy_taint();
+bool test_find_tainted();
+bool test_profile();
 bool test_untaint();
 bool test_untaint_stack();
+bool test_untaint_stack_alloca();
+bool test_reclaim_munmap();
+bool test_reclaim_mremap();
+bool test_reclaim_brk();
+bool test_untaint_read();
+bool test_untaint_readv();
+bool test_untaint_recvmsg();
+bool test_untaint_recvfrom();
+bool test_untaint_fstat();
 
 bool test_asm_ldr_imm();
 bool test_asm_ldr_imm_ex();
@@ -102,4 +150,11 @@ bool test_asm_arith_2rd_2rs();
 
 bool test_asm_pkhXX();
 
-bool test_asm_cond();
\ No newline at end of file
+bool test_asm_cond();
+
+// benchmark function prototypes
+bool bench_call();
+bool bench_arith();
+bool bench_clean();
+bool bench_memcpy();
+bool bench_copy_loop();
\ No newline at end of file
@@ -4,7 +4,6 @@
 
 #include "../../core/include/drtaint.h"
 #include <syscall.h>
-#include <string.h>
 
 /*
  *    drtaint_test is a client library testing drtaint capabilities.
@@ -24,6 +23,11 @@
 #define FD_APP_START_TRACE 0xFFFFEEEE
 #define FD_APP_STOP_TRACE 0xFFFFEEED
 #define FD_APP_IS_TRACED 0xFFFFEEEF
+#define FD_APP_COPY_TRACE 0xFFFFEEEC
+#define FD_APP_MOVE_TRACE 0xFFFFEEEB
+#define FD_APP_IS_CLEAN 0xFFFFEEEA
+#define FD_APP_FIND_TRACE 0xFFFFEEE9
+#define FD_APP_RECLAIMED 0xFFFFEEE8
 
 static void
 exit_event(void);
@@ -43,10 +47,30 @@ handle_stop_trace(void *drcontext);
 static void
 handle_check_trace(void *drcontext);
 
+static void
+handle_copy_trace(void *drcontext, bool overlap);
+
+static void
+handle_check_clean(void *drcontext);
+
+static void
+handle_find_trace(void *drcontext);
+
+static void
+handle_get_reclaimed(void *drcontext);
+
 DR_EXPORT void
 dr_client_main(client_id_t id, int argc, const char *argv[])
 {
-    drtaint_init(id);
+    drtaint_options_t ops = {sizeof(ops), 0};
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (!drtaint_parse_option(argc, argv, &i, &ops))
+            dr_printf("Unknown option: %s\n", argv[i]);
+    }
+
+    drtaint_init_ex(id, &ops);
     drmgr_init();
 
     dr_register_filter_syscall_event(event_filter_syscall);
@@ -95,6 +119,26 @@ event_pre_syscall(void *drcontext, int sysnum)
         case FD_APP_STOP_TRACE:
             handle_stop_trace(drcontext);
             return false;
+
+        case FD_APP_COPY_TRACE:
+            handle_copy_trace(drcontext, false);
+            return false;
+
+        case FD_APP_MOVE_TRACE:
+            handle_copy_trace(drcontext, true);
+            return false;
+
+        case FD_APP_IS_CLEAN:
+            handle_check_clean(drcontext);
+            return false;
+
+        case FD_APP_FIND_TRACE:
+            handle_find_trace(drcontext);
+            return false;
+
+        case FD_APP_RECLAIMED:
+            handle_get_reclaimed(drcontext);
+            return false;
         }
     }
 
@@ -128,21 +172,80 @@ handle_check_trace(void *drcontext)
 {
     char *buffer = (char *)dr_syscall_get_param(drcontext, 1);
     reg_t len = dr_syscall_get_param(drcontext, 2);
-    byte result;
+    byte result[256];
     bool ok;
 
-    // check the buffer is tainted
-    for (reg_t i = 0; i < len; ++i)
+    // check the buffer is tainted, a chunk at a time
+    for (reg_t i = 0; i < len; i += sizeof(result))
     {
-        ok = drtaint_get_app_taint(drcontext, (app_pc)&buffer[i], &result);
+        uint chunk = len - i < sizeof(result) ? len - i : sizeof(result);
+        ok = drtaint_get_app_area_taint(drcontext, (app_pc)&buffer[i], chunk, result);
         DR_ASSERT(ok);
 
-        if (!IS_TAINTED(result))
+        for (uint j = 0; j < chunk; ++j)
         {
-            dr_syscall_set_result(drcontext, DRTAINT_FAILURE);
-            return;
+            if (!IS_TAINTED(result[j]))
+            {
+                dr_syscall_set_result(drcontext, DRTAINT_FAILURE);
+                return;
+            }
         }
     }
 
     dr_syscall_set_result(drcontext, DRTAINT_SUCCESS);
+}
+
+static void
+handle_copy_trace(void *drcontext, bool overlap)
+{
+    app_pc *buffer = (app_pc *)dr_syscall_get_param(drcontext, 1);
+    uint len = dr_syscall_get_param(drcontext, 2);
+    app_pc range[2];
+    bool ok;
+
+    // the buffer holds the destination and the source
+    if (!dr_safe_read(buffer, sizeof(range), range, NULL))
+    {
+        dr_syscall_set_result(drcontext, DRTAINT_FAILURE);
+        return;
+    }
+
+    ok = overlap ? drtaint_move_app_taint(drcontext, range[0], range[1], len)
+                 : drtaint_copy_app_taint(drcontext, range[0], range[1], len);
+    dr_syscall_set_result(drcontext, ok ? DRTAINT_SUCCESS : DRTAINT_FAILURE);
+}
+
+static void
+handle_check_clean(void *drcontext)
+{
+    char *buffer = (char *)dr_syscall_get_param(drcontext, 1);
+    uint len = dr_syscall_get_param(drcontext, 2);
+
+    bool clean = drtaint_is_area_clean(drcontext, (app_pc)buffer, len);
+    dr_syscall_set_result(drcontext, clean ? DRTAINT_SUCCESS : DRTAINT_FAILURE);
+}
+
+static void
+handle_find_trace(void *drcontext)
+{
+    char *buffer = (char *)dr_syscall_get_param(drcontext, 1);
+    uint len = dr_syscall_get_param(drcontext, 2);
+    uint offset;
+
+    // the application's write returns -1 for a clean buffer
+    if (drtaint_find_tainted(drcontext, (app_pc)buffer, len, &offset))
+        dr_syscall_set_result(drcontext, offset);
+    else
+        dr_syscall_set_result(drcontext, (reg_t)-1);
+}
+
+static void
+handle_get_reclaimed(void *drcontext)
+{
+    drtaint_stats_t stats = {sizeof(stats)};
+
+    if (drtaint_get_stats(&stats))
+        dr_syscall_set_result(drcontext, (reg_t)stats.reclaimed_bytes);
+    else
+        dr_syscall_set_result(drcontext, DRTAINT_FAILURE);
 }
\ No newline at end of file
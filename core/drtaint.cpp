@@ -2,19 +2,45 @@
 #include "drmgr.h"
 #include "drreg.h"
 #include "drutil.h"
+#include "drwrap.h"
+#include "drsyms.h"
 #include "drsyscall.h"
+#include "hashtable.h"
 
 #include "drtaint.h"
 #include "drtaint_shadow.h"
 #include "drtaint_helper.h"
 #include "drtaint_template_utils.h"
 #include "drtaint_instr_groups.h"
+#include "drtaint_opcode_table.h"
+
+#include <elf.h>
+#include <string.h>
+#include <syscall.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/uio.h>
+#include <time.h>
 
 #pragma region prototypes
 
+static dr_emit_flags_t
+event_bb_app2app(void *drcontext, void *tag, instrlist_t *bb,
+                 bool for_trace, bool translating);
+
+static dr_emit_flags_t
+event_bb_analysis(void *drcontext, void *tag, instrlist_t *bb,
+                  bool for_trace, bool translating, void **user_data);
+
 static dr_emit_flags_t
 event_app_instruction(void *drcontext, void *tag, instrlist_t *ilist, instr_t *where,
                       bool for_trace, bool translating, void *user_data);
+
+static dr_emit_flags_t
+event_bb_measure(void *drcontext, void *tag, instrlist_t *bb,
+                 bool for_trace, bool translating);
+
 static bool
 event_pre_syscall(void *drcontext, int sysnum);
 
@@ -22,7 +48,64 @@ static void
 event_post_syscall(void *drcontext, int sysnum);
 
 static bool
-propagate_default_isa(void *drcontext, instrlist_t *ilist, instr_t *where, void *user_data);
+event_filter_syscall(void *drcontext, int sysnum);
+
+static void
+event_thread_init(void *drcontext);
+
+static void
+event_thread_exit(void *drcontext);
+
+static bool
+syscall_table_init(void);
+
+static void
+untaint_syscall_result(void *drcontext, instrlist_t *ilist, instr_t *where);
+
+static void
+event_module_load(void *drcontext, const module_data_t *info, bool loaded);
+
+static void
+event_module_unload(void *drcontext, const module_data_t *info);
+
+static void
+profile_module_load(const module_data_t *info, const char *name);
+
+static void
+profile_module_unload(const module_data_t *info);
+
+static void
+plans_module_load(const module_data_t *info, const char *name);
+
+static void
+plans_module_unload(const module_data_t *info);
+
+static void
+plans_exit(void);
+
+static bool
+watch_modules(void);
+
+static bool
+scope_by_modules(void);
+
+static void
+profile_init(void);
+
+static void
+profile_exit(void);
+
+static void
+wrap_libc_routines(const module_data_t *info);
+
+template <typename policy>
+static plan_t
+classify_instr(instr_t *where);
+
+template <typename policy>
+static bool
+propagate_default_isa(void *drcontext, instrlist_t *ilist, instr_t *where, void *user_data,
+                      plan_t plan);
 
 extern bool
 propagate_simd_isa(void *drcontext, instrlist_t *ilist, instr_t *where, void *user_data);
@@ -33,10 +116,187 @@ propagate_simd_isa(void *drcontext, instrlist_t *ilist, instr_t *where, void *us
 
 static int drtaint_init_count;
 static client_id_t client_id;
+static drtaint_options_t options;
+
+/* updated inline, see insert_load_app_taint */
+static uint64 summary_clean_loads;
+static uint64 summary_shadow_loads;
+
+/* range operation counters, see drtaint_get_stats.
+ * All stat_ counters are relaxed atomics, they are bumped from any thread
+ */
+static uint64 stat_range_ops;
+static uint64 stat_range_ns;
+static uint64 stat_bytes_tainted;
+static uint64 stat_bytes_untainted;
+static uint64 stat_bytes_copied;
+
+/* shadow register file base hoisting, see event_bb_analysis */
+static uint64 stat_hoisted_blocks;
+static uint64 stat_hoist_saved;
+static uint64 stat_hoist_setup;
+static uint64 stat_dead_writes;
+static uint64 stat_downgraded;
+static uint64 stat_coalesced;
+static uint64 stat_resident_regs;
+static uint64 stat_resident_accesses;
+static uint64 stat_dual_blocks;
+static uint64 stat_lazy_blocks;
+static uint64 stat_built_blocks;
+static uint64 stat_built_bytes;
+static uint64 stat_stub_calls;
+static uint64 stat_excluded_blocks;
+static uint64 stat_boundary_summaries;
+static uint64 stat_libc_summaries;
+static uint64 stat_loop_blocks;
+static uint64 stat_loop_summaries;
+static uint64 stat_loop_replays;
+static uint64 stat_loop_mismatches;
+static uint64 stat_guarded_blocks;
+static uint64 stat_guard_trips;
+static uint64 stat_translate_ns;
+static uint64 stat_plan_hits;
+static uint64 stat_plan_misses;
+
+/* cleared until the first taint source with DRTAINT_OPTION_LAZY_ACTIVATION */
+static volatile bool taint_active;
+static int activation_count;
+
+/* code running without propagation, see drtaint_exclude_range */
+#define MAX_EXCLUDED_RANGES 64
+
+typedef struct _excluded_range_t
+{
+    app_pc start;
+    app_pc end;
+
+    // start of the module it was added for, NULL if by drtaint_exclude_range
+    app_pc module;
+
+    // a libc routine handled by libc_post, see DRTAINT_OPTION_LIBC_SUMMARIES
+    bool summarized;
+} excluded_range_t;
+
+static excluded_range_t excluded_ranges[MAX_EXCLUDED_RANGES];
+static uint num_excluded_ranges;
+static void *excluded_lock;
+
+/* the lowest start and highest end of the excluded ranges,
+ * checked inline before a call into them, see insert_excluded_check
+ */
+static volatile app_pc excluded_lo;
+static volatile app_pc excluded_hi;
+
+/* the last program break we saw, brk is process wide,
+ * so it is only updated under brk_lock
+ */
+static app_pc last_brk;
+static void *brk_lock;
+
+/* set once anything may be excluded, blocks check their
+ * calls and jumps since then, see insert_boundary_summary
+ */
+static volatile bool scope_enabled;
+
+/* blocks which met taint, see drtaint_options_t.profile_file */
+#define MAX_PROFILE_NAME 64
+
+typedef struct _profile_record_t
+{
+    char module[MAX_PROFILE_NAME];
+    uint offset;
+} profile_record_t;
+
+static volatile bool profile_enabled;
+static hashtable_t profile_blocks;
+static profile_record_t *profile_records;
+static uint num_profile_records;
+static uint max_profile_records;
+static void *profile_lock;
+
+/* per-module plan files mapped at load, see drtaint_options_t.plan_cache_dir */
+#define MAX_PLAN_CACHES 64
+#define PLAN_MAGIC 0x4e4c5044
+#define PLAN_VERSION 1
+
+typedef struct _plan_header_t
+{
+    uint magic;
+    uint version;
+
+    // see plan_policy
+    uint policy;
+
+    // number of plans following
+    uint size;
+} plan_header_t;
+
+typedef struct _plan_cache_t
+{
+    app_pc start;
+    app_pc end;
+    byte *map;
+    size_t map_size;
+} plan_cache_t;
+
+static plan_cache_t plan_caches[MAX_PLAN_CACHES];
+static uint num_plan_caches;
+static void *plan_lock;
+
+/* per-thread syscall_args_t, see event_pre_syscall */
+static int syscall_tls_index = -1;
+
+/* labels marking block copies, see event_bb_app2app */
+enum
+{
+    DUAL_NOTE_FAST,
+    DUAL_NOTE_SLOW,
+    DUAL_NOTE_POS,
+    DUAL_NOTE_DONE,
+    DUAL_NOTES,
+};
+
+static ptr_uint_t dual_note_base;
+
+/* Raw TLS slots the fast copy and guarded blocks spill to, see
+ * insert_fast_spill. Only the first DR spill slots are in TLS,
+ * the others live in the dcontext, out of reach of shared code.
+ * The slot after them keeps where a guarded block stopped, see profile_trip
+ */
+#define FAST_SLOTS 3
+#define PROFILE_PC_SLOT FAST_SLOTS
+#define FAST_TLS_SLOTS (FAST_SLOTS + 1)
+
+static reg_id_t fast_tls_seg;
+static uint fast_tls_offs;
+
+/* the label a summarized copy loop branches back to and raw TLS
+ * slots keeping its source, destination and block tag at entry,
+ * see summarize_copy_loop. Blocks whose exit found another entry
+ * are rebuilt without the summary, see loop_summary
+ */
+#define LOOP_SLOTS 3
+
+static ptr_uint_t loop_note;
+static reg_id_t loop_tls_seg;
+static uint loop_tls_offs;
+static hashtable_t loop_unsummarized;
+
+// the label marking a block to measure, see event_bb_measure
+static ptr_uint_t measure_note;
+
+static void
+event_nudge(void *drcontext, uint64 arg);
 
 bool drtaint_init(client_id_t id)
 {
-    drreg_options_t drreg_ops = {sizeof(drreg_ops), 4, false};
+    drtaint_options_t ops = {sizeof(ops), 0};
+    return drtaint_init_ex(id, &ops);
+}
+
+bool drtaint_init_ex(client_id_t id, const drtaint_options_t *ops)
+{
+    drreg_options_t drreg_ops = {sizeof(drreg_ops), 9, false};
     drsys_options_t drsys_ops = {sizeof(drsys_ops), 0};
     drmgr_priority_t pri = {sizeof(pri),
                             DRMGR_PRIORITY_NAME_DRTAINT, NULL, NULL,
@@ -47,23 +307,95 @@ bool drtaint_init(client_id_t id)
         return true;
 
     client_id = id;
+    memset(&options, 0, sizeof(options));
+    if (ops != NULL)
+        memcpy(&options, ops, ops->struct_size < sizeof(options) ? ops->struct_size : sizeof(options));
+    options.struct_size = sizeof(options);
+    taint_active = !TEST(DRTAINT_OPTION_LAZY_ACTIVATION, options.flags);
+    scope_enabled = scope_by_modules();
+    excluded_lock = dr_rwlock_create();
+    brk_lock = dr_mutex_create();
+    profile_enabled = options.profile_file != NULL;
+    if (profile_enabled)
+        profile_init();
+    if (options.plan_cache_dir != NULL)
+        plan_lock = dr_rwlock_create();
+
     drmgr_init();
 
-    if (!ds_init(id) ||
+    if (!ds_init(id, &options) ||
         drreg_init(&drreg_ops) != DRREG_SUCCESS ||
         drsys_init(id, &drsys_ops) != DRMF_SUCCESS)
     {
         return false;
     }
 
-    drsys_filter_all_syscalls();
-    if (!drmgr_register_bb_instrumentation_event(NULL, event_app_instruction, &pri) ||
+    if (TEST(DRTAINT_OPTION_LIBC_SUMMARIES, options.flags) &&
+        (!drwrap_init() || drsym_init(0) != DRSYM_SUCCESS))
+    {
+        return false;
+    }
+
+    syscall_tls_index = drmgr_register_tls_field();
+    if (syscall_tls_index == -1 || !syscall_table_init())
+        return false;
+
+    if (TEST(DRTAINT_OPTION_DUAL_BLOCKS, options.flags))
+    {
+        dual_note_base = drmgr_reserve_note_range(DUAL_NOTES);
+        if (dual_note_base == DRMGR_NOTE_NONE)
+            return false;
+    }
+
+    if ((TEST(DRTAINT_OPTION_DUAL_BLOCKS, options.flags) || profile_enabled) &&
+        !dr_raw_tls_calloc(&fast_tls_seg, &fast_tls_offs, FAST_TLS_SLOTS, 0))
+        return false;
+
+    if (TEST(DRTAINT_OPTION_LOOP_SUMMARIES, options.flags))
+    {
+        loop_note = drmgr_reserve_note_range(1);
+        if (loop_note == DRMGR_NOTE_NONE ||
+            !dr_raw_tls_calloc(&loop_tls_seg, &loop_tls_offs, LOOP_SLOTS, 0))
+            return false;
+
+        // looked up by app2app, added to by loop_summary
+        hashtable_init(&loop_unsummarized, 6, HASH_INTPTR, true);
+    }
+
+    if (TEST(DRTAINT_OPTION_DUAL_BLOCKS | DRTAINT_OPTION_LOOP_SUMMARIES, options.flags) &&
+        !drmgr_register_bb_app2app_event(event_bb_app2app, &pri))
+        return false;
+
+    if (!drmgr_register_bb_instrumentation_event(event_bb_analysis, event_app_instruction, &pri) ||
         !drmgr_register_pre_syscall_event(event_pre_syscall) ||
-        !drmgr_register_post_syscall_event(event_post_syscall))
+        !drmgr_register_post_syscall_event(event_post_syscall) ||
+        !drmgr_register_thread_init_event(event_thread_init) ||
+        !drmgr_register_thread_exit_event(event_thread_exit))
+    {
+        return false;
+    }
+
+    dr_register_filter_syscall_event(event_filter_syscall);
+
+    // modules already loaded are reported too
+    if (watch_modules() &&
+        (!drmgr_register_module_load_event(event_module_load) ||
+         !drmgr_register_module_unload_event(event_module_unload)))
     {
         return false;
     }
 
+    if (TEST(DRTAINT_OPTION_STATS_REPORT, options.flags))
+    {
+        // measured after drreg has inserted its spills and restores
+        measure_note = drmgr_reserve_note_range(1);
+        if (measure_note == DRMGR_NOTE_NONE ||
+            !drmgr_register_bb_instru2instru_event(event_bb_measure, NULL))
+            return false;
+
+        dr_register_nudge_event(event_nudge, id);
+    }
+
     return true;
 }
 
@@ -75,1289 +407,4587 @@ void drtaint_exit(void)
 
     drmgr_unregister_pre_syscall_event(event_pre_syscall);
     drmgr_unregister_post_syscall_event(event_post_syscall);
+    drmgr_unregister_thread_init_event(event_thread_init);
+    drmgr_unregister_thread_exit_event(event_thread_exit);
+    drmgr_unregister_tls_field(syscall_tls_index);
+    dr_unregister_filter_syscall_event(event_filter_syscall);
+
+    if (watch_modules())
+    {
+        drmgr_unregister_module_load_event(event_module_load);
+        drmgr_unregister_module_unload_event(event_module_unload);
+    }
+
+    if (TEST(DRTAINT_OPTION_STATS_REPORT, options.flags))
+    {
+        drtaint_print_stats(STDERR);
+        drmgr_unregister_bb_instru2instru_event(event_bb_measure);
+        dr_unregister_nudge_event(event_nudge, client_id);
+    }
+
+    if (TEST(DRTAINT_OPTION_LIBC_SUMMARIES, options.flags))
+    {
+        drwrap_exit();
+        drsym_exit();
+    }
+
+    if (TEST(DRTAINT_OPTION_LOOP_SUMMARIES, options.flags))
+    {
+        dr_raw_tls_cfree(loop_tls_offs, LOOP_SLOTS);
+        hashtable_delete(&loop_unsummarized);
+    }
+
+    if (TEST(DRTAINT_OPTION_DUAL_BLOCKS, options.flags) || profile_enabled)
+        dr_raw_tls_cfree(fast_tls_offs, FAST_TLS_SLOTS);
+
+    if (profile_enabled)
+        profile_exit();
+
+    if (options.plan_cache_dir != NULL)
+        plans_exit();
 
     ds_exit();
     drmgr_exit();
     drreg_exit();
     drsys_exit();
+    dr_rwlock_destroy(excluded_lock);
+    dr_mutex_destroy(brk_lock);
+}
+
+bool drtaint_is_active(void)
+{
+    return taint_active;
+}
+
+static void
+activate_propagation(void)
+/*
+ *    The first taint source fired. Blocks built so far don't propagate,
+ *    so they are flushed and rebuilt instrumented
+ */
+{
+    if (taint_active || dr_atomic_add32_return_sum(&activation_count, 1) != 1)
+        return;
+
+    taint_active = true;
+    bool ok = dr_delay_flush_region(NULL, POINTER_MAX, 0, NULL);
+    DR_ASSERT(ok);
 }
 
 #pragma endregion init_exit
 
-#pragma region wrappers
+#pragma region options
 
-bool drtaint_insert_app_to_taint(void *drcontext, instrlist_t *ilist, instr_t *where,
-                                 reg_id_t reg_addr, reg_id_t scratch)
+/* client options mapped to flags, see drtaint_parse_option */
+typedef struct _option_flag_t
 {
-    return ds_insert_app_to_shadow(drcontext, ilist, where,
-                                   reg_addr, scratch);
+    const char *name;
+    uint flags;
+} option_flag_t;
+
+static const option_flag_t option_flags[] = {
+    {"-ldm_stm_clean_call", DRTAINT_OPTION_LDM_STM_CLEAN_CALL},
+    {"-direct_shadow", DRTAINT_OPTION_DIRECT_SHADOW},
+    {"-page_summary", DRTAINT_OPTION_PAGE_SUMMARY},
+    {"-summary_counters", DRTAINT_OPTION_SUMMARY_COUNTERS},
+    {"-stats", DRTAINT_OPTION_STATS_REPORT},
+    {"-resident_shadows", DRTAINT_OPTION_RESIDENT_SHADOWS},
+    {"-dual_blocks", DRTAINT_OPTION_DUAL_BLOCKS},
+    {"-lazy_activation", DRTAINT_OPTION_LAZY_ACTIVATION},
+    {"-out_of_line", DRTAINT_OPTION_OUT_OF_LINE},
+    {"-out_of_line_loads", DRTAINT_OPTION_OUT_OF_LINE_LOADS},
+    {"-out_of_line_stores", DRTAINT_OPTION_OUT_OF_LINE_STORES},
+    {"-out_of_line_regs", DRTAINT_OPTION_OUT_OF_LINE_REGS},
+    {"-libc_summaries", DRTAINT_OPTION_LIBC_SUMMARIES},
+    {"-loop_summaries", DRTAINT_OPTION_LOOP_SUMMARIES},
+};
+
+/* NULL-terminated module lists of -include and -exclude */
+#define MAX_OPTION_MODULES 16
+
+static const char *option_include[MAX_OPTION_MODULES + 1];
+static const char *option_exclude[MAX_OPTION_MODULES + 1];
+static uint num_option_include;
+static uint num_option_exclude;
+
+static bool
+add_option_module(const char **list, uint *count, const char *name)
+{
+    if (*count == MAX_OPTION_MODULES)
+    {
+        dr_fprintf(STDERR, "drtaint: too many modules listed, %s is ignored\n", name);
+        return false;
+    }
+
+    list[(*count)++] = name;
+    return true;
 }
 
-bool drtaint_insert_reg_to_taint(void *drcontext, instrlist_t *ilist, instr_t *where,
-                                 reg_id_t shadow, reg_id_t regaddr)
+bool drtaint_parse_option(int argc, const char *argv[], int *i, drtaint_options_t *ops)
 {
-    return ds_insert_reg_to_shadow(drcontext, ilist, where,
-                                   shadow, regaddr);
+    const char *opt = argv[*i];
+    const char *arg = *i + 1 < argc ? argv[*i + 1] : NULL;
+
+    for (uint k = 0; k < sizeof(option_flags) / sizeof(option_flags[0]); k++)
+    {
+        if (strcmp(opt, option_flags[k].name) == 0)
+        {
+            ops->flags |= option_flags[k].flags;
+            return true;
+        }
+    }
+
+    if (arg == NULL)
+        return false;
+
+    if (strcmp(opt, "-include") == 0)
+    {
+        if (add_option_module(option_include, &num_option_include, arg))
+            ops->include_modules = option_include;
+    }
+    else if (strcmp(opt, "-exclude") == 0)
+    {
+        if (add_option_module(option_exclude, &num_option_exclude, arg))
+            ops->exclude_modules = option_exclude;
+    }
+    else if (strcmp(opt, "-profile") == 0)
+        ops->profile_file = arg;
+    else if (strcmp(opt, "-plan_cache") == 0)
+        ops->plan_cache_dir = arg;
+    else
+        return false;
+
+    (*i)++;
+    return true;
 }
 
-bool drtaint_insert_reg_to_taint_load(void *drcontext, instrlist_t *ilist, instr_t *where,
-                                      reg_id_t shadow, reg_id_t regaddr)
+#pragma endregion options
+
+#pragma region scope
+
+static bool
+scope_by_modules(void)
 {
-    return ds_insert_reg_to_shadow_load(drcontext, ilist, where,
-                                        shadow, regaddr);
+    return options.include_modules != NULL || options.exclude_modules != NULL ||
+           TEST(DRTAINT_OPTION_LIBC_SUMMARIES, options.flags);
 }
 
-bool drtaint_get_reg_taint(void *drcontext, reg_id_t reg, uint *result)
+static bool
+watch_modules(void)
 {
-    return ds_get_reg_taint(drcontext, reg, result);
+    return scope_by_modules() || options.profile_file != NULL ||
+           options.plan_cache_dir != NULL;
 }
 
-bool drtaint_set_reg_taint(void *drcontext, reg_id_t reg, uint value)
+static void
+update_excluded_bounds(void)
+/*
+ *    excluded_lock has to be held for writing
+ */
 {
-    return ds_set_reg_taint(drcontext, reg, value);
+    app_pc lo = NULL, hi = NULL;
+
+    for (uint i = 0; i < num_excluded_ranges; i++)
+    {
+        if (lo == NULL || excluded_ranges[i].start < lo)
+            lo = excluded_ranges[i].start;
+        if (excluded_ranges[i].end > hi)
+            hi = excluded_ranges[i].end;
+    }
+    excluded_lo = lo;
+    excluded_hi = hi;
 }
 
-bool drtaint_get_app_taint(void *drcontext, app_pc app, byte *result)
+static bool
+add_excluded_range(app_pc start, app_pc end, app_pc module, bool summarized)
 {
-    return ds_get_app_taint(drcontext, app, result);
+    bool ok = false;
+
+    dr_rwlock_write_lock(excluded_lock);
+    if (num_excluded_ranges < MAX_EXCLUDED_RANGES)
+    {
+        excluded_ranges[num_excluded_ranges++] = {start, end, module, summarized};
+        update_excluded_bounds();
+        scope_enabled = true;
+        ok = true;
+    }
+    dr_rwlock_write_unlock(excluded_lock);
+    return ok;
 }
 
-bool drtaint_set_app_taint(void *drcontext, app_pc app, byte value)
+bool drtaint_exclude_range(app_pc start, app_pc end)
 {
-    return ds_set_app_taint(drcontext, app, value);
+    return start < end && add_excluded_range(start, end, NULL, false);
 }
 
-bool drtaint_get_app_taint4(void *drcontext, app_pc app, uint *result)
+static bool
+find_excluded(app_pc pc, bool *summarized)
+/*
+ *    Whether %pc% is excluded and whether
+ *    it's in a summarized libc routine
+ */
 {
-    return ds_get_app_taint4(drcontext, app, result);
+    bool found = false;
+    *summarized = false;
+
+    if (!scope_enabled)
+        return false;
+
+    // thumb addresses have the lowest bit set
+    pc = (app_pc)((ptr_uint_t)pc & ~(ptr_uint_t)1);
+
+    dr_rwlock_read_lock(excluded_lock);
+    for (uint i = 0; i < num_excluded_ranges; i++)
+    {
+        if (pc >= excluded_ranges[i].start && pc < excluded_ranges[i].end)
+        {
+            found = true;
+            *summarized |= excluded_ranges[i].summarized;
+        }
+    }
+    dr_rwlock_read_unlock(excluded_lock);
+    return found;
 }
 
-bool drtaint_set_app_taint4(void *drcontext, app_pc app, uint value)
+bool drtaint_is_excluded(app_pc pc)
 {
-    return ds_set_app_taint4(drcontext, app, value);
+    bool summarized;
+    return find_excluded(pc, &summarized);
 }
 
-void drtaint_set_app_area_taint(void *drcontext, app_pc app, uint size, byte value)
+static bool
+module_is_listed(const char **list, const char *name)
 {
-    ds_set_app_area_taint(drcontext, app, size, value);
+    for (; *list != NULL; list++)
+    {
+        if (strcmp(*list, name) == 0)
+            return true;
+    }
+    return false;
 }
 
-#pragma endregion wrappers
+static void
+event_module_load(void *drcontext, const module_data_t *info, bool loaded)
+{
+    const char *name = dr_module_preferred_name(info);
+    if (name == NULL)
+        name = "";
 
-#pragma region taint_propagation
+    if (TEST(DRTAINT_OPTION_LIBC_SUMMARIES, options.flags) && strncmp(name, "libc.", 5) == 0)
+        wrap_libc_routines(info);
 
-/* ======================================================================================
- * main implementation, taint propagation step
- * ==================================================================================== */
+    bool excluded =
+        (options.exclude_modules != NULL && module_is_listed(options.exclude_modules, name)) ||
+        (options.include_modules != NULL && !module_is_listed(options.include_modules, name));
 
-#pragma region load_store
+    if (excluded && !add_excluded_range(info->start, info->end, info->start, false))
+        dr_fprintf(STDERR, "drtaint: too many excluded ranges, %s is instrumented\n", name);
 
-template <opnd_sz_t sz>
-void propagate_ldr(void *drcontext, instrlist_t *ilist, instr_t *where)
+    if (profile_enabled)
+        profile_module_load(info, name);
+
+    if (options.plan_cache_dir != NULL)
+        plans_module_load(info, name);
+}
+
+static void
+event_module_unload(void *drcontext, const module_data_t *info)
+{
+    // DR flushes the module's blocks itself
+    dr_rwlock_write_lock(excluded_lock);
+    for (uint i = 0; i < num_excluded_ranges;)
+    {
+        if (excluded_ranges[i].module == info->start)
+            excluded_ranges[i] = excluded_ranges[--num_excluded_ranges];
+        else
+            i++;
+    }
+    update_excluded_bounds();
+    dr_rwlock_write_unlock(excluded_lock);
+
+    if (profile_enabled)
+        profile_module_unload(info);
+
+    if (options.plan_cache_dir != NULL)
+        plans_module_unload(info);
+}
+
+static void
+boundary_summary(app_pc target)
 /*
- *    ldr reg1, [mem2]
- *
- *    We need to save the tag value stored at
- *    [mem2] shadow address to shadow register of reg1
+ *    Called before a branch which may enter excluded code. The callee
+ *    doesn't propagate, so its effect on registers is approximated
+ *    by the calling convention: the return value (r0, r1) depends on
+ *    the arguments (r0-r3), other caller-saved registers are clobbered.
+ *    Callee-saved registers are restored by the callee and keep their tags.
+ *    Summarized libc routines need the tags of their arguments, they are
+ *    handled by libc_post instead.
  */
 {
-    opnd_t mem2 = instr_get_src(where, 0);
-    if (opnd_is_base_disp(mem2))
-    {
-        reg_id_t reg1 = opnd_get_reg(instr_get_dst(where, 0));
+    bool summarized;
 
-        auto sreg1 = drreg_reservation{drcontext, ilist, where};
-        auto sapp2 = drreg_reservation{drcontext, ilist, where};
+    if (!find_excluded(target, &summarized) || summarized)
+        return;
 
-        // get the memory address at mem2 and store the result to sapp2 register
-        drutil_insert_get_mem_addr(drcontext, ilist, where, mem2, sapp2, sreg1);
+    void *drcontext = dr_get_current_drcontext();
+    uint args = 0;
 
-        // get shadow memory addresses of reg1 and [mem2] and place them to sreg1 and sapp2
-        drtaint_insert_app_to_taint(drcontext, ilist, where, sapp2, sreg1);
-        drtaint_insert_reg_to_taint(drcontext, ilist, where, reg1, sreg1);
+    for (reg_id_t reg = DR_REG_R0; reg <= DR_REG_R3; reg++)
+    {
+        uint taint = 0;
+        ds_get_reg_taint(drcontext, reg, &taint);
+        args |= taint;
+    }
 
-        // place to sapp2 the value placed at [mem2] shadow address
-        instrlist_meta_preinsert(ilist, where,
-                                 instr_load<sz>(drcontext, // ldrXX sapp2, [sapp2]
-                                                opnd_create_reg(sapp2),
-                                                opnd_mem<sz>(sapp2, 0)));
+    ds_set_reg_taint(drcontext, DR_REG_R0, args);
+    ds_set_reg_taint(drcontext, DR_REG_R1, args);
+    ds_set_reg_taint(drcontext, DR_REG_R2, 0);
+    ds_set_reg_taint(drcontext, DR_REG_R3, 0);
+    ds_set_reg_taint(drcontext, DR_REG_R12, 0);
+    __atomic_fetch_add(&stat_boundary_summaries, 1, __ATOMIC_RELAXED);
+}
 
-        // propagate 3rd policy: ldr r0, [r1, r2].
-        // If r2 is tainted then r0 is tainted too
-        if (opnd_num_regs_used(mem2) == 2)
-        {
-            reg_id_t reg_ind = opnd_get_index(mem2);
-            auto sreg_ind = drreg_reservation{drcontext, ilist, where};
-
-            // get value of reg_ind shadow register and place it to sreg_ind
-            drtaint_insert_reg_to_taint_load(drcontext, ilist, where, reg_ind, sreg_ind);
+static void
+insert_excluded_check(void *drcontext, instrlist_t *ilist, instr_t *where,
+                      reg_id_t target, reg_id_t scratch)
+/*
+ *    Call boundary_summary if %target% is between the lowest and the
+ *    highest excluded address. The bounds may be stale, the call
+ *    looks the target up under excluded_lock. Registers and aflags
+ *    have to be reserved
+ */
+{
+    instr_t *skip = INSTR_CREATE_label(drcontext);
 
-            // combine tags
-            instrlist_meta_preinsert(ilist, where,
-                                     INSTR_CREATE_orr(drcontext, // sapp2 |= sreg_ind
-                                                      opnd_create_reg(sapp2),
-                                                      opnd_create_reg(sapp2),
-                                                      opnd_create_reg(sreg_ind)));
-        }
+    // the bounds are checked whether the branch is taken or not
+    {
+        auto pred = disabled_autopredication(ilist);
+        instrlist_insert_mov_immed_ptrsz(drcontext, (ptr_int_t)&excluded_lo,
+                                         opnd_create_reg(scratch), ilist, where, NULL, NULL);
+        instrlist_meta_preinsert(ilist, where,
+                                 XINST_CREATE_load(drcontext, // ldr scratch, [scratch]
+                                                   opnd_create_reg(scratch),
+                                                   OPND_CREATE_MEMPTR(scratch, 0)));
+        instrlist_meta_preinsert(ilist, where,
+                                 XINST_CREATE_cmp(drcontext, // cmp target, scratch
+                                                  opnd_create_reg(target),
+                                                  opnd_create_reg(scratch)));
+        instrlist_meta_preinsert(ilist, where,
+                                 XINST_CREATE_jump_cond(drcontext, DR_PRED_LO, // blo skip
+                                                        opnd_create_instr(skip)));
 
-        // save the value of sapp2 to shadow register of reg1
+        instrlist_insert_mov_immed_ptrsz(drcontext, (ptr_int_t)&excluded_hi,
+                                         opnd_create_reg(scratch), ilist, where, NULL, NULL);
         instrlist_meta_preinsert(ilist, where,
-                                 XINST_CREATE_store(drcontext, // str sapp2, [sreg1]
-                                                    OPND_CREATE_MEM32(sreg1, 0),
-                                                    opnd_create_reg(sapp2)));
+                                 XINST_CREATE_load(drcontext, // ldr scratch, [scratch]
+                                                   opnd_create_reg(scratch),
+                                                   OPND_CREATE_MEMPTR(scratch, 0)));
+        instrlist_meta_preinsert(ilist, where,
+                                 XINST_CREATE_cmp(drcontext, // cmp target, scratch
+                                                  opnd_create_reg(target),
+                                                  opnd_create_reg(scratch)));
+        instrlist_meta_preinsert(ilist, where,
+                                 XINST_CREATE_jump_cond(drcontext, DR_PRED_HS, // bhs skip
+                                                        opnd_create_instr(skip)));
     }
+
+    // the call runs only if the branch does
+    dr_insert_clean_call(drcontext, ilist, where, (void *)boundary_summary, false, 1,
+                         opnd_create_reg(target));
+
+    auto pred = disabled_autopredication(ilist);
+    instrlist_meta_preinsert(ilist, where, skip);
 }
 
 static void
-propagate_ldrd(void *drcontext, instrlist_t *ilist, instr_t *where)
+insert_boundary_summary(void *drcontext, instrlist_t *ilist, instr_t *where)
 /*
- *    ldrd reg1, reg2, [mem2]
- *
- *    We need to save the tag value stored at
- *    [mem2] shadow address to shadow registers reg1, reg2
+ *    b/bl/blx imm:  the target is checked now
+ *    bx/blx reg:    inline against the excluded bounds, then
+ *                   by boundary_summary, except bx lr
+ *    ldr pc, [mem]: the same with the loaded target, PLT stubs jump
+ *                   this way. Loads via sp and pc (returns, jump
+ *                   tables) stay in the module
  */
 {
-    opnd_t mem2 = instr_get_src(where, 0);
-    if (opnd_is_base_disp(mem2))
+    int opcode = instr_get_opcode(where);
+
+    if (instr_is_ubr(where) || instr_is_cbr(where) || instr_is_call_direct(where))
     {
-        reg_id_t reg1 = opnd_get_reg(instr_get_dst(where, 0));
-        reg_id_t reg2 = opnd_get_reg(instr_get_dst(where, 1));
+        app_pc target = opnd_get_pc(instr_get_target(where));
 
-        auto sreg1 = drreg_reservation{drcontext, ilist, where};
-        auto sapp2 = drreg_reservation{drcontext, ilist, where};
-        auto sapp2n = drreg_reservation{drcontext, ilist, where};
-        reg_id_t sreg2 = sreg1;
+        if (drtaint_is_excluded(target))
+        {
+            dr_insert_clean_call(drcontext, ilist, where, (void *)boundary_summary, false, 1,
+                                 OPND_CREATE_INTPTR(target));
+        }
+        return;
+    }
 
-        // dereference the memory address at mem2 and store the result to sapp2 register
-        drutil_insert_get_mem_addr(drcontext, ilist, where, mem2, sapp2, sreg1);
+    bool is_bx = (opcode == OP_bx || opcode == OP_blx_ind) &&
+                 opnd_get_reg(instr_get_src(where, 0)) != DR_REG_LR;
+    bool is_ldr = opcode == OP_ldr && opnd_get_reg(instr_get_dst(where, 0)) == DR_REG_PC;
 
-        // get [mem2 + 4] address
-        instrlist_meta_preinsert(ilist, where,
-                                 XINST_CREATE_add_2src(drcontext, // add sapp2n, sapp2, #4
-                                                       opnd_create_reg(sapp2n),
-                                                       opnd_create_reg(sapp2),
-                                                       OPND_CREATE_INT32(4)));
+    if (is_ldr)
+    {
+        reg_id_t base = opnd_get_base(instr_get_src(where, 0));
+        if (base == DR_REG_SP || base == DR_REG_PC)
+            return;
+    }
 
-        // get shadow memory addresses of reg1 and [mem2] and place them to sreg1 and sapp2
-        drtaint_insert_app_to_taint(drcontext, ilist, where, sapp2, sreg1);
-        drtaint_insert_reg_to_taint(drcontext, ilist, where, reg1, sreg1);
+    if (!is_bx && !is_ldr)
+        return;
 
-        // place to sapp2 the value placed at [mem2] shadow address
-        instrlist_meta_preinsert(ilist, where,
-                                 XINST_CREATE_load(drcontext, // ldr sapp2, [sapp2]
-                                                   opnd_create_reg(sapp2),
-                                                   OPND_CREATE_MEM32(sapp2, 0)));
+    // all reservations are made before the branch,
+    // so that spills and restores are the same on both paths
+    auto starget = drreg_reservation{drcontext, ilist, where};
+    auto sscratch = drreg_reservation{drcontext, ilist, where};
 
-        // save the value of sapp2 to shadow register of reg1
-        instrlist_meta_preinsert(ilist, where,
-                                 XINST_CREATE_store(drcontext, // str sapp2, [sreg1]
-                                                    OPND_CREATE_MEM32(sreg1, 0),
-                                                    opnd_create_reg(sapp2)));
+    bool ok = drreg_reserve_aflags(drcontext, ilist, where) == DRREG_SUCCESS;
+    DR_ASSERT(ok);
 
-        // get shadow memory addresses of reg2 and [mem2 + 4] and place them to sreg2 and sapp2n
-        drtaint_insert_app_to_taint(drcontext, ilist, where, sapp2n, sreg2);
-        drtaint_insert_reg_to_taint(drcontext, ilist, where, reg2, sreg2);
+    if (is_bx)
+    {
+        drreg_get_app_value(drcontext, ilist, where, opnd_get_reg(instr_get_src(where, 0)),
+                            starget);
+    }
+    else
+    {
+        // the branch loads the same word right after, so a fault
+        // here is its own: translate it to the branch and let the
+        // app get the signal
+        drutil_insert_get_mem_addr(drcontext, ilist, where, instr_get_src(where, 0),
+                                   starget, sscratch);
+        instrlist_meta_preinsert_xl8(ilist, where,
+                                     XINST_CREATE_load(drcontext, // ldr starget, [starget]
+                                                       opnd_create_reg(starget),
+                                                       OPND_CREATE_MEMPTR(starget, 0)));
+    }
 
-        // place to sapp2n the value placed at [mem2 + 4] shadow address
-        instrlist_meta_preinsert(ilist, where,
-                                 XINST_CREATE_load(drcontext, // ldr sapp2n, [sapp2n]
-                                                   opnd_create_reg(sapp2n),
-                                                   OPND_CREATE_MEM32(sapp2n, 0)));
+    insert_excluded_check(drcontext, ilist, where, starget, sscratch);
 
-        // save the value of sapp2n to shadow register of reg2
-        instrlist_meta_preinsert(ilist, where,
-                                 XINST_CREATE_store(drcontext, // str sapp2n, [sreg2]
-                                                    OPND_CREATE_MEM32(sreg2, 0),
-                                                    opnd_create_reg(sapp2n)));
-    }
+    ok = drreg_unreserve_aflags(drcontext, ilist, where) == DRREG_SUCCESS;
+    DR_ASSERT(ok);
 }
 
-template <opnd_sz_t sz>
-void propagate_str(void *drcontext, instrlist_t *ilist, instr_t *where)
+#pragma endregion scope
+
+#pragma region libc
+
+enum
+{
+    LIBC_MEMCPY,
+    LIBC_MEMMOVE,
+    LIBC_MEMSET,
+    LIBC_STRCPY,
+    LIBC_STRLEN,
+    LIBC_ROUTINES,
+};
+
+static const char *libc_routines[LIBC_ROUTINES] = {
+    "memcpy", "memmove", "memset", "strcpy", "strlen"};
+
+/* arguments of a summarized call saved by libc_pre */
+typedef struct _libc_call_t
+{
+    int routine;
+
+    // strlen: the string
+    app_pc dst;
+    app_pc src;
+    uint size;
+
+    // tags of the returned pointer and of memset's value
+    uint dst_taint;
+    byte value_taint;
+} libc_call_t;
+
+static app_pc
+routine_end(const module_data_t *info, app_pc func)
 /*
- *    str reg1, [mem2]
- *
- *    We need to save the tag value stored in
- *    shadow register of reg1 to shadow address of [mem2]
+ *    The end of the routine starting at %func% by its symbol size,
+ *    NULL if it's unknown
  */
 {
-    opnd_t mem2 = instr_get_dst(where, 0);
-    if (opnd_is_base_disp(mem2))
-    {
-        reg_id_t reg1 = opnd_get_reg(instr_get_src(where, 0));
-        auto sreg1 = drreg_reservation{drcontext, ilist, where};
-        auto sapp2 = drreg_reservation{drcontext, ilist, where};
-
-        // dereference the memory address at mem2 and store the result to sapp2 register
-        drutil_insert_get_mem_addr(drcontext, ilist, where, mem2, sapp2, sreg1);
+    char name[64];
+    drsym_info_t sym;
+    size_t offs = func - info->start;
 
-        // get shadow memory address of [mem2] and place it to sapp2
-        drtaint_insert_app_to_taint(drcontext, ilist, where, sapp2, sreg1);
+    memset(&sym, 0, sizeof(sym));
+    sym.struct_size = sizeof(sym);
+    sym.name = name;
+    sym.name_size = sizeof(name);
 
-        // get value of shadow register of reg1 and place it to sreg1
-        drtaint_insert_reg_to_taint_load(drcontext, ilist, where, reg1, sreg1);
+    drsym_error_t res = drsym_lookup_address(info->full_path, offs, &sym, DRSYM_DEFAULT_FLAGS);
+    if ((res != DRSYM_SUCCESS && res != DRSYM_ERROR_LINE_NOT_AVAILABLE) ||
+        sym.start_offs != offs || sym.end_offs <= sym.start_offs)
+        return NULL;
 
-        // write the value of reg1 to [mem2] shadow address
-        instrlist_meta_preinsert_xl8(ilist, where,
-                                 instr_store<sz>(drcontext, // str sreg1, [sapp2]
-                                                 opnd_mem<sz>(sapp2, 0),
-                                                 opnd_create_reg(sreg1)));
-    }
+    return info->start + sym.end_offs;
 }
 
-static void
-propagate_strd(void *drcontext, instrlist_t *ilist, instr_t *where)
+static uint
+app_string_size(app_pc str)
 /*
- *    strd reg1, reg2, [mem2]
- *
- *    We need to save the tag values stored in
- *    shadow registers of reg2 and reg3 to shadow addresses of [mem2] and [mem2 + 4]
+ *    Size of the string at %str% with its terminator, 0 if
+ *    it can't be read. The reads stop at page boundaries,
+ *    so that a string ending before an unmapped page is found
  */
 {
-    opnd_t mem2 = instr_get_dst(where, 0);
-    if (opnd_is_base_disp(mem2))
-    {
-        reg_id_t reg1 = opnd_get_reg(instr_get_src(where, 0));
-        reg_id_t reg2 = opnd_get_reg(instr_get_src(where, 1));
+    char buf[64];
+    uint size = 0;
 
-        auto sreg1 = drreg_reservation{drcontext, ilist, where};
-        auto sapp2 = drreg_reservation{drcontext, ilist, where};
-        auto sapp2n = drreg_reservation{drcontext, ilist, where};
+    for (;;)
+    {
+        size_t page_left = dr_page_size() - ((ptr_uint_t)str & (dr_page_size() - 1));
+        size_t count = page_left < sizeof(buf) ? page_left : sizeof(buf);
 
-        // dereference the memory address at mem2 and store the result to sapp2 register
-        drutil_insert_get_mem_addr(drcontext, ilist, where, mem2, sapp2, sreg1);
+        if (!dr_safe_read(str, count, buf, NULL))
+            return 0;
 
-        // get next 4 bytes after [mem2]
-        instrlist_meta_preinsert(ilist, where,
-                                 XINST_CREATE_add_2src(drcontext, // sapp2n = sapp2 + 4
-                                                       opnd_create_reg(sapp2n),
-                                                       opnd_create_reg(sapp2),
-                                                       OPND_CREATE_INT32(4)));
+        char *end = (char *)memchr(buf, 0, count);
+        if (end != NULL)
+            return size + (uint)(end - buf) + 1;
 
-        // get shadow memory address of [mem2] and place it to sapp2
-        drtaint_insert_app_to_taint(drcontext, ilist, where, sapp2, sreg1);
+        str += count;
+        size += (uint)count;
+    }
+}
 
-        // get value of shadow register of reg1 and place it to sreg1
-        drtaint_insert_reg_to_taint_load(drcontext, ilist, where, reg1, sreg1);
+static void
+libc_pre(void *wrapcxt, void **user_data)
+{
+    int routine = (int)(ptr_int_t)*user_data;
+    *user_data = NULL;
 
-        // write the value of reg1 to [mem2] shadow address
-        instrlist_meta_preinsert_xl8(ilist, where,
-                                 XINST_CREATE_store(drcontext, // str sreg1, [sapp2]
-                                                    OPND_CREATE_MEM32(sapp2, 0),
-                                                    opnd_create_reg(sreg1)));
+    // nothing to copy or scan
+    if (!taint_active)
+        return;
 
-        // get shadow memory address of [mem2 + 4] and place it to sapp2n
-        drtaint_insert_app_to_taint(drcontext, ilist, where, sapp2n, sapp2);
+    void *drcontext = drwrap_get_drcontext(wrapcxt);
+    libc_call_t *call = (libc_call_t *)dr_thread_alloc(drcontext, sizeof(libc_call_t));
+    uint value = 0;
 
-        // get value of shadow register of reg2 and place it to sreg1
-        drtaint_insert_reg_to_taint_load(drcontext, ilist, where, reg2, sreg1);
+    call->routine = routine;
+    call->dst = (app_pc)drwrap_get_arg(wrapcxt, 0);
+    call->src = (app_pc)drwrap_get_arg(wrapcxt, 1);
+    call->size = (uint)(ptr_uint_t)drwrap_get_arg(wrapcxt, 2);
 
-        // write the shadow value of reg2 to [mem2 + 4] shadow address
-        instrlist_meta_preinsert_xl8(ilist, where,
-                                 XINST_CREATE_store(drcontext, // str sreg1, [sapp2n]
-                                                    OPND_CREATE_MEM32(sapp2n, 0),
-                                                    opnd_create_reg(sreg1)));
-    }
-}
+    ds_get_reg_taint(drcontext, DR_REG_R0, &call->dst_taint);
+    ds_get_reg_taint(drcontext, DR_REG_R1, &value);
+    call->value_taint = (byte)value;
 
-#pragma endregion load_store
+    // a string which can't be read faults in the routine itself
+    if (routine == LIBC_STRCPY)
+        call->size = app_string_size(call->src);
+    else if (routine == LIBC_STRLEN)
+        call->size = app_string_size(call->dst);
 
-#pragma region move
+    *user_data = call;
+}
 
-static void
-propagate_mov_regs(void *drcontext, instrlist_t *ilist, instr_t *where,
-                   reg_id_t reg1, reg_id_t reg2)
+static byte
+app_area_union(void *drcontext, app_pc app, uint size)
 /*
- *    mov reg2, reg1
- *
- *    Need to save the tag value of reg1's
- *    shadow register to reg2's shadow register
+ *    Union of the tags of [app, app + size)
  */
 {
-    auto sreg2 = drreg_reservation{drcontext, ilist, where};
-    auto sreg1 = drreg_reservation{drcontext, ilist, where};
+    byte tags[256];
+    byte res = 0;
 
-    // get value of shadow register of reg1 and place it to sreg1
-    drtaint_insert_reg_to_taint_load(drcontext, ilist, where, reg1, sreg1);
+    if (ds_is_area_clean(drcontext, app, size))
+        return 0;
 
-    // get shadow register address of reg2 and place it to sreg2
-    drtaint_insert_reg_to_taint(drcontext, ilist, where, reg2, sreg2);
+    while (size > 0)
+    {
+        uint count = size < sizeof(tags) ? size : sizeof(tags);
 
-    // write shadow value of reg1 to shadow value of reg2
-    instrlist_meta_preinsert(ilist, where,
-                             XINST_CREATE_store(drcontext, // str sreg1, [sreg2]
-                                                OPND_CREATE_MEM32(sreg2, 0),
-                                                opnd_create_reg(sreg1)));
+        ds_get_app_area_taint(drcontext, app, count, tags);
+        for (uint i = 0; i < count; i++)
+            res |= tags[i];
+
+        app += count;
+        size -= count;
+    }
+    return res;
 }
 
 static void
-propagate_mov_reg_src(void *drcontext, instrlist_t *ilist, instr_t *where)
+libc_post(void *wrapcxt, void *user_data)
+/*
+ *    memcpy, memmove, strcpy: the shadow of the source is moved
+ *    memset:                  the destination gets the tag of the value
+ *    strlen:                  the result gets tags of the whole string
+ *    The result of the others is the destination pointer.
+ *    r1-r3 and r12 are clobbered by the call
+ */
 {
-    // mov reg2, reg1
-    reg_id_t reg2 = opnd_get_reg(instr_get_dst(where, 0));
-    reg_id_t reg1 = opnd_get_reg(instr_get_src(where, 0));
-    propagate_mov_regs(drcontext, ilist, where, reg1, reg2);
-}
+    libc_call_t *call = (libc_call_t *)user_data;
+    if (call == NULL)
+        return;
 
-#pragma endregion move
+    // the routine was left by longjmp
+    if (wrapcxt == NULL)
+    {
+        dr_thread_free(dr_get_current_drcontext(), call, sizeof(libc_call_t));
+        return;
+    }
 
-#pragma region arithmetic
+    void *drcontext = drwrap_get_drcontext(wrapcxt);
+    uint result = call->dst_taint;
+
+    switch (call->routine)
+    {
+    case LIBC_MEMCPY:
+    case LIBC_MEMMOVE:
+    case LIBC_STRCPY:
+        if (call->size > 0)
+            drtaint_move_app_taint(drcontext, call->dst, call->src, call->size);
+        break;
+
+    case LIBC_MEMSET:
+        if (call->size > 0)
+            drtaint_set_app_area_taint(drcontext, call->dst, call->size, call->value_taint);
+        break;
+
+    case LIBC_STRLEN:
+        result = app_area_union(drcontext, call->dst, call->size) * 0x01010101;
+        break;
+    }
+
+    ds_set_reg_taint(drcontext, DR_REG_R0, result);
+    ds_set_reg_taint(drcontext, DR_REG_R1, 0);
+    ds_set_reg_taint(drcontext, DR_REG_R2, 0);
+    ds_set_reg_taint(drcontext, DR_REG_R3, 0);
+    ds_set_reg_taint(drcontext, DR_REG_R12, 0);
+
+    __atomic_fetch_add(&stat_libc_summaries, 1, __ATOMIC_RELAXED);
+    dr_thread_free(drcontext, call, sizeof(libc_call_t));
+}
 
 static void
-propagate_arith_reg_imm(void *drcontext, instrlist_t *ilist, instr_t *where)
+wrap_libc_routines(const module_data_t *info)
 /*
- *    add reg2, reg1, imm
- *    sub reg2, reg1, imm
- *    ...
- *
- *    Need to mark reg2 tainted using tag of reg1
+ *    Wrap the routines and exclude their bodies if their size is known.
+ *    Resolved IFUNCs point to the chosen implementation, blocks it
+ *    branches to outside of the symbol still propagate, libc_post
+ *    overwrites their result
  */
 {
-    reg_id_t reg2 = opnd_get_reg(instr_get_dst(where, 0));
-    reg_id_t reg1 = opnd_get_reg(instr_get_src(where, 0));
+    for (int i = 0; i < LIBC_ROUTINES; i++)
+    {
+        app_pc func = (app_pc)dr_get_proc_address(info->handle, libc_routines[i]);
+        if (func == NULL)
+            continue;
 
-    auto sreg2 = drreg_reservation{drcontext, ilist, where};
-    auto sreg1 = drreg_reservation{drcontext, ilist, where};
+        if (!drwrap_wrap_ex(func, libc_pre, libc_post, (void *)(ptr_int_t)i, 0))
+            continue;
 
-    // get value of shadow register of reg1 and place it to sreg1
-    drtaint_insert_reg_to_taint_load(drcontext, ilist, where, reg1, sreg1);
+        // thumb routines have the lowest bit set
+        app_pc start = (app_pc)((ptr_uint_t)func & ~(ptr_uint_t)1);
+        app_pc end = routine_end(info, start);
 
-    // get shadow register address of reg2 and place it to sreg2
-    drtaint_insert_reg_to_taint(drcontext, ilist, where, reg2, sreg2);
+        if (end != NULL)
+            add_excluded_range(start, end, info->start, true);
+    }
+}
 
-    // write the result to shadow register of reg2
-    instrlist_meta_preinsert(ilist, where,
-                             XINST_CREATE_store(drcontext, // str sreg1, [sreg2]
-                                                OPND_CREATE_MEM32(sreg2, 0),
-                                                opnd_create_reg(sreg1)));
+#pragma endregion libc
+
+#pragma region profile
+
+static inline app_pc
+profile_key(app_pc pc)
+{
+    // thumb addresses have the lowest bit set
+    return (app_pc)((ptr_uint_t)pc & ~(ptr_uint_t)1);
 }
 
 static void
-propagate_arith_reg_reg(void *drcontext, instrlist_t *ilist, instr_t *where)
+add_profile_record(const char *module, uint offset)
 /*
- *    add reg3, reg2, reg1
- *    sub reg3, reg2, reg1
- *    ...
- *
- *    Need to mark reg3 tainted.
- *    Because its value depends on values of reg2, reg1,
- *    we use OR to combine their impacts to reg3
+ *    profile_lock must be held
  */
 {
-    reg_id_t reg3 = opnd_get_reg(instr_get_dst(where, 0));
-    reg_id_t reg2 = opnd_get_reg(instr_get_src(where, 0));
-    reg_id_t reg1 = opnd_get_reg(instr_get_src(where, 1));
-
-    auto sreg2 = drreg_reservation{drcontext, ilist, where};
-    auto sreg1 = drreg_reservation{drcontext, ilist, where};
-    reg_id_t sreg3 = sreg2; // we reuse a register for this
-
-    // get value of shadow registers of reg1, reg2 and place it to sreg1, sreg2
-    drtaint_insert_reg_to_taint_load(drcontext, ilist, where, reg1, sreg1);
-    drtaint_insert_reg_to_taint_load(drcontext, ilist, where, reg2, sreg2);
+    if (num_profile_records == max_profile_records)
+    {
+        uint max = max_profile_records == 0 ? 256 : max_profile_records * 2;
+        profile_record_t *records =
+            (profile_record_t *)dr_global_alloc(max * sizeof(profile_record_t));
 
-    // combine tags
-    instrlist_meta_preinsert(ilist, where,
-                             INSTR_CREATE_orr(drcontext, // sreg1 |= sreg2
-                                              opnd_create_reg(sreg1),
-                                              opnd_create_reg(sreg2),
-                                              opnd_create_reg(sreg1)));
+        if (profile_records != NULL)
+        {
+            memcpy(records, profile_records, num_profile_records * sizeof(profile_record_t));
+            dr_global_free(profile_records, max_profile_records * sizeof(profile_record_t));
+        }
 
-    // get shadow address of reg3 and place it to sreg3
-    drtaint_insert_reg_to_taint(drcontext, ilist, where, reg3, sreg3);
+        profile_records = records;
+        max_profile_records = max;
+    }
 
-    // save the result to shadow address of reg3
-    instrlist_meta_preinsert(ilist, where,
-                             XINST_CREATE_store(drcontext, // str sreg1, [sreg3]
-                                                OPND_CREATE_MEM32(sreg3, 0),
-                                                opnd_create_reg(sreg1)));
+    profile_record_t *record = &profile_records[num_profile_records++];
+    dr_snprintf(record->module, sizeof(record->module), "%s", module);
+    record->module[sizeof(record->module) - 1] = '\0';
+    record->offset = offset;
 }
 
 static void
-propagate_1rd_3rs(void *drcontext, instrlist_t *ilist, instr_t *where)
+load_profile(void)
 /*
- *    mla reg4, reg3, reg2, reg1
- *
- *    Need to mark reg4 tainted.
- *    Because its value depends on values of reg3, reg2, reg1,
- *    we use OR to combine their impacts to reg4
+ *    Lines are "module offset", the file is missing at the first run
  */
 {
-    reg_id_t reg1 = opnd_get_reg(instr_get_src(where, 2));
-    reg_id_t reg2 = opnd_get_reg(instr_get_src(where, 1));
-    reg_id_t reg3 = opnd_get_reg(instr_get_src(where, 0));
-    reg_id_t reg4 = opnd_get_reg(instr_get_dst(where, 0));
+    file_t file = dr_open_file(options.profile_file, DR_FILE_READ);
+    uint64 size;
+
+    if (file == INVALID_FILE)
+        return;
+
+    if (!dr_file_size(file, &size) || size == 0)
+    {
+        dr_close_file(file);
+        return;
+    }
+
+    char *buf = (char *)dr_global_alloc((size_t)size + 1);
+    ssize_t len = dr_read_file(file, buf, (size_t)size);
+    buf[len > 0 ? len : 0] = '\0';
+    dr_close_file(file);
+
+    for (char *line = buf; *line != '\0';)
+    {
+        char *eol = strchr(line, '\n');
+        char *space = strchr(line, ' ');
+        uint offset;
+
+        if (eol != NULL)
+            *eol = '\0';
+
+        if (space != NULL && space - line < MAX_PROFILE_NAME &&
+            dr_sscanf(space + 1, "%x", &offset) == 1)
+        {
+            *space = '\0';
+            add_profile_record(line, offset);
+        }
+
+        line = eol != NULL ? eol + 1 : line + strlen(line);
+    }
+
+    dr_global_free(buf, (size_t)size + 1);
+}
+
+static void
+profile_init(void)
+{
+    // looked up while blocks are built, without profile_lock
+    hashtable_init(&profile_blocks, 12, HASH_INTPTR, true);
+    profile_lock = dr_mutex_create();
+    load_profile();
+}
+
+static void
+profile_exit(void)
+/*
+ *    Records of modules this run didn't load are kept
+ */
+{
+    file_t file = dr_open_file(options.profile_file, DR_FILE_WRITE_OVERWRITE);
+
+    if (file != INVALID_FILE)
+    {
+        for (uint i = 0; i < num_profile_records; i++)
+            dr_fprintf(file, "%s 0x%x\n", profile_records[i].module, profile_records[i].offset);
+        dr_close_file(file);
+    }
+    else
+        dr_fprintf(STDERR, "drtaint: can't write profile %s\n", options.profile_file);
+
+    if (profile_records != NULL)
+        dr_global_free(profile_records, max_profile_records * sizeof(profile_record_t));
+
+    hashtable_delete(&profile_blocks);
+    dr_mutex_destroy(profile_lock);
+}
+
+static void
+profile_module_load(const module_data_t *info, const char *name)
+{
+    dr_mutex_lock(profile_lock);
+    for (uint i = 0; i < num_profile_records; i++)
+    {
+        if (strcmp(profile_records[i].module, name) == 0 &&
+            info->start + profile_records[i].offset < info->end)
+        {
+            hashtable_add(&profile_blocks, info->start + profile_records[i].offset, (void *)1);
+        }
+    }
+    dr_mutex_unlock(profile_lock);
+}
+
+static void
+profile_module_unload(const module_data_t *info)
+{
+    // the records stay, the module may be loaded elsewhere again
+    dr_mutex_lock(profile_lock);
+    hashtable_remove_range(&profile_blocks, info->start, info->end);
+    dr_mutex_unlock(profile_lock);
+}
+
+static bool
+profile_met_taint(app_pc pc)
+{
+    return hashtable_lookup(&profile_blocks, profile_key(pc)) != NULL;
+}
+
+static void
+profile_add(app_pc pc)
+{
+    pc = profile_key(pc);
+
+    dr_mutex_lock(profile_lock);
+    if (hashtable_add(&profile_blocks, pc, (void *)1))
+    {
+        module_data_t *info = dr_lookup_module(pc);
+        if (info != NULL)
+        {
+            const char *name = dr_module_preferred_name(info);
+            add_profile_record(name != NULL ? name : "", (uint)(pc - info->start));
+            dr_free_module_data(info);
+        }
+    }
+    dr_mutex_unlock(profile_lock);
+}
+
+static void
+profile_trip(app_pc start)
+/*
+ *    A guard of the block at %start% met taint. Instructions before the
+ *    one it guarded didn't access tainted memory with clean registers,
+ *    so they had nothing to propagate. The block is rebuilt with propagation
+ *    and execution resumes at that instruction, a block starts there too.
+ *
+ *    The flush is delayed, so other threads aren't stopped: DR does it
+ *    at this thread's next exit from the cache, which the redirect is.
+ *    Each trip still costs a flush, see drtaint_stats_t.guard_trips
+ */
+{
+    void *drcontext = dr_get_current_drcontext();
+    byte *tls = (byte *)dr_get_dr_segment_base(fast_tls_seg) + fast_tls_offs;
+    app_pc pc = *(app_pc *)(tls + PROFILE_PC_SLOT * sizeof(void *));
+    dr_mcontext_t mc = {sizeof(mc), DR_MC_ALL};
+
+    dr_get_mcontext(drcontext, &mc);
+    profile_add(start);
+    profile_add(pc);
+    __atomic_fetch_add(&stat_guard_trips, 1, __ATOMIC_RELAXED);
+
+    // a guarded block may start at the resume pc too
+    app_pc first = profile_key(start);
+    bool ok = dr_delay_flush_region(first, profile_key(pc) - first + 1, 0, NULL);
+    DR_ASSERT(ok);
+
+    mc.pc = dr_app_pc_as_jump_target(dr_get_isa_mode(drcontext), pc);
+    dr_redirect_execution(&mc);
+}
+
+#pragma endregion profile
+
+#pragma region plans
+
+static uint
+plan_policy(void)
+/*
+ *    Plans made under another propagation policy can't be reused
+ */
+{
+    return DRTAINT_POLICY::zeroing_idioms ? 1 : 0;
+}
+
+static uint
+module_build_id(const module_data_t *info, byte *id, uint max)
+/*
+ *    Copy the GNU build id note of the mapped module to %id%,
+ *    return its size or 0 if it has none
+ */
+{
+    Elf32_Ehdr *ehdr = (Elf32_Ehdr *)info->start;
+    size_t size = info->end - info->start;
+
+    if (size < sizeof(*ehdr) || memcmp(ehdr->e_ident, ELFMAG, SELFMAG) != 0 ||
+        ehdr->e_phoff + ehdr->e_phnum * sizeof(Elf32_Phdr) > size)
+        return 0;
+
+    Elf32_Phdr *phdr = (Elf32_Phdr *)(info->start + ehdr->e_phoff);
+    ptr_uint_t min_vaddr = POINTER_MAX;
+
+    // the module starts at its lowest segment
+    for (uint i = 0; i < ehdr->e_phnum; i++)
+    {
+        if (phdr[i].p_type == PT_LOAD && phdr[i].p_vaddr < min_vaddr)
+            min_vaddr = phdr[i].p_vaddr;
+    }
+
+    app_pc base = info->start - ALIGN_BACKWARD(min_vaddr, dr_page_size());
+
+    for (uint i = 0; i < ehdr->e_phnum; i++)
+    {
+        byte *note = base + phdr[i].p_vaddr;
+        byte *end = note + phdr[i].p_memsz;
+
+        if (phdr[i].p_type != PT_NOTE || note < info->start || end > info->end)
+            continue;
+
+        while (note + sizeof(Elf32_Nhdr) <= end)
+        {
+            Elf32_Nhdr *nhdr = (Elf32_Nhdr *)note;
+            byte *name = note + sizeof(*nhdr);
+            byte *desc = name + ALIGN_FORWARD(nhdr->n_namesz, 4);
+
+            if (desc + nhdr->n_descsz > end)
+                break;
+
+            if (nhdr->n_type == NT_GNU_BUILD_ID && nhdr->n_namesz == 4 &&
+                memcmp(name, "GNU", 4) == 0)
+            {
+                uint len = nhdr->n_descsz < max ? nhdr->n_descsz : max;
+                memcpy(id, desc, len);
+                return len;
+            }
+
+            note = desc + ALIGN_FORWARD(nhdr->n_descsz, 4);
+        }
+    }
+
+    return 0;
+}
+
+static bool
+plan_file_valid(const char *path, uint size)
+{
+    file_t file = dr_open_file(path, DR_FILE_READ);
+    plan_header_t header;
+    uint64 file_size;
+
+    if (file == INVALID_FILE)
+        return false;
+
+    bool ok = dr_file_size(file, &file_size) && file_size == sizeof(header) + size &&
+              dr_read_file(file, &header, sizeof(header)) == sizeof(header) &&
+              header.magic == PLAN_MAGIC && header.version == PLAN_VERSION &&
+              header.policy == plan_policy() && header.size == size;
+
+    dr_close_file(file);
+    return ok;
+}
+
+static bool
+create_plan_file(const char *path, uint size)
+/*
+ *    The header followed by %size% unknown plans. Other processes may
+ *    have the old file mapped, truncating it would make their accesses
+ *    fault. A new file is written aside and renamed over it instead,
+ *    they keep the old one
+ */
+{
+    static const byte zeros[4096] = {0};
+    plan_header_t header = {PLAN_MAGIC, PLAN_VERSION, plan_policy(), size};
+    char tmp[MAXIMUM_PATH];
+
+    if (dr_snprintf(tmp, sizeof(tmp), "%s.%d.tmp", path, dr_get_process_id()) < 0)
+        return false;
+
+    file_t file = dr_open_file(tmp, DR_FILE_WRITE_OVERWRITE);
+    if (file == INVALID_FILE)
+        return false;
+
+    bool ok = dr_write_file(file, &header, sizeof(header)) == sizeof(header);
+    for (uint done = 0; ok && done < size; done += sizeof(zeros))
+    {
+        uint len = size - done < sizeof(zeros) ? size - done : sizeof(zeros);
+        ok = dr_write_file(file, zeros, len) == (ssize_t)len;
+    }
+
+    dr_close_file(file);
+
+    ok = ok && dr_rename_file(tmp, path, true);
+    if (!ok)
+        dr_delete_file(tmp);
+    return ok;
+}
+
+static void
+plans_module_load(const module_data_t *info, const char *name)
+/*
+ *    Map <dir>/<name>-<build id>.plan shared, plans made in this run
+ *    go to the file. There is a plan per 2 bytes of the module, thumb
+ *    instructions are 2-byte aligned. Modules without a build id
+ *    aren't cached, the offsets of another build would be wrong
+ */
+{
+    byte id[32];
+    char hex[2 * sizeof(id) + 1] = {0};
+    char path[MAXIMUM_PATH];
+    uint len = module_build_id(info, id, sizeof(id));
+    uint size = (uint)((info->end - info->start) >> 1);
+
+    if (len == 0)
+        return;
+
+    for (uint i = 0; i < len; i++)
+        dr_snprintf(hex + 2 * i, 3, "%02x", id[i]);
+
+    if (dr_snprintf(path, sizeof(path), "%s/%s-%s.plan", options.plan_cache_dir, name, hex) < 0)
+        return;
+
+    if (!plan_file_valid(path, size) && !create_plan_file(path, size))
+    {
+        dr_fprintf(STDERR, "drtaint: can't create plan cache %s\n", path);
+        return;
+    }
+
+    file_t file = dr_open_file(path, DR_FILE_READ | DR_FILE_WRITE_APPEND);
+    if (file == INVALID_FILE)
+        return;
+
+    size_t map_size = sizeof(plan_header_t) + size;
+    byte *map = (byte *)dr_map_file(file, &map_size, 0, NULL,
+                                    DR_MEMPROT_READ | DR_MEMPROT_WRITE, 0);
+    dr_close_file(file);
+
+    if (map == NULL)
+        return;
+
+    dr_rwlock_write_lock(plan_lock);
+    if (num_plan_caches < MAX_PLAN_CACHES)
+    {
+        plan_caches[num_plan_caches++] = {info->start, info->end, map, map_size};
+        map = NULL;
+    }
+    dr_rwlock_write_unlock(plan_lock);
+
+    if (map != NULL)
+        dr_unmap_file(map, map_size);
+}
+
+static void
+plans_module_unload(const module_data_t *info)
+{
+    byte *map = NULL;
+    size_t map_size = 0;
+
+    dr_rwlock_write_lock(plan_lock);
+    for (uint i = 0; i < num_plan_caches; i++)
+    {
+        if (plan_caches[i].start == info->start)
+        {
+            map = plan_caches[i].map;
+            map_size = plan_caches[i].map_size;
+            plan_caches[i] = plan_caches[--num_plan_caches];
+            break;
+        }
+    }
+    dr_rwlock_write_unlock(plan_lock);
+
+    if (map != NULL)
+        dr_unmap_file(map, map_size);
+}
+
+static byte *
+find_plans(app_pc pc, app_pc *start, app_pc *end)
+/*
+ *    Plans of the module holding %pc%, indexed by (pc - start) / 2.
+ *    If there are any, plan_lock stays held for reading so that the
+ *    module's file isn't unmapped under the block being built,
+ *    see release_plans
+ */
+{
+    byte *plans = NULL;
+
+    dr_rwlock_read_lock(plan_lock);
+    for (uint i = 0; i < num_plan_caches; i++)
+    {
+        if (pc >= plan_caches[i].start && pc < plan_caches[i].end)
+        {
+            plans = plan_caches[i].map + sizeof(plan_header_t);
+            *start = plan_caches[i].start;
+            *end = plan_caches[i].end;
+            break;
+        }
+    }
+
+    if (plans == NULL)
+        dr_rwlock_read_unlock(plan_lock);
+    return plans;
+}
+
+static void
+release_plans(void)
+/*
+ *    The block whose plans find_plans returned is built
+ */
+{
+    dr_rwlock_read_unlock(plan_lock);
+}
+
+static void
+plans_exit(void)
+{
+    for (uint i = 0; i < num_plan_caches; i++)
+        dr_unmap_file(plan_caches[i].map, plan_caches[i].map_size);
+
+    num_plan_caches = 0;
+    dr_rwlock_destroy(plan_lock);
+}
+
+#pragma endregion plans
+
+#pragma region wrappers
+
+bool drtaint_insert_app_to_taint(void *drcontext, instrlist_t *ilist, instr_t *where,
+                                 reg_id_t reg_addr, reg_id_t scratch)
+{
+    return ds_insert_app_to_shadow(drcontext, ilist, where,
+                                   reg_addr, scratch);
+}
+
+bool drtaint_insert_reg_to_taint(void *drcontext, instrlist_t *ilist, instr_t *where,
+                                 reg_id_t shadow, reg_id_t regaddr)
+{
+    return ds_insert_reg_to_shadow(drcontext, ilist, where,
+                                   shadow, regaddr);
+}
+
+bool drtaint_insert_reg_to_taint_load(void *drcontext, instrlist_t *ilist, instr_t *where,
+                                      reg_id_t shadow, reg_id_t regaddr)
+{
+    return ds_insert_reg_to_shadow_load(drcontext, ilist, where,
+                                        shadow, regaddr);
+}
+
+bool drtaint_insert_reg_to_taint_store(void *drcontext, instrlist_t *ilist, instr_t *where,
+                                       reg_id_t shadow, reg_id_t value, reg_id_t scratch)
+{
+    return ds_insert_reg_to_shadow_store(drcontext, ilist, where,
+                                         shadow, value, scratch);
+}
+
+bool drtaint_get_reg_taint(void *drcontext, reg_id_t reg, uint *result)
+{
+    return ds_get_reg_taint(drcontext, reg, result);
+}
+
+bool drtaint_set_reg_taint(void *drcontext, reg_id_t reg, uint value)
+{
+    if (value != 0)
+        activate_propagation();
+    return ds_set_reg_taint(drcontext, reg, value);
+}
+
+bool drtaint_get_app_taint(void *drcontext, app_pc app, byte *result)
+{
+    return ds_get_app_taint(drcontext, app, result);
+}
+
+bool drtaint_set_app_taint(void *drcontext, app_pc app, byte value)
+{
+    if (value != 0)
+        activate_propagation();
+    return ds_set_app_taint(drcontext, app, value);
+}
+
+bool drtaint_get_app_taint4(void *drcontext, app_pc app, uint *result)
+{
+    return ds_get_app_taint4(drcontext, app, result);
+}
+
+bool drtaint_set_app_taint4(void *drcontext, app_pc app, uint value)
+{
+    if (value != 0)
+        activate_propagation();
+    return ds_set_app_taint4(drcontext, app, value);
+}
+
+static inline uint64
+stats_time_ns(void)
+/*
+ *    Range operations are timed only if the stats are reported,
+ *    clock_gettime costs more than many of the operations
+ */
+{
+    return TEST(DRTAINT_OPTION_STATS_REPORT, options.flags) ? ds_time_ns() : 0;
+}
+
+void drtaint_set_app_area_taint(void *drcontext, app_pc app, uint size, byte value)
+{
+    if (value != 0 && size > 0)
+        activate_propagation();
+
+    uint64 start = stats_time_ns();
+    ds_set_app_area_taint(drcontext, app, size, value);
+
+    __atomic_fetch_add(&stat_range_ops, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&stat_range_ns, stats_time_ns() - start, __ATOMIC_RELAXED);
+    if (value != 0)
+        __atomic_fetch_add(&stat_bytes_tainted, size, __ATOMIC_RELAXED);
+    else
+        __atomic_fetch_add(&stat_bytes_untainted, size, __ATOMIC_RELAXED);
+}
+
+bool drtaint_copy_app_taint(void *drcontext, app_pc dst, app_pc src, uint size)
+{
+    uint64 start = stats_time_ns();
+    bool ok = ds_copy_app_taint(drcontext, dst, src, size);
+
+    __atomic_fetch_add(&stat_range_ops, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&stat_range_ns, stats_time_ns() - start, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&stat_bytes_copied, size, __ATOMIC_RELAXED);
+    return ok;
+}
+
+bool drtaint_move_app_taint(void *drcontext, app_pc dst, app_pc src, uint size)
+{
+    uint64 start = stats_time_ns();
+    bool ok = ds_move_app_taint(drcontext, dst, src, size);
+
+    __atomic_fetch_add(&stat_range_ops, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&stat_range_ns, stats_time_ns() - start, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&stat_bytes_copied, size, __ATOMIC_RELAXED);
+    return ok;
+}
+
+bool drtaint_get_app_area_taint(void *drcontext, app_pc app, uint size, byte *result)
+{
+    return ds_get_app_area_taint(drcontext, app, size, result);
+}
+
+bool drtaint_find_tainted(void *drcontext, app_pc app, uint size, uint *first_offset)
+{
+    return ds_find_tainted(drcontext, app, size, first_offset);
+}
+
+bool drtaint_is_area_clean(void *drcontext, app_pc app, uint size)
+{
+    return ds_is_area_clean(drcontext, app, size);
+}
+
+void drtaint_get_summary_stats(uint64 *clean_loads, uint64 *shadow_loads)
+{
+    *clean_loads = summary_clean_loads;
+    *shadow_loads = summary_shadow_loads;
+}
+
+uint64 drtaint_get_reclaimed_bytes(void)
+{
+    return ds_get_reclaimed_bytes();
+}
+
+bool drtaint_get_stats(drtaint_stats_t *stats)
+{
+    if (stats == NULL || stats->struct_size != sizeof(*stats))
+        return false;
+
+    ds_get_stats(stats);
+    stats->range_ops = __atomic_load_n(&stat_range_ops, __ATOMIC_RELAXED);
+    stats->range_ns = __atomic_load_n(&stat_range_ns, __ATOMIC_RELAXED);
+    stats->bytes_tainted = __atomic_load_n(&stat_bytes_tainted, __ATOMIC_RELAXED);
+    stats->bytes_untainted = __atomic_load_n(&stat_bytes_untainted, __ATOMIC_RELAXED);
+    stats->bytes_copied = __atomic_load_n(&stat_bytes_copied, __ATOMIC_RELAXED);
+    stats->clean_loads = summary_clean_loads;
+    stats->shadow_loads = summary_shadow_loads;
+    stats->hoisted_blocks = __atomic_load_n(&stat_hoisted_blocks, __ATOMIC_RELAXED);
+    stats->hoist_saved_instrs = __atomic_load_n(&stat_hoist_saved, __ATOMIC_RELAXED);
+    stats->hoist_setup_instrs = __atomic_load_n(&stat_hoist_setup, __ATOMIC_RELAXED);
+    stats->dead_writes = __atomic_load_n(&stat_dead_writes, __ATOMIC_RELAXED);
+    stats->downgraded = __atomic_load_n(&stat_downgraded, __ATOMIC_RELAXED);
+    stats->coalesced = __atomic_load_n(&stat_coalesced, __ATOMIC_RELAXED);
+    stats->resident_regs = __atomic_load_n(&stat_resident_regs, __ATOMIC_RELAXED);
+    stats->resident_accesses = __atomic_load_n(&stat_resident_accesses, __ATOMIC_RELAXED);
+    stats->dual_blocks = __atomic_load_n(&stat_dual_blocks, __ATOMIC_RELAXED);
+    stats->lazy_blocks = __atomic_load_n(&stat_lazy_blocks, __ATOMIC_RELAXED);
+    stats->built_blocks = __atomic_load_n(&stat_built_blocks, __ATOMIC_RELAXED);
+    stats->built_bytes = __atomic_load_n(&stat_built_bytes, __ATOMIC_RELAXED);
+    stats->stub_calls = __atomic_load_n(&stat_stub_calls, __ATOMIC_RELAXED);
+    stats->excluded_blocks = __atomic_load_n(&stat_excluded_blocks, __ATOMIC_RELAXED);
+    stats->boundary_summaries = __atomic_load_n(&stat_boundary_summaries, __ATOMIC_RELAXED);
+    stats->libc_summaries = __atomic_load_n(&stat_libc_summaries, __ATOMIC_RELAXED);
+    stats->loop_blocks = __atomic_load_n(&stat_loop_blocks, __ATOMIC_RELAXED);
+    stats->loop_summaries = __atomic_load_n(&stat_loop_summaries, __ATOMIC_RELAXED);
+    stats->loop_replays = __atomic_load_n(&stat_loop_replays, __ATOMIC_RELAXED);
+    stats->loop_mismatches = __atomic_load_n(&stat_loop_mismatches, __ATOMIC_RELAXED);
+    stats->guarded_blocks = __atomic_load_n(&stat_guarded_blocks, __ATOMIC_RELAXED);
+    stats->guard_trips = __atomic_load_n(&stat_guard_trips, __ATOMIC_RELAXED);
+    stats->translate_ns = __atomic_load_n(&stat_translate_ns, __ATOMIC_RELAXED);
+    stats->plan_hits = __atomic_load_n(&stat_plan_hits, __ATOMIC_RELAXED);
+    stats->plan_misses = __atomic_load_n(&stat_plan_misses, __ATOMIC_RELAXED);
+    return true;
+}
+
+void drtaint_print_stats(file_t file)
+{
+    drtaint_stats_t st = {sizeof(st)};
+    if (!drtaint_get_stats(&st))
+        return;
+
+    dr_fprintf(file, "drtaint: shadow %llu KB, reclaimed %llu KB\n",
+               st.shadow_bytes >> 10, st.reclaimed_bytes >> 10);
+    dr_fprintf(file, "drtaint: %llu shadow faults (%llu block replacements, %llu ns avg), "
+                     "%llu app faults\n",
+               st.faults, st.block_replacements,
+               st.faults > 0 ? st.fault_ns / st.faults : 0, st.foreign_faults);
+    dr_fprintf(file, "drtaint: %llu range ops (%llu ns avg), tainted %llu, untainted %llu, "
+                     "copied %llu bytes\n",
+               st.range_ops, st.range_ops > 0 ? st.range_ns / st.range_ops : 0,
+               st.bytes_tainted, st.bytes_untainted, st.bytes_copied);
+
+    if (st.clean_loads + st.shadow_loads > 0)
+    {
+        dr_fprintf(file, "drtaint: clean page loads %llu, shadow loads %llu\n",
+                   st.clean_loads, st.shadow_loads);
+    }
+
+    if (st.dead_writes > 0)
+        dr_fprintf(file, "drtaint: %llu dead shadow register writes removed\n", st.dead_writes);
+
+    if (st.downgraded > 0)
+        dr_fprintf(file, "drtaint: %llu propagations simplified by clean sources\n", st.downgraded);
+
+    if (st.coalesced > 0)
+        dr_fprintf(file, "drtaint: %llu shadow translations coalesced\n", st.coalesced);
+
+    if (st.resident_regs > 0)
+    {
+        dr_fprintf(file, "drtaint: %llu resident shadow registers, %llu accesses served\n",
+                   st.resident_regs, st.resident_accesses);
+    }
+
+    if (st.dual_blocks > 0)
+        dr_fprintf(file, "drtaint: %llu blocks with an uninstrumented copy\n", st.dual_blocks);
+
+    if (st.lazy_blocks > 0)
+        dr_fprintf(file, "drtaint: %llu blocks built before the first taint\n", st.lazy_blocks);
+
+    if (st.excluded_blocks > 0)
+    {
+        dr_fprintf(file, "drtaint: %llu blocks of excluded code, %llu boundary summaries\n",
+                   st.excluded_blocks, st.boundary_summaries);
+    }
+
+    if (st.libc_summaries > 0)
+        dr_fprintf(file, "drtaint: %llu libc calls summarized\n", st.libc_summaries);
+
+    if (st.loop_blocks > 0)
+    {
+        dr_fprintf(file, "drtaint: %llu copy loop blocks, %llu loops summarized, "
+                         "%llu overlapping, %llu without their entry\n",
+                   st.loop_blocks, st.loop_summaries, st.loop_replays, st.loop_mismatches);
+    }
+
+    if (st.guarded_blocks > 0)
+    {
+        dr_fprintf(file, "drtaint: %llu guarded blocks, %llu met taint\n",
+                   st.guarded_blocks, st.guard_trips);
+    }
+
+    if (st.built_blocks > 0)
+    {
+        dr_fprintf(file, "drtaint: %llu blocks built, %llu KB of code, %llu bytes avg, "
+                         "%llu shared routine calls\n",
+                   st.built_blocks, st.built_bytes >> 10,
+                   st.built_bytes / st.built_blocks, st.stub_calls);
+        dr_fprintf(file, "drtaint: %llu us translating, %llu ns per block\n",
+                   st.translate_ns / 1000, st.translate_ns / st.built_blocks);
+    }
+
+    if (st.plan_hits + st.plan_misses > 0)
+    {
+        dr_fprintf(file, "drtaint: %llu plans from the cache, %llu classified\n",
+                   st.plan_hits, st.plan_misses);
+    }
+
+    if (st.hoisted_blocks > 0)
+    {
+        dr_fprintf(file, "drtaint: %llu blocks with hoisted shadow register base, "
+                         "%lld meta instructions saved per block\n",
+                   st.hoisted_blocks,
+                   ((int64)st.hoist_saved_instrs - (int64)st.hoist_setup_instrs) /
+                       (int64)st.hoisted_blocks);
+    }
+}
+
+static void
+event_nudge(void *drcontext, uint64 arg)
+{
+    if (arg == DRTAINT_NUDGE_DUMP_STATS)
+        drtaint_print_stats(STDERR);
+}
+
+#pragma endregion wrappers
+
+#pragma region taint_propagation
+
+/* ======================================================================================
+ * main implementation, taint propagation step
+ * ==================================================================================== */
+
+#pragma region load_store
+
+static void
+insert_counter_inc(void *drcontext, instrlist_t *ilist, instr_t *where,
+                   uint64 *counter, reg_id_t saddr, reg_id_t sval)
+/*
+ *    (*counter)++, aflags have to be reserved
+ */
+{
+    instrlist_insert_mov_immed_ptrsz(drcontext, (ptr_int_t)counter,
+                                     opnd_create_reg(saddr), ilist, where, NULL, NULL);
+
+    instrlist_meta_preinsert(ilist, where,
+                             XINST_CREATE_load(drcontext, // ldr sval, [saddr]
+                                               opnd_create_reg(sval),
+                                               OPND_CREATE_MEM32(saddr, 0)));
+    instrlist_meta_preinsert(ilist, where,
+                             INSTR_CREATE_adds(drcontext, // adds sval, sval, #1
+                                               opnd_create_reg(sval),
+                                               opnd_create_reg(sval),
+                                               OPND_CREATE_INT8(1)));
+    instrlist_meta_preinsert(ilist, where,
+                             XINST_CREATE_store(drcontext, // str sval, [saddr]
+                                                OPND_CREATE_MEM32(saddr, 0),
+                                                opnd_create_reg(sval)));
+
+    instrlist_meta_preinsert(ilist, where,
+                             XINST_CREATE_load(drcontext, // ldr sval, [saddr, #4]
+                                               opnd_create_reg(sval),
+                                               OPND_CREATE_MEM32(saddr, 4)));
+    instrlist_meta_preinsert(ilist, where,
+                             INSTR_CREATE_adc(drcontext, // adc sval, sval, #0
+                                              opnd_create_reg(sval),
+                                              opnd_create_reg(sval),
+                                              OPND_CREATE_INT8(0)));
+    instrlist_meta_preinsert(ilist, where,
+                             XINST_CREATE_store(drcontext, // str sval, [saddr, #4]
+                                                OPND_CREATE_MEM32(saddr, 4),
+                                                opnd_create_reg(sval)));
+}
+
+static bool
+use_stubs(instr_t *where, uint flag)
+/*
+ *    Whether the handler of %where% calls a shared routine,
+ *    see DRTAINT_OPTION_OUT_OF_LINE. Auto-predicated calls aren't supported
+ */
+{
+    return TEST(flag, options.flags) && !instr_is_predicated(where);
+}
+
+template <opnd_sz_t sz>
+ds_stub_t load_stub()
+{
+    return sz == BYTE ? DS_STUB_LOAD1 : sz == HALF ? DS_STUB_LOAD2 : DS_STUB_LOAD4;
+}
+
+template <opnd_sz_t sz>
+void insert_load_app_taint(void *drcontext, instrlist_t *ilist, instr_t *where,
+                           reg_id_t sapp, reg_id_t scratch)
+/*
+ *    sapp <- tag value stored at [sapp] shadow address
+ *
+ *    With page summary enabled we first check the summary
+ *    of the region and don't touch shadow memory if it's clean.
+ *    Predicated instructions take the plain path: our cmp would
+ *    clobber the flags the auto-predicated meta instructions depend on
+ */
+{
+    if (!TEST(DRTAINT_OPTION_PAGE_SUMMARY, options.flags) ||
+        instr_is_predicated(where))
+    {
+        drtaint_insert_app_to_taint(drcontext, ilist, where, sapp, scratch);
+        instrlist_meta_preinsert(ilist, where,
+                                 instr_load<sz>(drcontext, // ldrXX sapp, [sapp]
+                                                opnd_create_reg(sapp),
+                                                opnd_mem<sz>(sapp, 0)));
+        return;
+    }
+
+    bool counters = TEST(DRTAINT_OPTION_SUMMARY_COUNTERS, options.flags);
+    instr_t *clean = INSTR_CREATE_label(drcontext);
+    instr_t *done = INSTR_CREATE_label(drcontext);
+    reg_id_t scnt = DR_REG_NULL;
+
+    // all reservations are made before the branch,
+    // so that spills and restores are the same on both paths
+    if (counters)
+    {
+        bool ok = drreg_reserve_register(drcontext, ilist, where, NULL, &scnt) == DRREG_SUCCESS;
+        DR_ASSERT(ok);
+    }
+
+    bool ok = drreg_reserve_aflags(drcontext, ilist, where) == DRREG_SUCCESS;
+    DR_ASSERT(ok);
+
+    // get summary of [sapp] region and place it to scratch
+    ds_insert_app_to_summary_load(drcontext, ilist, where, sapp, scratch);
+
+    instrlist_meta_preinsert(ilist, where,
+                             XINST_CREATE_cmp(drcontext, // cmp scratch, #0
+                                              opnd_create_reg(scratch),
+                                              OPND_CREATE_INT8(0)));
+    instrlist_meta_preinsert(ilist, where,
+                             XINST_CREATE_jump_cond(drcontext, DR_PRED_EQ, // beq clean
+                                                    opnd_create_instr(clean)));
+
+    // the region may be tainted, load the tag from shadow memory
+    if (counters)
+        insert_counter_inc(drcontext, ilist, where, &summary_shadow_loads, scratch, scnt);
+
+    drtaint_insert_app_to_taint(drcontext, ilist, where, sapp, scratch);
+    instrlist_meta_preinsert(ilist, where,
+                             instr_load<sz>(drcontext, // ldrXX sapp, [sapp]
+                                            opnd_create_reg(sapp),
+                                            opnd_mem<sz>(sapp, 0)));
+    instrlist_meta_preinsert(ilist, where,
+                             XINST_CREATE_jump(drcontext, // b done
+                                               opnd_create_instr(done)));
+
+    // the region is clean, the tag is zero
+    instrlist_meta_preinsert(ilist, where, clean);
+    if (counters)
+        insert_counter_inc(drcontext, ilist, where, &summary_clean_loads, scratch, scnt);
+
+    instrlist_meta_preinsert(ilist, where,
+                             XINST_CREATE_move(drcontext, // mov sapp, #0
+                                               opnd_create_reg(sapp),
+                                               OPND_CREATE_INT32(0)));
+    instrlist_meta_preinsert(ilist, where, done);
+
+    ok = drreg_unreserve_aflags(drcontext, ilist, where) == DRREG_SUCCESS;
+    DR_ASSERT(ok);
+
+    if (counters)
+    {
+        ok = drreg_unreserve_register(drcontext, ilist, where, scnt) == DRREG_SUCCESS;
+        DR_ASSERT(ok);
+    }
+}
+
+template <opnd_sz_t sz, typename policy>
+void propagate_ldr(void *drcontext, instrlist_t *ilist, instr_t *where)
+/*
+ *    ldr reg1, [mem2]
+ *
+ *    We need to save the tag value stored at
+ *    [mem2] shadow address to shadow register of reg1
+ */
+{
+    opnd_t mem2 = instr_get_src(where, 0);
+    if (opnd_is_base_disp(mem2))
+    {
+        reg_id_t reg1 = opnd_get_reg(instr_get_dst(where, 0));
+
+        // the stub registers first, drreg would hand them out otherwise.
+        // The stub doesn't count summary hits
+        bool stub = use_stubs(where, DRTAINT_OPTION_OUT_OF_LINE_LOADS) &&
+                    ds_has_stub(load_stub<sz>()) &&
+                    !TEST(DRTAINT_OPTION_SUMMARY_COUNTERS, options.flags) &&
+                    ds_stub_begin(drcontext, ilist, where, mem2);
+
+        auto sreg1 = drreg_reservation{drcontext, ilist, where};
+        auto sapp2 = drreg_reservation{drcontext, ilist, where};
+        reg_id_t tag = sapp2;
+
+        // get shadow address of mem2 relative to an access via the same base
+        if (ds_insert_mem_to_shadow(drcontext, ilist, where, mem2, sapp2))
+        {
+            instrlist_meta_preinsert(ilist, where,
+                                     instr_load<sz>(drcontext, // ldrXX sapp2, [sapp2]
+                                                    opnd_create_reg(sapp2),
+                                                    opnd_mem<sz>(sapp2, 0)));
+        }
+        else if (stub)
+        {
+            // the stub loads the tag at [mem2] to the argument register
+            drutil_insert_get_mem_addr(drcontext, ilist, where, mem2, DS_STUB_ARG, sreg1);
+            ds_insert_stub_call(drcontext, ilist, where, load_stub<sz>());
+            tag = DS_STUB_ARG;
+        }
+        else
+        {
+            // get the memory address at mem2 and store the result to sapp2 register
+            drutil_insert_get_mem_addr(drcontext, ilist, where, mem2, sapp2, sreg1);
+
+            // place to sapp2 the value placed at [mem2] shadow address
+            insert_load_app_taint<sz>(drcontext, ilist, where, sapp2, sreg1);
+        }
+
+        // get shadow register address of reg1 and place it to sreg1
+        drtaint_insert_reg_to_taint(drcontext, ilist, where, reg1, sreg1);
+
+        // propagate 3rd policy: ldr r0, [r1, r2].
+        // If r2 is tainted then r0 is tainted too
+        if (policy::address_taint && opnd_num_regs_used(mem2) == 2)
+        {
+            reg_id_t reg_ind = opnd_get_index(mem2);
+            auto sreg_ind = drreg_reservation{drcontext, ilist, where};
+
+            // get value of reg_ind shadow register and place it to sreg_ind
+            drtaint_insert_reg_to_taint_load(drcontext, ilist, where, reg_ind, sreg_ind);
+
+            // combine tags
+            instrlist_meta_preinsert(ilist, where,
+                                     INSTR_CREATE_orr(drcontext, // tag |= sreg_ind
+                                                      opnd_create_reg(tag),
+                                                      opnd_create_reg(tag),
+                                                      opnd_create_reg(sreg_ind)));
+        }
+
+        // save the tag to shadow register of reg1
+        instrlist_meta_preinsert(ilist, where,
+                                 XINST_CREATE_store(drcontext, // str tag, [sreg1]
+                                                    OPND_CREATE_MEM32(sreg1, 0),
+                                                    opnd_create_reg(tag)));
+
+        if (stub)
+            ds_stub_end(drcontext, ilist, where);
+    }
+}
+
+static void
+propagate_ldrd(void *drcontext, instrlist_t *ilist, instr_t *where)
+/*
+ *    ldrd reg1, reg2, [mem2]
+ *
+ *    We need to save the tag value stored at
+ *    [mem2] shadow address to shadow registers reg1, reg2
+ */
+{
+    opnd_t mem2 = instr_get_src(where, 0);
+    if (opnd_is_base_disp(mem2))
+    {
+        reg_id_t reg1 = opnd_get_reg(instr_get_dst(where, 0));
+        reg_id_t reg2 = opnd_get_reg(instr_get_dst(where, 1));
+
+        auto sreg1 = drreg_reservation{drcontext, ilist, where};
+        auto sapp2 = drreg_reservation{drcontext, ilist, where};
+        auto sapp2n = drreg_reservation{drcontext, ilist, where};
+        reg_id_t sreg2 = sreg1;
+
+        // sapp2 is either a shadow address of mem2 or the address itself
+        bool coalesced = ds_insert_mem_to_shadow(drcontext, ilist, where, mem2, sapp2);
+
+        // dereference the memory address at mem2 and store the result to sapp2 register
+        if (!coalesced)
+            drutil_insert_get_mem_addr(drcontext, ilist, where, mem2, sapp2, sreg1);
+
+        // get [mem2 + 4] address or its shadow
+        instrlist_meta_preinsert(ilist, where,
+                                 XINST_CREATE_add_2src(drcontext, // add sapp2n, sapp2, #4
+                                                       opnd_create_reg(sapp2n),
+                                                       opnd_create_reg(sapp2),
+                                                       OPND_CREATE_INT32(4)));
+
+        // place to sapp2 the value placed at [mem2] shadow address
+        if (coalesced)
+            instrlist_meta_preinsert(ilist, where,
+                                     XINST_CREATE_load(drcontext, // ldr sapp2, [sapp2]
+                                                       opnd_create_reg(sapp2),
+                                                       OPND_CREATE_MEM32(sapp2, 0)));
+        else
+            insert_load_app_taint<WORD>(drcontext, ilist, where, sapp2, sreg1);
+
+        // get shadow register address of reg1 and place it to sreg1
+        drtaint_insert_reg_to_taint(drcontext, ilist, where, reg1, sreg1);
+
+        // save the value of sapp2 to shadow register of reg1
+        instrlist_meta_preinsert(ilist, where,
+                                 XINST_CREATE_store(drcontext, // str sapp2, [sreg1]
+                                                    OPND_CREATE_MEM32(sreg1, 0),
+                                                    opnd_create_reg(sapp2)));
+
+        // place to sapp2n the value placed at [mem2 + 4] shadow address
+        if (coalesced)
+            instrlist_meta_preinsert(ilist, where,
+                                     XINST_CREATE_load(drcontext, // ldr sapp2n, [sapp2n]
+                                                       opnd_create_reg(sapp2n),
+                                                       OPND_CREATE_MEM32(sapp2n, 0)));
+        else
+            insert_load_app_taint<WORD>(drcontext, ilist, where, sapp2n, sreg2);
+
+        // get shadow register address of reg2 and place it to sreg2
+        drtaint_insert_reg_to_taint(drcontext, ilist, where, reg2, sreg2);
+
+        // save the value of sapp2n to shadow register of reg2
+        instrlist_meta_preinsert(ilist, where,
+                                 XINST_CREATE_store(drcontext, // str sapp2n, [sreg2]
+                                                    OPND_CREATE_MEM32(sreg2, 0),
+                                                    opnd_create_reg(sapp2n)));
+    }
+}
+
+template <opnd_sz_t sz>
+void propagate_str(void *drcontext, instrlist_t *ilist, instr_t *where)
+/*
+ *    str reg1, [mem2]
+ *
+ *    We need to save the tag value stored in
+ *    shadow register of reg1 to shadow address of [mem2]
+ */
+{
+    opnd_t mem2 = instr_get_dst(where, 0);
+    if (opnd_is_base_disp(mem2))
+    {
+        reg_id_t reg1 = opnd_get_reg(instr_get_src(where, 0));
+
+        // the stub registers first, drreg would hand them out otherwise
+        bool stub = use_stubs(where, DRTAINT_OPTION_OUT_OF_LINE_STORES) &&
+                    ds_stub_begin(drcontext, ilist, where, mem2);
+
+        auto sreg1 = drreg_reservation{drcontext, ilist, where};
+        auto sapp2 = drreg_reservation{drcontext, ilist, where};
+        reg_id_t saddr = sapp2;
+
+        // get shadow address of mem2 relative to an access via the same base
+        bool coalesced = ds_insert_mem_to_shadow(drcontext, ilist, where, mem2, sapp2);
+
+        if (!coalesced && stub)
+        {
+            // The stub only translates, the store which may fault stays
+            // in the code cache where the fault handler expects it
+            drutil_insert_get_mem_addr(drcontext, ilist, where, mem2, DS_STUB_ARG, sreg1);
+            ds_insert_stub_call(drcontext, ilist, where, DS_STUB_TRANSLATE);
+            saddr = DS_STUB_ARG;
+        }
+        else if (!coalesced)
+        {
+            // dereference the memory address at mem2 and store the result to sapp2 register
+            drutil_insert_get_mem_addr(drcontext, ilist, where, mem2, sapp2, sreg1);
+
+            // get shadow memory address of [mem2] and place it to sapp2
+            drtaint_insert_app_to_taint(drcontext, ilist, where, sapp2, sreg1);
+        }
+
+        // get value of shadow register of reg1 and place it to sreg1
+        drtaint_insert_reg_to_taint_load(drcontext, ilist, where, reg1, sreg1);
+
+        // write the value of reg1 to [mem2] shadow address
+        instrlist_meta_preinsert_xl8(ilist, where,
+                                 instr_store<sz>(drcontext, // str sreg1, [saddr]
+                                                 opnd_mem<sz>(saddr, 0),
+                                                 opnd_create_reg(sreg1)));
+
+        if (stub)
+            ds_stub_end(drcontext, ilist, where);
+    }
+}
+
+static void
+propagate_strd(void *drcontext, instrlist_t *ilist, instr_t *where)
+/*
+ *    strd reg1, reg2, [mem2]
+ *
+ *    We need to save the tag values stored in
+ *    shadow registers of reg2 and reg3 to shadow addresses of [mem2] and [mem2 + 4]
+ */
+{
+    opnd_t mem2 = instr_get_dst(where, 0);
+    if (opnd_is_base_disp(mem2))
+    {
+        reg_id_t reg1 = opnd_get_reg(instr_get_src(where, 0));
+        reg_id_t reg2 = opnd_get_reg(instr_get_src(where, 1));
+
+        auto sreg1 = drreg_reservation{drcontext, ilist, where};
+        auto sapp2 = drreg_reservation{drcontext, ilist, where};
+        auto sapp2n = drreg_reservation{drcontext, ilist, where};
+
+        // sapp2 is either a shadow address of mem2 or the address itself
+        bool coalesced = ds_insert_mem_to_shadow(drcontext, ilist, where, mem2, sapp2);
+
+        // dereference the memory address at mem2 and store the result to sapp2 register
+        if (!coalesced)
+            drutil_insert_get_mem_addr(drcontext, ilist, where, mem2, sapp2, sreg1);
+
+        // get next 4 bytes after [mem2] or their shadow
+        instrlist_meta_preinsert(ilist, where,
+                                 XINST_CREATE_add_2src(drcontext, // sapp2n = sapp2 + 4
+                                                       opnd_create_reg(sapp2n),
+                                                       opnd_create_reg(sapp2),
+                                                       OPND_CREATE_INT32(4)));
+
+        // get shadow memory address of [mem2] and place it to sapp2
+        if (!coalesced)
+            drtaint_insert_app_to_taint(drcontext, ilist, where, sapp2, sreg1);
+
+        // get value of shadow register of reg1 and place it to sreg1
+        drtaint_insert_reg_to_taint_load(drcontext, ilist, where, reg1, sreg1);
+
+        // write the value of reg1 to [mem2] shadow address
+        instrlist_meta_preinsert_xl8(ilist, where,
+                                 XINST_CREATE_store(drcontext, // str sreg1, [sapp2]
+                                                    OPND_CREATE_MEM32(sapp2, 0),
+                                                    opnd_create_reg(sreg1)));
+
+        // get shadow memory address of [mem2 + 4] and place it to sapp2n
+        if (!coalesced)
+            drtaint_insert_app_to_taint(drcontext, ilist, where, sapp2n, sapp2);
+
+        // get value of shadow register of reg2 and place it to sreg1
+        drtaint_insert_reg_to_taint_load(drcontext, ilist, where, reg2, sreg1);
+
+        // write the shadow value of reg2 to [mem2 + 4] shadow address
+        instrlist_meta_preinsert_xl8(ilist, where,
+                                 XINST_CREATE_store(drcontext, // str sreg1, [sapp2n]
+                                                    OPND_CREATE_MEM32(sapp2n, 0),
+                                                    opnd_create_reg(sreg1)));
+    }
+}
+
+#pragma endregion load_store
+
+#pragma region move
+
+static void
+propagate_mov_regs(void *drcontext, instrlist_t *ilist, instr_t *where,
+                   reg_id_t reg1, reg_id_t reg2)
+/*
+ *    mov reg2, reg1
+ *
+ *    Need to save the tag value of reg1's
+ *    shadow register to reg2's shadow register
+ */
+{
+    if (use_stubs(where, DRTAINT_OPTION_OUT_OF_LINE_REGS) &&
+        ds_insert_regs_stub_call(drcontext, ilist, where, reg2, reg1, reg1))
+        return;
+
+    auto sreg2 = drreg_reservation{drcontext, ilist, where};
+    auto sreg1 = drreg_reservation{drcontext, ilist, where};
+
+    // get value of shadow register of reg1 and place it to sreg1
+    drtaint_insert_reg_to_taint_load(drcontext, ilist, where, reg1, sreg1);
+
+    // write shadow value of reg1 to shadow value of reg2
+    drtaint_insert_reg_to_taint_store(drcontext, ilist, where, reg2, sreg1, sreg2);
+}
+
+static void
+propagate_mov_reg_src(void *drcontext, instrlist_t *ilist, instr_t *where)
+{
+    // mov reg2, reg1
+    reg_id_t reg2 = opnd_get_reg(instr_get_dst(where, 0));
+    reg_id_t reg1 = opnd_get_reg(instr_get_src(where, 0));
+    propagate_mov_regs(drcontext, ilist, where, reg1, reg2);
+}
+
+#pragma endregion move
+
+#pragma region arithmetic
+
+static void
+propagate_arith_reg_imm(void *drcontext, instrlist_t *ilist, instr_t *where)
+/*
+ *    add reg2, reg1, imm
+ *    sub reg2, reg1, imm
+ *    ...
+ *
+ *    Need to mark reg2 tainted using tag of reg1
+ */
+{
+    reg_id_t reg2 = opnd_get_reg(instr_get_dst(where, 0));
+    reg_id_t reg1 = opnd_get_reg(instr_get_src(where, 0));
+
+    if (use_stubs(where, DRTAINT_OPTION_OUT_OF_LINE_REGS) &&
+        ds_insert_regs_stub_call(drcontext, ilist, where, reg2, reg1, reg1))
+        return;
+
+    auto sreg2 = drreg_reservation{drcontext, ilist, where};
+    auto sreg1 = drreg_reservation{drcontext, ilist, where};
+
+    // get value of shadow register of reg1 and place it to sreg1
+    drtaint_insert_reg_to_taint_load(drcontext, ilist, where, reg1, sreg1);
+
+    // write the result to shadow register of reg2
+    drtaint_insert_reg_to_taint_store(drcontext, ilist, where, reg2, sreg1, sreg2);
+}
+
+static void
+propagate_arith_reg_reg(void *drcontext, instrlist_t *ilist, instr_t *where)
+/*
+ *    add reg3, reg2, reg1
+ *    sub reg3, reg2, reg1
+ *    ...
+ *
+ *    Need to mark reg3 tainted.
+ *    Because its value depends on values of reg2, reg1,
+ *    we use OR to combine their impacts to reg3
+ */
+{
+    reg_id_t reg3 = opnd_get_reg(instr_get_dst(where, 0));
+    reg_id_t reg2 = opnd_get_reg(instr_get_src(where, 0));
+    reg_id_t reg1 = opnd_get_reg(instr_get_src(where, 1));
+
+    if (use_stubs(where, DRTAINT_OPTION_OUT_OF_LINE_REGS) &&
+        ds_insert_regs_stub_call(drcontext, ilist, where, reg3, reg2, reg1))
+        return;
+
+    auto sreg2 = drreg_reservation{drcontext, ilist, where};
+    auto sreg1 = drreg_reservation{drcontext, ilist, where};
+    reg_id_t sreg3 = sreg2; // we reuse a register for this
+
+    // get value of shadow registers of reg1, reg2 and place it to sreg1, sreg2
+    drtaint_insert_reg_to_taint_load(drcontext, ilist, where, reg1, sreg1);
+    drtaint_insert_reg_to_taint_load(drcontext, ilist, where, reg2, sreg2);
+
+    // combine tags
+    instrlist_meta_preinsert(ilist, where,
+                             INSTR_CREATE_orr(drcontext, // sreg1 |= sreg2
+                                              opnd_create_reg(sreg1),
+                                              opnd_create_reg(sreg2),
+                                              opnd_create_reg(sreg1)));
+
+    // save the result to shadow address of reg3
+    drtaint_insert_reg_to_taint_store(drcontext, ilist, where, reg3, sreg1, sreg3);
+}
+
+static void
+propagate_1rd_3rs(void *drcontext, instrlist_t *ilist, instr_t *where)
+/*
+ *    mla reg4, reg3, reg2, reg1
+ *
+ *    Need to mark reg4 tainted.
+ *    Because its value depends on values of reg3, reg2, reg1,
+ *    we use OR to combine their impacts to reg4
+ */
+{
+    reg_id_t reg1 = opnd_get_reg(instr_get_src(where, 2));
+    reg_id_t reg2 = opnd_get_reg(instr_get_src(where, 1));
+    reg_id_t reg3 = opnd_get_reg(instr_get_src(where, 0));
+    reg_id_t reg4 = opnd_get_reg(instr_get_dst(where, 0));
+
+    auto sreg1 = drreg_reservation{drcontext, ilist, where};
+    auto sreg2 = drreg_reservation{drcontext, ilist, where};
+    reg_id_t sreg3 = sreg2;
+    reg_id_t sreg4 = sreg3; /* we reuse a register for this */
+
+    // get value of shadow registers of reg1, reg2 and place it to sreg1, sreg2
+    drtaint_insert_reg_to_taint_load(drcontext, ilist, where, reg1, sreg1);
+    drtaint_insert_reg_to_taint_load(drcontext, ilist, where, reg2, sreg2);
+
+    // combine tags
+    instrlist_meta_preinsert(ilist, where,
+                             INSTR_CREATE_orr(drcontext, // sreg1 |= sreg2
+                                              opnd_create_reg(sreg1),
+                                              opnd_create_reg(sreg2),
+                                              opnd_create_reg(sreg1)));
+
+    // get value of shadow register of reg3 and place it to sreg3
+    drtaint_insert_reg_to_taint_load(drcontext, ilist, where, reg3, sreg3);
+
+    // combine tags
+    instrlist_meta_preinsert(ilist, where,
+                             INSTR_CREATE_orr(drcontext, // sreg1 |= sreg3
+                                              opnd_create_reg(sreg1),
+                                              opnd_create_reg(sreg3),
+                                              opnd_create_reg(sreg1)));
+
+    // save the result to shadow register of reg4
+    drtaint_insert_reg_to_taint_store(drcontext, ilist, where, reg4, sreg1, sreg4);
+}
+
+static void
+propagate_mull(void *drcontext, instrlist_t *ilist, instr_t *where)
+/*
+ *    umull reg4, reg3, reg2, reg1
+ *
+ *    Need to mark reg3 and reg4 tainted.
+ *    Because their values depend on values of reg2, reg1,
+ *    we use OR to combine their impacts to reg3 and reg4
+ */
+{
+    reg_id_t reg1 = opnd_get_reg(instr_get_src(where, 0));
+    reg_id_t reg2 = opnd_get_reg(instr_get_src(where, 1));
+    reg_id_t reg3 = opnd_get_reg(instr_get_dst(where, 0));
+    reg_id_t reg4 = opnd_get_reg(instr_get_dst(where, 1));
+
+    auto sreg1 = drreg_reservation{drcontext, ilist, where};
+    auto sreg2 = drreg_reservation{drcontext, ilist, where};
+    reg_id_t sreg3 = sreg2; /* we reuse a register for this */
+    reg_id_t sreg4 = sreg3;
+
+    // get value of shadow registers of reg1, reg2 and place it to sreg1, sreg2
+    drtaint_insert_reg_to_taint_load(drcontext, ilist, where, reg1, sreg1);
+    drtaint_insert_reg_to_taint_load(drcontext, ilist, where, reg2, sreg2);
+
+    // combine tags
+    instrlist_meta_preinsert(ilist, where,
+                             INSTR_CREATE_orr(drcontext, // sreg1 |= sreg2
+                                              opnd_create_reg(sreg1),
+                                              opnd_create_reg(sreg2),
+                                              opnd_create_reg(sreg1)));
+
+    // save the higher part of result to shadow register of reg3
+    drtaint_insert_reg_to_taint_store(drcontext, ilist, where, reg3, sreg1, sreg3);
+
+    // save the the lower part of result to shadow register of reg4
+    drtaint_insert_reg_to_taint_store(drcontext, ilist, where, reg4, sreg1, sreg4);
+}
+
+static void
+propagate_smlal(void *drcontext, instrlist_t *ilist, instr_t *where)
+/*
+ *    smlal rdlo, rdhi, reg1, reg2
+ *
+ *    rdlo, rdhi - source and destination registers
+ *
+ *    Need to mark rdlo and rdhi tainted.
+ *    Because their values depend on values of reg2, reg1
+ *    we use OR to combine their impacts to rdlo and rdhi
+ */
+{
+    reg_id_t reg1 = opnd_get_reg(instr_get_src(where, 2));
+    reg_id_t reg2 = opnd_get_reg(instr_get_src(where, 3));
+    reg_id_t rdlo = opnd_get_reg(instr_get_src(where, 1));
+    reg_id_t rdhi = opnd_get_reg(instr_get_src(where, 0));
+
+    auto sreg1 = drreg_reservation{drcontext, ilist, where};
+    auto sreg2 = drreg_reservation{drcontext, ilist, where};
+    auto sreg3 = drreg_reservation{drcontext, ilist, where};
+    reg_id_t srdlo = sreg2;
+    reg_id_t srdhi = srdlo;
+
+    // get value of shadow registers of reg1, reg2 and place it to sreg1, sreg2
+    drtaint_insert_reg_to_taint_load(drcontext, ilist, where, reg1, sreg1);
+    drtaint_insert_reg_to_taint_load(drcontext, ilist, where, reg2, sreg2);
+
+    // combine tags of reg1, reg2
+    instrlist_meta_preinsert(ilist, where,
+                             INSTR_CREATE_orr(drcontext, // sreg1 |= sreg2
+                                              opnd_create_reg(sreg1),
+                                              opnd_create_reg(sreg2),
+                                              opnd_create_reg(sreg1)));
+
+    // copy tag1 | tag2 to sreg3
+    instrlist_meta_preinsert(ilist, where,
+                             INSTR_CREATE_mov(drcontext, // sreg3 = reg1
+                                              opnd_create_reg(sreg3),
+                                              opnd_create_reg(sreg1)));
+
+    // get value of shadow register of rdlo and place it to srdlo
+    drtaint_insert_reg_to_taint_load(drcontext, ilist, where, rdlo, srdlo);
+
+    // combine tags of reg1, reg2, rdlo
+    instrlist_meta_preinsert(ilist, where,
+                             INSTR_CREATE_orr(drcontext, // sreg1 |= srdlo
+                                              opnd_create_reg(sreg1),
+                                              opnd_create_reg(srdlo),
+                                              opnd_create_reg(sreg1)));
+
+    // save the the lower part of result to shadow register of rdlo
+    drtaint_insert_reg_to_taint_store(drcontext, ilist, where, rdlo, sreg1, srdlo);
+
+    // get value of shadow register of rdhi and place it to srdhi
+    drtaint_insert_reg_to_taint_load(drcontext, ilist, where, rdhi, srdhi);
+
+    // combine tags of reg1, reg2, rdhi
+    instrlist_meta_preinsert(ilist, where,
+                             INSTR_CREATE_orr(drcontext, // sreg3 |= srdhi
+                                              opnd_create_reg(sreg3),
+                                              opnd_create_reg(srdhi),
+                                              opnd_create_reg(sreg3)));
+
+    // save the the higher part of result to shadow register of rdhi
+    drtaint_insert_reg_to_taint_store(drcontext, ilist, where, rdhi, sreg3, srdhi);
+}
+
+static void
+propagate_pkhXX(void *drcontext, instrlist_t *ilist,
+                instr_t *where, bool is_pkhbt)
+/*
+ *    pkhbt r0, r1, r2
+ *    pkhtb r0, r1, r2
+ *
+ *    Need to mark r0 tainted.
+ *    r0's tag value depends on 0:15, 16:31 bits of r1, r2
+ */
+{
+    reg_id_t reg0 = opnd_get_reg(instr_get_dst(where, 0));
+    reg_id_t reg1 = opnd_get_reg(instr_get_src(where, 0));
+    reg_id_t reg2 = opnd_get_reg(instr_get_src(where, 1));
 
     auto sreg1 = drreg_reservation{drcontext, ilist, where};
     auto sreg2 = drreg_reservation{drcontext, ilist, where};
-    reg_id_t sreg3 = sreg2;
-    reg_id_t sreg4 = sreg3; /* we reuse a register for this */
+    auto simm = drreg_reservation{drcontext, ilist, where};
+    reg_id_t sreg0 = simm;
+
+    // get 0xFFFF constant and place it to simm
+    instrlist_meta_preinsert(ilist, where,
+                             INSTR_CREATE_mov(drcontext,
+                                              opnd_create_reg(simm),
+                                              OPND_CREATE_INT32(0x10000)));
+
+    instrlist_meta_preinsert(ilist, where,
+                             INSTR_CREATE_sub(drcontext,
+                                              opnd_create_reg(simm),
+                                              opnd_create_reg(simm),
+                                              OPND_CREATE_INT32(1)));
+
+    // shift simm left if pkhtb and get 0xFFFF0000 constant
+    if (!is_pkhbt)
+    {
+        instrlist_meta_preinsert(ilist, where,
+                                 INSTR_CREATE_lsl(drcontext,
+                                                  opnd_create_reg(simm),
+                                                  opnd_create_reg(simm),
+                                                  OPND_CREATE_INT32(16)));
+    }
+
+    // get value of shadow register of reg1 and place it to sreg1
+    drtaint_insert_reg_to_taint_load(drcontext, ilist, where, reg1, sreg1);
+    drtaint_insert_reg_to_taint_load(drcontext, ilist, where, reg2, sreg2);
+
+    // get bits x:y of sreg1
+    instrlist_meta_preinsert(ilist, where,
+                             INSTR_CREATE_and(drcontext,
+                                              opnd_create_reg(sreg1),
+                                              opnd_create_reg(sreg1),
+                                              opnd_create_reg(simm)));
+
+    // shift simm: pkhbt -> left; pkhtb -> right
+    if (!is_pkhbt)
+    {
+        instrlist_meta_preinsert(ilist, where,
+                                 INSTR_CREATE_lsr(drcontext,
+                                                  opnd_create_reg(simm),
+                                                  opnd_create_reg(simm),
+                                                  OPND_CREATE_INT32(16)));
+    }
+    else
+    {
+        instrlist_meta_preinsert(ilist, where,
+                                 INSTR_CREATE_lsl(drcontext,
+                                                  opnd_create_reg(simm),
+                                                  opnd_create_reg(simm),
+                                                  OPND_CREATE_INT32(16)));
+    }
+
+    // get bits x:y of sreg2
+    instrlist_meta_preinsert(ilist, where,
+                             INSTR_CREATE_and(drcontext,
+                                              opnd_create_reg(sreg2),
+                                              opnd_create_reg(sreg2),
+                                              opnd_create_reg(simm)));
+    // combine tags of sreg1, sreg2
+    instrlist_meta_preinsert(ilist, where,
+                             INSTR_CREATE_orr(drcontext,
+                                              opnd_create_reg(sreg1),
+                                              opnd_create_reg(sreg2),
+                                              opnd_create_reg(sreg1)));
+
+    // write shadow value of reg1 to shadow value of reg2
+    drtaint_insert_reg_to_taint_store(drcontext, ilist, where, reg0, sreg1, sreg0);
+}
+
+#pragma endregion arithmetic
+
+#pragma region load_store_multiple
+
+template <stack_dir_t c>
+void propagate_ldm_cc_template(app_pc pc, void *base, bool writeback)
+/*
+ *    ldm r, { regs }
+ *
+ *    When handling a ldm command we have to save all values of registers
+ *    that will be popped from a stack to their shadow registers
+ */
+{
+    void *drcontext = dr_get_current_drcontext();
+    auto instr = instr_decoded(drcontext, pc);
+
+    int num_dsts = instr_num_dsts(instr);
+    if (writeback)
+        num_dsts--;
+
+    for (int i = 0; i < num_dsts; ++i)
+    {
+        bool ok;
+        uint res;
+
+        app_pc addr = calculate_addr<c>(instr, base, i, num_dsts);
+        reg_id_t reg = opnd_get_reg(instr_get_dst(instr, i));
+
+        // set taint from stack to the appropriate register
+        ok = drtaint_get_app_taint4(drcontext, addr, &res);
+        DR_ASSERT(ok);
+        ok = drtaint_set_reg_taint(drcontext, reg, res);
+        DR_ASSERT(ok);
+    }
+}
+
+template <stack_dir_t c>
+void propagate_stm_cc_template(app_pc pc, void *base, bool writeback)
+/*
+ *    stm r, { regs }
+ *
+ *    When handling a stm command we have to set all memory
+ *    in the stack, where the register values will be written, tainted
+ */
+{
+    void *drcontext = dr_get_current_drcontext();
+    auto instr = instr_decoded(drcontext, pc);
+
+    int num_srcs = instr_num_srcs(instr);
+    if (writeback)
+        num_srcs--;
+
+    for (int i = 0; i < num_srcs; ++i)
+    {
+        bool ok;
+        uint res;
+
+        reg_id_t reg = opnd_get_reg(instr_get_src(instr, i));
+        app_pc addr = calculate_addr<c>(instr, base, i, num_srcs);
+
+        // set taint from registers to the stack
+        ok = drtaint_get_reg_taint(drcontext, reg, &res);
+        DR_ASSERT(ok);
+        ok = drtaint_set_app_taint4(drcontext, addr, res);
+        DR_ASSERT(ok);
+    }
+}
+
+static void
+insert_base_plus_offs(void *drcontext, instrlist_t *ilist, instr_t *where,
+                      reg_id_t dst, reg_id_t base, int offs)
+/*
+ *    dst = base + offs, where offs is a small signed constant
+ */
+{
+    if (offs >= 0)
+    {
+        instrlist_meta_preinsert(ilist, where,
+                                 XINST_CREATE_add_2src(drcontext, // add dst, base, #offs
+                                                       opnd_create_reg(dst),
+                                                       opnd_create_reg(base),
+                                                       OPND_CREATE_INT32(offs)));
+    }
+    else
+    {
+        instrlist_meta_preinsert(ilist, where,
+                                 XINST_CREATE_sub_2src(drcontext, // sub dst, base, #-offs
+                                                       opnd_create_reg(dst),
+                                                       opnd_create_reg(base),
+                                                       OPND_CREATE_INT32(-offs)));
+    }
+}
+
+static bool
+ldm_stm_needs_clean_call(instr_t *where, reg_id_t base)
+/*
+ *    Cases we don't handle inline: user-mode register banks (^),
+ *    pc-relative base and explicit request of the caller
+ */
+{
+    int opcode = instr_get_opcode(where);
+
+    if (TEST(DRTAINT_OPTION_LDM_STM_CLEAN_CALL, options.flags))
+        return true;
+
+    if (base == DR_REG_PC || base == DR_REG_NULL)
+        return true;
+
+    return opcode == OP_ldm_priv || opcode == OP_ldmda_priv ||
+           opcode == OP_ldmdb_priv || opcode == OP_ldmib_priv ||
+           opcode == OP_stm_priv || opcode == OP_stmda_priv ||
+           opcode == OP_stmdb_priv || opcode == OP_stmib_priv;
+}
+
+template <stack_dir_t c>
+void propagate_ldm(void *drcontext, instrlist_t *ilist, instr_t *where)
+/*
+ *    ldm r, { regs }
+ *
+ *    Every address of the register list is known at translation time
+ *    as r + const, so we copy tags from [r + const] shadow to
+ *    the shadow registers inline, without decoding the instruction again
+ */
+{
+    reg_id_t base = opnd_get_base(instr_get_src(where, 0));
+    bool writeback = instr_num_srcs(where) > 1;
+
+    if (ldm_stm_needs_clean_call(where, base))
+    {
+        dr_insert_clean_call(
+            drcontext, ilist, where, (void *)propagate_ldm_cc_template<c>, false, 3,
+            OPND_CREATE_INTPTR(instr_get_app_pc(where)),
+            opnd_create_reg(base),
+            OPND_CREATE_INT(writeback));
+        return;
+    }
+
+    int num_dsts = instr_num_dsts(where);
+    if (writeback)
+        num_dsts--;
+
+    auto sbase = drreg_reservation{drcontext, ilist, where};
+    auto sapp = drreg_reservation{drcontext, ilist, where};
+    auto sreg = drreg_reservation{drcontext, ilist, where};
+
+    // get the application value of base register before the ldm executes
+    drreg_get_app_value(drcontext, ilist, where, base, sbase);
+
+    for (int i = 0; i < num_dsts; ++i)
+    {
+        reg_id_t reg = opnd_get_reg(instr_get_dst(where, i));
+
+        // sapp = base + offs_i
+        insert_base_plus_offs(drcontext, ilist, where, sapp, sbase,
+                              calculate_offs<c>(i, num_dsts));
+
+        // get shadow memory address of [sapp] and load its tag
+        drtaint_insert_app_to_taint(drcontext, ilist, where, sapp, sreg);
+        instrlist_meta_preinsert(ilist, where,
+                                 XINST_CREATE_load(drcontext, // ldr sapp, [sapp]
+                                                   opnd_create_reg(sapp),
+                                                   OPND_CREATE_MEM32(sapp, 0)));
+
+        // save the tag to shadow register of reg
+        drtaint_insert_reg_to_taint(drcontext, ilist, where, reg, sreg);
+        instrlist_meta_preinsert(ilist, where,
+                                 XINST_CREATE_store(drcontext, // str sapp, [sreg]
+                                                    OPND_CREATE_MEM32(sreg, 0),
+                                                    opnd_create_reg(sapp)));
+    }
+}
+
+template <stack_dir_t c>
+void propagate_stm(void *drcontext, instrlist_t *ilist, instr_t *where)
+/*
+ *    stm r, { regs }
+ *
+ *    The same as propagate_ldm, but tags are copied
+ *    from the shadow registers to [r + const] shadow
+ */
+{
+    reg_id_t base = opnd_get_base(instr_get_dst(where, 0));
+    bool writeback = instr_num_dsts(where) > 1;
+
+    if (ldm_stm_needs_clean_call(where, base))
+    {
+        dr_insert_clean_call(
+            drcontext, ilist, where, (void *)propagate_stm_cc_template<c>, false, 3,
+            OPND_CREATE_INTPTR(instr_get_app_pc(where)),
+            opnd_create_reg(base),
+            OPND_CREATE_INT(writeback));
+        return;
+    }
+
+    int num_srcs = instr_num_srcs(where);
+    if (writeback)
+        num_srcs--;
+
+    auto sbase = drreg_reservation{drcontext, ilist, where};
+    auto sapp = drreg_reservation{drcontext, ilist, where};
+    auto sreg = drreg_reservation{drcontext, ilist, where};
+
+    // get the application value of base register before the stm executes
+    drreg_get_app_value(drcontext, ilist, where, base, sbase);
+
+    for (int i = 0; i < num_srcs; ++i)
+    {
+        reg_id_t reg = opnd_get_reg(instr_get_src(where, i));
+
+        // sapp = base + offs_i
+        insert_base_plus_offs(drcontext, ilist, where, sapp, sbase,
+                              calculate_offs<c>(i, num_srcs));
+
+        // get shadow memory address of [sapp]
+        drtaint_insert_app_to_taint(drcontext, ilist, where, sapp, sreg);
+
+        // get value of shadow register of reg and write it to [sapp] shadow address
+        drtaint_insert_reg_to_taint_load(drcontext, ilist, where, reg, sreg);
+        instrlist_meta_preinsert_xl8(ilist, where,
+                                     XINST_CREATE_store(drcontext, // str sreg, [sapp]
+                                                        OPND_CREATE_MEM32(sapp, 0),
+                                                        opnd_create_reg(sreg)));
+    }
+}
+
+static void
+propagate_ldmXX(void *drcontext, instrlist_t *ilist, instr_t *where)
+{
+    int opcode = instr_get_opcode(where);
+
+    switch (opcode)
+    {
+    case OP_ldmia:
+    case OP_ldm_priv:
+        propagate_ldm<IA>(drcontext, ilist, where);
+        break;
+
+    case OP_ldmdb:
+    case OP_ldmdb_priv:
+        propagate_ldm<DB>(drcontext, ilist, where);
+        break;
+
+    case OP_ldmib:
+    case OP_ldmib_priv:
+        propagate_ldm<IB>(drcontext, ilist, where);
+        break;
+
+    case OP_ldmda:
+    case OP_ldmda_priv:
+        propagate_ldm<DA>(drcontext, ilist, where);
+        break;
+
+    default:
+        DR_ASSERT(false);
+    }
+}
+
+static void
+propagate_stmXX(void *drcontext, instrlist_t *ilist, instr_t *where)
+{
+    int opcode = instr_get_opcode(where);
+
+    switch (opcode)
+    {
+    case OP_stmia:
+    case OP_stm_priv:
+        propagate_stm<IA>(drcontext, ilist, where);
+        break;
+
+    case OP_stmdb:
+    case OP_stmdb_priv:
+        propagate_stm<DB>(drcontext, ilist, where);
+        break;
+
+    case OP_stmib:
+    case OP_stmib_priv:
+        propagate_stm<IB>(drcontext, ilist, where);
+        break;
+
+    case OP_stmda:
+    case OP_stmda_priv:
+        propagate_stm<DA>(drcontext, ilist, where);
+        break;
+
+    default:
+        DR_ASSERT(false);
+    }
+}
+
+#pragma endregion load_store_multiple
+
+#pragma region no_taint
+
+static void
+propagate_mov_imm_src(void *drcontext, instrlist_t *ilist, instr_t *where)
+/*
+ *    mov reg2, imm1
+ *
+ *    Saves the value of 0 to the shadow register
+ *    of reg2 because moving constant to reg2 untaints reg2
+ */
+{
+    reg_id_t reg2 = opnd_get_reg(instr_get_dst(where, 0));
+
+    auto sreg2 = drreg_reservation{drcontext, ilist, where};
+    auto simm2 = drreg_reservation{drcontext, ilist, where};
+
+    // place constant imm to register simm2
+    instrlist_meta_preinsert(ilist, where,
+                             XINST_CREATE_move(drcontext, // mov simm2, 0
+                                               opnd_create_reg(simm2),
+                                               OPND_CREATE_INT32(0)));
+
+    // move propagation to shadow register of reg2 the value of imm1
+    drtaint_insert_reg_to_taint_store(drcontext, ilist, where, reg2, simm2, sreg2);
+}
+
+static bool
+instr_is_zeroing_idiom(instr_t *where)
+/*
+ *    xor r0, r1, r1
+ *
+ *    This instructions causes r0 to be untainted
+ */
+{
+    int opcode = instr_get_opcode(where);
+
+    if (opcode == OP_eor ||
+        opcode == OP_eors ||
+        opcode == OP_sub ||
+        opcode == OP_subs ||
+        opcode == OP_sbc ||
+        opcode == OP_sbcs)
+    {
+        if (!opnd_is_reg(instr_get_src(where, 0)))
+            return false;
+
+        if (!opnd_is_reg(instr_get_src(where, 1)))
+            return false;
+
+        if (opnd_get_reg(instr_get_src(where, 0)) !=
+            opnd_get_reg(instr_get_src(where, 1)))
+            return false;
+
+        return true;
+    }
+    return false;
+}
+
+static void
+untaint_stack(void *drcontext, app_pc sp_val, ptr_int_t imm)
+/*
+ *    Routine for clearing stack frames before their allocation
+ */
+{
+    drtaint_set_app_area_taint(drcontext, sp_val - imm, imm, 0);
+}
+
+static bool
+is_stack_frame_alloc(instr_t *where)
+/*
+ *    sub sp, sp, imm
+ *    sub sp, sp, reg
+ *
+ *    Pushes (stmdb sp!, str reg, [sp, #-4]!) write every word they
+ *    allocate, their store propagation overwrites the shadow already
+ */
+{
+    int opcode = instr_get_opcode(where);
+
+    return (opcode == OP_sub || opcode == OP_subs) &&
+           instr_num_srcs(where) == 2 &&
+           opnd_get_reg(instr_get_dst(where, 0)) == DR_REG_SP &&
+           opnd_get_reg(instr_get_src(where, 0)) == DR_REG_SP &&
+           (opnd_is_immed(instr_get_src(where, 1)) || opnd_is_reg(instr_get_src(where, 1)));
+}
+
+static void
+insert_untaint_stack_call(void *drcontext, instrlist_t *ilist, instr_t *where, opnd_t size)
+{
+    dr_insert_clean_call(drcontext, ilist, where, (void *)untaint_stack, false, 3,
+                         OPND_CREATE_INTPTR(drcontext),
+                         opnd_create_reg(DR_REG_SP),
+                         size);
+}
+
+static void
+untaint_stack_frame(void *drcontext, instrlist_t *ilist, instr_t *where)
+/*
+ *    Clear the shadow of the new frame [sp - size, sp) inline,
+ *    skipping it if the stack region is clean. Frames crossing a summary
+ *    region, sizes not multiple of 4 and predicated allocations
+ *    fall back to the untaint_stack clean call
+ */
+{
+    opnd_t size = instr_get_src(where, 1);
+    instr_t *slow = INSTR_CREATE_label(drcontext);
+    instr_t *done = INSTR_CREATE_label(drcontext);
+    ptr_int_t imm = opnd_is_immed(size) ? opnd_get_immed_int(size) : 0;
+
+    // the inline code has branches, which can't be auto-predicated
+    if (instr_is_predicated(where) ||
+        (opnd_is_immed(size) && (imm <= 0 || imm >= 0x10000 || imm % 4 != 0)))
+    {
+        insert_untaint_stack_call(drcontext, ilist, where, size);
+        return;
+    }
+
+    auto saddr = drreg_reservation{drcontext, ilist, where};
+    auto ssize = drreg_reservation{drcontext, ilist, where};
+    auto scratch = drreg_reservation{drcontext, ilist, where};
+
+    bool ok = drreg_reserve_aflags(drcontext, ilist, where) == DRREG_SUCCESS;
+    DR_ASSERT(ok);
+
+    if (opnd_is_immed(size))
+    {
+        instrlist_insert_mov_immed_ptrsz(drcontext, imm, opnd_create_reg(ssize),
+                                         ilist, where, NULL, NULL);
+    }
+    else
+    {
+        // the size register may be one of ours
+        drreg_get_app_value(drcontext, ilist, where, opnd_get_reg(size), ssize);
+
+        instrlist_meta_preinsert(ilist, where,
+                                 INSTR_CREATE_tst(drcontext, // tst ssize, #3
+                                                  opnd_create_reg(ssize),
+                                                  OPND_CREATE_INT8(3)));
+        instrlist_meta_preinsert(ilist, where,
+                                 XINST_CREATE_jump_cond(drcontext, DR_PRED_NE, // bne slow
+                                                        opnd_create_instr(slow)));
+        instrlist_meta_preinsert(ilist, where,
+                                 XINST_CREATE_cmp(drcontext, // cmp ssize, #0
+                                                  opnd_create_reg(ssize),
+                                                  OPND_CREATE_INT8(0)));
+        instrlist_meta_preinsert(ilist, where,
+                                 XINST_CREATE_jump_cond(drcontext, DR_PRED_EQ, // beq done
+                                                        opnd_create_instr(done)));
+    }
+
+    instrlist_meta_preinsert(ilist, where,
+                             XINST_CREATE_sub_2src(drcontext, // sub saddr, sp, ssize
+                                                   opnd_create_reg(saddr),
+                                                   opnd_create_reg(DR_REG_SP),
+                                                   opnd_create_reg(ssize)));
+
+    ds_insert_clear_app_area(drcontext, ilist, where, saddr, ssize, (uint)imm,
+                             scratch, slow, done);
+    instrlist_meta_preinsert(ilist, where,
+                             XINST_CREATE_jump(drcontext, // b done
+                                               opnd_create_instr(done)));
+
+    // ssize still holds the size on this path
+    instrlist_meta_preinsert(ilist, where, slow);
+    insert_untaint_stack_call(drcontext, ilist, where, opnd_create_reg(ssize));
+
+    instrlist_meta_preinsert(ilist, where, done);
+
+    ok = drreg_unreserve_aflags(drcontext, ilist, where) == DRREG_SUCCESS;
+    DR_ASSERT(ok);
+}
+
+#pragma endregion no_taint
+
+#pragma endregion taint_propagation
+
+#pragma region event_app_handler
+
+/* ======================================================================================
+ * main: event app instruction handler
+ * ==================================================================================== */
+
+/* shadow registers a block may keep in registers, see choose_resident_shadows */
+#define MAX_RESIDENT_SHADOWS 2
+
+/* per block data passed from event_bb_analysis to event_app_instruction */
+typedef struct _block_data_t
+{
+    /* load the shadow register file address once for the whole block */
+    bool hoist_base;
+
+    /* Registers the instrumentation reads directly: clean call arguments
+     * and memory address registers. They must hold the application value,
+     * so they can't be reserved for the whole block
+     */
+    bool app_value_needed[DR_NUM_GPR_REGS];
+
+    /* app base register whose accesses are translated once,
+     * see ds_insert_mem_to_shadow, and the register caching it
+     */
+    reg_id_t coalesce_base;
+    reg_id_t coalesce_cache;
+
+    /* app registers whose shadows are kept in the holder registers,
+     * see choose_resident_shadows
+     */
+    reg_id_t resident[MAX_RESIDENT_SHADOWS];
+    reg_id_t holders[MAX_RESIDENT_SHADOWS];
+    uint num_resident;
+    uint num_holders;
+
+    /* Fast and slow copies of the block, see event_bb_app2app.
+     * slow_pos[k] is the label before the k-th instruction of
+     * the slow copy, the k-th instruction of the fast one falls over to it
+     */
+    bool dual;
+    bool in_fast;
+    bool in_slow;
+    instr_t *slow_label;
+    instr_t *entry_stub;
+    instr_t **slow_pos;
+    uint num_dup;
+    uint cur_dup;
+
+    /* The label a summarized copy loop branches back to, its load
+     * and store, see summarize_copy_loop
+     */
+    instr_t *loop_head;
+    instr_t *loop_load;
+    instr_t *loop_store;
+    reg_id_t loop_src;
+    reg_id_t loop_dst;
+    uint loop_elem_size;
+    uint loop_regs;
+
+    /* A block which didn't meet taint yet and where its guards
+     * jump to, see insert_profile_guard
+     */
+    bool guarded;
+    instr_t *trip;
+
+    /* Cached plans of the block's module, see get_plan */
+    byte *plans;
+    app_pc plans_start;
+    app_pc plans_end;
+    uint64 start_ns;
+
+    bool translating;
+    reg_id_t shadow_base;
+    uint setup;
+
+    /* dead[i] is set if the shadow write of the i-th app instruction
+     * is overwritten before it can be read, see find_dead_shadow_writes
+     */
+    byte *dead;
+    uint num_app;
+    uint cur_app;
+
+    /* Registers whose shadow is known to be zero at the current
+     * instruction, see update_clean_regs. Nothing is known at the
+     * block entry. This relies on register taint being changed only by
+     * the propagation and at syscalls, which end blocks
+     */
+    uint clean_regs;
+
+} block_data_t;
+
+#define ALL_GPRS_MASK ((1u << DR_NUM_GPR_REGS) - 1)
+
+static bool
+writes_dst_shadow_only(instr_t *instr)
+/*
+ *    Instructions handled by propagate_mov_* and propagate_arith_*
+ *    whose only effect is a full write of the destination shadow register.
+ *    sp is excluded, frame allocations also untaint the stack
+ */
+{
+    if (instr_num_dsts(instr) != 1 || !opnd_is_reg(instr_get_dst(instr, 0)) ||
+        !reg_is_gpr(opnd_get_reg(instr_get_dst(instr, 0))) ||
+        opnd_get_reg(instr_get_dst(instr, 0)) == DR_REG_PC ||
+        opnd_get_reg(instr_get_dst(instr, 0)) == DR_REG_SP)
+        return false;
+
+    switch (instr_get_opcode(instr))
+    {
+    case OP_mov:
+    case OP_mvn:
+    case OP_mvns:
+    case OP_movs:
+    case OP_movw:
+    case OP_movt:
+
+    case OP_adc:
+    case OP_adcs:
+    case OP_add:
+    case OP_adds:
+    case OP_addw:
+    case OP_rsb:
+    case OP_rsbs:
+    case OP_rsc:
+    case OP_rscs:
+    case OP_sbc:
+    case OP_sbcs:
+    case OP_sub:
+    case OP_subw:
+    case OP_subs:
+    case OP_and:
+    case OP_ands:
+    case OP_bic:
+    case OP_bics:
+    case OP_eor:
+    case OP_eors:
+    case OP_orr:
+    case OP_orrs:
+    case OP_ror:
+    case OP_rors:
+    case OP_lsl:
+    case OP_lsls:
+    case OP_lsr:
+    case OP_lsrs:
+    case OP_asr:
+    case OP_asrs:
+    case OP_orn:
+    case OP_orns:
+        return true;
+
+    default:
+        return false;
+    }
+}
+
+static uint
+shadow_reads_mask(instr_t *instr)
+/*
+ *    Registers whose shadow may be read while handling %instr%:
+ *    register sources and address registers
+ */
+{
+    uint mask = 0;
+
+    for (int i = 0; i < instr_num_srcs(instr); i++)
+    {
+        opnd_t opnd = instr_get_src(instr, i);
+        for (int j = 0; j < opnd_num_regs_used(opnd); j++)
+        {
+            reg_id_t reg = opnd_get_reg_used(opnd, j);
+            if (reg_is_gpr(reg))
+                mask |= 1u << (reg - DR_REG_R0);
+        }
+    }
+
+    for (int i = 0; i < instr_num_dsts(instr); i++)
+    {
+        opnd_t opnd = instr_get_dst(instr, i);
+        if (!opnd_is_memory_reference(opnd))
+            continue;
+
+        for (int j = 0; j < opnd_num_regs_used(opnd); j++)
+        {
+            reg_id_t reg = opnd_get_reg_used(opnd, j);
+            if (reg_is_gpr(reg))
+                mask |= 1u << (reg - DR_REG_R0);
+        }
+    }
+
+    return mask;
+}
+
+static uint
+handler_srcs_mask(instr_t *instr)
+/*
+ *    Registers whose shadows propagate_mov_* and propagate_arith_*
+ *    combine into the destination shadow: src 0 for movs, src 0 and 1 otherwise
+ */
+{
+    int opcode = instr_get_opcode(instr);
+    bool is_mov = opcode == OP_mov || opcode == OP_mvn || opcode == OP_mvns ||
+                  opcode == OP_movs || opcode == OP_movw || opcode == OP_movt;
+    uint mask = 0;
+
+    for (int i = 0; i < (is_mov ? 1 : 2) && i < instr_num_srcs(instr); i++)
+    {
+        opnd_t opnd = instr_get_src(instr, i);
+        if (opnd_is_reg(opnd) && reg_is_gpr(opnd_get_reg(opnd)))
+            mask |= 1u << (opnd_get_reg(opnd) - DR_REG_R0);
+    }
+
+    return mask;
+}
+
+static bool
+is_shadow_barrier(instr_t *instr)
+/*
+ *    All shadow registers must be up to date before %instr%:
+ *    it may fault and a signal handler may observe the state,
+ *    it's a call or it's handled by a clean call
+ */
+{
+    return instr_reads_memory(instr) || instr_writes_memory(instr) ||
+           instr_is_call(instr) || instr_is_syscall(instr) ||
+           instr_is_interrupt(instr) || instr_is_cti(instr);
+}
+
+static uint
+find_dead_shadow_writes(instrlist_t *bb, block_data_t *data)
+/*
+ *    Backward liveness of shadow registers over the block.
+ *    A shadow write of a register which is written again before
+ *    any read isn't observable and its propagation is dropped.
+ *    Everything is live at the block end and at barriers.
+ *    Predicated writes may not happen, so they don't kill earlier ones.
+ *    Return the number of dropped propagations
+ */
+{
+    uint live = ALL_GPRS_MASK;
+    uint index = data->num_app;
+    uint count = 0;
+
+    for (instr_t *instr = instrlist_last(bb); instr != NULL; instr = instr_get_prev(instr))
+    {
+        // the fast copy isn't propagated
+        if (instr == data->slow_label)
+            break;
+
+        if (!instr_is_app(instr))
+            continue;
+
+        index--;
+
+        if (is_shadow_barrier(instr))
+        {
+            live = ALL_GPRS_MASK;
+            continue;
+        }
+
+        if (writes_dst_shadow_only(instr))
+        {
+            uint dst = 1u << (opnd_get_reg(instr_get_dst(instr, 0)) - DR_REG_R0);
+
+            if ((live & dst) == 0)
+            {
+                // the instruction is dropped, it neither reads nor writes shadows
+                data->dead[index] = 1;
+                count++;
+                continue;
+            }
+
+            if (!instr_is_predicated(instr))
+                live &= ~dst;
+        }
+
+        live |= shadow_reads_mask(instr);
+    }
+
+    return count;
+}
+
+static bool
+instr_uses_gprs(instr_t *instr)
+/*
+ *    Whether instrumentation of %instr% is likely to access shadow registers
+ */
+{
+    for (int i = 0; i < instr_num_srcs(instr); i++)
+    {
+        opnd_t opnd = instr_get_src(instr, i);
+        if (opnd_is_memory_reference(opnd) ||
+            (opnd_is_reg(opnd) && opnd_get_reg(opnd) != DR_REG_PC))
+            return true;
+    }
+
+    for (int i = 0; i < instr_num_dsts(instr); i++)
+    {
+        opnd_t opnd = instr_get_dst(instr, i);
+        if (opnd_is_memory_reference(opnd) ||
+            (opnd_is_reg(opnd) && opnd_get_reg(opnd) != DR_REG_PC))
+            return true;
+    }
+
+    return false;
+}
+
+static void
+mark_app_value_needed(block_data_t *data, opnd_t opnd)
+{
+    for (int i = 0; i < opnd_num_regs_used(opnd); i++)
+    {
+        reg_id_t reg = opnd_get_reg_used(opnd, i);
+        if (reg_is_gpr(reg))
+            data->app_value_needed[reg - DR_REG_R0] = true;
+    }
+}
+
+static bool
+is_coalescable_access(instr_t *instr, opnd_t *mem)
+/*
+ *    ldr/str family access via [base, #disp], see ds_insert_mem_to_shadow
+ */
+{
+    int opcode = instr_get_opcode(instr);
+
+    if (instr_group_is_load(opcode))
+        *mem = instr_get_src(instr, 0);
+    else if (instr_group_is_store(opcode))
+        *mem = instr_get_dst(instr, 0);
+    else
+        return false;
+
+    return opnd_is_base_disp(*mem) && opnd_get_index(*mem) == DR_REG_NULL &&
+           reg_is_gpr(opnd_get_base(*mem)) && opnd_get_base(*mem) != DR_REG_PC;
+}
+
+static void
+choose_resident_shadows(instrlist_t *bb, block_data_t *data)
+/*
+ *    Shadow registers accessed most by mov/arith propagations of the block.
+ *    Keeping one in a register costs a load and a store at most,
+ *    so it pays off from three accesses on. The last instruction
+ *    is handled after resident registers are written back
+ */
+{
+    int accesses[DR_NUM_GPR_REGS] = {0};
+    uint index = 0;
+
+    for (instr_t *instr = instrlist_first_app(bb); instr_get_next_app(instr) != NULL;
+         instr = instr_get_next_app(instr), index++)
+    {
+        if (data->dead[index] || !writes_dst_shadow_only(instr))
+            continue;
+
+        uint mask = handler_srcs_mask(instr) |
+                    1u << (opnd_get_reg(instr_get_dst(instr, 0)) - DR_REG_R0);
+
+        for (int i = 0; i < DR_NUM_GPR_REGS; i++)
+        {
+            if (TEST(1u << i, mask))
+                accesses[i]++;
+        }
+    }
+
+    accesses[DR_REG_PC - DR_REG_R0] = 0;
+
+    while (data->num_resident < MAX_RESIDENT_SHADOWS)
+    {
+        int best = -1;
+        for (int i = 0; i < DR_NUM_GPR_REGS; i++)
+        {
+            if (accesses[i] >= 3 && (best < 0 || accesses[i] > accesses[best]))
+                best = i;
+        }
+
+        if (best < 0)
+            break;
+
+        data->resident[data->num_resident++] = DR_REG_R0 + best;
+        accesses[best] = 0;
+    }
+}
+
+static instr_t *
+create_dual_label(void *drcontext, uint note)
+{
+    instr_t *label = INSTR_CREATE_label(drcontext);
+    instr_set_note(label, (void *)(dual_note_base + note));
+    return label;
+}
+
+static bool
+get_copy_access(instr_t *instr, bool load, reg_id_t *base, uint *elem_size, uint *regs)
+/*
+ *    ldr/ldrh/ldrb reg, [base], #size     ldm base!, {regs}
+ *    str/strh/strb reg, [base], #size     stm base!, {regs}
+ *
+ *    Return the base, the size of each register's element and the
+ *    mask of data registers if %instr% is one of these
+ */
+{
+    int opcode = instr_get_opcode(instr);
 
-    // get value of shadow registers of reg1, reg2 and place it to sreg1, sreg2
-    drtaint_insert_reg_to_taint_load(drcontext, ilist, where, reg1, sreg1);
-    drtaint_insert_reg_to_taint_load(drcontext, ilist, where, reg2, sreg2);
+    if (instr_is_predicated(instr))
+        return false;
 
-    // combine tags
+    if (opcode == (load ? OP_ldm : OP_stm))
+    {
+        int num = load ? instr_num_dsts(instr) : instr_num_srcs(instr);
+        opnd_t mem = load ? instr_get_src(instr, 0) : instr_get_dst(instr, 0);
+
+        // no writeback
+        if ((load ? instr_num_srcs(instr) : instr_num_dsts(instr)) < 2)
+            return false;
+
+        *base = opnd_get_base(mem);
+        *elem_size = 4;
+        *regs = 0;
+
+        // the last one is the written back base
+        for (int i = 0; i < num - 1; i++)
+        {
+            opnd_t reg = load ? instr_get_dst(instr, i) : instr_get_src(instr, i);
+            *regs |= 1u << (opnd_get_reg(reg) - DR_REG_R0);
+        }
+        return true;
+    }
+
+    if (load ? (opcode != OP_ldr && opcode != OP_ldrh && opcode != OP_ldrb)
+             : (opcode != OP_str && opcode != OP_strh && opcode != OP_strb))
+        return false;
+
+    // post-indexed: the address is the base, the immediate is added after
+    opnd_t mem = load ? instr_get_src(instr, 0) : instr_get_dst(instr, 0);
+    opnd_t value = load ? instr_get_dst(instr, 0) : instr_get_src(instr, 0);
+    opnd_t offs = instr_get_src(instr, instr_num_srcs(instr) - 1);
+
+    if (instr_num_srcs(instr) != 3 || instr_num_dsts(instr) != 2 ||
+        opnd_get_index(mem) != DR_REG_NULL || opnd_get_disp(mem) != 0 ||
+        !opnd_is_immed_int(offs) || TEST(DR_OPND_NEGATED, opnd_get_flags(offs)))
+        return false;
+
+    *base = opnd_get_base(mem);
+    *elem_size = opnd_size_in_bytes(opnd_get_size(mem));
+    *regs = 1u << (opnd_get_reg(value) - DR_REG_R0);
+    return opnd_get_immed_int(offs) == (ptr_int_t)*elem_size;
+}
+
+static bool
+summarize_copy_loop(void *drcontext, void *tag, instrlist_t *bb)
+/*
+ *    loop:  ldrb r3, [r1], #1        head:  ldrb r3, [r1], #1
+ *           ...                  =>         ...
+ *           strb r3, [r0], #1               strb r3, [r0], #1
+ *           subs r2, r2, #1                 subs r2, r2, #1
+ *           bne loop                        bne head       (meta)
+ *                                           bne loop       (never taken)
+ *
+ *    The block loops inside the code cache without leaving it. The load
+ *    and the store aren't propagated, r1 and r0 are saved at the entry
+ *    and loop_summary copies the shadow of the whole range at the exit.
+ *    Other instructions must not access memory or the data registers,
+ *    whose shadows are stale in the loop, nor write the bases
+ */
+{
+    instr_t *first = instrlist_first_app(bb);
+    instr_t *last = instrlist_last_app(bb);
+    instr_t *load = NULL, *store = NULL;
+    reg_id_t src = DR_REG_NULL, dst = DR_REG_NULL;
+    uint load_size = 0, store_size = 0, load_regs = 0, store_regs = 0;
+
+    if (first == NULL || last == NULL || instr_get_opcode(last) != OP_b ||
+        !instr_is_cbr(last) || !opnd_is_pc(instr_get_target(last)))
+        return false;
+
+    // its exit once found another loop's entry, see loop_summary
+    if (hashtable_lookup(&loop_unsummarized, tag) != NULL)
+        return false;
+
+    // thumb addresses have the lowest bit set
+    ptr_uint_t target = (ptr_uint_t)opnd_get_pc(instr_get_target(last)) & ~(ptr_uint_t)1;
+    if (target != ((ptr_uint_t)dr_fragment_app_pc(tag) & ~(ptr_uint_t)1))
+        return false;
+
+    for (instr_t *instr = first; instr != last; instr = instr_get_next_app(instr))
+    {
+        if (load == NULL && get_copy_access(instr, true, &src, &load_size, &load_regs))
+            load = instr;
+        else if (load != NULL && store == NULL &&
+                 get_copy_access(instr, false, &dst, &store_size, &store_regs))
+            store = instr;
+        else if (instr_reads_memory(instr) || instr_writes_memory(instr) ||
+                 instr_is_cti(instr) || instr_is_predicated(instr) ||
+                 instr_is_syscall(instr) || instr_is_interrupt(instr))
+            return false;
+    }
+
+    if (store == NULL || load_size != store_size || load_regs != store_regs || src == dst)
+        return false;
+
+    // DR keeps its TLS base in the stolen register
+    uint bases = (1u << (src - DR_REG_R0)) | (1u << (dst - DR_REG_R0));
+    reg_id_t stolen = dr_get_stolen_reg();
+    if ((load_regs & bases) != 0 || src == stolen || dst == stolen ||
+        src == DR_REG_SP || dst == DR_REG_SP || src == DR_REG_PC || dst == DR_REG_PC ||
+        (load_regs & ((1u << (DR_REG_SP - DR_REG_R0)) | (1u << (DR_REG_PC - DR_REG_R0)))) != 0)
+        return false;
+
+    // the rest of the loop must leave them alone, comparing bases is fine
+    for (instr_t *instr = first; instr != last; instr = instr_get_next_app(instr))
+    {
+        if (instr == load || instr == store)
+            continue;
+
+        for (uint i = 0; i < DR_NUM_GPR_REGS; i++)
+        {
+            reg_id_t reg = DR_REG_R0 + i;
+
+            if ((TEST(1u << i, load_regs) && instr_uses_reg(instr, reg)) ||
+                (TEST(1u << i, bases) && instr_writes_to_reg(instr, reg, DR_QUERY_INCLUDE_ALL)))
+                return false;
+        }
+    }
+
+    instr_t *head = INSTR_CREATE_label(drcontext);
+    instr_set_note(head, (void *)loop_note);
+    instrlist_meta_preinsert(bb, first, head);
+
+    instrlist_meta_preinsert(bb, last,
+                             XINST_CREATE_jump_cond(drcontext, // b<cond> head
+                                                    instr_get_predicate(last),
+                                                    opnd_create_instr(head)));
+
+    // lazy restores of drreg must not span the back edge
+    drreg_set_bb_properties(drcontext, DRREG_CONTAINS_SPANNING_CONTROL_FLOW);
+    return true;
+}
+
+static inline ptr_uint_t *
+loop_tls(void)
+{
+    return (ptr_uint_t *)((byte *)dr_get_dr_segment_base(loop_tls_seg) + loop_tls_offs);
+}
+
+static void
+loop_summary(app_pc src_end, app_pc dst_end, uint elem_size, uint regs, void *tag)
+/*
+ *    Called at the exit of a summarized copy loop. The ranges copied
+ *    are [entry, end) of both bases. If the destination overlaps the
+ *    source after its start, the loop copied data it had written itself:
+ *    the shadow is copied element by element in the loop's order.
+ *    The data registers get the tags of the last element.
+ *
+ *    The entry may belong to another loop, e.g. one a signal handler
+ *    ran. Only the last element is known to be copied then, the block
+ *    is flushed and rebuilt without the summary
+ */
+{
+    void *drcontext = dr_get_current_drcontext();
+    ptr_uint_t *entry = loop_tls();
+    app_pc src = (app_pc)entry[0];
+    app_pc dst = (app_pc)entry[1];
+    uint size = (uint)(src_end - src);
+    uint stride = elem_size * __builtin_popcount(regs);
+
+    if ((void *)entry[2] != tag || src_end < src || dst_end - dst != (ptr_int_t)size ||
+        size < stride || size % stride != 0)
+    {
+        src = src_end - stride;
+        dst = dst_end - stride;
+        size = stride;
+
+        hashtable_add(&loop_unsummarized, tag, (void *)1);
+        dr_delay_flush_region(dr_fragment_app_pc(tag), 1, 0, NULL);
+        __atomic_fetch_add(&stat_loop_mismatches, 1, __ATOMIC_RELAXED);
+    }
+
+    if (dst > src && dst < src_end)
+    {
+        for (uint offs = 0; offs < size; offs += stride)
+            ds_move_app_taint(drcontext, dst + offs, src + offs, stride);
+        __atomic_fetch_add(&stat_loop_replays, 1, __ATOMIC_RELAXED);
+    }
+    else if (dst < src && dst + size > src)
+        ds_move_app_taint(drcontext, dst, src, size);
+    else
+        ds_copy_app_taint(drcontext, dst, src, size);
+
+    app_pc elem = src_end - stride;
+    for (uint i = 0; i < DR_NUM_GPR_REGS; i++)
+    {
+        if (!TEST(1u << i, regs))
+            continue;
+
+        byte tags[4] = {0};
+        uint tag;
+
+        ds_get_app_area_taint(drcontext, elem, elem_size, tags);
+        memcpy(&tag, tags, sizeof(tag));
+        ds_set_reg_taint(drcontext, DR_REG_R0 + i, tag);
+        elem += elem_size;
+    }
+
+    __atomic_fetch_add(&stat_loop_summaries, 1, __ATOMIC_RELAXED);
+}
+
+static dr_emit_flags_t
+event_bb_app2app(void *drcontext, void *tag, instrlist_t *bb,
+                 bool for_trace, bool translating)
+/*
+ *    Most of the time no register holds taint. With
+ *    DRTAINT_OPTION_DUAL_BLOCKS each block is duplicated:
+ *
+ *        fast:  I1' ... In'    nothing is propagated, memory accesses
+ *               b done         fall over to the same instruction of the
+ *        slow:  I1  ... In     slow copy if their region may hold taint
+ *        done:  tail           the final cti isn't duplicated
+ *
+ *    The entry takes the fast copy if the per-thread flag says
+ *    no register is tainted, the slow copy recomputes the flag at its end.
+ *    drbbdup would do this, but it doesn't support ARM.
+ *
+ *    With DRTAINT_OPTION_LOOP_SUMMARIES copy loops are rewritten
+ *    instead, see summarize_copy_loop
+ */
+{
+    instr_t *first, *tail, *slow, *done;
+
+    // nothing to duplicate for, see event_bb_analysis
+    if (!taint_active || drtaint_is_excluded(dr_fragment_app_pc(tag)))
+        return DR_EMIT_DEFAULT;
+
+    if (dr_get_isa_mode(drcontext) == DR_ISA_ARM_THUMB)
+        dr_remove_it_instrs(drcontext, bb);
+
+    // guards only, see event_bb_analysis
+    if (profile_enabled && !profile_met_taint(dr_fragment_app_pc(tag)))
+        return DR_EMIT_DEFAULT;
+
+    if (TEST(DRTAINT_OPTION_LOOP_SUMMARIES, options.flags) &&
+        summarize_copy_loop(drcontext, tag, bb))
+        return DR_EMIT_DEFAULT;
+
+    if (!TEST(DRTAINT_OPTION_DUAL_BLOCKS, options.flags))
+        return DR_EMIT_DEFAULT;
+
+    // only app instructions can be duplicated
+    for (instr_t *instr = instrlist_first(bb); instr != NULL; instr = instr_get_next(instr))
+    {
+        if (!instr_is_app(instr))
+            return DR_EMIT_DEFAULT;
+    }
+
+    first = instrlist_first(bb);
+    tail = instrlist_last(bb);
+    if (tail != NULL && !instr_is_cti(tail) && !instr_is_syscall(tail) &&
+        !instr_is_interrupt(tail))
+        tail = NULL;
+
+    if (first == NULL || first == tail)
+        return DR_EMIT_DEFAULT;
+
+    slow = create_dual_label(drcontext, DUAL_NOTE_SLOW);
+    done = create_dual_label(drcontext, DUAL_NOTE_DONE);
+
+    instrlist_meta_preinsert(bb, first, create_dual_label(drcontext, DUAL_NOTE_FAST));
+    instr_t *jmp = XINST_CREATE_jump(drcontext, opnd_create_instr(done));
+    instrlist_meta_preinsert(bb, first, jmp);
+    instrlist_meta_preinsert(bb, first, slow);
+
+    for (instr_t *instr = first; instr != tail; instr = instr_get_next(instr))
+    {
+        instrlist_preinsert(bb, jmp, instr_clone(drcontext, instr));
+        instrlist_meta_preinsert(bb, instr, create_dual_label(drcontext, DUAL_NOTE_POS));
+    }
+
+    if (tail != NULL)
+        instrlist_meta_preinsert(bb, tail, done);
+    else
+        instrlist_meta_append(bb, done);
+
+    // lazy restores of drreg must not span the jumps between copies
+    drreg_set_bb_properties(drcontext, DRREG_CONTAINS_SPANNING_CONTROL_FLOW);
+    return DR_EMIT_DEFAULT;
+}
+
+static bool
+is_dual_label(instr_t *instr, uint note)
+{
+    return instr_is_label(instr) &&
+           (ptr_uint_t)instr_get_note(instr) == dual_note_base + note;
+}
+
+static void
+find_dual_labels(void *drcontext, instrlist_t *bb, block_data_t *data)
+{
+    uint k = 0;
+
+    for (instr_t *instr = instrlist_first(bb); instr != NULL; instr = instr_get_next(instr))
+    {
+        if (is_dual_label(instr, DUAL_NOTE_FAST))
+            data->dual = true;
+        else if (is_dual_label(instr, DUAL_NOTE_SLOW))
+            data->slow_label = instr;
+        else if (is_dual_label(instr, DUAL_NOTE_POS))
+            data->num_dup++;
+    }
+
+    if (!data->dual)
+        return;
+
+    data->entry_stub = INSTR_CREATE_label(drcontext);
+    data->slow_pos = (instr_t **)dr_thread_alloc(drcontext, data->num_dup * sizeof(instr_t *));
+
+    for (instr_t *instr = data->slow_label; instr != NULL; instr = instr_get_next(instr))
+    {
+        if (is_dual_label(instr, DUAL_NOTE_POS))
+            data->slow_pos[k++] = instr;
+    }
+}
+
+static void
+find_copy_loop(instrlist_t *bb, block_data_t *data)
+{
+    instr_t *instr;
+
+    for (instr = instrlist_first(bb); instr != NULL; instr = instr_get_next(instr))
+    {
+        if (instr_is_label(instr) && (ptr_uint_t)instr_get_note(instr) == loop_note)
+            break;
+    }
+
+    if (instr == NULL)
+        return;
+
+    data->loop_head = instr;
+
+    // the same accesses summarize_copy_loop found
+    for (instr = instr_get_next_app(instr); instr != NULL; instr = instr_get_next_app(instr))
+    {
+        if (data->loop_load == NULL &&
+            get_copy_access(instr, true, &data->loop_src, &data->loop_elem_size, &data->loop_regs))
+            data->loop_load = instr;
+        else if (data->loop_load != NULL && data->loop_store == NULL &&
+                 get_copy_access(instr, false, &data->loop_dst, &data->loop_elem_size,
+                                 &data->loop_regs))
+            data->loop_store = instr;
+    }
+}
+
+static void
+insert_loop_entry(void *drcontext, instrlist_t *ilist, void *tag, block_data_t *data)
+/*
+ *    Save the bases and the tag before the loop head. Nothing is
+ *    reserved yet, the source base carries the tag and is reloaded
+ *    from its slot. mov doesn't touch the flags
+ */
+{
+    instr_t *head = data->loop_head;
+
+    dr_insert_write_raw_tls(drcontext, ilist, head, loop_tls_seg,
+                            loop_tls_offs, data->loop_src);
+    dr_insert_write_raw_tls(drcontext, ilist, head, loop_tls_seg,
+                            loop_tls_offs + sizeof(void *), data->loop_dst);
+
+    instrlist_insert_mov_immed_ptrsz(drcontext, (ptr_int_t)tag, opnd_create_reg(data->loop_src),
+                                     ilist, head, NULL, NULL);
+    dr_insert_write_raw_tls(drcontext, ilist, head, loop_tls_seg,
+                            loop_tls_offs + 2 * sizeof(void *), data->loop_src);
+    dr_insert_read_raw_tls(drcontext, ilist, head, loop_tls_seg,
+                           loop_tls_offs, data->loop_src);
+}
+
+static void
+insert_loop_summary_call(void *drcontext, instrlist_t *ilist, instr_t *where, void *tag,
+                         block_data_t *data)
+{
+    dr_insert_clean_call(drcontext, ilist, where, (void *)loop_summary, false, 5,
+                         opnd_create_reg(data->loop_src),
+                         opnd_create_reg(data->loop_dst),
+                         OPND_CREATE_INT32(data->loop_elem_size),
+                         OPND_CREATE_INT32(data->loop_regs),
+                         OPND_CREATE_INTPTR(tag));
+}
+
+static void
+insert_loop_exit(void *drcontext, instrlist_t *ilist, instr_t *where, void *tag,
+                 block_data_t *data)
+/*
+ *    The exit runs when the branch isn't taken, so it can't be predicated by it.
+ *
+ *    With DRTAINT_OPTION_PAGE_SUMMARY the call is skipped if the entry is the
+ *    block's own and both ranges lie in clean summary regions: the copy moved
+ *    no taint and the data registers are clean. The shadow register file is
+ *    up to date here, see release_residents
+ */
+{
+    auto pred = disabled_autopredication(ilist);
+
+    if (!TEST(DRTAINT_OPTION_PAGE_SUMMARY, options.flags))
+    {
+        insert_loop_summary_call(drcontext, ilist, where, tag, data);
+        return;
+    }
+
+    instr_t *call = INSTR_CREATE_label(drcontext);
+    instr_t *done = INSTR_CREATE_label(drcontext);
+    drvector_t allowed;
+    reg_id_t saddr, sscratch;
+
+    // all reservations are made before the branch, so that spills and
+    // restores are the same on both paths. The bases are read directly
+    drreg_init_and_fill_vector(&allowed, true);
+    drreg_set_vector_entry(&allowed, data->loop_src, false);
+    drreg_set_vector_entry(&allowed, data->loop_dst, false);
+
+    bool ok = drreg_reserve_register(drcontext, ilist, where, &allowed, &saddr) ==
+                  DRREG_SUCCESS &&
+              drreg_reserve_register(drcontext, ilist, where, &allowed, &sscratch) ==
+                  DRREG_SUCCESS &&
+              drreg_reserve_aflags(drcontext, ilist, where) == DRREG_SUCCESS;
+    DR_ASSERT(ok);
+    drvector_delete(&allowed);
+
+    // the entry is the block's own
+    dr_insert_read_raw_tls(drcontext, ilist, where, loop_tls_seg,
+                           loop_tls_offs + 2 * sizeof(void *), saddr);
+    instrlist_insert_mov_immed_ptrsz(drcontext, (ptr_int_t)tag, opnd_create_reg(sscratch),
+                                     ilist, where, NULL, NULL);
     instrlist_meta_preinsert(ilist, where,
-                             INSTR_CREATE_orr(drcontext, // sreg1 |= sreg2
-                                              opnd_create_reg(sreg1),
-                                              opnd_create_reg(sreg2),
-                                              opnd_create_reg(sreg1)));
+                             XINST_CREATE_cmp(drcontext, // cmp saddr, sscratch
+                                              opnd_create_reg(saddr),
+                                              opnd_create_reg(sscratch)));
+    instrlist_meta_preinsert(ilist, where,
+                             XINST_CREATE_jump_cond(drcontext, DR_PRED_NE, // bne call
+                                                    opnd_create_instr(call)));
+
+    // both ranges are clean
+    dr_insert_read_raw_tls(drcontext, ilist, where, loop_tls_seg, loop_tls_offs, saddr);
+    ds_insert_app_range_clean_check(drcontext, ilist, where, saddr, data->loop_src,
+                                    sscratch, call);
+    dr_insert_read_raw_tls(drcontext, ilist, where, loop_tls_seg,
+                           loop_tls_offs + sizeof(void *), saddr);
+    ds_insert_app_range_clean_check(drcontext, ilist, where, saddr, data->loop_dst,
+                                    sscratch, call);
+
+    // so are the data registers
+    instrlist_meta_preinsert(ilist, where,
+                             XINST_CREATE_move(drcontext, // mov sscratch, #0
+                                               opnd_create_reg(sscratch),
+                                               OPND_CREATE_INT32(0)));
+    for (uint i = 0; i < DR_NUM_GPR_REGS; i++)
+    {
+        if (!TEST(1u << i, data->loop_regs))
+            continue;
 
-    // get value of shadow register of reg3 and place it to sreg3
-    drtaint_insert_reg_to_taint_load(drcontext, ilist, where, reg3, sreg3);
+        ds_insert_reg_to_shadow(drcontext, ilist, where, DR_REG_R0 + i, saddr);
+        instrlist_meta_preinsert(ilist, where,
+                                 XINST_CREATE_store(drcontext, // str sscratch, [saddr]
+                                                    OPND_CREATE_MEM32(saddr, 0),
+                                                    opnd_create_reg(sscratch)));
+    }
 
-    // combine tags
     instrlist_meta_preinsert(ilist, where,
-                             INSTR_CREATE_orr(drcontext, // sreg1 |= sreg3
-                                              opnd_create_reg(sreg1),
-                                              opnd_create_reg(sreg3),
-                                              opnd_create_reg(sreg1)));
+                             XINST_CREATE_jump(drcontext, // b done
+                                               opnd_create_instr(done)));
+    instrlist_meta_preinsert(ilist, where, call);
+    insert_loop_summary_call(drcontext, ilist, where, tag, data);
+    instrlist_meta_preinsert(ilist, where, done);
+
+    ok = drreg_unreserve_aflags(drcontext, ilist, where) == DRREG_SUCCESS &&
+         drreg_unreserve_register(drcontext, ilist, where, sscratch) == DRREG_SUCCESS &&
+         drreg_unreserve_register(drcontext, ilist, where, saddr) == DRREG_SUCCESS;
+    DR_ASSERT(ok);
+}
+
+static bool
+has_it_block(void *drcontext, instrlist_t *bb)
+/*
+ *    A guard resumes execution at the instruction it guards, a block
+ *    starting inside an IT block would run the rest unconditionally.
+ *    IT instructions are gone if app2app removed them, the
+ *    instructions they predicated are the only predicated ones then
+ */
+{
+    if (dr_get_isa_mode(drcontext) != DR_ISA_ARM_THUMB)
+        return false;
+
+    for (instr_t *instr = instrlist_first_app(bb); instr != NULL;
+         instr = instr_get_next_app(instr))
+    {
+        if (instr_get_opcode(instr) == OP_it ||
+            (instr_is_predicated(instr) && !instr_is_cbr(instr)))
+            return true;
+    }
+    return false;
+}
+
+static dr_emit_flags_t
+event_bb_analysis(void *drcontext, void *tag, instrlist_t *bb,
+                  bool for_trace, bool translating, void **user_data)
+/*
+ *    Every propagate_* routine loads the shadow register file address
+ *    from TLS on its own. If the block has several instructions to handle,
+ *    the address is loaded once at the block entry into a register
+ *    reserved for the whole block instead.
+ *
+ *    The same way, if several loads and stores of the block use
+ *    the same base register, the shadow address of the first one is
+ *    kept in a register and the others are addressed relative to it.
+ *
+ *    With DRTAINT_OPTION_RESIDENT_SHADOWS, shadows of the registers
+ *    the block's mov/arith instructions use most are kept in registers
+ *    too and written back before instructions which may fault
+ *    or whose handling reads the shadow register file directly.
+ *
+ *    Clean calls save and restore all registers, so both survive them.
+ *    None of these is used in blocks having an uninstrumented copy
+ *
+ *    Until the first taint source blocks aren't instrumented at all.
+ *    They can't be recreated for translation after it, so DR
+ *    keeps their translations instead. Blocks of excluded code
+ *    aren't instrumented either, see drtaint_exclude_range
+ *
+ *    With a profile, blocks which didn't meet taint get
+ *    guards only, see insert_profile_guard
+ */
+{
+    if (!taint_active)
+    {
+        if (!translating)
+            __atomic_fetch_add(&stat_lazy_blocks, 1, __ATOMIC_RELAXED);
+
+        *user_data = NULL;
+        return DR_EMIT_STORE_TRANSLATIONS;
+    }
+
+    if (drtaint_is_excluded(dr_fragment_app_pc(tag)))
+    {
+        if (!translating)
+            __atomic_fetch_add(&stat_excluded_blocks, 1, __ATOMIC_RELAXED);
+
+        *user_data = NULL;
+        return DR_EMIT_DEFAULT;
+    }
+
+    block_data_t *data = (block_data_t *)dr_thread_alloc(drcontext, sizeof(block_data_t));
+
+    // the block may be rebuilt with propagation before a fault in this one
+    if (profile_enabled && !profile_met_taint(dr_fragment_app_pc(tag)) &&
+        !has_it_block(drcontext, bb))
+    {
+        memset(data, 0, sizeof(block_data_t));
+        data->guarded = true;
+        if (!translating)
+            __atomic_fetch_add(&stat_guarded_blocks, 1, __ATOMIC_RELAXED);
+
+        *user_data = data;
+        return DR_EMIT_STORE_TRANSLATIONS;
+    }
+
+    int base_uses[DR_NUM_GPR_REGS] = {0};
+    int uses = 0;
+
+    memset(data, 0, sizeof(block_data_t));
+    data->translating = translating;
+    data->shadow_base = DR_REG_NULL;
+    data->coalesce_base = DR_REG_NULL;
+
+    if (!translating && TEST(DRTAINT_OPTION_STATS_REPORT, options.flags))
+        data->start_ns = ds_time_ns();
+    if (options.plan_cache_dir != NULL)
+        data->plans = find_plans(dr_fragment_app_pc(tag), &data->plans_start, &data->plans_end);
+    data->coalesce_cache = DR_REG_NULL;
+
+    if (TEST(DRTAINT_OPTION_DUAL_BLOCKS, options.flags))
+    {
+        find_dual_labels(drcontext, bb, data);
+        if (data->dual && !translating)
+            __atomic_fetch_add(&stat_dual_blocks, 1, __ATOMIC_RELAXED);
+    }
+
+    if (TEST(DRTAINT_OPTION_LOOP_SUMMARIES, options.flags))
+    {
+        find_copy_loop(bb, data);
+        if (data->loop_head != NULL && !translating)
+            __atomic_fetch_add(&stat_loop_blocks, 1, __ATOMIC_RELAXED);
+    }
+
+    for (instr_t *instr = instrlist_first_app(bb); instr != NULL;
+         instr = instr_get_next_app(instr))
+    {
+        opnd_t mem;
+
+        data->num_app++;
+        if (instr_uses_gprs(instr))
+            uses++;
+
+        // drutil and the ldm/stm clean calls read address registers directly
+        for (int i = 0; i < instr_num_srcs(instr); i++)
+        {
+            if (opnd_is_memory_reference(instr_get_src(instr, i)))
+                mark_app_value_needed(data, instr_get_src(instr, i));
+        }
+
+        for (int i = 0; i < instr_num_dsts(instr); i++)
+        {
+            if (opnd_is_memory_reference(instr_get_dst(instr, i)))
+                mark_app_value_needed(data, instr_get_dst(instr, i));
+        }
+
+        if (is_coalescable_access(instr, &mem))
+            base_uses[opnd_get_base(mem) - DR_REG_R0]++;
+    }
+
+    // block wide registers can't be set up for falling over to the slow copy
+    // or across the back edge of a loop
+    data->hoist_base = uses >= 2 && !data->dual && data->loop_head == NULL;
+
+    if (ds_can_coalesce() && !data->dual && data->loop_head == NULL)
+    {
+        int best = 0;
+        for (int i = 0; i < DR_NUM_GPR_REGS; i++)
+        {
+            if (base_uses[i] >= 2 && base_uses[i] > best)
+            {
+                best = base_uses[i];
+                data->coalesce_base = DR_REG_R0 + i;
+            }
+        }
+    }
+
+    if (data->num_app > 0)
+    {
+        data->dead = (byte *)dr_thread_alloc(drcontext, data->num_app);
+        memset(data->dead, 0, data->num_app);
+
+        uint count = find_dead_shadow_writes(bb, data);
+        if (!translating)
+            __atomic_fetch_add(&stat_dead_writes, count, __ATOMIC_RELAXED);
+
+        if (TEST(DRTAINT_OPTION_RESIDENT_SHADOWS, options.flags) && data->hoist_base)
+            choose_resident_shadows(bb, data);
+    }
+
+    *user_data = data;
+    return DR_EMIT_DEFAULT;
+}
+
+template <typename policy>
+static void
+update_clean_regs(block_data_t *data, instr_t *instr, bool propagated)
+/*
+ *    Translation time transfer function of the clean register state
+ */
+{
+    uint clean = data->clean_regs;
+    uint written = 0;
+
+    for (int i = 0; i < instr_num_dsts(instr); i++)
+    {
+        opnd_t opnd = instr_get_dst(instr, i);
+        if (opnd_is_reg(opnd) && reg_is_gpr(opnd_get_reg(opnd)))
+            written |= 1u << (opnd_get_reg(opnd) - DR_REG_R0);
+    }
 
-    // get address of shadow register of reg4 and place it to sreg4
-    drtaint_insert_reg_to_taint(drcontext, ilist, where, reg4, sreg4);
+    // by default all written registers become unknown
+    data->clean_regs &= ~written;
 
-    // save the result to shadow register of reg4
-    instrlist_meta_preinsert(ilist, where,
-                             XINST_CREATE_store(drcontext, // str sreg1, [sreg4]
-                                                OPND_CREATE_MEM32(sreg4, 0),
-                                                opnd_create_reg(sreg1)));
+    if (!propagated)
+        return;
+
+    if ((policy::zeroing_idioms && instr_is_zeroing_idiom(instr)) ||
+        (writes_dst_shadow_only(instr) && (handler_srcs_mask(instr) & ~clean) == 0))
+    {
+        // a predicated write keeps the old shadow if not executed
+        if (!instr_is_predicated(instr) || (clean & written) == written)
+            data->clean_regs |= written;
+    }
 }
 
-static void
-propagate_mull(void *drcontext, instrlist_t *ilist, instr_t *where)
+static bool
+propagate_statically_clean(void *drcontext, instrlist_t *ilist, instr_t *where,
+                           block_data_t *data)
 /*
- *    umull reg4, reg3, reg2, reg1
- *
- *    Need to mark reg3 and reg4 tainted.
- *    Because their values depend on values of reg2, reg1,
- *    we use OR to combine their impacts to reg3 and reg4
+ *    Sources of mov/arith known to be clean at translation time:
+ *    if all of them are clean the destination shadow is just cleared,
+ *    if one of two is clean the other one is copied without the orr
  */
 {
-    reg_id_t reg1 = opnd_get_reg(instr_get_src(where, 0));
-    reg_id_t reg2 = opnd_get_reg(instr_get_src(where, 1));
-    reg_id_t reg3 = opnd_get_reg(instr_get_dst(where, 0));
-    reg_id_t reg4 = opnd_get_reg(instr_get_dst(where, 1));
-
-    auto sreg1 = drreg_reservation{drcontext, ilist, where};
-    auto sreg2 = drreg_reservation{drcontext, ilist, where};
-    reg_id_t sreg3 = sreg2; /* we reuse a register for this */
-    reg_id_t sreg4 = sreg3;
+    if (!writes_dst_shadow_only(where))
+        return false;
 
-    // get value of shadow registers of reg1, reg2 and place it to sreg1, sreg2
-    drtaint_insert_reg_to_taint_load(drcontext, ilist, where, reg1, sreg1);
-    drtaint_insert_reg_to_taint_load(drcontext, ilist, where, reg2, sreg2);
+    uint srcs = handler_srcs_mask(where);
+    uint unknown = srcs & ~data->clean_regs;
+    reg_id_t dst = opnd_get_reg(instr_get_dst(where, 0));
 
-    // combine tags
-    instrlist_meta_preinsert(ilist, where,
-                             INSTR_CREATE_orr(drcontext, // sreg1 |= sreg2
-                                              opnd_create_reg(sreg1),
-                                              opnd_create_reg(sreg2),
-                                              opnd_create_reg(sreg1)));
+    // nothing to load, the usual handlers are as cheap
+    if (srcs == 0 || unknown == srcs)
+        return false;
 
-    // get address of shadow register of reg3 and place it to sreg3
-    drtaint_insert_reg_to_taint(drcontext, ilist, where, reg3, sreg3);
+    if (unknown == 0)
+        propagate_mov_imm_src(drcontext, ilist, where);
 
-    // save the higher part of result to shadow register of reg3
-    instrlist_meta_preinsert(ilist, where,
-                             XINST_CREATE_store(drcontext, // str sreg1, [sreg3]
-                                                OPND_CREATE_MEM32(sreg3, 0),
-                                                opnd_create_reg(sreg1)));
+    else
+    {
+        // exactly one of two sources is unknown
+        reg_id_t src = opnd_get_reg(instr_get_src(where, 0));
+        if ((unknown & (1u << (src - DR_REG_R0))) == 0)
+            src = opnd_get_reg(instr_get_src(where, 1));
 
-    // get address of shadow register of reg4 and place it to sreg4
-    drtaint_insert_reg_to_taint(drcontext, ilist, where, reg4, sreg4);
+        propagate_mov_regs(drcontext, ilist, where, src, dst);
+    }
 
-    // save the the lower part of result to shadow register of reg4
-    instrlist_meta_preinsert(ilist, where,
-                             XINST_CREATE_store(drcontext, // str sreg1, [sreg4]
-                                                OPND_CREATE_MEM32(sreg4, 0),
-                                                opnd_create_reg(sreg1)));
+    if (!data->translating)
+        __atomic_fetch_add(&stat_downgraded, 1, __ATOMIC_RELAXED);
+    return true;
 }
 
-static void
-propagate_smlal(void *drcontext, instrlist_t *ilist, instr_t *where)
+static reg_id_t
+reserve_block_reg(void *drcontext, instrlist_t *ilist, instr_t *where, block_data_t *data)
 /*
- *    smlal rdlo, rdhi, reg1, reg2
- *
- *    rdlo, rdhi - source and destination registers
- *
- *    Need to mark rdlo and rdhi tainted.
- *    Because their values depend on values of reg2, reg1
- *    we use OR to combine their impacts to rdlo and rdhi
+ *    Reserve a register holding a tool value for the whole block
  */
 {
-    reg_id_t reg1 = opnd_get_reg(instr_get_src(where, 2));
-    reg_id_t reg2 = opnd_get_reg(instr_get_src(where, 3));
-    reg_id_t rdlo = opnd_get_reg(instr_get_src(where, 1));
-    reg_id_t rdhi = opnd_get_reg(instr_get_src(where, 0));
+    drvector_t allowed;
+    reg_id_t reg;
 
-    auto sreg1 = drreg_reservation{drcontext, ilist, where};
-    auto sreg2 = drreg_reservation{drcontext, ilist, where};
-    auto sreg3 = drreg_reservation{drcontext, ilist, where};
-    reg_id_t srdlo = sreg2;
-    reg_id_t srdhi = srdlo;
-
-    // get value of shadow registers of reg1, reg2 and place it to sreg1, sreg2
-    drtaint_insert_reg_to_taint_load(drcontext, ilist, where, reg1, sreg1);
-    drtaint_insert_reg_to_taint_load(drcontext, ilist, where, reg2, sreg2);
+    drreg_init_and_fill_vector(&allowed, true);
+    for (int i = 0; i < DR_NUM_GPR_REGS; i++)
+    {
+        if (data->app_value_needed[i])
+            drreg_set_vector_entry(&allowed, DR_REG_R0 + i, false);
+    }
 
-    // combine tags of reg1, reg2
-    instrlist_meta_preinsert(ilist, where,
-                             INSTR_CREATE_orr(drcontext, // sreg1 |= sreg2
-                                              opnd_create_reg(sreg1),
-                                              opnd_create_reg(sreg2),
-                                              opnd_create_reg(sreg1)));
+    if (drreg_reserve_register(drcontext, ilist, where, &allowed, &reg) != DRREG_SUCCESS)
+        reg = DR_REG_NULL;
 
-    // copy tag1 | tag2 to sreg3
-    instrlist_meta_preinsert(ilist, where,
-                             INSTR_CREATE_mov(drcontext, // sreg3 = reg1
-                                              opnd_create_reg(sreg3),
-                                              opnd_create_reg(sreg1)));
+    drvector_delete(&allowed);
+    return reg;
+}
 
-    // get value of shadow register of rdlo and place it to srdlo
-    drtaint_insert_reg_to_taint_load(drcontext, ilist, where, rdlo, srdlo);
+static void
+insert_block_base(void *drcontext, instrlist_t *ilist, instr_t *where, block_data_t *data)
+{
+    data->shadow_base = reserve_block_reg(drcontext, ilist, where, data);
+    if (data->shadow_base != DR_REG_NULL)
+        data->setup = ds_insert_shadow_base(drcontext, ilist, where, data->shadow_base);
+}
 
-    // combine tags of reg1, reg2, rdlo
-    instrlist_meta_preinsert(ilist, where,
-                             INSTR_CREATE_orr(drcontext, // sreg1 |= srdlo
-                                              opnd_create_reg(sreg1),
-                                              opnd_create_reg(srdlo),
-                                              opnd_create_reg(sreg1)));
+static void
+start_coalescing(void *drcontext, instrlist_t *ilist, instr_t *where, block_data_t *data)
+{
+    data->coalesce_cache = reserve_block_reg(drcontext, ilist, where, data);
+    if (data->coalesce_cache != DR_REG_NULL)
+        ds_start_coalescing(drcontext, data->coalesce_base, data->coalesce_cache);
+}
 
-    // get address of shadow register of rdlo and place it to srdlo
-    drtaint_insert_reg_to_taint(drcontext, ilist, where, rdlo, srdlo);
+static void
+stop_coalescing(void *drcontext, instrlist_t *ilist, instr_t *where, block_data_t *data)
+{
+    uint coalesced = ds_stop_coalescing(drcontext);
 
-    // save the the lower part of result to shadow register of rdlo
-    instrlist_meta_preinsert(ilist, where,
-                             XINST_CREATE_store(drcontext, // str sreg1, [srdlo]
-                                                OPND_CREATE_MEM32(srdlo, 0),
-                                                opnd_create_reg(sreg1)));
+    drreg_status_t status = drreg_unreserve_register(drcontext, ilist, where,
+                                                     data->coalesce_cache);
+    DR_ASSERT(status == DRREG_SUCCESS);
 
-    // get value of shadow register of rdhi and place it to srdhi
-    drtaint_insert_reg_to_taint_load(drcontext, ilist, where, rdhi, srdhi);
+    if (!data->translating)
+        __atomic_fetch_add(&stat_coalesced, coalesced, __ATOMIC_RELAXED);
+}
 
-    // combine tags of reg1, reg2, rdhi
-    instrlist_meta_preinsert(ilist, where,
-                             INSTR_CREATE_orr(drcontext, // sreg3 |= srdhi
-                                              opnd_create_reg(sreg3),
-                                              opnd_create_reg(srdhi),
-                                              opnd_create_reg(sreg3)));
+static void
+make_residents(void *drcontext, instrlist_t *ilist, instr_t *where, block_data_t *data)
+{
+    for (uint i = 0; i < data->num_resident; i++)
+    {
+        reg_id_t holder = reserve_block_reg(drcontext, ilist, where, data);
+        if (holder == DR_REG_NULL)
+            break;
 
-    // get address of shadow register of rdlo and place it to srdlo
-    drtaint_insert_reg_to_taint(drcontext, ilist, where, rdhi, srdhi);
+        data->holders[data->num_holders++] = holder;
+        ds_make_resident(drcontext, data->resident[i], holder);
+    }
 
-    // save the the higher part of result to shadow register of rdhi
-    instrlist_meta_preinsert(ilist, where,
-                             XINST_CREATE_store(drcontext, // str sreg1, [srdhi]
-                                                OPND_CREATE_MEM32(srdhi, 0),
-                                                opnd_create_reg(sreg3)));
+    if (!data->translating)
+        __atomic_fetch_add(&stat_resident_regs, data->num_holders, __ATOMIC_RELAXED);
 }
 
 static void
-propagate_pkhXX(void *drcontext, instrlist_t *ilist,
-                instr_t *where, bool is_pkhbt)
+release_residents(void *drcontext, instrlist_t *ilist, instr_t *where, block_data_t *data)
 /*
- *    pkhbt r0, r1, r2
- *    pkhtb r0, r1, r2
- *
- *    Need to mark r0 tainted.
- *    r0's tag value depends on 0:15, 16:31 bits of r1, r2
+ *    Write back resident shadows before %where% and release their registers
  */
 {
-    reg_id_t reg0 = opnd_get_reg(instr_get_dst(where, 0));
-    reg_id_t reg1 = opnd_get_reg(instr_get_src(where, 0));
-    reg_id_t reg2 = opnd_get_reg(instr_get_src(where, 1));
+    uint accesses = ds_clear_residents(drcontext, ilist, where);
 
-    auto sreg1 = drreg_reservation{drcontext, ilist, where};
-    auto sreg2 = drreg_reservation{drcontext, ilist, where};
-    auto simm = drreg_reservation{drcontext, ilist, where};
-    reg_id_t sreg0 = simm;
+    for (uint i = 0; i < data->num_holders; i++)
+    {
+        drreg_status_t status = drreg_unreserve_register(drcontext, ilist, where,
+                                                         data->holders[i]);
+        DR_ASSERT(status == DRREG_SUCCESS);
+    }
 
-    // get 0xFFFF constant and place it to simm
-    instrlist_meta_preinsert(ilist, where,
-                             INSTR_CREATE_mov(drcontext,
-                                              opnd_create_reg(simm),
-                                              OPND_CREATE_INT32(0x10000)));
+    data->num_holders = 0;
+    if (!data->translating)
+        __atomic_fetch_add(&stat_resident_accesses, accesses, __ATOMIC_RELAXED);
+}
 
-    instrlist_meta_preinsert(ilist, where,
-                             INSTR_CREATE_sub(drcontext,
-                                              opnd_create_reg(simm),
-                                              opnd_create_reg(simm),
-                                              OPND_CREATE_INT32(1)));
+template <typename policy>
+static bool
+needs_resident_writeback(instr_t *instr)
+/*
+ *    Resident shadows must be in the shadow register file before %instr%:
+ *    it may fault, its handling makes a clean call or it ends the block
+ */
+{
+    return is_shadow_barrier(instr) ||
+           (policy::untaint_stack && is_stack_frame_alloc(instr));
+}
 
-    // shift simm left if pkhtb and get 0xFFFF0000 constant
-    if (!is_pkhbt)
+static void
+pick_scratch_regs(opnd_t mem, reg_id_t *regs, uint count)
+/*
+ *    Registers not used by %mem% for the spills of the fast copy
+ */
+{
+    uint n = 0;
+
+    for (reg_id_t reg = DR_REG_R0; reg <= DR_REG_R12 && n < count; reg++)
     {
-        instrlist_meta_preinsert(ilist, where,
-                                 INSTR_CREATE_lsl(drcontext,
-                                                  opnd_create_reg(simm),
-                                                  opnd_create_reg(simm),
-                                                  OPND_CREATE_INT32(16)));
+        if (reg == dr_get_stolen_reg() || (!opnd_is_null(mem) && opnd_uses_reg(mem, reg)))
+            continue;
+        regs[n++] = reg;
     }
 
-    // get value of shadow register of reg1 and place it to sreg1
-    drtaint_insert_reg_to_taint_load(drcontext, ilist, where, reg1, sreg1);
-    drtaint_insert_reg_to_taint_load(drcontext, ilist, where, reg2, sreg2);
+    DR_ASSERT(n == count);
+}
 
-    // get bits x:y of sreg1
-    instrlist_meta_preinsert(ilist, where,
-                             INSTR_CREATE_and(drcontext,
-                                              opnd_create_reg(sreg1),
-                                              opnd_create_reg(sreg1),
-                                              opnd_create_reg(simm)));
+static void
+insert_fast_spill(void *drcontext, instrlist_t *ilist, instr_t *where,
+                  const reg_id_t *regs, uint count)
+/*
+ *    The fast copy jumps to the slow one in the middle of a block,
+ *    drreg wouldn't restore its registers on that path. So the fast copy
+ *    spills to raw TLS slots of its own, valid within an app instruction
+ */
+{
+    DR_ASSERT(count <= FAST_SLOTS);
 
-    // shift simm: pkhbt -> left; pkhtb -> right
-    if (!is_pkhbt)
-    {
-        instrlist_meta_preinsert(ilist, where,
-                                 INSTR_CREATE_lsr(drcontext,
-                                                  opnd_create_reg(simm),
-                                                  opnd_create_reg(simm),
-                                                  OPND_CREATE_INT32(16)));
-    }
-    else
-    {
-        instrlist_meta_preinsert(ilist, where,
-                                 INSTR_CREATE_lsl(drcontext,
-                                                  opnd_create_reg(simm),
-                                                  opnd_create_reg(simm),
-                                                  OPND_CREATE_INT32(16)));
-    }
+    for (uint i = 0; i < count; i++)
+        dr_insert_write_raw_tls(drcontext, ilist, where, fast_tls_seg,
+                                fast_tls_offs + i * sizeof(void *), regs[i]);
+}
 
-    // get bits x:y of sreg2
-    instrlist_meta_preinsert(ilist, where,
-                             INSTR_CREATE_and(drcontext,
-                                              opnd_create_reg(sreg2),
-                                              opnd_create_reg(sreg2),
-                                              opnd_create_reg(simm)));
-    // combine tags of sreg1, sreg2
-    instrlist_meta_preinsert(ilist, where,
-                             INSTR_CREATE_orr(drcontext,
-                                              opnd_create_reg(sreg1),
-                                              opnd_create_reg(sreg2),
-                                              opnd_create_reg(sreg1)));
+static void
+insert_fast_restore(void *drcontext, instrlist_t *ilist, instr_t *where,
+                    const reg_id_t *regs, uint count, reg_id_t sflags)
+{
+    if (sflags != DR_REG_NULL)
+        dr_restore_arith_flags_from_reg(drcontext, ilist, where, sflags);
 
-    // get shadow register address of reg0 and place it to sreg0
-    drtaint_insert_reg_to_taint(drcontext, ilist, where, reg0, sreg0);
+    for (uint i = 0; i < count; i++)
+        dr_insert_read_raw_tls(drcontext, ilist, where, fast_tls_seg,
+                               fast_tls_offs + i * sizeof(void *), regs[i]);
+}
 
-    // write shadow value of reg1 to shadow value of reg2
-    instrlist_meta_preinsert(ilist, where,
-                             XINST_CREATE_store(drcontext, // str sreg1, [sreg0]
-                                                OPND_CREATE_MEM32(sreg0, 0),
-                                                opnd_create_reg(sreg1)));
+static void
+insert_trip_pc(void *drcontext, instrlist_t *ilist, instr_t *where, reg_id_t scratch, app_pc pc)
+/*
+ *    Tell profile_trip where to resume, %scratch% must be spilled
+ */
+{
+    instrlist_insert_mov_immed_ptrsz(drcontext, (ptr_int_t)pc, opnd_create_reg(scratch),
+                                     ilist, where, NULL, NULL);
+    dr_insert_write_raw_tls(drcontext, ilist, where, fast_tls_seg,
+                            fast_tls_offs + PROFILE_PC_SLOT * sizeof(void *), scratch);
 }
 
-#pragma endregion arithmetic
+static void
+insert_fall_over_check(void *drcontext, instrlist_t *ilist, instr_t *where,
+                       opnd_t mem, instr_t *slow, app_pc resume)
+/*
+ *    Jump to %slow% if the region %mem% refers to may hold taint.
+ *    The fast copy is valid while registers are clean, a clean
+ *    region keeps them so and stores to it don't change its taint.
+ *    %resume%: the pc a guarded block resumes at, NULL in the fast copy
+ */
+{
+    reg_id_t regs[3];
+    instr_t *cont = INSTR_CREATE_label(drcontext);
 
-#pragma region load_store_multiple
+    pick_scratch_regs(mem, regs, 3);
+    reg_id_t saddr = regs[0], ssum = regs[1], sflags = regs[2];
 
-template <stack_dir_t c>
-void propagate_ldm_cc_template(app_pc pc, void *base, bool writeback)
+    insert_fast_spill(drcontext, ilist, where, regs, 3);
+    dr_save_arith_flags_to_reg(drcontext, ilist, where, sflags);
+
+    bool ok = drutil_insert_get_mem_addr(drcontext, ilist, where, mem, saddr, ssum);
+    DR_ASSERT(ok);
+
+    // get summary of the region and place it to ssum
+    ds_insert_app_to_summary_load(drcontext, ilist, where, saddr, ssum);
+
+    instrlist_meta_preinsert(ilist, where,
+                             XINST_CREATE_cmp(drcontext, // cmp ssum, #0
+                                              opnd_create_reg(ssum),
+                                              OPND_CREATE_INT8(0)));
+    instrlist_meta_preinsert(ilist, where,
+                             XINST_CREATE_jump_cond(drcontext, DR_PRED_EQ, // beq cont
+                                                    opnd_create_instr(cont)));
+
+    // The region may be tainted, continue in the slow copy.
+    // Registers may get tainted before it recomputes the flag
+    ds_insert_any_reg_tainted_set(drcontext, ilist, where, ssum, saddr);
+    if (resume != NULL)
+        insert_trip_pc(drcontext, ilist, where, saddr, resume);
+    insert_fast_restore(drcontext, ilist, where, regs, 3, sflags);
+    instrlist_meta_preinsert(ilist, where,
+                             XINST_CREATE_jump(drcontext, // b slow
+                                               opnd_create_instr(slow)));
+
+    instrlist_meta_preinsert(ilist, where, cont);
+    insert_fast_restore(drcontext, ilist, where, regs, 3, sflags);
+}
+
+template <typename policy>
+static void
+insert_fast_checks(void *drcontext, instrlist_t *ilist, instr_t *where, instr_t *slow,
+                   app_pc resume)
 /*
- *    ldm r, { regs }
- *
- *    When handling a ldm command we have to save all values of registers
- *    that will be popped from a stack to their shadow registers
+ *    Instrumentation of an instruction of the fast copy or a guarded
+ *    block: nothing is propagated, only memory accesses are checked
  */
 {
-    void *drcontext = dr_get_current_drcontext();
-    auto instr = instr_decoded(drcontext, pc);
+    // the checks must run whether the instruction executes or not
+    auto pred = disabled_autopredication(ilist);
 
-    int num_dsts = instr_num_dsts(instr);
-    if (writeback)
-        num_dsts--;
+    for (int i = 0; i < instr_num_srcs(where); i++)
+    {
+        if (opnd_is_memory_reference(instr_get_src(where, i)))
+            insert_fall_over_check(drcontext, ilist, where, instr_get_src(where, i), slow, resume);
+    }
 
-    for (int i = 0; i < num_dsts; ++i)
+    for (int i = 0; i < instr_num_dsts(where); i++)
     {
-        bool ok;
-        uint res;
+        if (opnd_is_memory_reference(instr_get_dst(where, i)))
+            insert_fall_over_check(drcontext, ilist, where, instr_get_dst(where, i), slow, resume);
+    }
 
-        app_pc addr = calculate_addr<c>(instr, base, i, num_dsts);
-        reg_id_t reg = opnd_get_reg(instr_get_dst(instr, i));
+    // the slow copy untaints the new frame
+    if (policy::untaint_stack && is_stack_frame_alloc(where))
+    {
+        opnd_t size = instr_get_src(where, 1);
+        ptr_int_t imm = opnd_is_immed(size) ? opnd_get_immed_int(size) : 0;
 
-        // set taint from stack to the appropriate register
-        ok = drtaint_get_app_taint4(drcontext, addr, &res);
-        DR_ASSERT(ok);
-        ok = drtaint_set_reg_taint(drcontext, reg, res);
-        DR_ASSERT(ok);
+        // the summary covers an access straddling into the next 64KB region only,
+        // frames of a register size are rare enough to always fall over
+        if (imm > 0 && imm < 0x10000)
+        {
+            insert_fall_over_check(drcontext, ilist, where,
+                                   opnd_create_base_disp(DR_REG_SP, DR_REG_NULL, 0,
+                                                         (int)-imm, OPSZ_4),
+                                   slow, resume);
+        }
+        else
+        {
+            if (resume != NULL)
+            {
+                reg_id_t reg;
+                pick_scratch_regs(opnd_create_null(), &reg, 1);
+                insert_fast_spill(drcontext, ilist, where, &reg, 1);
+                insert_trip_pc(drcontext, ilist, where, reg, resume);
+                insert_fast_restore(drcontext, ilist, where, &reg, 1, DR_REG_NULL);
+            }
+
+            instrlist_meta_preinsert(ilist, where,
+                                     XINST_CREATE_jump(drcontext, // b slow
+                                                       opnd_create_instr(slow)));
+        }
     }
 }
 
 static void
-propagate_ldmXX(void *drcontext, instrlist_t *ilist, instr_t *where)
+insert_dual_entry(void *drcontext, instrlist_t *ilist, instr_t *where, instr_t *stub)
+/*
+ *    Take the fast copy if no register is tainted, the slow one otherwise.
+ *    %stub% restores the spilled registers before the slow copy
+ */
 {
-    int opcode = instr_get_opcode(where);
-
-    switch (opcode)
-    {
-    case OP_ldmia:
-        dr_insert_clean_call(
-            drcontext, ilist, where, (void *)propagate_ldm_cc_template<IA>, false, 3,
-            OPND_CREATE_INTPTR(instr_get_app_pc(where)),
-            opnd_create_reg(opnd_get_base(instr_get_src(where, 0))),
-            /* writeback */
-            OPND_CREATE_INT(instr_num_srcs(where) > 1));
-        break;
-
-    case OP_ldmdb:
-        dr_insert_clean_call(
-            drcontext, ilist, where, (void *)propagate_ldm_cc_template<DB>, false, 3,
-            OPND_CREATE_INTPTR(instr_get_app_pc(where)),
-            opnd_create_reg(opnd_get_base(instr_get_src(where, 0))),
-            OPND_CREATE_INT(instr_num_srcs(where) > 1));
-        break;
+    reg_id_t regs[2];
+    auto pred = disabled_autopredication(ilist);
 
-    case OP_ldmib:
-        dr_insert_clean_call(
-            drcontext, ilist, where, (void *)propagate_ldm_cc_template<IB>, false, 3,
-            OPND_CREATE_INTPTR(instr_get_app_pc(where)),
-            opnd_create_reg(opnd_get_base(instr_get_src(where, 0))),
-            OPND_CREATE_INT(instr_num_srcs(where) > 1));
-        break;
+    pick_scratch_regs(opnd_create_null(), regs, 2);
+    insert_fast_spill(drcontext, ilist, where, regs, 2);
+    dr_save_arith_flags_to_reg(drcontext, ilist, where, regs[1]);
 
-    case OP_ldmda:
-        dr_insert_clean_call(
-            drcontext, ilist, where, (void *)propagate_ldm_cc_template<DA>, false, 3,
-            OPND_CREATE_INTPTR(instr_get_app_pc(where)),
-            opnd_create_reg(opnd_get_base(instr_get_src(where, 0))),
-            OPND_CREATE_INT(instr_num_srcs(where) > 1));
-        break;
+    ds_insert_any_reg_tainted_load(drcontext, ilist, where, regs[0]);
+    instrlist_meta_preinsert(ilist, where,
+                             XINST_CREATE_cmp(drcontext, // cmp flag, #0
+                                              opnd_create_reg(regs[0]),
+                                              OPND_CREATE_INT8(0)));
+    instrlist_meta_preinsert(ilist, where,
+                             XINST_CREATE_jump_cond(drcontext, DR_PRED_NE, // bne stub
+                                                    opnd_create_instr(stub)));
 
-    default:
-        DR_ASSERT(false);
-    }
+    insert_fast_restore(drcontext, ilist, where, regs, 2, regs[1]);
 }
 
-template <stack_dir_t c>
-void propagate_stm_cc_template(app_pc pc, void *base, bool writeback)
+static void
+insert_profile_entry(void *drcontext, instrlist_t *ilist, instr_t *where,
+                     instr_t *trip, app_pc pc)
 /*
- *    stm r, { regs }
- *
- *    When handling a stm command we have to set all memory
- *    in the stack, where the register values will be written, tainted
+ *    Registers may be tainted, e.g. the previous block loaded taint
  */
 {
-    void *drcontext = dr_get_current_drcontext();
-    auto instr = instr_decoded(drcontext, pc);
+    reg_id_t regs[2];
+    instr_t *cont = INSTR_CREATE_label(drcontext);
 
-    int num_srcs = instr_num_srcs(instr);
-    if (writeback)
-        num_srcs--;
+    pick_scratch_regs(opnd_create_null(), regs, 2);
+    insert_fast_spill(drcontext, ilist, where, regs, 2);
+    dr_save_arith_flags_to_reg(drcontext, ilist, where, regs[1]);
 
-    for (int i = 0; i < num_srcs; ++i)
-    {
-        bool ok;
-        uint res;
+    ds_insert_any_reg_tainted_load(drcontext, ilist, where, regs[0]);
+    instrlist_meta_preinsert(ilist, where,
+                             XINST_CREATE_cmp(drcontext, // cmp flag, #0
+                                              opnd_create_reg(regs[0]),
+                                              OPND_CREATE_INT8(0)));
+    instrlist_meta_preinsert(ilist, where,
+                             XINST_CREATE_jump_cond(drcontext, DR_PRED_EQ, // beq cont
+                                                    opnd_create_instr(cont)));
 
-        reg_id_t reg = opnd_get_reg(instr_get_src(instr, i));
-        app_pc addr = calculate_addr<c>(instr, base, i, num_srcs);
+    insert_trip_pc(drcontext, ilist, where, regs[0], pc);
+    insert_fast_restore(drcontext, ilist, where, regs, 2, regs[1]);
+    instrlist_meta_preinsert(ilist, where,
+                             XINST_CREATE_jump(drcontext, // b trip
+                                               opnd_create_instr(trip)));
 
-        // set taint from registers to the stack
-        ok = drtaint_get_reg_taint(drcontext, reg, &res);
-        DR_ASSERT(ok);
-        ok = drtaint_set_app_taint4(drcontext, addr, res);
-        DR_ASSERT(ok);
-    }
+    instrlist_meta_preinsert(ilist, where, cont);
+    insert_fast_restore(drcontext, ilist, where, regs, 2, regs[1]);
 }
 
+template <typename policy>
 static void
-propagate_stmXX(void *drcontext, instrlist_t *ilist, instr_t *where)
+insert_profile_guard(void *drcontext, void *tag, instrlist_t *ilist, instr_t *where,
+                     block_data_t *data)
+/*
+ *    A block which didn't meet taint gets the checks of the fast copy,
+ *    see DRTAINT_OPTION_DUAL_BLOCKS, and no propagation:
+ *
+ *           b entry
+ *    trip:  clean call profile_trip
+ *    entry: jump to trip if a register may be tainted
+ *           I1          jump to trip if the accessed region may hold taint
+ *           ...
+ */
 {
-    int opcode = instr_get_opcode(where);
-
-    switch (opcode)
+    if (drmgr_is_first_instr(drcontext, where))
     {
-    case OP_stmia:
-        dr_insert_clean_call(
-            drcontext, ilist, where, (void *)propagate_stm_cc_template<IA>, false, 3,
-            OPND_CREATE_INTPTR(instr_get_app_pc(where)),
-            opnd_create_reg(opnd_get_base(instr_get_dst(where, 0))),
-            OPND_CREATE_INT(instr_num_dsts(where) > 1));
-        break;
-
-    case OP_stmdb:
-        dr_insert_clean_call(
-            drcontext, ilist, where, (void *)propagate_stm_cc_template<DB>, false, 3,
-            OPND_CREATE_INTPTR(instr_get_app_pc(where)),
-            opnd_create_reg(opnd_get_base(instr_get_dst(where, 0))),
-            OPND_CREATE_INT(instr_num_dsts(where) > 1));
-        break;
-
-    case OP_stmib:
-        dr_insert_clean_call(
-            drcontext, ilist, where, (void *)propagate_stm_cc_template<IB>, false, 3,
-            OPND_CREATE_INTPTR(instr_get_app_pc(where)),
-            opnd_create_reg(opnd_get_base(instr_get_dst(where, 0))),
-            OPND_CREATE_INT(instr_num_dsts(where) > 1));
-        break;
-
-    case OP_stmda:
-        dr_insert_clean_call(
-            drcontext, ilist, where, (void *)propagate_stm_cc_template<DA>, false, 3,
-            OPND_CREATE_INTPTR(instr_get_app_pc(where)),
-            opnd_create_reg(opnd_get_base(instr_get_dst(where, 0))),
-            OPND_CREATE_INT(instr_num_dsts(where) > 1));
-        break;
+        auto pred = disabled_autopredication(ilist);
+        instr_t *entry = INSTR_CREATE_label(drcontext);
 
-    default:
-        DR_ASSERT(false);
+        data->trip = INSTR_CREATE_label(drcontext);
+        instrlist_meta_preinsert(ilist, where,
+                                 XINST_CREATE_jump(drcontext, // b entry
+                                                   opnd_create_instr(entry)));
+        instrlist_meta_preinsert(ilist, where, data->trip);
+        // profile_trip doesn't return to the cache
+        dr_insert_clean_call(drcontext, ilist, where, (void *)profile_trip, true, 1,
+                             OPND_CREATE_INTPTR(dr_fragment_app_pc(tag)));
+        instrlist_meta_preinsert(ilist, where, entry);
+        insert_profile_entry(drcontext, ilist, where, data->trip, instr_get_app_pc(where));
     }
-}
 
-#pragma endregion load_store_multiple
+    if (instr_is_app(where))
+        insert_fast_checks<policy>(drcontext, ilist, where, data->trip, instr_get_app_pc(where));
 
-#pragma region no_taint
+    if (drmgr_is_last_instr(drcontext, where))
+        dr_thread_free(drcontext, data, sizeof(block_data_t));
+}
 
 static void
-propagate_mov_imm_src(void *drcontext, instrlist_t *ilist, instr_t *where)
+insert_dual_stub(void *drcontext, instrlist_t *ilist, instr_t *where, instr_t *stub)
 /*
- *    mov reg2, imm1
- *
- *    Saves the value of 0 to the shadow register
- *    of reg2 because moving constant to reg2 untaints reg2
+ *    Placed before the slow copy, the fast one jumps over it
  */
 {
-    reg_id_t reg2 = opnd_get_reg(instr_get_dst(where, 0));
+    reg_id_t regs[2];
+    auto pred = disabled_autopredication(ilist);
 
-    auto sreg2 = drreg_reservation{drcontext, ilist, where};
-    auto simm2 = drreg_reservation{drcontext, ilist, where};
-
-    // get shadow register address of reg2 and place it to sreg2
-    drtaint_insert_reg_to_taint(drcontext, ilist, where, reg2, sreg2);
+    pick_scratch_regs(opnd_create_null(), regs, 2);
+    instrlist_meta_preinsert(ilist, where, stub);
+    insert_fast_restore(drcontext, ilist, where, regs, 2, regs[1]);
+}
 
-    // place constant imm to register simm2
-    instrlist_meta_preinsert(ilist, where,
-                             XINST_CREATE_move(drcontext, // mov simm2, 0
-                                               opnd_create_reg(simm2),
-                                               OPND_CREATE_INT32(0)));
+static void
+insert_any_reg_tainted_update(void *drcontext, instrlist_t *ilist, instr_t *where)
+/*
+ *    At the end of the slow copy: registers might be tainted
+ *    or untainted by the block, recompute the flag
+ */
+{
+    reg_id_t regs[3];
+    auto pred = disabled_autopredication(ilist);
 
-    // move propagation to shadow register of reg2 the value of imm1
-    instrlist_meta_preinsert(ilist, where,
-                             XINST_CREATE_store(drcontext, // str simm2, [sreg2]
-                                                OPND_CREATE_MEM32(sreg2, 0),
-                                                opnd_create_reg(simm2)));
+    pick_scratch_regs(opnd_create_null(), regs, 3);
+    insert_fast_spill(drcontext, ilist, where, regs, 3);
+    ds_insert_any_reg_tainted_update(drcontext, ilist, where, regs[0], regs[1], regs[2]);
+    insert_fast_restore(drcontext, ilist, where, regs, 3, DR_REG_NULL);
 }
 
-static bool
-special_cases_not_propagate(void *drcontext, instrlist_t *ilist, instr_t *where)
+static void
+insert_any_reg_tainted_or(void *drcontext, instrlist_t *ilist, instr_t *where)
 /*
- *    xor r0, r1, r1
- *
- *    This instructions causes r0 to be untainted
+ *    Loads which aren't followed by insert_any_reg_tainted_update,
+ *    i.e. the last instruction and those of blocks without copies,
+ *    set the flag if they read a region which may hold taint
  */
 {
-    int opcode = instr_get_opcode(where);
+    auto pred = disabled_autopredication(ilist);
 
-    if (opcode == OP_eor ||
-        opcode == OP_eors ||
-        opcode == OP_sub ||
-        opcode == OP_subs ||
-        opcode == OP_sbc ||
-        opcode == OP_sbcs)
+    for (int i = 0; i < instr_num_srcs(where); i++)
     {
-        if (!opnd_is_reg(instr_get_src(where, 0)))
-            return false;
+        opnd_t mem = instr_get_src(where, i);
+        if (!opnd_is_memory_reference(mem))
+            continue;
 
-        if (!opnd_is_reg(instr_get_src(where, 1)))
-            return false;
+        auto saddr = drreg_reservation{drcontext, ilist, where};
+        auto ssum = drreg_reservation{drcontext, ilist, where};
+        auto sflag = drreg_reservation{drcontext, ilist, where};
 
-        if (opnd_get_reg(instr_get_src(where, 0)) !=
-            opnd_get_reg(instr_get_src(where, 1)))
-            return false;
+        drutil_insert_get_mem_addr(drcontext, ilist, where, mem, saddr, ssum);
+        ds_insert_app_to_summary_load(drcontext, ilist, where, saddr, ssum);
+        ds_insert_any_reg_tainted_or(drcontext, ilist, where, ssum, saddr, sflag);
+    }
+}
 
-        // mov r1, imm
-        propagate_mov_imm_src(drcontext, ilist, where);
-        return true;
+static void
+handle_dual_label(void *drcontext, instrlist_t *ilist, instr_t *where, block_data_t *data)
+{
+    if (is_dual_label(where, DUAL_NOTE_FAST))
+    {
+        insert_dual_entry(drcontext, ilist, where, data->entry_stub);
+        data->in_fast = true;
+    }
+    else if (is_dual_label(where, DUAL_NOTE_SLOW))
+    {
+        insert_dual_stub(drcontext, ilist, where, data->entry_stub);
+        data->in_fast = false;
+        data->in_slow = true;
+
+        // nothing is known at the slow copy entry
+        data->clean_regs = 0;
+    }
+    else if (is_dual_label(where, DUAL_NOTE_DONE))
+    {
+        insert_any_reg_tainted_update(drcontext, ilist, where);
+        data->in_slow = false;
     }
-    return false;
 }
 
 static void
-untaint_stack(void *drcontext, app_pc sp_val, ptr_int_t imm)
+release_block_base(void *drcontext, instrlist_t *ilist, instr_t *where, block_data_t *data)
+{
+    uint saved = ds_clear_shadow_base(drcontext);
+
+    drreg_status_t status = drreg_unreserve_register(drcontext, ilist, where, data->shadow_base);
+    DR_ASSERT(status == DRREG_SUCCESS);
+
+    if (!data->translating)
+    {
+        __atomic_fetch_add(&stat_hoisted_blocks, 1, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&stat_hoist_saved, saved, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&stat_hoist_setup, data->setup, __ATOMIC_RELAXED);
+    }
+}
+
+template <typename policy>
+static plan_t
+get_plan(instr_t *where, block_data_t *data)
 /*
- *    Routine for clearing stack frames before their allocation
+ *    The plan cached for %where% or a new one, cached if the module
+ *    has a plan file. Plans don't depend on the block, see classify_instr
  */
 {
-    drtaint_set_app_area_taint(drcontext, sp_val - imm, imm, 0);
+    app_pc pc = instr_get_app_pc(where);
+    byte *slot = NULL;
+
+    if (data->plans != NULL && pc >= data->plans_start && pc < data->plans_end)
+        slot = &data->plans[(pc - data->plans_start) >> 1];
+
+    if (slot != NULL && *slot != PLAN_UNKNOWN && *slot < PLAN_COUNT)
+    {
+        if (!data->translating)
+            __atomic_fetch_add(&stat_plan_hits, 1, __ATOMIC_RELAXED);
+        return (plan_t)*slot;
+    }
+
+    plan_t plan = classify_instr<policy>(where);
+    if (slot != NULL)
+    {
+        *slot = plan;
+        if (!data->translating)
+            __atomic_fetch_add(&stat_plan_misses, 1, __ATOMIC_RELAXED);
+    }
+    return plan;
 }
 
-#pragma endregion no_taint
+template <typename policy>
+static void
+propagate_instr(void *drcontext, instrlist_t *ilist, instr_t *where, void *user_data)
+{
+    // handle only application instructions
+    if (instr_is_meta(where))
+        return;
 
-#pragma endregion taint_propagation
+    // untaint stack area when allocating a new frame
+    if (policy::untaint_stack && is_stack_frame_alloc(where))
+        untaint_stack_frame(drcontext, ilist, where);
 
-#pragma region event_app_handler
+    plan_t plan = get_plan<policy>(where, (block_data_t *)user_data);
+    if (propagate_default_isa<policy>(drcontext, ilist, where, user_data, plan))
+        return;
 
-/* ======================================================================================
- * main: event app instruction handler
- * ==================================================================================== */
+    propagate_simd_isa(drcontext, ilist, where, user_data);
+}
+
+static uint
+block_code_size(void *drcontext, instrlist_t *ilist)
+/*
+ *    Encoded size of the instrumented block, drreg's spills
+ *    and restores included. DR's mangling and the exit stubs
+ *    are added after the last client pass, so it is a lower
+ *    bound of what the block takes in the code cache
+ */
+{
+    uint size = 0;
+
+    for (instr_t *instr = instrlist_first(ilist); instr != NULL; instr = instr_get_next(instr))
+    {
+        // branches to labels can't be encoded yet, they are 4 bytes at most
+        if (instr_is_cti(instr) && opnd_is_instr(instr_get_target(instr)))
+            size += 4;
+        else
+            size += instr_length(drcontext, instr);
+    }
+    return size;
+}
 
 static dr_emit_flags_t
-event_app_instruction(void *drcontext, void *tag, instrlist_t *ilist, instr_t *where,
-                      bool for_trace, bool translating, void *user_data)
+event_bb_measure(void *drcontext, void *tag, instrlist_t *bb,
+                 bool for_trace, bool translating)
+/*
+ *    Counts the size of blocks built with propagation, see
+ *    DRTAINT_OPTION_STATS_REPORT
+ */
 {
-    // handle only application instructions
-    if (instr_is_meta(where))
+    if (translating)
         return DR_EMIT_DEFAULT;
 
-    int opcode = instr_get_opcode(where);
-
-    // untaint stack area when allocating a new frame
-    if (opcode == OP_sub || opcode == OP_subs)
+    for (instr_t *instr = instrlist_first(bb); instr != NULL; instr = instr_get_next(instr))
     {
-        if (opnd_get_reg(instr_get_dst(where, 0)) == DR_REG_SP &&
-            opnd_get_reg(instr_get_src(where, 0)) == DR_REG_SP &&
-            opnd_is_immed(instr_get_src(where, 1)))
+        if (instr_is_label(instr) && (ptr_uint_t)instr_get_note(instr) == measure_note)
         {
-            dr_insert_clean_call(drcontext, ilist, where, (void *)untaint_stack, false, 3,
-                                 OPND_CREATE_INTPTR(drcontext),
-                                 opnd_create_reg(DR_REG_SP),
-                                 instr_get_src(where, 1));
+            instrlist_remove(bb, instr);
+            instr_destroy(drcontext, instr);
+
+            __atomic_fetch_add(&stat_built_bytes, block_code_size(drcontext, bb),
+                               __ATOMIC_RELAXED);
+            break;
         }
     }
 
-    if (propagate_default_isa(drcontext, ilist, where, user_data))
-        return DR_EMIT_DEFAULT;
-
-    propagate_simd_isa(drcontext, ilist, where, user_data);
     return DR_EMIT_DEFAULT;
 }
 
-/* ======================================================================================
- * default ISA taint propagation handling
- * ==================================================================================== */
-
-static bool
-propagate_load_store(void *drcontext, instrlist_t *ilist, instr_t *where)
+static dr_emit_flags_t
+event_app_instruction(void *drcontext, void *tag, instrlist_t *ilist, instr_t *where,
+                      bool for_trace, bool translating, void *user_data)
 {
-    // Handle ldmXX, stmXX, ldrXX, strXX
+    block_data_t *data = (block_data_t *)user_data;
 
-    int opcode = instr_get_opcode(where);
+    // built before the first taint or excluded, see event_bb_analysis
+    if (data == NULL)
+        return DR_EMIT_DEFAULT;
 
-    if (instr_group_is_ldm(opcode))
+    if (data->guarded)
     {
-        propagate_ldmXX(drcontext, ilist, where);
-        return true;
+        insert_profile_guard<DRTAINT_POLICY>(drcontext, tag, ilist, where, data);
+        return DR_EMIT_DEFAULT;
     }
 
-    if (instr_group_is_stm(opcode))
+    // a stale base of an unfinished block must not leak into this one
+    if (drmgr_is_first_instr(drcontext, where))
     {
-        propagate_stmXX(drcontext, ilist, where);
-        return true;
+        // the setup must run even if the first instruction is predicated
+        auto pred = disabled_autopredication(ilist);
+
+        ds_clear_residents(drcontext, NULL, NULL);
+        ds_clear_shadow_base(drcontext);
+        ds_stop_coalescing(drcontext);
+        ds_take_stub_calls(drcontext);
+
+        if (data->hoist_base)
+            insert_block_base(drcontext, ilist, where, data);
+        if (data->coalesce_base != DR_REG_NULL)
+            start_coalescing(drcontext, ilist, where, data);
+        if (data->num_resident > 0 && data->shadow_base != DR_REG_NULL)
+            make_residents(drcontext, ilist, where, data);
     }
 
-    if (instr_group_is_load(opcode))
+    if (data->dual)
+        handle_dual_label(drcontext, ilist, where, data);
+
+    if (data->loop_head != NULL && drmgr_is_first_instr(drcontext, where))
+        insert_loop_entry(drcontext, ilist, tag, data);
+
+    // the last instruction works with the shadow register file
+    if (data->num_holders > 0 && drmgr_is_last_instr(drcontext, where))
+        release_residents(drcontext, ilist, where, data);
+
+    // guarded blocks check the flag, the slow copy updates it itself
+    if (profile_enabled && !data->dual && drmgr_is_last_instr(drcontext, where))
+        insert_any_reg_tainted_update(drcontext, ilist, where);
+
+    if (instr_is_app(where) && data->in_fast)
+    {
+        insert_fast_checks<DRTAINT_POLICY>(drcontext, ilist, where,
+                                           data->slow_pos[data->cur_dup++], NULL);
+        data->cur_app++;
+    }
+    else if (instr_is_app(where))
     {
-        if (instr_group_is_ldrb(opcode))
-            propagate_ldr<BYTE>(drcontext, ilist, where);
+        if ((TEST(DRTAINT_OPTION_DUAL_BLOCKS, options.flags) || profile_enabled) &&
+            !data->in_slow && instr_reads_memory(where))
+            insert_any_reg_tainted_or(drcontext, ilist, where);
 
-        else if (instr_group_is_ldrh(opcode))
-            propagate_ldr<HALF>(drcontext, ilist, where);
+        bool writeback = data->num_holders > 0 && needs_resident_writeback<DRTAINT_POLICY>(where);
+        if (writeback)
+            ds_resident_writeback(drcontext, ilist, where);
 
-        else if (instr_group_is_ldr(opcode))
-            propagate_ldr<WORD>(drcontext, ilist, where);
+        // a dead shadow write, the destination is overwritten later,
+        // or a copy handled at the loop exit
+        bool propagated = !data->dead[data->cur_app] &&
+                          where != data->loop_load && where != data->loop_store;
 
-        else if (instr_group_is_ldrd(opcode))
-            propagate_ldrd(drcontext, ilist, where);
+        if (data->loop_head != NULL && drmgr_is_last_instr(drcontext, where))
+            insert_loop_exit(drcontext, ilist, where, tag, data);
+        if (propagated)
+            propagate_instr<DRTAINT_POLICY>(drcontext, ilist, where, user_data);
 
-        else
-            DR_ASSERT(false);
+        // the handler might change the file directly
+        if (writeback)
+            ds_resident_invalidate(drcontext);
 
-        return true;
-    }
+        update_clean_regs<DRTAINT_POLICY>(data, where, propagated);
+        ds_coalescing_update(drcontext, where);
 
-    if (instr_group_is_store(opcode))
-    {
-        if (instr_group_is_strb(opcode))
-            propagate_str<BYTE>(drcontext, ilist, where);
+        // most syscalls aren't filtered, see event_filter_syscall
+        if (instr_is_syscall(where))
+            untaint_syscall_result(drcontext, ilist, where);
+
+        // the shadow register file is up to date before ctis
+        if (scope_enabled && instr_is_cti(where))
+            insert_boundary_summary(drcontext, ilist, where);
 
-        else if (instr_group_is_strh(opcode))
-            propagate_str<HALF>(drcontext, ilist, where);
+        data->cur_app++;
+    }
 
-        else if (instr_group_is_str(opcode))
-            propagate_str<WORD>(drcontext, ilist, where);
+    if (drmgr_is_last_instr(drcontext, where))
+    {
+        if (data->coalesce_cache != DR_REG_NULL)
+            stop_coalescing(drcontext, ilist, where, data);
 
-        else if (instr_group_is_strd(opcode))
-            propagate_strd(drcontext, ilist, where);
+        if (data->shadow_base != DR_REG_NULL)
+            release_block_base(drcontext, ilist, where, data);
 
-        else
-            DR_ASSERT(false);
+        uint stub_calls = ds_take_stub_calls(drcontext);
+        if (!translating && TEST(DRTAINT_OPTION_STATS_REPORT, options.flags))
+        {
+            __atomic_fetch_add(&stat_built_blocks, 1, __ATOMIC_RELAXED);
+            __atomic_fetch_add(&stat_translate_ns, ds_time_ns() - data->start_ns,
+                               __ATOMIC_RELAXED);
+            __atomic_fetch_add(&stat_stub_calls, stub_calls, __ATOMIC_RELAXED);
+
+            instr_t *mark = INSTR_CREATE_label(drcontext);
+            instr_set_note(mark, (void *)measure_note);
+            instrlist_meta_preinsert(ilist, where, mark);
+        }
 
-        return true;
+        if (data->plans != NULL)
+            release_plans();
+        if (data->dead != NULL)
+            dr_thread_free(drcontext, data->dead, data->num_app);
+        if (data->slow_pos != NULL)
+            dr_thread_free(drcontext, data->slow_pos, data->num_dup * sizeof(instr_t *));
+        dr_thread_free(drcontext, data, sizeof(block_data_t));
     }
 
-    return false;
+    return DR_EMIT_DEFAULT;
 }
 
+/* ======================================================================================
+ * default ISA taint propagation handling
+ * ==================================================================================== */
 
-static bool
-propagate_default_isa(void *drcontext, instrlist_t *ilist, instr_t *where, void *user_data)
+template <typename policy>
+static plan_t
+classify_instr(instr_t *where)
+/*
+ *    Choose the handler of %where%. The choice depends on the
+ *    instruction and the policy only, not on the block
+ */
 {
-    if (special_cases_not_propagate(drcontext, ilist, where))
-        return true;
+    if (policy::zeroing_idioms && instr_is_zeroing_idiom(where))
+        return PLAN_ZEROING;
 
-    if (propagate_load_store(drcontext, ilist, where))
-        return true;
+    return opcode_plan(where);
+}
 
-    switch (instr_get_opcode(where))
+template <typename policy>
+static bool
+propagate_default_isa(void *drcontext, instrlist_t *ilist, instr_t *where, void *user_data,
+                      plan_t plan)
+{
+    // mov r1, imm
+    if (plan == PLAN_ZEROING)
     {
+        propagate_mov_imm_src(drcontext, ilist, where);
+        return true;
+    }
 
-    case OP_mov:
-    case OP_mvn:
-    case OP_mvns:
-    case OP_movs:
-    case OP_movw:
-    case OP_movt:
-
-        if (opnd_is_reg(instr_get_src(where, 0)))
-            propagate_mov_reg_src(drcontext, ilist, where);
-        else
-            propagate_mov_imm_src(drcontext, ilist, where);
-
-        break;
-
-    case OP_rrx:
-    case OP_rrxs:
-    case OP_sbfx:
-    case OP_ubfx:
-    case OP_uxtb:
-    case OP_uxth:
-    case OP_sxtb:
-    case OP_sxtb16:
-    case OP_sxth:
-    case OP_uxtb16:
-    case OP_rev:
-    case OP_rev16:
-    case OP_revsh:
-    case OP_rbit:
-    case OP_bfi:
-    case OP_clz:
-
-        /* These aren't mov's per se, but they only accept 1
-         * reg source and 1 reg dest.
-         */
-
-        // some instructions contain optional Rd
-        if (instr_num_dsts(where) > 0)
-            propagate_mov_reg_src(drcontext, ilist, where);
+    if (propagate_statically_clean(drcontext, ilist, where, (block_data_t *)user_data))
+        return true;
 
+    switch (plan)
+    {
+    case PLAN_LDM:
+        propagate_ldmXX(drcontext, ilist, where);
         break;
 
-    // op rd, r1, op2
-    case OP_adc:
-    case OP_adcs:
-    case OP_add:
-    case OP_adds:
-    case OP_addw:
-    case OP_rsb:
-    case OP_rsbs:
-    case OP_rsc:
-    case OP_rscs:
-    case OP_sbc:
-    case OP_sbcs:
-    case OP_sub:
-    case OP_subw:
-    case OP_subs:
-    case OP_and:
-    case OP_ands:
-    case OP_bic:
-    case OP_bics:
-    case OP_eor:
-    case OP_eors:
-    case OP_orr:
-    case OP_orrs:
-    case OP_ror:
-    case OP_rors:
-    case OP_lsl:
-    case OP_lsls:
-    case OP_lsr:
-    case OP_lsrs:
-    case OP_asr:
-    case OP_asrs:
-    case OP_orn:
-    case OP_orns:
-
-        // some instructions contain optional Rd
-        if (instr_num_dsts(where) > 0)
-        {
-            if (opnd_is_reg(instr_get_src(where, 1)))
-                propagate_arith_reg_reg(drcontext, ilist, where);
-            else
-                propagate_arith_reg_imm(drcontext, ilist, where);
-        }
+    case PLAN_STM:
+        propagate_stmXX(drcontext, ilist, where);
+        break;
 
+    case PLAN_LDRB:
+        propagate_ldr<BYTE, policy>(drcontext, ilist, where);
         break;
 
-    // op rd, r1, r2
-    case OP_mul:
-    case OP_muls:
-
-    case OP_shsub16:
-    case OP_shsub8:
-    case OP_sdiv:
-    case OP_sadd16:
-    case OP_sadd8:
-    case OP_sasx:
-    case OP_ssax:
-    case OP_ssub16:
-    case OP_ssub8:
-    case OP_sxtab:
-    case OP_sxtab16:
-    case OP_sxtah:
-
-    case OP_qadd:
-    case OP_qadd16:
-    case OP_qadd8:
-    case OP_qasx:
-    case OP_qdadd:
-    case OP_qdsub:
-    case OP_qsax:
-    case OP_qsub:
-    case OP_qsub16:
-    case OP_qsub8:
-
-    case OP_udiv:
-    case OP_uadd8:
-    case OP_uadd16:
-    case OP_usax:
-    case OP_usub16:
-    case OP_usub8:
-    case OP_uasx:
-    case OP_uqadd16:
-    case OP_uqadd8:
-    case OP_uqasx:
-    case OP_uqsax:
-    case OP_uqsub16:
-    case OP_usad8:
-
-    case OP_uhadd16:
-    case OP_uhadd8:
-    case OP_uhasx:
-    case OP_uhsax:
-    case OP_uhsub16:
-    case OP_uhsub8:
-
-    case OP_smmul:
-    case OP_smmulr:
-    case OP_smuad:
-    case OP_smuadx:
-    case OP_smulbb:
-    case OP_smulbt:
-    case OP_smultb:
-    case OP_smultt:
-    case OP_smulwb:
-    case OP_smulwt:
-    case OP_smusd:
-    case OP_smusdx:
-
-    case OP_uxtab:
-    case OP_uxtab16:
-    case OP_uxtah:
-
-        if (instr_num_dsts(where) > 0) // some instructions contain optional Rd
-            propagate_arith_reg_reg(drcontext, ilist, where);
+    case PLAN_LDRH:
+        propagate_ldr<HALF, policy>(drcontext, ilist, where);
+        break;
 
+    case PLAN_LDR:
+        propagate_ldr<WORD, policy>(drcontext, ilist, where);
         break;
 
-    // op rd1, rd2, r1, r2
-    case OP_smull:
-    case OP_smulls:
-    case OP_umull:
-    case OP_umulls:
+    case PLAN_LDRD:
+        propagate_ldrd(drcontext, ilist, where);
+        break;
 
-        propagate_mull(drcontext, ilist, where);
+    case PLAN_STRB:
+        propagate_str<BYTE>(drcontext, ilist, where);
         break;
 
-    // op rdlo, rdhi, r1, r2
-    case OP_smlal:
-    case OP_smlalbb:
-    case OP_smlalbt:
-    case OP_smlald:
-    case OP_smlaldx:
-    case OP_smlals:
-    case OP_smlaltb:
-    case OP_smlaltt:
-    case OP_smlsld:
-    case OP_smlsldx:
-    case OP_umaal:
-    case OP_umlal:
-    case OP_umlals:
+    case PLAN_STRH:
+        propagate_str<HALF>(drcontext, ilist, where);
+        break;
 
-        propagate_smlal(drcontext, ilist, where);
+    case PLAN_STR:
+        propagate_str<WORD>(drcontext, ilist, where);
         break;
 
-    // op rd, r1, r2, r3
-    case OP_mla:
-    case OP_mlas:
-    case OP_mls:
-
-    case OP_smlabb:
-    case OP_smlabt:
-    case OP_smlatb:
-    case OP_smlatt:
-    case OP_smlad:
-    case OP_smladx:
-    case OP_smlawb:
-    case OP_smlawt:
-    case OP_smlsd:
-    case OP_smlsdx:
-    case OP_smmla:
-    case OP_smmlar:
-    case OP_smmls:
-    case OP_smmlsr:
-    case OP_usada8:
+    case PLAN_STRD:
+        propagate_strd(drcontext, ilist, where);
+        break;
 
-        propagate_1rd_3rs(drcontext, ilist, where);
+    case PLAN_MOV_REG:
+        propagate_mov_reg_src(drcontext, ilist, where);
         break;
 
-    case OP_pkhbt:
+    case PLAN_MOV_IMM:
+        propagate_mov_imm_src(drcontext, ilist, where);
+        break;
 
-        propagate_pkhXX(drcontext, ilist, where, true);
+    case PLAN_ARITH_REG_REG:
+        propagate_arith_reg_reg(drcontext, ilist, where);
         break;
 
-    case OP_pkhtb:
+    case PLAN_ARITH_REG_IMM:
+        propagate_arith_reg_imm(drcontext, ilist, where);
+        break;
 
-        propagate_pkhXX(drcontext, ilist, where, false);
+    case PLAN_MULL:
+        propagate_mull(drcontext, ilist, where);
         break;
 
-        // ===================================
+    case PLAN_SMLAL:
+        propagate_smlal(drcontext, ilist, where);
+        break;
 
-    case OP_swp:
-    case OP_swpb:
+    case PLAN_1RD_3RS:
+        propagate_1rd_3rs(drcontext, ilist, where);
         break;
 
-    case OP_usat:
-    case OP_usat16:
-    case OP_ssat:
-    case OP_ssat16:
+    case PLAN_PKHBT:
+        propagate_pkhXX(drcontext, ilist, where, true);
+        break;
 
+    case PLAN_PKHTB:
+        propagate_pkhXX(drcontext, ilist, where, false);
         break;
-        // ===================================
 
-    case OP_bl:
-    case OP_blx:
-    case OP_blx_ind:
+    case PLAN_CALL:
+    case PLAN_CALL_REG:
 
         // lr containts next instruction address after pc
         // then taint lr
         propagate_mov_regs(drcontext, ilist, where,
                            DR_REG_LR, DR_REG_PC);
 
-        // fallthrough, we could have a register dest
-
-    case OP_bxj:
-    case OP_bx:
-    case OP_b:
-    case OP_b_short:
-
-        // could have register destination
-        if (opnd_is_reg(instr_get_src(where, 0)))
+        if (plan == PLAN_CALL_REG)
         {
             propagate_mov_regs(drcontext, ilist, where,
                                opnd_get_reg(instr_get_src(where, 0)),
                                DR_REG_PC);
         }
+        break;
+
+    case PLAN_BRANCH_REG:
 
-        // we don't have to do anything for immediates
+        propagate_mov_regs(drcontext, ilist, where,
+                           opnd_get_reg(instr_get_src(where, 0)),
+                           DR_REG_PC);
+        break;
+
+    case PLAN_NOTHING:
         break;
 
     default:
@@ -1396,19 +5026,410 @@ drsys_iter_cb(drsys_arg_t *arg, void *drcontext)
     return true;
 }
 
-static bool
-event_pre_syscall(void *drcontext, int sysnum)
+
+/* parameters saved in event_pre_syscall, they can't be read after */
+typedef struct _syscall_args_t
+{
+    ptr_uint_t arg[6];
+
+    /* size of the peer address buffer of recvfrom and recvmsg,
+     * the kernel sets the length to the whole address after
+     */
+    socklen_t addrlen;
+} syscall_args_t;
+
+/* Handles a successful syscall with %result%. Syscalls having no
+ * handler don't write memory, they aren't filtered at all
+ */
+typedef void (*syscall_handler_t)(void *drcontext, const ptr_uint_t *arg, reg_t result);
+
+/* kernel's struct stat and struct stat64 on ARM EABI */
+#define KERNEL_STAT_SIZE 64
+#define KERNEL_STAT64_SIZE 104
+
+#define MAX_SYSNUM 512
+
+static syscall_handler_t syscall_handlers[MAX_SYSNUM];
+
+static inline void
+untaint_area(void *drcontext, ptr_uint_t app, size_t size)
+{
+    if (app != 0 && size > 0)
+        drtaint_set_app_area_taint(drcontext, (app_pc)app, (uint)size, 0);
+}
+
+static void
+untaint_iovecs(void *drcontext, const struct iovec *iov, int count, size_t size)
+/*
+ *   The first %size% bytes of the buffers of %iov%
+ */
+{
+    for (int i = 0; i < count && size > 0; i++)
+    {
+        struct iovec vec;
+        if (!dr_safe_read(&iov[i], sizeof(vec), &vec, NULL))
+            return;
+
+        size_t len = vec.iov_len < size ? vec.iov_len : size;
+        untaint_area(drcontext, (ptr_uint_t)vec.iov_base, len);
+        size -= len;
+    }
+}
+
+static inline socklen_t
+saved_addrlen(const ptr_uint_t *arg)
+/*
+ *   Handlers get the arg member of syscall_args_t
+ */
+{
+    return ((const syscall_args_t *)arg)->addrlen;
+}
+
+static socklen_t
+address_buffer_size(int sysnum, const ptr_uint_t *arg)
+/*
+ *   The size of the peer address buffer before the syscall
+ */
+{
+    socklen_t len = 0;
+
+#ifdef SYS_recvfrom
+    if (sysnum == SYS_recvfrom && arg[4] != 0 && arg[5] != 0 &&
+        !dr_safe_read((void *)arg[5], sizeof(len), &len, NULL))
+        len = 0;
+#endif
+#ifdef SYS_recvmsg
+    struct msghdr hdr;
+    if (sysnum == SYS_recvmsg && dr_safe_read((void *)arg[1], sizeof(hdr), &hdr, NULL))
+        len = hdr.msg_namelen;
+#endif
+
+    return len;
+}
+
+static void
+untaint_sockaddr(void *drcontext, ptr_uint_t addr, ptr_uint_t addrlen, socklen_t size)
+/*
+ *   The address is truncated to the %size% bytes
+ *   of the buffer, the length is not
+ */
+{
+    socklen_t len;
+
+    if (addr == 0 || addrlen == 0 ||
+        !dr_safe_read((void *)addrlen, sizeof(len), &len, NULL))
+        return;
+
+    untaint_area(drcontext, addr, len < size ? len : size);
+    untaint_area(drcontext, addrlen, sizeof(len));
+}
+
+static void
+handle_read(void *drcontext, const ptr_uint_t *arg, reg_t result)
+/*
+ *   read, pread64, recv, getdents, getdents64: result bytes at arg 1
+ */
+{
+    untaint_area(drcontext, arg[1], result);
+}
+
+static void
+handle_recvfrom(void *drcontext, const ptr_uint_t *arg, reg_t result)
+{
+    untaint_area(drcontext, arg[1], result);
+    untaint_sockaddr(drcontext, arg[4], arg[5], saved_addrlen(arg));
+}
+
+static void
+handle_readv(void *drcontext, const ptr_uint_t *arg, reg_t result)
+/*
+ *   readv, preadv
+ */
+{
+    untaint_iovecs(drcontext, (const struct iovec *)arg[1], (int)arg[2], result);
+}
+
+static void
+handle_recvmsg(void *drcontext, const ptr_uint_t *arg, reg_t result)
+/*
+ *   The data, the address and the control data, the kernel
+ *   updates their lengths and the flags in the header
+ */
+{
+    struct msghdr *msg = (struct msghdr *)arg[1];
+    struct msghdr hdr;
+
+    if (!dr_safe_read(msg, sizeof(hdr), &hdr, NULL))
+        return;
+
+    untaint_iovecs(drcontext, hdr.msg_iov, (int)hdr.msg_iovlen, result);
+    untaint_area(drcontext, (ptr_uint_t)hdr.msg_name,
+                 hdr.msg_namelen < saved_addrlen(arg) ? hdr.msg_namelen : saved_addrlen(arg));
+    untaint_area(drcontext, (ptr_uint_t)hdr.msg_control, hdr.msg_controllen);
+    untaint_area(drcontext, (ptr_uint_t)&msg->msg_namelen, sizeof(hdr.msg_namelen));
+    untaint_area(drcontext, (ptr_uint_t)&msg->msg_controllen, sizeof(hdr.msg_controllen));
+    untaint_area(drcontext, (ptr_uint_t)&msg->msg_flags, sizeof(hdr.msg_flags));
+}
+
+static void
+handle_fstat(void *drcontext, const ptr_uint_t *arg, reg_t result)
+{
+    untaint_area(drcontext, arg[1], KERNEL_STAT_SIZE);
+}
+
+static void
+handle_stat64(void *drcontext, const ptr_uint_t *arg, reg_t result)
+/*
+ *   stat64, lstat64, fstat64
+ */
+{
+    untaint_area(drcontext, arg[1], KERNEL_STAT64_SIZE);
+}
+
+static void
+handle_fstatat64(void *drcontext, const ptr_uint_t *arg, reg_t result)
+{
+    untaint_area(drcontext, arg[2], KERNEL_STAT64_SIZE);
+}
+
+static void
+handle_epoll_wait(void *drcontext, const ptr_uint_t *arg, reg_t result)
+/*
+ *   epoll_wait, epoll_pwait: result events at arg 1
+ */
+{
+    untaint_area(drcontext, arg[1], result * sizeof(struct epoll_event));
+}
+
+static void
+handle_clock_gettime(void *drcontext, const ptr_uint_t *arg, reg_t result)
+{
+    untaint_area(drcontext, arg[1], sizeof(struct timespec));
+}
+
+static void
+handle_gettimeofday(void *drcontext, const ptr_uint_t *arg, reg_t result)
+{
+    untaint_area(drcontext, arg[0], sizeof(struct timeval));
+    untaint_area(drcontext, arg[1], sizeof(struct timezone));
+}
+
+static void
+handle_drsys(void *drcontext, const ptr_uint_t *arg, reg_t result)
+/*
+ *   Any other syscall with memory outputs, drsyscall knows their layout
+ */
 {
     drmf_status_t status = drsys_iterate_memargs(
         drcontext, drsys_iter_cb, drcontext);
 
     DR_ASSERT(status == DRMF_SUCCESS);
+}
+
+static void
+handle_mmap(void *drcontext, const ptr_uint_t *arg, reg_t result)
+{
+    ds_add_app_area(drcontext, (app_pc)result, ALIGN_FORWARD(arg[1], dr_page_size()));
+}
+
+static void
+handle_munmap(void *drcontext, const ptr_uint_t *arg, reg_t result)
+/*
+ *   Memory the application gave back to the kernel can't hold
+ *   taint anymore, so its shadow is released
+ */
+{
+    ds_reclaim_app_area(drcontext, (app_pc)arg[0],
+                        (uint)ALIGN_FORWARD(arg[1], dr_page_size()));
+}
+
+static void
+handle_mremap(void *drcontext, const ptr_uint_t *arg, reg_t result)
+{
+    app_pc old_addr = (app_pc)arg[0];
+    uint old_size = (uint)ALIGN_FORWARD(arg[1], dr_page_size());
+    uint new_size = (uint)ALIGN_FORWARD(arg[2], dr_page_size());
+    app_pc new_addr = (app_pc)result;
+
+    ds_add_app_area(drcontext, new_addr, new_size);
+
+    if (new_addr != old_addr)
+    {
+        // the contents moved, so does their taint
+        ds_move_app_taint(drcontext, new_addr, old_addr,
+                          old_size < new_size ? old_size : new_size);
+        ds_reclaim_app_area(drcontext, old_addr, old_size);
+    }
+    else if (new_size < old_size)
+        ds_reclaim_app_area(drcontext, old_addr + new_size, old_size - new_size);
+}
+
+static void
+handle_brk(void *drcontext, const ptr_uint_t *arg, reg_t result)
+{
+    app_pc new_brk = (app_pc)result;
+
+    dr_mutex_lock(brk_lock);
+    if (last_brk != NULL && new_brk < last_brk)
+        ds_reclaim_app_area(drcontext, new_brk, (uint)(last_brk - new_brk));
+    else if (last_brk != NULL && new_brk > last_brk)
+        ds_add_app_area(drcontext, last_brk, new_brk - last_brk);
+
+    last_brk = new_brk;
+    dr_mutex_unlock(brk_lock);
+}
+
+static void
+set_syscall_handler(int sysnum, syscall_handler_t handler)
+{
+    if (sysnum >= 0 && sysnum < MAX_SYSNUM)
+        syscall_handlers[sysnum] = handler;
+}
+
+static bool
+arg_is_memory_out(drsys_arg_t *arg, void *user_data)
+{
+    if (TEST(DRSYS_PARAM_OUT, arg->mode) && !TEST(DRSYS_PARAM_RETVAL, arg->mode))
+    {
+        *(bool *)user_data = true;
+        return false;
+    }
+    return true;
+}
+
+static bool
+add_drsys_handler(drsys_syscall_t *syscall, void *user_data)
+/*
+ *   Syscalls writing memory without a handler of their own
+ */
+{
+    drsys_sysnum_t num;
+    bool writes = false;
+
+    if (drsys_syscall_number(syscall, &num) != DRMF_SUCCESS ||
+        num.number < 0 || num.number >= MAX_SYSNUM ||
+        syscall_handlers[num.number] != NULL)
+        return true;
+
+    drsys_iterate_arg_types(syscall, arg_is_memory_out, &writes);
+
+    // ioctl outputs depend on the request
+    if (writes || num.number == SYS_ioctl)
+    {
+        syscall_handlers[num.number] = handle_drsys;
+        drsys_filter_syscall(num);
+    }
+    return true;
+}
+
+static bool
+syscall_table_init(void)
+/*
+ *   Only syscalls with a handler are filtered. The common ones
+ *   are handled directly, the other ones writing memory by drsyscall
+ */
+{
+    set_syscall_handler(SYS_read, handle_read);
+    set_syscall_handler(SYS_pread64, handle_read);
+    set_syscall_handler(SYS_readv, handle_readv);
+    set_syscall_handler(SYS_getdents, handle_read);
+    set_syscall_handler(SYS_getdents64, handle_read);
+    set_syscall_handler(SYS_fstat, handle_fstat);
+    set_syscall_handler(SYS_fstat64, handle_stat64);
+    set_syscall_handler(SYS_stat64, handle_stat64);
+    set_syscall_handler(SYS_lstat64, handle_stat64);
+    set_syscall_handler(SYS_clock_gettime, handle_clock_gettime);
+    set_syscall_handler(SYS_gettimeofday, handle_gettimeofday);
+    set_syscall_handler(SYS_epoll_wait, handle_epoll_wait);
+    set_syscall_handler(SYS_mmap2, handle_mmap);
+    set_syscall_handler(SYS_munmap, handle_munmap);
+    set_syscall_handler(SYS_mremap, handle_mremap);
+    set_syscall_handler(SYS_brk, handle_brk);
+#ifdef SYS_mmap
+    set_syscall_handler(SYS_mmap, handle_mmap);
+#endif
+#ifdef SYS_preadv
+    set_syscall_handler(SYS_preadv, handle_readv);
+#endif
+#ifdef SYS_fstatat64
+    set_syscall_handler(SYS_fstatat64, handle_fstatat64);
+#endif
+#ifdef SYS_epoll_pwait
+    set_syscall_handler(SYS_epoll_pwait, handle_epoll_wait);
+#endif
+#ifdef SYS_recv
+    set_syscall_handler(SYS_recv, handle_read);
+#endif
+#ifdef SYS_recvfrom
+    set_syscall_handler(SYS_recvfrom, handle_recvfrom);
+#endif
+#ifdef SYS_recvmsg
+    set_syscall_handler(SYS_recvmsg, handle_recvmsg);
+#endif
+
+    return drsys_iterate_syscalls(add_drsys_handler, NULL) == DRMF_SUCCESS;
+}
+
+static bool
+event_filter_syscall(void *drcontext, int sysnum)
+{
+    return sysnum >= 0 && sysnum < MAX_SYSNUM && syscall_handlers[sysnum] != NULL;
+}
+
+static void
+event_thread_init(void *drcontext)
+{
+    void *args = dr_thread_alloc(drcontext, sizeof(syscall_args_t));
+    drmgr_set_tls_field(drcontext, syscall_tls_index, args);
+}
+
+static void
+event_thread_exit(void *drcontext)
+{
+    void *args = drmgr_get_tls_field(drcontext, syscall_tls_index);
+    dr_thread_free(drcontext, args, sizeof(syscall_args_t));
+}
+
+static void
+untaint_syscall_result(void *drcontext, instrlist_t *ilist, instr_t *where)
+/*
+ *    Syscalls without a handler aren't filtered, so r0 which gets
+ *    their result is untainted before them. The kernel doesn't care
+ *    about its tag, filtered ones untaint it in event_post_syscall too
+ */
+{
+    auto sreg = drreg_reservation{drcontext, ilist, where};
+    auto szero = drreg_reservation{drcontext, ilist, where};
+
+    instrlist_meta_preinsert(ilist, where,
+                             XINST_CREATE_move(drcontext, // mov szero, 0
+                                               opnd_create_reg(szero),
+                                               OPND_CREATE_INT32(0)));
+
+    drtaint_insert_reg_to_taint_store(drcontext, ilist, where, DR_REG_R0, szero, sreg);
+}
+
+static bool
+event_pre_syscall(void *drcontext, int sysnum)
+{
+    // other clients may filter syscalls we don't handle
+    if (!event_filter_syscall(drcontext, sysnum))
+        return true;
+
+    syscall_args_t *args = (syscall_args_t *)drmgr_get_tls_field(drcontext, syscall_tls_index);
+    for (int i = 0; i < 6; i++)
+        args->arg[i] = dr_syscall_get_param(drcontext, i);
+    args->addrlen = address_buffer_size(sysnum, args->arg);
+
     return true;
 }
 
 static void
 event_post_syscall(void *drcontext, int sysnum)
 {
+    if (!event_filter_syscall(drcontext, sysnum))
+        return;
+
     dr_syscall_result_info_t info = {
         sizeof(info),
     };
@@ -1421,11 +5442,8 @@ event_post_syscall(void *drcontext, int sysnum)
     if (!info.succeeded)
         return;
 
-    // Clear taint for system calls with an OUT memarg param
-    drmf_status_t status = drsys_iterate_memargs(
-        drcontext, drsys_iter_cb, drcontext);
-
-    DR_ASSERT(status == DRMF_SUCCESS);
+    syscall_args_t *args = (syscall_args_t *)drmgr_get_tls_field(drcontext, syscall_tls_index);
+    syscall_handlers[sysnum](drcontext, args->arg, info.value);
 }
 
 #pragma endregion syscall_handling
\ No newline at end of file
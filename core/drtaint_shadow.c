@@ -7,7 +7,51 @@
 #include <string.h>
 #include <signal.h>
 #include <stddef.h>
+#include <time.h>
+#include <sys/mman.h>
+
+/* Direct-mapped shadow memory.
+ * The low 30 bits of an application address index a 1GB shadow window
+ * reserved at DS_DIRECT_BASE, so translation is just bic + orr.
+ * Addresses congruent modulo 1GB share shadow. On ARM Linux the
+ * executable and heap live below 0x40000000 and libraries and stack live
+ * above 0xB0000000, so they don't collide, but apps mapping memory into
+ * 0x00000000-0x3FFFFFFF and 0x80000000-0xBFFFFFFF at the same time do.
+ * Every mapping claims its regions of the window, see ds_add_app_area,
+ * so such a collision is caught instead of mixing up taint.
+ */
+#define DS_DIRECT_BASE 0x40000000
+#define DS_DIRECT_SIZE 0x40000000
+#define DS_DIRECT_MASK (DS_DIRECT_SIZE - 1)
+
+/* Inaccessible guards around the window. No application memory lies
+ * within DS_DIRECT_GUARD of the window edges, so two addresses which are
+ * closer than that and both valid are in the same 1GB alias,
+ * and their shadows are as far apart as they are.
+ * See ds_insert_mem_to_shadow
+ */
+#define DS_DIRECT_GUARD 0x2000
+
+/* Page summary.
+ * One byte per 64KB application region: DS_SUMMARY_PRIVATE is set once
+ * the region's shadow became private, i.e. may hold taint, and
+ * DS_SUMMARY_NEXT_PRIVATE is set once the next region's did, so that
+ * accesses straddling the region end are covered too. Inline loads check
+ * it to skip shadow translation for clean regions.
+ */
+#define DS_SUMMARY_SHIFT 16
+#define DS_SUMMARY_REGION (1 << DS_SUMMARY_SHIFT)
+#define DS_SUMMARY_ENTRIES (1 << (32 - DS_SUMMARY_SHIFT))
+#define DS_SUMMARY_PRIVATE 0x01
+#define DS_SUMMARY_NEXT_PRIVATE 0x02
+
+/* Areas up to this size are cleared with unrolled stores,
+ * see ds_insert_clear_app_area
+ */
+#define DS_CLEAR_UNROLL_SIZE 32
 
+/* number of app regions sharing one direct shadow region */
+#define DS_DIRECT_ALIASES (DS_SUMMARY_ENTRIES / (DS_DIRECT_SIZE >> DS_SUMMARY_SHIFT))
 
 static reg_id_t
 get_faulting_shadow_reg(void *drcontext, dr_mcontext_t *mc);
@@ -19,8 +63,14 @@ handle_special_shadow_fault(void *drcontext, dr_mcontext_t *raw_mc,
 static dr_signal_action_t
 event_signal_instrumentation(void *drcontext, dr_siginfo_t *info);
 
+static void
+ds_insert_resident_load(void *drcontext, instrlist_t *ilist, instr_t *where, uint i);
+
+static void
+ds_insert_resident_writeback(void *drcontext, instrlist_t *ilist, instr_t *where, uint i);
+
 static bool
-ds_mem_init(int id);
+ds_mem_init(int id, bool direct);
 
 static void
 ds_mem_exit(void);
@@ -37,12 +87,55 @@ event_thread_init(void *drcontext);
 static void
 event_thread_exit(void *drcontext);
 
+static bool
+ds_stubs_init(bool summary_check);
+
 static void
-event_thread_exit(void *drcontext);
+ds_stubs_exit(void);
 
 static int num_shadow_count;
+
+/* time shadow faults, see DRTAINT_OPTION_STATS_REPORT */
+static bool time_faults;
 static umbra_map_t *umbra_map;
-static int tls_index;
+static bool direct_shadow;
+
+/* raw TLS holding per_thread_t, see ds_reg_init */
+static reg_id_t tls_seg;
+static uint tls_offs;
+
+static byte summary[DS_SUMMARY_ENTRIES];
+
+/* umbra shadow block size, a block becomes private as a whole */
+static size_t umbra_block_size;
+
+/* resident shadow pages given back, see ds_decommit */
+static uint64 reclaimed_bytes;
+
+/* Shadow fault counters, see drtaint_get_stats.
+ * Like reclaimed_bytes they are relaxed atomics, faults come from any thread
+ */
+static uint64 stat_faults;
+static uint64 stat_block_replacements;
+static uint64 stat_foreign_faults;
+static uint64 stat_fault_ns;
+
+/* Regions of the direct shadow window which were made writable */
+static byte direct_writable[DS_DIRECT_SIZE >> DS_SUMMARY_SHIFT];
+
+/* 1GB alias + 1 of the application memory using each region
+ * of the direct shadow window, 0 if there is none yet
+ */
+static byte direct_owner[DS_DIRECT_SIZE >> DS_SUMMARY_SHIFT];
+
+/* protects direct_writable and direct_owner */
+static void *direct_lock;
+
+/* per_thread_t lives in DR raw TLS slots aligned to a cache line,
+ * so a shadow register is a single ldr from the TLS base
+ * and all the GPR shadows share one line
+ */
+#define DS_CACHE_LINE 64
 
 typedef struct _per_thread_t
 {
@@ -52,23 +145,92 @@ typedef struct _per_thread_t
      */
     reg_t shadow_gprs[DR_NUM_GPR_REGS];
 
+    /* Zero if none of shadow_gprs is tainted, see ds_insert_any_reg_tainted_load */
+    reg_t any_reg_tainted;
+
+    /* Scratch registers of the out-of-line stubs, see ds_stub_save */
+    reg_t stub_spill[3];
+
     /* Holds shadow values for SIMD registers. */
     //dr_simd_t shadow_simd[NUM_SIMD_SLOTS];
 
 } per_thread_t;
 
-bool ds_init(int id)
+#define DS_TLS_SLOTS (sizeof(per_thread_t) / sizeof(void *))
+
+/* Instrumentation time state of the block being built,
+ * see ds_insert_shadow_base
+ */
+typedef struct _per_thread_instr_t
+{
+    /* raw TLS of the thread, reachable from other threads through here */
+    per_thread_t *regs;
+
+    /* register holding &per_thread_t or DR_REG_NULL */
+    reg_id_t shadow_base;
+
+    /* meta instructions not emitted thanks to %shadow_base% */
+    uint saved;
+
+    /* app register whose accesses are translated once or DR_REG_NULL */
+    reg_id_t app_base;
+
+    /* register holding shadow of [app_base + cache_disp] */
+    reg_id_t cache;
+    int cache_disp;
+    bool cache_valid;
+
+    /* translations done relative to %cache% */
+    uint coalesced;
+
+    /* register holding the shadow of an app register
+     * for the rest of the block or DR_REG_NULL, see ds_make_resident
+     */
+    reg_id_t resident[DR_NUM_GPR_REGS];
+
+    /* resident[i] holds the current shadow value */
+    bool resident_valid[DR_NUM_GPR_REGS];
+
+    /* resident[i] wasn't written back to the shadow register file */
+    bool resident_dirty[DR_NUM_GPR_REGS];
+
+    /* shadow register accesses served by resident registers */
+    uint resident_accesses;
+
+    /* calls of out-of-line stubs, see ds_insert_stub_call */
+    uint stub_calls;
+
+} per_thread_instr_t;
+
+/* the guards around the direct window are mapped */
+static bool direct_guards;
+
+static int instr_tls_index;
+
+/* length of dr_insert_get_seg_base sequence */
+static uint seg_base_len;
+
+bool ds_init(int id, const drtaint_options_t *ops)
 {
+    bool direct = ops != NULL &&
+                  (ops->flags & DRTAINT_OPTION_DIRECT_SHADOW) != 0;
+
     /* XXX: we only support a single umbra mapping */
     if (dr_atomic_add32_return_sum(&num_shadow_count, 1) > 1)
         return false;
-    if (!ds_mem_init(id) || !ds_reg_init())
+    time_faults = ops != NULL && (ops->flags & DRTAINT_OPTION_STATS_REPORT) != 0;
+    if (!ds_mem_init(id, direct) || !ds_reg_init())
+        return false;
+
+    if (ops != NULL && (ops->flags & DRTAINT_OPTION_OUT_OF_LINE) != 0 &&
+        !ds_stubs_init((ops->flags & DRTAINT_OPTION_PAGE_SUMMARY) != 0))
         return false;
     return true;
 }
 
 void ds_exit(void)
 {
+    ds_stubs_exit();
     ds_mem_exit();
     ds_reg_exit();
 }
@@ -77,235 +239,1416 @@ void ds_exit(void)
  * shadow memory API
  * ==================================================================================== */
 
-bool ds_insert_app_to_shadow(void *drcontext, instrlist_t *ilist, instr_t *where,
-                             reg_id_t regaddr, reg_id_t scratch)
-/*
- *    Save original application address in %regaddr% to SPILL_SLOT_2 
- *    and translate value of %regaddr% to its shadow address
- *
- *    out <- %regaddr% - address of register where the value is/will be stored
- */
+static inline byte *
+ds_direct_app_to_shadow(app_pc app)
 {
-    /* XXX: we shouldn't have to do this */
-    /* Save the app address to a well-known spill slot, so that the fault handler
-     * can recover if no shadow memory was installed yet.
-     */
-    dr_save_reg(drcontext, ilist, where, regaddr, SPILL_SLOT_2);
-    drmf_status_t status = umbra_insert_app_to_shadow(drcontext, umbra_map,
-                                                      ilist, where, regaddr, &scratch, 1);
-
-    return status == DRMF_SUCCESS;
+    return (byte *)(((ptr_uint_t)app & DS_DIRECT_MASK) | DS_DIRECT_BASE);
 }
 
-bool ds_get_app_taint(void *drcontext, app_pc app, byte *result)
+/* Summary bytes are updated by several threads and by the fault
+ * handler at once. A lost DS_SUMMARY_PRIVATE bit hides taint from
+ * every inline clean check, so the bits are set and cleared atomically
+ */
+static void
+ds_summary_mark_region(uint region)
 {
-    size_t sz = 1;
-    drmf_status_t status = umbra_read_shadow_memory(umbra_map, app, 1, &sz, result);
-    return status == DRMF_SUCCESS;
+    __atomic_fetch_or(&summary[region], DS_SUMMARY_PRIVATE, __ATOMIC_SEQ_CST);
+    if (region > 0)
+        __atomic_fetch_or(&summary[region - 1], DS_SUMMARY_NEXT_PRIVATE, __ATOMIC_SEQ_CST);
 }
 
-bool ds_get_app_taint4(void *drcontext, app_pc app, uint *result)
+static void
+ds_summary_unmark_region(uint region)
 {
-    size_t sz = sizeof(uint);
-    drmf_status_t status = umbra_read_shadow_memory(umbra_map, app,
-                                                    sizeof(uint), &sz, (byte *)result);
-    return status == DRMF_SUCCESS;
+    __atomic_fetch_and(&summary[region], (byte)~DS_SUMMARY_PRIVATE, __ATOMIC_SEQ_CST);
+    if (region > 0)
+        __atomic_fetch_and(&summary[region - 1], (byte)~DS_SUMMARY_NEXT_PRIVATE,
+                           __ATOMIC_SEQ_CST);
 }
 
-bool ds_set_app_taint(void *drcontext, app_pc app, byte value)
+static void
+ds_direct_make_writable(uint window_region)
+/*
+ *    The window is mapped read-only, so untouched shadow reads as zero
+ *    for free. Before the first write to a region we make it writable
+ *    and mark all app regions aliasing it as possibly tainted
+ */
 {
-    size_t sz = 1;
-    drmf_status_t status = umbra_write_shadow_memory(umbra_map, app, 1, &sz, &value);
-    return status == DRMF_SUCCESS;
+    uint i;
+
+    if (direct_writable[window_region])
+        return;
+
+    dr_mutex_lock(direct_lock);
+    if (!direct_writable[window_region])
+    {
+        dr_memory_protect((byte *)DS_DIRECT_BASE + ((size_t)window_region << DS_SUMMARY_SHIFT),
+                          DS_SUMMARY_REGION, DR_MEMPROT_READ | DR_MEMPROT_WRITE);
+
+        for (i = 0; i < DS_DIRECT_ALIASES; i++)
+            ds_summary_mark_region(i * (DS_DIRECT_SIZE >> DS_SUMMARY_SHIFT) + window_region);
+
+        direct_writable[window_region] = 1;
+    }
+    dr_mutex_unlock(direct_lock);
 }
 
-bool ds_set_app_taint4(void *drcontext, app_pc app, uint value)
+static void
+ds_count_reclaimed(uint64 bytes)
 {
-    size_t sz = sizeof(uint);
-    drmf_status_t status = umbra_write_shadow_memory(umbra_map, app,
-                                                     sizeof(uint), &sz, (byte *)&value);
-    return status == DRMF_SUCCESS;
+    __atomic_fetch_add(&reclaimed_bytes, bytes, __ATOMIC_RELAXED);
 }
 
-void ds_set_app_area_taint(void *drcontext, app_pc app, uint size, byte value)
+static void
+ds_decommit(byte *shadow, size_t size)
 /*
- *  Set linear memory area tainted, 
- *  beginning from %app% and filling %size% bytes 
+ *    Give the pages of private shadow [shadow, shadow + size) back,
+ *    they read as zero afterwards. The range stays mapped, so a store
+ *    of another thread which is translated already only commits a page
+ *    again. Only the pages which were resident are counted as reclaimed
  */
 {
-    uint cnt4 = size / 4, cnt1 = size % 4;
-    uint start = 0, end = cnt4 * 4, i;
-    uint value4 = value + (value << 8) + (value << 16) + (value << 24);
-    bool ok;
+    size_t page = dr_page_size();
+    byte *start = (byte *)ALIGN_FORWARD(shadow, page);
+    byte *end = (byte *)ALIGN_BACKWARD(shadow + size, page);
+    unsigned char resident[64];
+    byte *pc;
 
-    for (i = start; i < end; i += 4)
+    for (pc = start; pc < end; pc += sizeof(resident) * page)
     {
-        ok = ds_set_app_taint4(drcontext, &app[i], value4);
-        DR_ASSERT(ok);
+        size_t chunk = (size_t)(end - pc);
+        size_t i;
+
+        if (chunk > sizeof(resident) * page)
+            chunk = sizeof(resident) * page;
+
+        if (mincore(pc, chunk, resident) == 0)
+        {
+            for (i = 0; i < chunk / page; i++)
+            {
+                if (TEST(1, resident[i]))
+                    ds_count_reclaimed(page);
+            }
+        }
+
+        madvise(pc, chunk, MADV_DONTNEED);
     }
+}
+
+static void
+ds_direct_release_region(uint window_region)
+/*
+ *    Make the region read-only again and decommit it, so untouched
+ *    pages aren't committed by clearing them. A store of another
+ *    thread which is translated already faults and makes the region
+ *    writable again
+ */
+{
+    uint i;
+    byte *shadow = (byte *)DS_DIRECT_BASE + ((size_t)window_region << DS_SUMMARY_SHIFT);
 
-    start = end;
-    end += cnt1;
-    for (i = start; i < end; i++)
+    dr_mutex_lock(direct_lock);
+    if (direct_writable[window_region])
     {
-        ok = ds_set_app_taint(drcontext, &app[i], value);
-        DR_ASSERT(ok);
+        dr_memory_protect(shadow, DS_SUMMARY_REGION, DR_MEMPROT_READ);
+        ds_decommit(shadow, DS_SUMMARY_REGION);
+        direct_writable[window_region] = 0;
+
+        // the shadow is shared by the aliases, all of them are clean now
+        for (i = 0; i < DS_DIRECT_ALIASES; i++)
+            ds_summary_unmark_region(i * (DS_DIRECT_SIZE >> DS_SUMMARY_SHIFT) + window_region);
     }
+    dr_mutex_unlock(direct_lock);
 }
 
-/* ======================================================================================
- * shadow memory implementation
- * ==================================================================================== */
+static bool
+ds_direct_is_app_area(const dr_mem_info_t *info)
+/*
+ *    Whether %info% describes application memory, i.e. not DR's,
+ *    ours or the direct window with its guards
+ */
+{
+    ptr_uint_t guard_start = DS_DIRECT_BASE - DS_DIRECT_GUARD;
+    ptr_uint_t guard_end = DS_DIRECT_BASE + DS_DIRECT_SIZE + DS_DIRECT_GUARD;
+    ptr_uint_t start = (ptr_uint_t)info->base_pc;
+    ptr_uint_t next = start + info->size;
+
+    return info->type != DR_MEMTYPE_FREE &&
+           (start >= guard_end || next <= guard_start) &&
+           !dr_memory_is_dr_internal(info->base_pc) &&
+           !dr_memory_is_in_client(info->base_pc);
+}
 
 static bool
-ds_mem_init(int id)
+ds_direct_region_in_use(byte owner, uint window_region)
+/*
+ *    Whether application memory of 1GB alias %owner% - 1 is still
+ *    mapped in %window_region%. An owner is only dropped when an unmap
+ *    covers its region as a whole, so it may be stale, e.g. after
+ *    two unmaps of the halves of a region
+ */
 {
-    umbra_map_options_t umbra_map_ops;
-    drmgr_init();
+    ptr_uint_t pc = (ptr_uint_t)(owner - 1) * DS_DIRECT_SIZE +
+                    ((ptr_uint_t)window_region << DS_SUMMARY_SHIFT);
+    size_t left = DS_SUMMARY_REGION;
+    dr_mem_info_t info;
 
-    /* initialize umbra and lazy page handling */
-    memset(&umbra_map_ops, 0, sizeof(umbra_map_ops));
-    umbra_map_ops.scale = UMBRA_MAP_SCALE_SAME_1X;
-    umbra_map_ops.flags = UMBRA_MAP_CREATE_SHADOW_ON_TOUCH |
-                          UMBRA_MAP_SHADOW_SHARED_READONLY;
+    while (dr_query_memory_ex((byte *)pc, &info))
+    {
+        ptr_uint_t next = (ptr_uint_t)info.base_pc + info.size;
 
-    umbra_map_ops.default_value = 0;
-    umbra_map_ops.default_value_size = 1;
+        if (ds_direct_is_app_area(&info))
+            return true;
 
-    if (umbra_init(id) != DRMF_SUCCESS)
-        return false;
-    if (umbra_create_mapping(&umbra_map_ops, &umbra_map) != DRMF_SUCCESS)
-        return false;
+        // the last area ends at the top of the address space
+        if (next <= pc || next - pc >= left)
+            break;
+        left -= next - pc;
+        pc = next;
+    }
 
-    drmgr_register_signal_event(event_signal_instrumentation);
-    return true;
+    return false;
 }
 
-static void
-ds_mem_exit(void)
+static bool
+ds_direct_claim(app_pc app, size_t size)
+/*
+ *    Record that application memory [app, app + size) uses its
+ *    regions of the window. Fail if one of them is used by memory
+ *    of another 1GB alias which is still mapped: the two would
+ *    share shadow
+ */
 {
-    if (umbra_destroy_mapping(umbra_map) != DRMF_SUCCESS)
-        DR_ASSERT(false);
-
-    drmgr_unregister_signal_event(event_signal_instrumentation);
-    umbra_exit();
-    drmgr_exit();
-}
+    ptr_uint_t first = (ptr_uint_t)app >> DS_SUMMARY_SHIFT;
+    ptr_uint_t last = ((ptr_uint_t)app + size - 1) >> DS_SUMMARY_SHIFT;
+    ptr_uint_t r;
+    bool ok = true;
 
-static reg_id_t
-get_faulting_shadow_reg(void *drcontext, dr_mcontext_t *mc)
-{
-    instr_t inst;
-    reg_id_t reg;
+    if (size == 0)
+        return true;
 
-    instr_init(drcontext, &inst);
-    decode(drcontext, mc->pc, &inst);
+    dr_mutex_lock(direct_lock);
+    for (r = first; r <= last && ok; r++)
+    {
+        uint window_region = r & (DS_DIRECT_MASK >> DS_SUMMARY_SHIFT);
+        byte owner = (byte)((r << DS_SUMMARY_SHIFT) / DS_DIRECT_SIZE + 1);
+        byte current = direct_owner[window_region];
+
+        if (current != 0 && current != owner &&
+            ds_direct_region_in_use(current, window_region))
+            ok = false;
+        else
+            direct_owner[window_region] = owner;
+    }
+    dr_mutex_unlock(direct_lock);
 
-    DR_ASSERT_MSG(opnd_is_base_disp(instr_get_dst(&inst, 0)), "Emulation error");
-    reg = opnd_get_base(instr_get_dst(&inst, 0));
-    DR_ASSERT_MSG(reg != DR_REG_NULL, "Emulation error");
+    return ok;
+}
 
-    instr_free(drcontext, &inst);
-    return reg;
+static void
+ds_direct_unclaim(app_pc app, size_t size)
+/*
+ *    [app, app + size) was unmapped, regions it covered
+ *    as a whole may be claimed by another alias again
+ */
+{
+    ptr_uint_t first = ALIGN_FORWARD(app, DS_SUMMARY_REGION) >> DS_SUMMARY_SHIFT;
+    ptr_uint_t end = ALIGN_BACKWARD(app + size, DS_SUMMARY_REGION) >> DS_SUMMARY_SHIFT;
+    ptr_uint_t r;
+
+    dr_mutex_lock(direct_lock);
+    for (r = first; r < end; r++)
+        direct_owner[r & (DS_DIRECT_MASK >> DS_SUMMARY_SHIFT)] = 0;
+    dr_mutex_unlock(direct_lock);
 }
 
-static bool
-handle_special_shadow_fault(void *drcontext, dr_mcontext_t *raw_mc, app_pc app_shadow)
+static void
+ds_summary_mark(app_pc app, size_t size)
+/*
+ *    Mark all regions overlapping [app, app + size) as possibly tainted
+ */
 {
-    umbra_shadow_memory_type_t shadow_type;
-    app_pc app_target;
-    reg_id_t reg;
+    ptr_uint_t first = (ptr_uint_t)app >> DS_SUMMARY_SHIFT;
+    ptr_uint_t last = ((ptr_uint_t)app + size - 1) >> DS_SUMMARY_SHIFT;
+    ptr_uint_t r;
 
-    /* If a fault occured, it is probably because we computed the
-     * address of shadow memory which was initialized to a shared
-     * readonly shadow block. We allocate a shadow page there and
-     * replace the reg value used by the faulting instr.
-     */
+    if (size == 0)
+        return;
 
-    /* handle faults from writes to special shadow blocks */
-    if (umbra_shadow_memory_is_shared(umbra_map, app_shadow,
-                                      &shadow_type) != DRMF_SUCCESS)
+    for (r = first; r <= last; r++)
     {
-        DR_ASSERT(false);
-        return true;
+        if (direct_shadow)
+            ds_direct_make_writable(r & (DS_DIRECT_MASK >> DS_SUMMARY_SHIFT));
+        else
+            ds_summary_mark_region(r);
     }
-    if (shadow_type != UMBRA_SHADOW_MEMORY_TYPE_SHARED)
-        return true;
+}
 
-    /* Grab the original app target out of the spill slot so we
-     * don't have to compute the app target ourselves (this is
-     * difficult).
-     */
-    app_target = (app_pc)dr_read_saved_reg(drcontext, SPILL_SLOT_2);
+static bool
+ds_summary_any_marked(app_pc app, size_t size)
+/*
+ *    Whether a region overlapping [app, app + size) may hold taint.
+ *    Shadow of unmarked regions is clean, so untainting them or
+ *    copying from them never needs to mark anything
+ */
+{
+    ptr_uint_t first = (ptr_uint_t)app >> DS_SUMMARY_SHIFT;
+    ptr_uint_t last = ((ptr_uint_t)app + size - 1) >> DS_SUMMARY_SHIFT;
+    ptr_uint_t r;
 
-    /* replace the shared block, and record the new app shadow */
-    if (umbra_replace_shared_shadow_memory(umbra_map, app_target,
-                                           &app_shadow) != DRMF_SUCCESS)
+    if (size == 0)
+        return false;
+
+    for (r = first; r <= last; r++)
     {
-        DR_ASSERT(false);
-        return true;
+        if (TESTANY(DS_SUMMARY_PRIVATE, summary[r]))
+            return true;
     }
 
-    /* Replace the faulting register value to reflect the new shadow
-     * memory.
-     */
-    reg = get_faulting_shadow_reg(drcontext, raw_mc);
-    reg_set_value(reg, raw_mc, (reg_t)app_shadow);
     return false;
 }
 
-static dr_signal_action_t
-event_signal_instrumentation(void *drcontext, dr_siginfo_t *info)
+static void
+ds_direct_read(app_pc app, size_t size, byte *result)
 {
-    if (info->sig != SIGSEGV && info->sig != SIGBUS)
-        return DR_SIGNAL_DELIVER;
-
-    DR_ASSERT(info->raw_mcontext_valid);
-    return handle_special_shadow_fault(drcontext, info->raw_mcontext,
-                                       info->access_address)
-               ? DR_SIGNAL_DELIVER
-               : DR_SIGNAL_SUPPRESS;
+    for (size_t i = 0; i < size; i++)
+        result[i] = *ds_direct_app_to_shadow(app + i);
 }
 
-/* ======================================================================================
- * shadow registers implementation
- * ==================================================================================== */
-static bool
-ds_reg_init(void)
+static void
+ds_direct_write(app_pc app, size_t size, const byte *value)
 {
-    drmgr_priority_t exit_priority = {
-        sizeof(exit_priority), DRMGR_PRIORITY_NAME_DRTAINT_EXIT, NULL, NULL,
-        DRMGR_PRIORITY_THREAD_EXIT_DRTAINT};
-
-    drmgr_priority_t init_priority = {
-        sizeof(init_priority), DRMGR_PRIORITY_NAME_DRTAINT_INIT, NULL, NULL,
-        DRMGR_PRIORITY_THREAD_INIT_DRTAINT};
-
-    drmgr_init();
-    drmgr_register_thread_init_event_ex(event_thread_init, &init_priority);
-    drmgr_register_thread_exit_event_ex(event_thread_exit, &exit_priority);
-
-    /* initialize tls for per-thread data */
-    tls_index = drmgr_register_tls_field();
-    if (tls_index == -1)
-        return false;
-    return true;
+    ds_summary_mark(app, size);
+    for (size_t i = 0; i < size; i++)
+        *ds_direct_app_to_shadow(app + i) = value[i];
 }
 
-bool ds_insert_reg_to_shadow(void *drcontext, instrlist_t *ilist, instr_t *where,
-                             reg_id_t shadow, reg_id_t regaddr)
+bool ds_insert_app_to_shadow(void *drcontext, instrlist_t *ilist, instr_t *where,
+                             reg_id_t regaddr, reg_id_t scratch)
 /*
- *    Inserts instructions to gain shadow %shadow% register's address 
- *    of the current thread and place result to register of %regaddr% 
+ *    Save original application address in %regaddr% to SPILL_SLOT_2 
+ *    and translate value of %regaddr% to its shadow address
+ *
+ *    out <- %regaddr% - address of register where the value is/will be stored
  */
 {
-    DR_ASSERT(shadow - DR_REG_R0 < DR_NUM_GPR_REGS);
-    unsigned int offs = offsetof(per_thread_t, shadow_gprs[shadow - DR_REG_R0]);
+    if (direct_shadow)
+    {
+        /* The first store to a read-only window region faults and
+         * the handler makes the whole region writable, it doesn't
+         * need the app address
+         */
+        instrlist_meta_preinsert(ilist, where,
+                                 INSTR_CREATE_bic(drcontext, // bic regaddr, regaddr, #~mask
+                                                  opnd_create_reg(regaddr),
+                                                  opnd_create_reg(regaddr),
+                                                  OPND_CREATE_INT32(~DS_DIRECT_MASK)));
+        instrlist_meta_preinsert(ilist, where,
+                                 INSTR_CREATE_orr(drcontext, // orr regaddr, regaddr, #base
+                                                  opnd_create_reg(regaddr),
+                                                  opnd_create_reg(regaddr),
+                                                  OPND_CREATE_INT32(DS_DIRECT_BASE)));
+        return true;
+    }
 
-    /* Load the per_thread data structure holding
-     * the thread-local taint values of each register to %regaddr%
+    /* XXX: we shouldn't have to do this */
+    /* Save the app address to a well-known spill slot, so that the fault handler
+     * can recover if no shadow memory was installed yet.
      */
-    drmgr_insert_read_tls_field(drcontext, tls_index, ilist, where, regaddr);
+    dr_save_reg(drcontext, ilist, where, regaddr, SPILL_SLOT_2);
+    drmf_status_t status = umbra_insert_app_to_shadow(drcontext, umbra_map,
+                                                      ilist, where, regaddr, &scratch, 1);
+
+    return status == DRMF_SUCCESS;
+}
+
+bool ds_insert_app_to_summary_load(void *drcontext, instrlist_t *ilist, instr_t *where,
+                                   reg_id_t regaddr, reg_id_t result)
+/*
+ *    Load the summary byte of the region holding the application
+ *    address in %regaddr% to %result%. Zero means the region is clean
+ */
+{
+    instrlist_insert_mov_immed_ptrsz(drcontext, (ptr_int_t)summary,
+                                     opnd_create_reg(result), ilist, where, NULL, NULL);
+
+    instrlist_meta_preinsert(ilist, where,
+                             INSTR_CREATE_add_shimm(drcontext, // add result, result, regaddr, lsr #16
+                                                    opnd_create_reg(result),
+                                                    opnd_create_reg(result),
+                                                    opnd_create_reg(regaddr),
+                                                    OPND_CREATE_INT8(DR_SHIFT_LSR),
+                                                    OPND_CREATE_INT8(DS_SUMMARY_SHIFT)));
+
+    instrlist_meta_preinsert(ilist, where,
+                             XINST_CREATE_load_1byte(drcontext, // ldrb result, [result]
+                                                     opnd_create_reg(result),
+                                                     OPND_CREATE_MEM8(result, 0)));
+    return true;
+}
+
+void ds_insert_app_range_clean_check(void *drcontext, instrlist_t *ilist, instr_t *where,
+                                     reg_id_t start, reg_id_t end, reg_id_t scratch,
+                                     instr_t *tainted)
+/*
+ *    Jump to %tainted% unless [%start%, %end%) is shorter than a summary
+ *    region and the regions of both its ends are clean, so that no region
+ *    in between is missed. %start% is clobbered, aflags have to be reserved
+ */
+{
+    instrlist_meta_preinsert(ilist, where,
+                             INSTR_CREATE_sub(drcontext, /* sub scratch, end, start */
+                                              opnd_create_reg(scratch),
+                                              opnd_create_reg(end),
+                                              opnd_create_reg(start)));
+    instrlist_meta_preinsert(ilist, where,
+                             XINST_CREATE_cmp(drcontext, /* cmp scratch, #DS_SUMMARY_REGION */
+                                              opnd_create_reg(scratch),
+                                              OPND_CREATE_INT32(DS_SUMMARY_REGION)));
+    instrlist_meta_preinsert(ilist, where,
+                             XINST_CREATE_jump_cond(drcontext, DR_PRED_HS, /* bhs tainted */
+                                                    opnd_create_instr(tainted)));
+
+    ds_insert_app_to_summary_load(drcontext, ilist, where, start, scratch);
+    instrlist_meta_preinsert(ilist, where,
+                             XINST_CREATE_cmp(drcontext, /* cmp scratch, #0 */
+                                              opnd_create_reg(scratch),
+                                              OPND_CREATE_INT8(0)));
+    instrlist_meta_preinsert(ilist, where,
+                             XINST_CREATE_jump_cond(drcontext, DR_PRED_NE, /* bne tainted */
+                                                    opnd_create_instr(tainted)));
+
+    instrlist_meta_preinsert(ilist, where,
+                             INSTR_CREATE_sub(drcontext, /* sub start, end, #1 */
+                                              opnd_create_reg(start),
+                                              opnd_create_reg(end),
+                                              OPND_CREATE_INT8(1)));
+    ds_insert_app_to_summary_load(drcontext, ilist, where, start, scratch);
+    instrlist_meta_preinsert(ilist, where,
+                             XINST_CREATE_cmp(drcontext, /* cmp scratch, #0 */
+                                              opnd_create_reg(scratch),
+                                              OPND_CREATE_INT8(0)));
+    instrlist_meta_preinsert(ilist, where,
+                             XINST_CREATE_jump_cond(drcontext, DR_PRED_NE, /* bne tainted */
+                                                    opnd_create_instr(tainted)));
+}
+
+void ds_insert_clear_app_area(void *drcontext, instrlist_t *ilist, instr_t *where,
+                              reg_id_t regaddr, reg_id_t regsize, uint size,
+                              reg_id_t scratch, instr_t *slow, instr_t *done)
+/*
+ *    Untaint [%regaddr%, %regaddr% + %regsize%) inline. The size is
+ *    a nonzero multiple of 4, %size% is its value if known at
+ *    translation time or 0. The area must lie within one summary region,
+ *    shadow of different regions isn't contiguous with umbra,
+ *    otherwise jump to %slow%. Jump to %done% if the region is clean.
+ *    Aflags have to be reserved, all three registers are clobbered
+ */
+{
+    instr_t *loop = INSTR_CREATE_label(drcontext);
+
+    instrlist_meta_preinsert(ilist, where,
+                             XINST_CREATE_add_2src(drcontext, // add scratch, regaddr, regsize
+                                                   opnd_create_reg(scratch),
+                                                   opnd_create_reg(regaddr),
+                                                   opnd_create_reg(regsize)));
+    instrlist_meta_preinsert(ilist, where,
+                             INSTR_CREATE_sub(drcontext, // sub scratch, scratch, #1
+                                              opnd_create_reg(scratch),
+                                              opnd_create_reg(scratch),
+                                              OPND_CREATE_INT8(1)));
+    instrlist_meta_preinsert(ilist, where,
+                             INSTR_CREATE_eor(drcontext, // eor scratch, scratch, regaddr
+                                              opnd_create_reg(scratch),
+                                              opnd_create_reg(scratch),
+                                              opnd_create_reg(regaddr)));
+    instrlist_meta_preinsert(ilist, where,
+                             INSTR_CREATE_lsrs(drcontext, // lsrs scratch, scratch, #16
+                                               opnd_create_reg(scratch),
+                                               opnd_create_reg(scratch),
+                                               OPND_CREATE_INT8(DS_SUMMARY_SHIFT)));
+    instrlist_meta_preinsert(ilist, where,
+                             XINST_CREATE_jump_cond(drcontext, DR_PRED_NE, // bne slow
+                                                    opnd_create_instr(slow)));
+
+    /* nothing to clear if the region never held taint */
+    ds_insert_app_to_summary_load(drcontext, ilist, where, regaddr, scratch);
+    instrlist_meta_preinsert(ilist, where,
+                             XINST_CREATE_cmp(drcontext, // cmp scratch, #0
+                                              opnd_create_reg(scratch),
+                                              OPND_CREATE_INT8(0)));
+    instrlist_meta_preinsert(ilist, where,
+                             XINST_CREATE_jump_cond(drcontext, DR_PRED_EQ, // beq done
+                                                    opnd_create_instr(done)));
+
+    /* The stores may hit a shared umbra block. The fault handler replaces
+     * it and points %regaddr% to the private one, the offsets stay valid
+     */
+    ds_insert_app_to_shadow(drcontext, ilist, where, regaddr, scratch);
+    instrlist_meta_preinsert(ilist, where,
+                             XINST_CREATE_move(drcontext, // mov scratch, #0
+                                               opnd_create_reg(scratch),
+                                               OPND_CREATE_INT32(0)));
+
+    if (size != 0 && size <= DS_CLEAR_UNROLL_SIZE)
+    {
+        for (uint offs = 0; offs < size; offs += 4)
+        {
+            instrlist_meta_preinsert(ilist, where,
+                                     INSTR_XL8(XINST_CREATE_store(drcontext, // str scratch, [regaddr, #offs]
+                                                                  OPND_CREATE_MEM32(regaddr, offs),
+                                                                  opnd_create_reg(scratch)),
+                                               instr_get_app_pc(where)));
+        }
+        return;
+    }
+
+    instrlist_meta_preinsert(ilist, where, loop);
+    instrlist_meta_preinsert(ilist, where,
+                             INSTR_CREATE_subs(drcontext, // subs regsize, regsize, #4
+                                               opnd_create_reg(regsize),
+                                               opnd_create_reg(regsize),
+                                               OPND_CREATE_INT8(4)));
+    instrlist_meta_preinsert(ilist, where,
+                             INSTR_XL8(XINST_CREATE_store(drcontext, // str scratch, [regaddr, regsize]
+                                                          opnd_create_base_disp_arm(regaddr, regsize,
+                                                                                    DR_SHIFT_NONE, 0, 0,
+                                                                                    DR_OPND_DEFAULT,
+                                                                                    OPSZ_4),
+                                                          opnd_create_reg(scratch)),
+                                       instr_get_app_pc(where)));
+    instrlist_meta_preinsert(ilist, where,
+                             XINST_CREATE_jump_cond(drcontext, DR_PRED_NE, // bne loop
+                                                    opnd_create_instr(loop)));
+}
+
+bool ds_get_app_taint(void *drcontext, app_pc app, byte *result)
+{
+    if (direct_shadow)
+    {
+        *result = *ds_direct_app_to_shadow(app);
+        return true;
+    }
+
+    size_t sz = 1;
+    drmf_status_t status = umbra_read_shadow_memory(umbra_map, app, 1, &sz, result);
+    return status == DRMF_SUCCESS;
+}
+
+bool ds_get_app_taint4(void *drcontext, app_pc app, uint *result)
+{
+    if (direct_shadow)
+    {
+        ds_direct_read(app, sizeof(uint), (byte *)result);
+        return true;
+    }
+
+    size_t sz = sizeof(uint);
+    drmf_status_t status = umbra_read_shadow_memory(umbra_map, app,
+                                                    sizeof(uint), &sz, (byte *)result);
+    return status == DRMF_SUCCESS;
+}
+
+bool ds_set_app_taint(void *drcontext, app_pc app, byte value)
+{
+    if (value == 0 && !ds_summary_any_marked(app, 1))
+        return true;
+
+    if (direct_shadow)
+    {
+        ds_direct_write(app, 1, &value);
+        return true;
+    }
+
+    ds_summary_mark(app, 1);
+
+    size_t sz = 1;
+    drmf_status_t status = umbra_write_shadow_memory(umbra_map, app, 1, &sz, &value);
+    return status == DRMF_SUCCESS;
+}
+
+bool ds_set_app_taint4(void *drcontext, app_pc app, uint value)
+{
+    if (value == 0 && !ds_summary_any_marked(app, sizeof(uint)))
+        return true;
+
+    if (direct_shadow)
+    {
+        ds_direct_write(app, sizeof(uint), (byte *)&value);
+        return true;
+    }
+
+    ds_summary_mark(app, sizeof(uint));
+
+    size_t sz = sizeof(uint);
+    drmf_status_t status = umbra_write_shadow_memory(umbra_map, app,
+                                                     sizeof(uint), &sz, (byte *)&value);
+    return status == DRMF_SUCCESS;
+}
+
+static inline size_t
+ds_direct_chunk_size(app_pc app, size_t size)
+/*
+ *    The number of bytes starting from %app% which have
+ *    contiguous shadow, i.e. don't wrap around the shadow window
+ */
+{
+    size_t left = DS_DIRECT_SIZE - ((ptr_uint_t)app & DS_DIRECT_MASK);
+    return size < left ? size : left;
+}
+
+static void
+ds_direct_set_range(app_pc app, size_t size, byte value)
+{
+    while (size > 0)
+    {
+        /* walk the range a summary region at a time */
+        size_t left = DS_SUMMARY_REGION - ((ptr_uint_t)app & (DS_SUMMARY_REGION - 1));
+        size_t chunk = size < left ? size : left;
+        uint window_region = ((ptr_uint_t)app & DS_DIRECT_MASK) >> DS_SUMMARY_SHIFT;
+        byte *shadow = ds_direct_app_to_shadow(app);
+
+        if (value == 0 && !direct_writable[window_region])
+        {
+            /* never written, so it's clean already */
+        }
+        else if (value == 0 && chunk == DS_SUMMARY_REGION)
+            ds_direct_release_region(window_region);
+
+        else
+        {
+            ds_direct_make_writable(window_region);
+            memset(shadow, value, chunk);
+        }
+
+        app += chunk;
+        size -= chunk;
+    }
+}
+
+static void
+ds_direct_move_range(app_pc dst, app_pc src, size_t size)
+{
+    /* Copy backwards if the ranges overlap and dst is above src */
+    bool backward = dst > src && dst < src + size;
+
+    ds_summary_mark(dst, size);
+
+    while (size > 0)
+    {
+        size_t chunk;
+
+        if (backward)
+        {
+            /* the last contiguous piece of both ranges */
+            size_t sl = ((ptr_uint_t)(src + size - 1) & DS_DIRECT_MASK) + 1;
+            size_t dl = ((ptr_uint_t)(dst + size - 1) & DS_DIRECT_MASK) + 1;
+            chunk = size;
+            if (sl < chunk)
+                chunk = sl;
+            if (dl < chunk)
+                chunk = dl;
+
+            memmove(ds_direct_app_to_shadow(dst + size - chunk),
+                    ds_direct_app_to_shadow(src + size - chunk), chunk);
+        }
+        else
+        {
+            chunk = ds_direct_chunk_size(dst, ds_direct_chunk_size(src, size));
+            memmove(ds_direct_app_to_shadow(dst),
+                    ds_direct_app_to_shadow(src), chunk);
+
+            src += chunk;
+            dst += chunk;
+        }
+
+        size -= chunk;
+    }
+}
+
+static void
+ds_umbra_release_blocks(app_pc start, app_pc end)
+/*
+ *    Decommit the private shadow blocks of [start, end), which must be
+ *    block aligned. The blocks aren't deleted: inline code of other
+ *    threads may be translating into them. They stay private, so the
+ *    summary keeps them marked since a later store to a private block
+ *    doesn't fault and so doesn't mark it
+ */
+{
+    umbra_shadow_memory_info_t info;
+    byte *shadow;
+    app_pc block;
+
+    info.struct_size = sizeof(info);
+    for (block = start; block < end; block += umbra_block_size)
+    {
+        if (umbra_get_shadow_memory(umbra_map, block, &shadow, &info) != DRMF_SUCCESS ||
+            info.shadow_type == UMBRA_SHADOW_MEMORY_TYPE_SHARED)
+            continue;
+
+        ds_decommit(shadow, umbra_block_size);
+    }
+}
+
+void ds_set_app_area_taint(void *drcontext, app_pc app, uint size, byte value)
+/*
+ *  Set linear memory area tainted, 
+ *  beginning from %app% and filling %size% bytes 
+ */
+{
+    size_t shadow_size;
+    drmf_status_t status;
+
+    if (direct_shadow)
+    {
+        ds_direct_set_range(app, size, value);
+        return;
+    }
+
+    if (size == 0)
+        return;
+
+    if (value == 0 && umbra_block_size != 0)
+    {
+        /* whole blocks are decommitted, only the edges are cleared */
+        app_pc start = (app_pc)ALIGN_FORWARD(app, umbra_block_size);
+        app_pc end = (app_pc)ALIGN_BACKWARD(app + size, umbra_block_size);
+
+        if (start < end)
+        {
+            ds_umbra_release_blocks(start, end);
+            ds_set_app_area_taint(drcontext, app, start - app, 0);
+            ds_set_app_area_taint(drcontext, end, app + size - end, 0);
+            return;
+        }
+    }
+
+    /* Untainting leaves the summary alone: private blocks
+     * are marked already and shared ones stay shared
+     */
+    if (value != 0)
+        ds_summary_mark(app, size);
+
+    /* Umbra walks the range one shadow block at a time and memsets it.
+     * Shared blocks already holding %value% (i.e. the default clean block
+     * when untainting) are left as is, so clearing clean memory is free.
+     */
+    status = umbra_shadow_set_range(umbra_map, app, size, &shadow_size, value, 1);
+    DR_ASSERT(status == DRMF_SUCCESS);
+}
+
+void ds_reclaim_app_area(void *drcontext, app_pc app, uint size)
+/*
+ *  The application doesn't use the area anymore (munmap, brk shrink),
+ *  clear its shadow. Whole direct regions and umbra blocks are
+ *  decommitted, the rest is cleared in place
+ */
+{
+    ds_set_app_area_taint(drcontext, app, size, 0);
+
+    if (direct_shadow)
+        ds_direct_unclaim(app, size);
+}
+
+void ds_add_app_area(void *drcontext, app_pc app, size_t size)
+/*
+ *  The application mapped [app, app + size). With the direct shadow
+ *  the memory must not alias memory of another 1GB area. By now
+ *  direct translations are emitted already, there is no way back
+ */
+{
+    if (!direct_shadow || ds_direct_claim(app, size))
+        return;
+
+    dr_fprintf(STDERR, "drtaint: " PFX "-" PFX " shares direct shadow with other memory, "
+                       "run without the direct shadow\n",
+               app, app + size);
+    dr_abort();
+}
+
+uint64 ds_get_reclaimed_bytes(void)
+{
+    return __atomic_load_n(&reclaimed_bytes, __ATOMIC_RELAXED);
+}
+
+uint64 ds_time_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static bool
+ds_count_private_block(umbra_map_t *map, const umbra_shadow_memory_info_t *info,
+                       void *user_data)
+{
+    if (info->shadow_type != UMBRA_SHADOW_MEMORY_TYPE_SHARED)
+        *(uint64 *)user_data += info->shadow_size;
+    return true;
+}
+
+void ds_get_stats(drtaint_stats_t *stats)
+/*
+ *  Fill in the shadow layer part of %stats%
+ */
+{
+    uint i;
+
+    stats->shadow_bytes = 0;
+    if (direct_shadow)
+    {
+        // writable regions are the only ones which may be backed by pages
+        for (i = 0; i < sizeof(direct_writable); i++)
+        {
+            if (direct_writable[i])
+                stats->shadow_bytes += DS_SUMMARY_REGION;
+        }
+    }
+    else
+    {
+        umbra_iterate_shadow_memory(umbra_map, &stats->shadow_bytes,
+                                    ds_count_private_block);
+    }
+
+    stats->faults = __atomic_load_n(&stat_faults, __ATOMIC_RELAXED);
+    stats->block_replacements = __atomic_load_n(&stat_block_replacements, __ATOMIC_RELAXED);
+    stats->foreign_faults = __atomic_load_n(&stat_foreign_faults, __ATOMIC_RELAXED);
+    stats->fault_ns = __atomic_load_n(&stat_fault_ns, __ATOMIC_RELAXED);
+    stats->reclaimed_bytes = ds_get_reclaimed_bytes();
+}
+
+bool ds_copy_app_taint(void *drcontext, app_pc dst, app_pc src, uint size)
+/*
+ *  Copy taint of %size% bytes from %src% to %dst%.
+ *  The ranges must not overlap
+ */
+{
+    size_t shadow_size;
+
+    /* a clean source only clears %dst%, which needs no marking */
+    if (!ds_summary_any_marked(src, size))
+    {
+        ds_set_app_area_taint(drcontext, dst, size, 0);
+        return true;
+    }
+
+    if (direct_shadow)
+    {
+        ds_direct_move_range(dst, src, size);
+        return true;
+    }
+
+    ds_summary_mark(dst, size);
+    return umbra_shadow_copy_range(umbra_map, src, dst, size,
+                                   &shadow_size) == DRMF_SUCCESS;
+}
+
+bool ds_move_app_taint(void *drcontext, app_pc dst, app_pc src, uint size)
+/*
+ *  Copy taint of %size% bytes from %src% to %dst%.
+ *  The ranges may overlap, like memmove
+ */
+{
+    byte buf[256];
+    bool backward = dst > src && dst < src + size;
+
+    /* a clean source only clears %dst%, see ds_copy_app_taint */
+    if (!ds_summary_any_marked(src, size))
+    {
+        ds_set_app_area_taint(drcontext, dst, size, 0);
+        return true;
+    }
+
+    if (direct_shadow)
+    {
+        ds_direct_move_range(dst, src, size);
+        return true;
+    }
+
+    if (dst + size <= src || src + size <= dst)
+        return ds_copy_app_taint(drcontext, dst, src, size);
+
+    ds_summary_mark(dst, size);
+
+    /* Overlapping ranges go through a bounce buffer,
+     * walking in the direction which doesn't clobber the source
+     */
+    while (size > 0)
+    {
+        size_t chunk = size < sizeof(buf) ? size : sizeof(buf);
+        size_t sz = chunk;
+        size_t offs = backward ? size - chunk : 0;
+
+        if (umbra_read_shadow_memory(umbra_map, src + offs, chunk,
+                                     &sz, buf) != DRMF_SUCCESS)
+            return false;
+        if (umbra_write_shadow_memory(umbra_map, dst + offs, chunk,
+                                      &sz, buf) != DRMF_SUCCESS)
+            return false;
+
+        if (!backward)
+        {
+            src += chunk;
+            dst += chunk;
+        }
+
+        size -= chunk;
+    }
+
+    return true;
+}
+
+static size_t
+ds_scan_tainted(const byte *shadow, size_t size)
+/*
+ *    Return offset of the first non-zero shadow byte or %size% if there is no one.
+ *    Shadow is scanned a word at a time, 4 words per iteration.
+ *    XXX: NEON would be faster, but DR doesn't preserve app SIMD
+ *    state around client code on ARM, so we stay with GPRs
+ */
+{
+    size_t i = 0;
+
+    // unaligned head
+    for (; i < size && !ALIGNED(shadow + i, sizeof(uint)); i++)
+    {
+        if (shadow[i] != 0)
+            return i;
+    }
+
+    for (; i + 4 * sizeof(uint) <= size; i += 4 * sizeof(uint))
+    {
+        const uint *w = (const uint *)(shadow + i);
+        if ((w[0] | w[1] | w[2] | w[3]) != 0)
+            break;
+    }
+
+    for (; i + sizeof(uint) <= size; i += sizeof(uint))
+    {
+        if (*(const uint *)(shadow + i) != 0)
+            break;
+    }
+
+    // the tail or the word containing taint
+    for (; i < size; i++)
+    {
+        if (shadow[i] != 0)
+            return i;
+    }
+
+    return size;
+}
+
+static inline size_t
+ds_page_run_size(app_pc app, size_t size)
+{
+    size_t left = ALIGN_FORWARD(app + 1, dr_page_size()) - (ptr_uint_t)app;
+    return size < left ? size : left;
+}
+
+bool ds_get_app_area_taint(void *drcontext, app_pc app, uint size, byte *result)
+/*
+ *  Copy taint of %size% bytes beginning from %app% to %result%
+ */
+{
+    size_t sz = size;
+
+    if (direct_shadow)
+    {
+        while (size > 0)
+        {
+            size_t chunk = ds_direct_chunk_size(app, size);
+            memcpy(result, ds_direct_app_to_shadow(app), chunk);
+
+            app += chunk;
+            result += chunk;
+            size -= chunk;
+        }
+        return true;
+    }
+
+    /* umbra copies the shared default block the same way,
+     * so there is nothing special to do for clean memory
+     */
+    return umbra_read_shadow_memory(umbra_map, app, size, &sz, result) == DRMF_SUCCESS &&
+           sz == size;
+}
+
+/* result of ds_scan_area */
+typedef enum
+{
+    DS_SCAN_CLEAN,
+    DS_SCAN_TAINTED,
+    DS_SCAN_FAILED,
+} ds_scan_t;
+
+static size_t
+ds_umbra_shared_run(app_pc app, size_t size)
+/*
+ *    The number of bytes from %app% on whose shadow is umbra's
+ *    shared default block, i.e. clean without reading it. 0 if
+ *    the shadow of %app% is private or its type is unknown
+ */
+{
+    umbra_shadow_memory_info_t info;
+    byte *shadow;
+    size_t run;
+
+    info.struct_size = sizeof(info);
+    if (umbra_get_shadow_memory(umbra_map, app, &shadow, &info) != DRMF_SUCCESS ||
+        !TEST(UMBRA_SHADOW_MEMORY_TYPE_SHARED, info.shadow_type))
+        return 0;
+
+    run = info.app_base + info.app_size - app;
+    return size < run ? size : run;
+}
+
+static ds_scan_t
+ds_scan_area(void *drcontext, app_pc app, uint size, uint *offset)
+/*
+ *  Find the first tainted byte in area beginning from %app% and
+ *  filling %size% bytes. Regions which never held taint according
+ *  to the page summary and umbra shared blocks are skipped unread
+ */
+{
+    byte buf[256];
+    uint done = 0;
+
+    while (done < size)
+    {
+        app_pc cur = app + done;
+        size_t left = size - done;
+        size_t region_left = DS_SUMMARY_REGION - ((ptr_uint_t)cur & (DS_SUMMARY_REGION - 1));
+        size_t chunk, found;
+
+        if (!TESTANY(DS_SUMMARY_PRIVATE, summary[(ptr_uint_t)cur >> DS_SUMMARY_SHIFT]))
+        {
+            done += left < region_left ? left : region_left;
+            continue;
+        }
+
+        if (direct_shadow)
+        {
+            chunk = ds_direct_chunk_size(cur, left);
+            found = ds_scan_tainted(ds_direct_app_to_shadow(cur), chunk);
+        }
+        else
+        {
+            chunk = ds_umbra_shared_run(cur, left);
+            if (chunk > 0)
+            {
+                done += chunk;
+                continue;
+            }
+
+            /* don't let a read cross a page, so that each one
+             * hits a single (possibly shared) shadow block
+             */
+            chunk = ds_page_run_size(cur, left);
+            if (chunk > sizeof(buf))
+                chunk = sizeof(buf);
+
+            if (!ds_get_app_area_taint(drcontext, cur, chunk, buf))
+                return DS_SCAN_FAILED;
+            found = ds_scan_tainted(buf, chunk);
+        }
+
+        if (found < chunk)
+        {
+            if (offset != NULL)
+                *offset = done + found;
+            return DS_SCAN_TAINTED;
+        }
+
+        done += chunk;
+    }
+
+    return DS_SCAN_CLEAN;
+}
+
+bool ds_find_tainted(void *drcontext, app_pc app, uint size, uint *offset)
+/*
+ *  Return true and the offset of the first tainted byte of the area
+ *  if it exists. False if it's clean or its shadow couldn't be read
+ */
+{
+    return ds_scan_area(drcontext, app, size, offset) == DS_SCAN_TAINTED;
+}
+
+bool ds_is_area_clean(void *drcontext, app_pc app, uint size)
+/*
+ *  Return true only if the whole shadow of the area was checked
+ *  and none of it is tainted
+ */
+{
+    return ds_scan_area(drcontext, app, size, NULL) == DS_SCAN_CLEAN;
+}
+
+/* ======================================================================================
+ * shadow memory implementation
+ * ==================================================================================== */
+
+static bool
+ds_direct_map(byte *addr, size_t size, uint prot)
+{
+    void *mem = dr_raw_mem_alloc(size, prot, addr);
+
+    if (mem == NULL)
+        return false;
+
+    /* the address is only a hint, we need exactly this one */
+    if (mem != addr)
+    {
+        dr_raw_mem_free(mem, size);
+        return false;
+    }
+
+    return true;
+}
+
+static bool
+ds_direct_claim_existing(void)
+/*
+ *    Claim the window for the memory mapped before we took over,
+ *    i.e. the executable, the loader, the stack and the vdso
+ */
+{
+    ptr_uint_t pc = 0;
+    dr_mem_info_t info;
+
+    while (dr_query_memory_ex((byte *)pc, &info))
+    {
+        ptr_uint_t next = (ptr_uint_t)info.base_pc + info.size;
+
+        if (ds_direct_is_app_area(&info) && !ds_direct_claim(info.base_pc, info.size))
+            return false;
+
+        // the last area ends at the top of the address space
+        if (next <= pc)
+            break;
+        pc = next;
+    }
+
+    return true;
+}
+
+static void
+ds_direct_module_load(void *drcontext, const module_data_t *info, bool loaded)
+{
+    ds_add_app_area(drcontext, info->start, info->end - info->start);
+}
+
+static void
+ds_direct_unmap(void)
+{
+    dr_raw_mem_free((void *)DS_DIRECT_BASE, DS_DIRECT_SIZE);
+    if (direct_guards)
+    {
+        dr_raw_mem_free((byte *)DS_DIRECT_BASE - DS_DIRECT_GUARD, DS_DIRECT_GUARD);
+        dr_raw_mem_free((byte *)DS_DIRECT_BASE + DS_DIRECT_SIZE, DS_DIRECT_GUARD);
+        direct_guards = false;
+    }
+}
+
+static bool
+ds_direct_init(void)
+/*
+ *    Reserve the shadow window. dr_raw_mem_alloc has no
+ *    MAP_NORESERVE, but a read-only private mapping isn't
+ *    charged against the commit limit: a region is charged
+ *    when it's made writable, 64KB at a time. Pages are backed
+ *    lazily by the kernel on the first touch
+ */
+{
+    if (!ds_direct_map((byte *)DS_DIRECT_BASE, DS_DIRECT_SIZE, DR_MEMPROT_READ))
+        return false;
+
+    /* the guards are optional, without them translations aren't coalesced */
+    direct_guards = ds_direct_map((byte *)DS_DIRECT_BASE - DS_DIRECT_GUARD,
+                                  DS_DIRECT_GUARD, DR_MEMPROT_NONE) &&
+                    ds_direct_map((byte *)DS_DIRECT_BASE + DS_DIRECT_SIZE,
+                                  DS_DIRECT_GUARD, DR_MEMPROT_NONE);
+
+    /* memory already sharing shadow can't be told apart */
+    direct_lock = dr_mutex_create();
+    if (!ds_direct_claim_existing())
+    {
+        dr_log(NULL, DR_LOG_ALL, 1,
+               "drtaint: application memory aliases in the direct shadow window\n");
+        ds_direct_unmap();
+        dr_mutex_destroy(direct_lock);
+        memset(direct_owner, 0, sizeof(direct_owner));
+        return false;
+    }
+
+    drmgr_register_module_load_event(ds_direct_module_load);
+    return true;
+}
+
+static bool
+ds_mem_init(int id, bool direct)
+{
+    umbra_map_options_t umbra_map_ops;
+    drmgr_init();
+
+    if (direct)
+    {
+        direct_shadow = ds_direct_init();
+        if (direct_shadow)
+        {
+            drmgr_register_signal_event(event_signal_instrumentation);
+            return true;
+        }
+
+        dr_log(NULL, DR_LOG_ALL, 1,
+               "drtaint: failed to set up direct shadow window, using umbra\n");
+    }
+
+    /* initialize umbra and lazy page handling */
+    memset(&umbra_map_ops, 0, sizeof(umbra_map_ops));
+    umbra_map_ops.scale = UMBRA_MAP_SCALE_SAME_1X;
+    umbra_map_ops.flags = UMBRA_MAP_CREATE_SHADOW_ON_TOUCH |
+                          UMBRA_MAP_SHADOW_SHARED_READONLY;
+
+    umbra_map_ops.default_value = 0;
+    umbra_map_ops.default_value_size = 1;
+
+    if (umbra_init(id) != DRMF_SUCCESS)
+        return false;
+    if (umbra_create_mapping(&umbra_map_ops, &umbra_map) != DRMF_SUCCESS)
+        return false;
+    if (umbra_get_shadow_block_size(umbra_map, &umbra_block_size) != DRMF_SUCCESS)
+        umbra_block_size = 0;
+
+    drmgr_register_signal_event(event_signal_instrumentation);
+    return true;
+}
+
+static void
+ds_mem_exit(void)
+{
+    if (direct_shadow)
+    {
+        drmgr_unregister_module_load_event(ds_direct_module_load);
+        ds_direct_unmap();
+        dr_mutex_destroy(direct_lock);
+        direct_shadow = false;
+        drmgr_unregister_signal_event(event_signal_instrumentation);
+        drmgr_exit();
+        return;
+    }
+
+    if (umbra_destroy_mapping(umbra_map) != DRMF_SUCCESS)
+        DR_ASSERT(false);
+
+    drmgr_unregister_signal_event(event_signal_instrumentation);
+    umbra_exit();
+    drmgr_exit();
+}
+
+static reg_id_t
+get_faulting_shadow_reg(void *drcontext, dr_mcontext_t *mc)
+{
+    instr_t inst;
+    reg_id_t reg;
+
+    instr_init(drcontext, &inst);
+    decode(drcontext, mc->pc, &inst);
+
+    DR_ASSERT_MSG(opnd_is_base_disp(instr_get_dst(&inst, 0)), "Emulation error");
+    reg = opnd_get_base(instr_get_dst(&inst, 0));
+    DR_ASSERT_MSG(reg != DR_REG_NULL, "Emulation error");
+
+    instr_free(drcontext, &inst);
+    return reg;
+}
+
+static bool
+handle_special_shadow_fault(void *drcontext, dr_mcontext_t *raw_mc, app_pc app_shadow)
+{
+    umbra_shadow_memory_type_t shadow_type;
+    app_pc app_target;
+    reg_id_t reg;
+
+    /* If a fault occured, it is probably because we computed the
+     * address of shadow memory which was initialized to a shared
+     * readonly shadow block. We allocate a shadow page there and
+     * replace the reg value used by the faulting instr.
+     */
+
+    /* handle faults from writes to special shadow blocks */
+    if (umbra_shadow_memory_is_shared(umbra_map, app_shadow,
+                                      &shadow_type) != DRMF_SUCCESS)
+    {
+        DR_ASSERT(false);
+        return true;
+    }
+    if (shadow_type != UMBRA_SHADOW_MEMORY_TYPE_SHARED)
+        return true;
+
+    /* Grab the original app target out of the spill slot so we
+     * don't have to compute the app target ourselves (this is
+     * difficult).
+     */
+    app_target = (app_pc)dr_read_saved_reg(drcontext, SPILL_SLOT_2);
+
+    /* replace the shared block, and record the new app shadow */
+    if (umbra_replace_shared_shadow_memory(umbra_map, app_target,
+                                           &app_shadow) != DRMF_SUCCESS)
+    {
+        DR_ASSERT(false);
+        return true;
+    }
+
+    __atomic_fetch_add(&stat_block_replacements, 1, __ATOMIC_RELAXED);
+
+    /* the whole block became private, mark it possibly tainted */
+    if (umbra_block_size != 0)
+        ds_summary_mark((app_pc)ALIGN_BACKWARD(app_target, umbra_block_size), umbra_block_size);
+    else
+        ds_summary_mark(app_target, 1);
+
+    /* Replace the faulting register value to reflect the new shadow
+     * memory.
+     */
+    reg = get_faulting_shadow_reg(drcontext, raw_mc);
+    reg_set_value(reg, raw_mc, (reg_t)app_shadow);
+    return false;
+}
+
+static dr_signal_action_t
+event_signal_instrumentation(void *drcontext, dr_siginfo_t *info)
+{
+    if (info->sig != SIGSEGV && info->sig != SIGBUS)
+        return DR_SIGNAL_DELIVER;
+
+    uint64 start = time_faults ? ds_time_ns() : 0;
+    dr_signal_action_t action;
+
+    if (direct_shadow)
+    {
+        ptr_uint_t addr = (ptr_uint_t)info->access_address;
+        if (addr < DS_DIRECT_BASE || addr >= DS_DIRECT_BASE + DS_DIRECT_SIZE)
+        {
+            __atomic_fetch_add(&stat_foreign_faults, 1, __ATOMIC_RELAXED);
+            return DR_SIGNAL_DELIVER;
+        }
+
+        /* make the region writable and re-execute the store */
+        ds_direct_make_writable((addr - DS_DIRECT_BASE) >> DS_SUMMARY_SHIFT);
+        action = DR_SIGNAL_SUPPRESS;
+    }
+    else
+    {
+        DR_ASSERT(info->raw_mcontext_valid);
+        action = handle_special_shadow_fault(drcontext, info->raw_mcontext,
+                                             info->access_address)
+                     ? DR_SIGNAL_DELIVER
+                     : DR_SIGNAL_SUPPRESS;
+    }
+
+    if (action == DR_SIGNAL_DELIVER)
+    {
+        __atomic_fetch_add(&stat_foreign_faults, 1, __ATOMIC_RELAXED);
+        return action;
+    }
+
+    __atomic_fetch_add(&stat_faults, 1, __ATOMIC_RELAXED);
+    if (time_faults)
+        __atomic_fetch_add(&stat_fault_ns, ds_time_ns() - start, __ATOMIC_RELAXED);
+    return action;
+}
+
+/* ======================================================================================
+ * shadow registers implementation
+ * ==================================================================================== */
+static bool
+ds_reg_init(void)
+{
+    drmgr_priority_t exit_priority = {
+        sizeof(exit_priority), DRMGR_PRIORITY_NAME_DRTAINT_EXIT, NULL, NULL,
+        DRMGR_PRIORITY_THREAD_EXIT_DRTAINT};
+
+    drmgr_priority_t init_priority = {
+        sizeof(init_priority), DRMGR_PRIORITY_NAME_DRTAINT_INIT, NULL, NULL,
+        DRMGR_PRIORITY_THREAD_INIT_DRTAINT};
+
+    drmgr_init();
+    drmgr_register_thread_init_event_ex(event_thread_init, &init_priority);
+    drmgr_register_thread_exit_event_ex(event_thread_exit, &exit_priority);
+
+    /* initialize tls for instrumentation time data */
+    instr_tls_index = drmgr_register_tls_field();
+    if (instr_tls_index == -1)
+        return false;
+
+    /* initialize raw tls for per-thread data */
+    if (!dr_raw_tls_calloc(&tls_seg, &tls_offs, DS_TLS_SLOTS, DS_CACHE_LINE))
+        return false;
+
+    /* offsets of the fields are folded into ldr/str, which take 12 bits */
+    DR_ASSERT(tls_offs + sizeof(per_thread_t) < 4096);
+    return true;
+}
+
+static inline per_thread_t *
+ds_get_per_thread(void *drcontext)
+/*
+ *    The segment base only gives the raw slots of the current thread,
+ *    so their address is kept with the thread's drcontext. Any
+ *    thread's drcontext may be passed to the shadow register API
+ */
+{
+    per_thread_instr_t *pti = drmgr_get_tls_field(drcontext, instr_tls_index);
+    return pti->regs;
+}
+
+bool ds_insert_reg_to_shadow(void *drcontext, instrlist_t *ilist, instr_t *where,
+                             reg_id_t shadow, reg_id_t regaddr)
+/*
+ *    Inserts instructions to gain shadow %shadow% register's address 
+ *    of the current thread and place result to register of %regaddr% 
+ */
+{
+    DR_ASSERT(shadow - DR_REG_R0 < DR_NUM_GPR_REGS);
+    unsigned int offs = offsetof(per_thread_t, shadow_gprs[shadow - DR_REG_R0]);
+    per_thread_instr_t *pti = drmgr_get_tls_field(drcontext, instr_tls_index);
+
+    /* the caller accesses the shadow register file directly */
+    if (pti->resident[shadow - DR_REG_R0] != DR_REG_NULL)
+    {
+        ds_insert_resident_writeback(drcontext, ilist, where, shadow - DR_REG_R0);
+        pti->resident_valid[shadow - DR_REG_R0] = false;
+    }
+
+    if (pti->shadow_base != DR_REG_NULL)
+    {
+        /* out <- %regaddr% = &shadow_gprs[offs] */
+        instrlist_meta_preinsert(ilist, where,
+                                 XINST_CREATE_add_2src(drcontext, /* regaddr = shadow_base + offs */
+                                                       opnd_create_reg(regaddr),
+                                                       opnd_create_reg(pti->shadow_base),
+                                                       OPND_CREATE_INT8(offs)));
+        pti->saved += seg_base_len + (tls_offs != 0 ? 1 : 0);
+        return true;
+    }
+
+    /* Load the raw TLS base, per_thread data structure holding
+     * the thread-local taint values of each register follows it
+     */
+    dr_insert_get_seg_base(drcontext, ilist, where, tls_seg, regaddr);
+
+    /* %tls_offs% is cache line aligned and %offs% is within a line,
+     * so each of them is a valid immediate while their sum may be not
+     */
+    if (tls_offs != 0)
+    {
+        instrlist_meta_preinsert(ilist, where,
+                                 XINST_CREATE_add(drcontext, /* regaddr = regaddr + tls_offs */
+                                                  opnd_create_reg(regaddr),
+                                                  OPND_CREATE_INT(tls_offs)));
+    }
 
     /* out <- %regaddr% = &shadow_gprs[offs] */
     instrlist_meta_preinsert(ilist, where,
@@ -315,37 +1658,508 @@ bool ds_insert_reg_to_shadow(void *drcontext, instrlist_t *ilist, instr_t *where
     return true;
 }
 
-bool ds_insert_reg_to_shadow_load(void *drcontext, instrlist_t *ilist,
-                                  instr_t *where, reg_id_t shadow,
-                                  reg_id_t regaddr)
+bool ds_insert_reg_to_shadow_load(void *drcontext, instrlist_t *ilist,
+                                  instr_t *where, reg_id_t shadow,
+                                  reg_id_t regaddr)
+/*
+ *    Inserts instructions to gain shadow %shadow% register's value 
+ *    of the current thread and place result to register of %regaddr% 
+ */
+{
+    DR_ASSERT(shadow - DR_REG_R0 < DR_NUM_GPR_REGS);
+    unsigned int offs = offsetof(per_thread_t, shadow_gprs[shadow - DR_REG_R0]);
+    per_thread_instr_t *pti = drmgr_get_tls_field(drcontext, instr_tls_index);
+    reg_id_t resident = pti->resident[shadow - DR_REG_R0];
+
+    if (resident != DR_REG_NULL)
+    {
+        if (!pti->resident_valid[shadow - DR_REG_R0])
+            ds_insert_resident_load(drcontext, ilist, where, shadow - DR_REG_R0);
+
+        /* out <- %regaddr% = resident */
+        instrlist_meta_preinsert(ilist, where,
+                                 XINST_CREATE_move(drcontext, /* mov regaddr, resident */
+                                                   opnd_create_reg(regaddr),
+                                                   opnd_create_reg(resident)));
+        pti->resident_accesses++;
+        return true;
+    }
+
+    if (pti->shadow_base != DR_REG_NULL)
+    {
+        /* out <- %regaddr% = shadow_gprs[offs] */
+        instrlist_meta_preinsert(ilist, where,
+                                 XINST_CREATE_load(drcontext, /* ldr regaddr, [shadow_base, #offs] */
+                                                   opnd_create_reg(regaddr),
+                                                   OPND_CREATE_MEM32(pti->shadow_base, offs)));
+        pti->saved += seg_base_len;
+        return true;
+    }
+
+    offs += tls_offs;
+
+    /* Load the raw TLS base, per_thread data structure holding
+     * the thread-local taint values of each register follows it
+     */
+    dr_insert_get_seg_base(drcontext, ilist, where, tls_seg, regaddr);
+
+    /* out <- %regaddr% = shadow_gprs[offs] */
+    instrlist_meta_preinsert(ilist, where,
+                             XINST_CREATE_load(drcontext, /* ldr regaddr, [regaddr, #offs] */
+                                               opnd_create_reg(regaddr),
+                                               OPND_CREATE_MEM32(regaddr, offs)));
+
+    return true;
+}
+
+bool ds_insert_reg_to_shadow_store(void *drcontext, instrlist_t *ilist,
+                                   instr_t *where, reg_id_t shadow,
+                                   reg_id_t value, reg_id_t regaddr)
+/*
+ *    Inserts instructions to set shadow %shadow% register's value
+ *    of the current thread to %value%, %regaddr% is used as a scratch
+ */
+{
+    DR_ASSERT(shadow - DR_REG_R0 < DR_NUM_GPR_REGS);
+    per_thread_instr_t *pti = drmgr_get_tls_field(drcontext, instr_tls_index);
+    uint i = shadow - DR_REG_R0;
+
+    /* A predicated write may not happen: the resident register
+     * becomes valid only if it holds the current value already
+     */
+    if (pti->resident[i] != DR_REG_NULL &&
+        (pti->resident_valid[i] || !instr_is_predicated(where)))
+    {
+        instrlist_meta_preinsert(ilist, where,
+                                 XINST_CREATE_move(drcontext, /* mov resident, value */
+                                                   opnd_create_reg(pti->resident[i]),
+                                                   opnd_create_reg(value)));
+        pti->resident_valid[i] = true;
+        pti->resident_dirty[i] = true;
+        pti->resident_accesses++;
+        return true;
+    }
+
+    ds_insert_reg_to_shadow(drcontext, ilist, where, shadow, regaddr);
+    instrlist_meta_preinsert(ilist, where,
+                             XINST_CREATE_store(drcontext, /* str value, [regaddr] */
+                                                OPND_CREATE_MEM32(regaddr, 0),
+                                                opnd_create_reg(value)));
+    return true;
+}
+
+static void
+ds_insert_resident_load(void *drcontext, instrlist_t *ilist, instr_t *where, uint i)
+/*
+ *    Load the shadow of the i-th app register to its resident register.
+ *    It's done whether %where% executes or not
+ */
+{
+    per_thread_instr_t *pti = drmgr_get_tls_field(drcontext, instr_tls_index);
+    dr_pred_type_t pred = instrlist_get_auto_predicate(ilist);
+
+    instrlist_set_auto_predicate(ilist, DR_PRED_NONE);
+    instrlist_meta_preinsert(ilist, where,
+                             XINST_CREATE_load(drcontext, /* ldr resident, [shadow_base, #offs] */
+                                               opnd_create_reg(pti->resident[i]),
+                                               OPND_CREATE_MEM32(pti->shadow_base,
+                                                                 offsetof(per_thread_t,
+                                                                          shadow_gprs[i]))));
+    instrlist_set_auto_predicate(ilist, pred);
+
+    pti->resident_valid[i] = true;
+    pti->resident_dirty[i] = false;
+}
+
+static void
+ds_insert_resident_writeback(void *drcontext, instrlist_t *ilist, instr_t *where, uint i)
+/*
+ *    Store the resident register of the i-th app register
+ *    to the shadow register file if it was changed
+ */
+{
+    per_thread_instr_t *pti = drmgr_get_tls_field(drcontext, instr_tls_index);
+    dr_pred_type_t pred = instrlist_get_auto_predicate(ilist);
+
+    if (!pti->resident_dirty[i])
+        return;
+
+    instrlist_set_auto_predicate(ilist, DR_PRED_NONE);
+    instrlist_meta_preinsert(ilist, where,
+                             XINST_CREATE_store(drcontext, /* str resident, [shadow_base, #offs] */
+                                                OPND_CREATE_MEM32(pti->shadow_base,
+                                                                  offsetof(per_thread_t,
+                                                                           shadow_gprs[i])),
+                                                opnd_create_reg(pti->resident[i])));
+    instrlist_set_auto_predicate(ilist, pred);
+
+    pti->resident_dirty[i] = false;
+}
+
+void ds_make_resident(void *drcontext, reg_id_t shadow, reg_id_t holder)
 /*
- *    Inserts instructions to gain shadow %shadow% register's value 
- *    of the current thread and place result to register of %regaddr% 
+ *    Keep the shadow of %shadow% register in %holder% until
+ *    ds_clear_residents. It's loaded on the first read.
+ *    Requires the register set by ds_insert_shadow_base
  */
 {
+    per_thread_instr_t *pti = drmgr_get_tls_field(drcontext, instr_tls_index);
+
     DR_ASSERT(shadow - DR_REG_R0 < DR_NUM_GPR_REGS);
-    unsigned int offs = offsetof(per_thread_t, shadow_gprs[shadow - DR_REG_R0]);
+    DR_ASSERT(pti->shadow_base != DR_REG_NULL);
 
-    /* Load the per_thread data structure holding
-     * the thread-local taint values of each register to %regaddr%
-     */
-    drmgr_insert_read_tls_field(drcontext, tls_index, ilist, where, regaddr);
+    pti->resident[shadow - DR_REG_R0] = holder;
+    pti->resident_valid[shadow - DR_REG_R0] = false;
+    pti->resident_dirty[shadow - DR_REG_R0] = false;
+}
 
-    /* out <- %regaddr% = shadow_gprs[offs] */
+void ds_resident_writeback(void *drcontext, instrlist_t *ilist, instr_t *where)
+/*
+ *    Store changed resident registers before %where%,
+ *    so that the shadow register file is up to date if it faults
+ *    or its handling reads the file directly
+ */
+{
+    per_thread_instr_t *pti = drmgr_get_tls_field(drcontext, instr_tls_index);
+
+    for (uint i = 0; i < DR_NUM_GPR_REGS; i++)
+    {
+        if (pti->resident[i] != DR_REG_NULL)
+            ds_insert_resident_writeback(drcontext, ilist, where, i);
+    }
+}
+
+void ds_resident_invalidate(void *drcontext)
+/*
+ *    The shadow register file might be changed directly,
+ *    resident registers are loaded again on the next read
+ */
+{
+    per_thread_instr_t *pti = drmgr_get_tls_field(drcontext, instr_tls_index);
+    memset(pti->resident_valid, 0, sizeof(pti->resident_valid));
+}
+
+uint ds_clear_residents(void *drcontext, instrlist_t *ilist, instr_t *where)
+/*
+ *    Write back resident registers before %where% and stop using them.
+ *    Return the number of shadow register accesses they served
+ */
+{
+    per_thread_instr_t *pti = drmgr_get_tls_field(drcontext, instr_tls_index);
+    uint accesses = pti->resident_accesses;
+
+    if (ilist != NULL)
+        ds_resident_writeback(drcontext, ilist, where);
+
+    memset(pti->resident, 0, sizeof(pti->resident));
+    memset(pti->resident_valid, 0, sizeof(pti->resident_valid));
+    memset(pti->resident_dirty, 0, sizeof(pti->resident_dirty));
+    pti->resident_accesses = 0;
+    return accesses;
+}
+
+void ds_insert_any_reg_tainted_load(void *drcontext, instrlist_t *ilist, instr_t *where,
+                                    reg_id_t result)
+/*
+ *    Load the flag which is zero if no register of the current thread
+ *    is tainted to %result%. Nonzero doesn't mean some is: the flag is
+ *    set conservatively and cleared by ds_insert_any_reg_tainted_update
+ */
+{
+    dr_insert_get_seg_base(drcontext, ilist, where, tls_seg, result);
+
+    /* out <- %result% = any_reg_tainted */
     instrlist_meta_preinsert(ilist, where,
-                             XINST_CREATE_load(drcontext, /* ldr regaddr, [regaddr, #offs] */
-                                               opnd_create_reg(regaddr),
-                                               OPND_CREATE_MEM32(regaddr, offs)));
+                             XINST_CREATE_load(drcontext, /* ldr result, [result, #offs] */
+                                               opnd_create_reg(result),
+                                               OPND_CREATE_MEM32(result,
+                                                                 tls_offs +
+                                                                     offsetof(per_thread_t,
+                                                                              any_reg_tainted))));
+}
+
+void ds_insert_any_reg_tainted_update(void *drcontext, instrlist_t *ilist, instr_t *where,
+                                      reg_id_t base, reg_id_t acc, reg_id_t scratch)
+/*
+ *    Recompute the flag from all shadow registers
+ */
+{
+    dr_insert_get_seg_base(drcontext, ilist, where, tls_seg, base);
+    if (tls_offs != 0)
+    {
+        instrlist_meta_preinsert(ilist, where,
+                                 XINST_CREATE_add(drcontext, /* base = base + tls_offs */
+                                                  opnd_create_reg(base),
+                                                  OPND_CREATE_INT(tls_offs)));
+    }
+
+    instrlist_meta_preinsert(ilist, where,
+                             XINST_CREATE_load(drcontext, /* ldr acc, [base] */
+                                               opnd_create_reg(acc),
+                                               OPND_CREATE_MEM32(base, 0)));
+
+    for (uint i = 1; i < DR_NUM_GPR_REGS; i++)
+    {
+        instrlist_meta_preinsert(ilist, where,
+                                 XINST_CREATE_load(drcontext, /* ldr scratch, [base, #offs] */
+                                                   opnd_create_reg(scratch),
+                                                   OPND_CREATE_MEM32(base,
+                                                                     offsetof(per_thread_t,
+                                                                              shadow_gprs[i]))));
+        instrlist_meta_preinsert(ilist, where,
+                                 INSTR_CREATE_orr(drcontext, /* acc |= scratch */
+                                                  opnd_create_reg(acc),
+                                                  opnd_create_reg(acc),
+                                                  opnd_create_reg(scratch)));
+    }
+
+    instrlist_meta_preinsert(ilist, where,
+                             XINST_CREATE_store(drcontext, /* str acc, [base, #offs] */
+                                                OPND_CREATE_MEM32(base,
+                                                                  offsetof(per_thread_t,
+                                                                           any_reg_tainted)),
+                                                opnd_create_reg(acc)));
+}
+
+void ds_insert_any_reg_tainted_set(void *drcontext, instrlist_t *ilist, instr_t *where,
+                                   reg_id_t value, reg_id_t base)
+/*
+ *    Set the flag to %value%
+ */
+{
+    dr_insert_get_seg_base(drcontext, ilist, where, tls_seg, base);
+    if (tls_offs != 0)
+    {
+        instrlist_meta_preinsert(ilist, where,
+                                 XINST_CREATE_add(drcontext, /* base = base + tls_offs */
+                                                  opnd_create_reg(base),
+                                                  OPND_CREATE_INT(tls_offs)));
+    }
+
+    instrlist_meta_preinsert(ilist, where,
+                             XINST_CREATE_store(drcontext, /* str value, [base, #offs] */
+                                                OPND_CREATE_MEM32(base,
+                                                                  offsetof(per_thread_t,
+                                                                           any_reg_tainted)),
+                                                opnd_create_reg(value)));
+}
+
+void ds_insert_any_reg_tainted_or(void *drcontext, instrlist_t *ilist, instr_t *where,
+                                  reg_id_t value, reg_id_t base, reg_id_t scratch)
+/*
+ *    Set the flag if %value% is nonzero
+ */
+{
+    dr_insert_get_seg_base(drcontext, ilist, where, tls_seg, base);
+    if (tls_offs != 0)
+    {
+        instrlist_meta_preinsert(ilist, where,
+                                 XINST_CREATE_add(drcontext, /* base = base + tls_offs */
+                                                  opnd_create_reg(base),
+                                                  OPND_CREATE_INT(tls_offs)));
+    }
+
+    instrlist_meta_preinsert(ilist, where,
+                             XINST_CREATE_load(drcontext, /* ldr scratch, [base, #offs] */
+                                               opnd_create_reg(scratch),
+                                               OPND_CREATE_MEM32(base,
+                                                                 offsetof(per_thread_t,
+                                                                          any_reg_tainted))));
+    instrlist_meta_preinsert(ilist, where,
+                             INSTR_CREATE_orr(drcontext, /* scratch |= value */
+                                              opnd_create_reg(scratch),
+                                              opnd_create_reg(scratch),
+                                              opnd_create_reg(value)));
+    instrlist_meta_preinsert(ilist, where,
+                             XINST_CREATE_store(drcontext, /* str scratch, [base, #offs] */
+                                                OPND_CREATE_MEM32(base,
+                                                                  offsetof(per_thread_t,
+                                                                           any_reg_tainted)),
+                                                opnd_create_reg(scratch)));
+}
+
+uint ds_insert_shadow_base(void *drcontext, instrlist_t *ilist, instr_t *where,
+                           reg_id_t base)
+/*
+ *    Load the address of the shadow register file to %base%.
+ *    Until ds_clear_shadow_base is called, shadow register accesses
+ *    of this thread's instrumentation use it instead of loading it again.
+ *    Return the number of inserted instructions
+ */
+{
+    per_thread_instr_t *pti = drmgr_get_tls_field(drcontext, instr_tls_index);
+    instr_t *prev = instr_get_prev(where);
+    instr_t *in;
+    uint count = 0;
+
+    dr_insert_get_seg_base(drcontext, ilist, where, tls_seg, base);
+    for (in = prev == NULL ? instrlist_first(ilist) : instr_get_next(prev);
+         in != where; in = instr_get_next(in))
+        count++;
+    seg_base_len = count;
+
+    if (tls_offs != 0)
+    {
+        instrlist_meta_preinsert(ilist, where,
+                                 XINST_CREATE_add(drcontext, /* base = base + tls_offs */
+                                                  opnd_create_reg(base),
+                                                  OPND_CREATE_INT(tls_offs)));
+        count++;
+    }
+
+    pti->shadow_base = base;
+    pti->saved = 0;
+    return count;
+}
+
+bool ds_can_coalesce(void)
+/*
+ *    Umbra shadow blocks aren't contiguous, a check whether two accesses
+ *    hit the same block costs as much as the translation itself
+ */
+{
+    return direct_shadow && direct_guards;
+}
+
+void ds_start_coalescing(void *drcontext, reg_id_t app_base, reg_id_t cache)
+/*
+ *    Translate accesses via %app_base% relative to a shadow address
+ *    kept in %cache% until ds_stop_coalescing
+ */
+{
+    per_thread_instr_t *pti = drmgr_get_tls_field(drcontext, instr_tls_index);
+
+    pti->app_base = app_base;
+    pti->cache = cache;
+    pti->cache_valid = false;
+    pti->coalesced = 0;
+}
+
+void ds_coalescing_update(void *drcontext, instr_t *instr)
+/*
+ *    Called after each app instruction: the cached
+ *    translation is lost once the base register is written
+ */
+{
+    per_thread_instr_t *pti = drmgr_get_tls_field(drcontext, instr_tls_index);
+
+    if (pti->app_base != DR_REG_NULL &&
+        instr_writes_to_reg(instr, pti->app_base, DR_QUERY_INCLUDE_ALL))
+        pti->cache_valid = false;
+}
+
+uint ds_stop_coalescing(void *drcontext)
+/*
+ *    Return the number of coalesced translations
+ */
+{
+    per_thread_instr_t *pti = drmgr_get_tls_field(drcontext, instr_tls_index);
+    uint coalesced = pti->coalesced;
+
+    pti->app_base = DR_REG_NULL;
+    pti->cache = DR_REG_NULL;
+    pti->cache_valid = false;
+    pti->coalesced = 0;
+    return coalesced;
+}
+
+static void
+ds_insert_add_disp(void *drcontext, instrlist_t *ilist, instr_t *where,
+                   reg_id_t dst, reg_id_t src, int disp)
+{
+    if (disp >= 0)
+    {
+        instrlist_meta_preinsert(ilist, where,
+                                 XINST_CREATE_add_2src(drcontext, /* add dst, src, #disp */
+                                                       opnd_create_reg(dst),
+                                                       opnd_create_reg(src),
+                                                       OPND_CREATE_INT32(disp)));
+    }
+    else
+    {
+        instrlist_meta_preinsert(ilist, where,
+                                 XINST_CREATE_sub_2src(drcontext, /* sub dst, src, #-disp */
+                                                       opnd_create_reg(dst),
+                                                       opnd_create_reg(src),
+                                                       OPND_CREATE_INT32(-disp)));
+    }
+}
+
+bool ds_insert_mem_to_shadow(void *drcontext, instrlist_t *ilist, instr_t *where,
+                             opnd_t mem, reg_id_t regaddr)
+/*
+ *    Place the shadow address of [base + disp] memory operand to %regaddr%
+ *    using the translation of a previous access via the same base.
+ *    The first access is translated in full into the cache register.
+ *    Return false if the operand can't be handled this way,
+ *    the caller translates it as usual then
+ */
+{
+    per_thread_instr_t *pti = drmgr_get_tls_field(drcontext, instr_tls_index);
+    int disp;
+
+    if (pti->app_base == DR_REG_NULL || !opnd_is_base_disp(mem) ||
+        opnd_get_base(mem) != pti->app_base || opnd_get_index(mem) != DR_REG_NULL)
+        return false;
+
+    disp = opnd_get_disp(mem);
+
+    /* only 8-bit displacements are valid immediates in both ARM and Thumb */
+    if (!pti->cache_valid)
+    {
+        if (disp < -255 || disp > 255)
+            return false;
+
+        /* meta instructions of a predicated instruction are predicated too,
+         * the cache would be left unset if it's not executed
+         */
+        if (instr_is_predicated(where))
+            return false;
+
+        /* cache = shadow(base + disp) */
+        ds_insert_add_disp(drcontext, ilist, where, pti->cache, pti->app_base, disp);
+        ds_insert_app_to_shadow(drcontext, ilist, where, pti->cache, regaddr);
+
+        pti->cache_disp = disp;
+        pti->cache_valid = true;
+    }
+
+    disp -= pti->cache_disp;
+    if (disp < -255 || disp > 255)
+        return false;
+
+    /* both accesses are valid and closer than the guard size,
+     * so they can't be in different aliases of the window
+     */
+    DR_ASSERT(disp > -DS_DIRECT_GUARD && disp < DS_DIRECT_GUARD);
 
+    /* out <- %regaddr% = cache + (disp - cache_disp) */
+    ds_insert_add_disp(drcontext, ilist, where, regaddr, pti->cache, disp);
+
+    pti->coalesced++;
     return true;
 }
 
+uint ds_clear_shadow_base(void *drcontext)
+/*
+ *    Stop using the register set by ds_insert_shadow_base.
+ *    Return the number of instructions it saved
+ */
+{
+    per_thread_instr_t *pti = drmgr_get_tls_field(drcontext, instr_tls_index);
+    uint saved = pti->saved;
+
+    pti->shadow_base = DR_REG_NULL;
+    pti->saved = 0;
+    return saved;
+}
+
 bool ds_get_reg_taint(void *drcontext, reg_id_t reg, uint *result)
 /*
  *    Get the value of shadow register %reg% and store it in %result%
  */
 {
-    per_thread_t *data = drmgr_get_tls_field(drcontext, tls_index);
+    per_thread_t *data = ds_get_per_thread(drcontext);
     if (reg - DR_REG_R0 >= DR_NUM_GPR_REGS)
         return false;
 
@@ -358,18 +2172,21 @@ bool ds_set_reg_taint(void *drcontext, reg_id_t reg, uint value)
  *    Set the value of shadow register %reg% to value %value%
  */
 {
-    per_thread_t *data = drmgr_get_tls_field(drcontext, tls_index);
+    per_thread_t *data = ds_get_per_thread(drcontext);
     if (reg - DR_REG_R0 >= DR_NUM_GPR_REGS)
         return false;
 
     data->shadow_gprs[reg - DR_REG_R0] = value;
+    if (value != 0)
+        data->any_reg_tainted = 1;
     return true;
 }
 
 static void
 ds_reg_exit(void)
 {
-    drmgr_unregister_tls_field(tls_index);
+    dr_raw_tls_cfree(tls_offs, DS_TLS_SLOTS);
+    drmgr_unregister_tls_field(instr_tls_index);
     drmgr_unregister_thread_init_event(event_thread_init);
     drmgr_unregister_thread_exit_event(event_thread_exit);
     drmgr_exit();
@@ -378,14 +2195,385 @@ ds_reg_exit(void)
 static void
 event_thread_init(void *drcontext)
 {
-    per_thread_t *data = dr_thread_alloc(drcontext, sizeof(per_thread_t));
+    per_thread_t *data = (per_thread_t *)((byte *)dr_get_dr_segment_base(tls_seg) + tls_offs);
+    per_thread_instr_t *pti = dr_thread_alloc(drcontext, sizeof(per_thread_instr_t));
+
     memset(data, 0, sizeof(per_thread_t));
-    drmgr_set_tls_field(drcontext, tls_index, data);
+    pti->regs = data;
+    pti->shadow_base = DR_REG_NULL;
+    pti->saved = 0;
+    pti->app_base = DR_REG_NULL;
+    pti->cache = DR_REG_NULL;
+    pti->cache_valid = false;
+    pti->coalesced = 0;
+    memset(pti->resident, 0, sizeof(pti->resident));
+    memset(pti->resident_valid, 0, sizeof(pti->resident_valid));
+    memset(pti->resident_dirty, 0, sizeof(pti->resident_dirty));
+    pti->resident_accesses = 0;
+    pti->stub_calls = 0;
+    drmgr_set_tls_field(drcontext, instr_tls_index, pti);
 }
 
 static void
 event_thread_exit(void *drcontext)
 {
-    per_thread_t *data = drmgr_get_tls_field(drcontext, tls_index);
-    dr_thread_free(drcontext, data, sizeof(per_thread_t));
-}
\ No newline at end of file
+    per_thread_instr_t *pti = drmgr_get_tls_field(drcontext, instr_tls_index);
+    dr_thread_free(drcontext, pti, sizeof(per_thread_instr_t));
+}
+/* ======================================================================================
+ * out-of-line propagation stubs
+ * ==================================================================================== */
+
+/* Stubs are called with blx lr, take their argument in DS_STUB_ARG
+ * and preserve all other registers and the flags.
+ *
+ * They run outside the code cache, where DR can't translate a fault,
+ * so they only read memory that is always mapped: the thread's raw TLS,
+ * the summary, umbra's table and the read-only direct window. Umbra
+ * shadow of a bad app address isn't, so the load stubs exist with the
+ * direct shadow only. Stores to shadow memory are translated in a stub
+ * but done by the caller in the cache
+ */
+static byte *stubs_mem;
+static size_t stubs_size;
+static app_pc stub_pc[DS_STUBS];
+
+static void
+ds_stub_save(void *drcontext, instrlist_t *ilist, instr_t *where, reg_id_t reg, uint slot)
+/*
+ *    Save %reg% to the thread's stub_spill[%slot%]. DR spill slots
+ *    past the first few live in the dcontext, which a stub
+ *    shared by all threads can't address
+ */
+{
+    dr_insert_write_raw_tls(drcontext, ilist, where, tls_seg,
+                            tls_offs + offsetof(per_thread_t, stub_spill) + slot * sizeof(reg_t),
+                            reg);
+}
+
+static void
+ds_stub_restore(void *drcontext, instrlist_t *ilist, instr_t *where, reg_id_t reg, uint slot)
+{
+    dr_insert_read_raw_tls(drcontext, ilist, where, tls_seg,
+                           tls_offs + offsetof(per_thread_t, stub_spill) + slot * sizeof(reg_t),
+                           reg);
+}
+
+static void
+ds_build_translate_stub(void *drcontext, instrlist_t *ilist, instr_t *ret)
+/*
+ *    r0 <- shadow address of app address in r0
+ */
+{
+    ds_stub_save(drcontext, ilist, ret, DR_REG_R1, 0);
+    ds_stub_save(drcontext, ilist, ret, DR_REG_R2, 1);
+    dr_save_arith_flags_to_reg(drcontext, ilist, ret, DR_REG_R2);
+
+    ds_insert_app_to_shadow(drcontext, ilist, ret, DR_REG_R0, DR_REG_R1);
+
+    dr_restore_arith_flags_from_reg(drcontext, ilist, ret, DR_REG_R2);
+    ds_stub_restore(drcontext, ilist, ret, DR_REG_R2, 1);
+    ds_stub_restore(drcontext, ilist, ret, DR_REG_R1, 0);
+}
+
+static void
+ds_build_load_stub(void *drcontext, instrlist_t *ilist, instr_t *ret,
+                   opnd_size_t size, bool summary_check)
+/*
+ *    r0 <- tag of %size% bytes at app address in r0
+ */
+{
+    instr_t *clean = INSTR_CREATE_label(drcontext);
+    instr_t *done = INSTR_CREATE_label(drcontext);
+    opnd_t r0 = opnd_create_reg(DR_REG_R0);
+    opnd_t mem = opnd_create_base_disp(DR_REG_R0, DR_REG_NULL, 0, 0, size);
+
+    ds_stub_save(drcontext, ilist, ret, DR_REG_R1, 0);
+    ds_stub_save(drcontext, ilist, ret, DR_REG_R2, 1);
+    dr_save_arith_flags_to_reg(drcontext, ilist, ret, DR_REG_R2);
+
+    if (summary_check)
+    {
+        ds_insert_app_to_summary_load(drcontext, ilist, ret, DR_REG_R0, DR_REG_R1);
+        instrlist_meta_preinsert(ilist, ret,
+                                 XINST_CREATE_cmp(drcontext, /* cmp r1, #0 */
+                                                  opnd_create_reg(DR_REG_R1),
+                                                  OPND_CREATE_INT8(0)));
+        instrlist_meta_preinsert(ilist, ret,
+                                 XINST_CREATE_jump_cond(drcontext, DR_PRED_EQ, /* beq clean */
+                                                        opnd_create_instr(clean)));
+    }
+
+    ds_insert_app_to_shadow(drcontext, ilist, ret, DR_REG_R0, DR_REG_R1);
+
+    if (size == OPSZ_1)
+        instrlist_meta_preinsert(ilist, ret, XINST_CREATE_load_1byte(drcontext, r0, mem));
+    else if (size == OPSZ_2)
+        instrlist_meta_preinsert(ilist, ret, XINST_CREATE_load_2bytes(drcontext, r0, mem));
+    else
+        instrlist_meta_preinsert(ilist, ret, XINST_CREATE_load(drcontext, r0, mem));
+
+    if (summary_check)
+    {
+        instrlist_meta_preinsert(ilist, ret,
+                                 XINST_CREATE_jump(drcontext, /* b done */
+                                                   opnd_create_instr(done)));
+        instrlist_meta_preinsert(ilist, ret, clean);
+        instrlist_meta_preinsert(ilist, ret,
+                                 XINST_CREATE_move(drcontext, /* mov r0, #0 */
+                                                   r0, OPND_CREATE_INT32(0)));
+        instrlist_meta_preinsert(ilist, ret, done);
+    }
+
+    dr_restore_arith_flags_from_reg(drcontext, ilist, ret, DR_REG_R2);
+    ds_stub_restore(drcontext, ilist, ret, DR_REG_R2, 1);
+    ds_stub_restore(drcontext, ilist, ret, DR_REG_R1, 0);
+}
+
+static void
+ds_build_regs_stub(void *drcontext, instrlist_t *ilist, instr_t *ret)
+/*
+ *    r0 = dst << 8 | src1 << 4 | src2, register numbers
+ *
+ *    shadow(dst) <- shadow(src1) | shadow(src2)
+ */
+{
+    opnd_t r0 = opnd_create_reg(DR_REG_R0);
+    opnd_t r2 = opnd_create_reg(DR_REG_R2);
+    opnd_t r3 = opnd_create_reg(DR_REG_R3);
+
+    DR_ASSERT(offsetof(per_thread_t, shadow_gprs) == 0);
+
+    ds_stub_save(drcontext, ilist, ret, DR_REG_R1, 0);
+    ds_stub_save(drcontext, ilist, ret, DR_REG_R2, 1);
+    ds_stub_save(drcontext, ilist, ret, DR_REG_R3, 2);
+
+    dr_insert_get_seg_base(drcontext, ilist, ret, tls_seg, DR_REG_R1);
+    if (tls_offs != 0)
+    {
+        instrlist_meta_preinsert(ilist, ret,
+                                 XINST_CREATE_add(drcontext, /* r1 = r1 + tls_offs */
+                                                  opnd_create_reg(DR_REG_R1),
+                                                  OPND_CREATE_INT(tls_offs)));
+    }
+
+    instrlist_meta_preinsert(ilist, ret,
+                             INSTR_CREATE_and(drcontext, r2, r0, /* and r2, r0, #15 */
+                                              OPND_CREATE_INT8(15)));
+    instrlist_meta_preinsert(ilist, ret,
+                             XINST_CREATE_load(drcontext, r2, /* ldr r2, [r1, r2, lsl #2] */
+                                               opnd_create_base_disp_arm(DR_REG_R1, DR_REG_R2,
+                                                                         DR_SHIFT_LSL, 2, 0,
+                                                                         DR_OPND_DEFAULT, OPSZ_4)));
+    instrlist_meta_preinsert(ilist, ret,
+                             INSTR_CREATE_lsr(drcontext, r0, r0, /* lsr r0, r0, #4 */
+                                              OPND_CREATE_INT8(4)));
+    instrlist_meta_preinsert(ilist, ret,
+                             INSTR_CREATE_and(drcontext, r3, r0, /* and r3, r0, #15 */
+                                              OPND_CREATE_INT8(15)));
+    instrlist_meta_preinsert(ilist, ret,
+                             XINST_CREATE_load(drcontext, r3, /* ldr r3, [r1, r3, lsl #2] */
+                                               opnd_create_base_disp_arm(DR_REG_R1, DR_REG_R3,
+                                                                         DR_SHIFT_LSL, 2, 0,
+                                                                         DR_OPND_DEFAULT, OPSZ_4)));
+    instrlist_meta_preinsert(ilist, ret,
+                             INSTR_CREATE_orr(drcontext, r2, r2, r3)); /* orr r2, r2, r3 */
+    instrlist_meta_preinsert(ilist, ret,
+                             INSTR_CREATE_lsr(drcontext, r0, r0, /* lsr r0, r0, #4 */
+                                              OPND_CREATE_INT8(4)));
+    instrlist_meta_preinsert(ilist, ret,
+                             XINST_CREATE_store(drcontext, /* str r2, [r1, r0, lsl #2] */
+                                                opnd_create_base_disp_arm(DR_REG_R1, DR_REG_R0,
+                                                                          DR_SHIFT_LSL, 2, 0,
+                                                                          DR_OPND_DEFAULT, OPSZ_4),
+                                                r2));
+
+    ds_stub_restore(drcontext, ilist, ret, DR_REG_R3, 2);
+    ds_stub_restore(drcontext, ilist, ret, DR_REG_R2, 1);
+    ds_stub_restore(drcontext, ilist, ret, DR_REG_R1, 0);
+}
+
+static bool
+ds_stubs_init(bool summary_check)
+/*
+ *    Encode the stubs shared by all threads. They are ARM code,
+ *    blx switches to it and bx lr back to Thumb if needed
+ */
+{
+    void *drcontext = GLOBAL_DCONTEXT;
+    app_pc pc;
+    uint i;
+
+    stubs_size = dr_page_size();
+    stubs_mem = dr_nonheap_alloc(stubs_size, DR_MEMPROT_READ | DR_MEMPROT_WRITE |
+                                                 DR_MEMPROT_EXEC);
+    if (stubs_mem == NULL)
+        return false;
+
+    pc = stubs_mem;
+    for (i = 0; i < DS_STUBS; i++)
+    {
+        instrlist_t *ilist = instrlist_create(drcontext);
+        instr_t *ret = XINST_CREATE_return(drcontext); /* bx lr */
+        bool load = i == DS_STUB_LOAD1 || i == DS_STUB_LOAD2 || i == DS_STUB_LOAD4;
+
+        instrlist_meta_append(ilist, ret);
+        if (load && !direct_shadow)
+        {
+            stub_pc[i] = NULL;
+            instrlist_clear_and_destroy(drcontext, ilist);
+            continue;
+        }
+
+        switch (i)
+        {
+        case DS_STUB_TRANSLATE:
+            ds_build_translate_stub(drcontext, ilist, ret);
+            break;
+        case DS_STUB_LOAD1:
+            ds_build_load_stub(drcontext, ilist, ret, OPSZ_1, summary_check);
+            break;
+        case DS_STUB_LOAD2:
+            ds_build_load_stub(drcontext, ilist, ret, OPSZ_2, summary_check);
+            break;
+        case DS_STUB_LOAD4:
+            ds_build_load_stub(drcontext, ilist, ret, OPSZ_4, summary_check);
+            break;
+        case DS_STUB_REGS:
+            ds_build_regs_stub(drcontext, ilist, ret);
+            break;
+        }
+
+        stub_pc[i] = pc;
+        pc = instrlist_encode(drcontext, ilist, pc, true);
+        instrlist_clear_and_destroy(drcontext, ilist);
+
+        DR_ASSERT(pc != NULL && pc <= stubs_mem + stubs_size);
+    }
+
+    return dr_memory_protect(stubs_mem, stubs_size, DR_MEMPROT_READ | DR_MEMPROT_EXEC);
+}
+
+static void
+ds_stubs_exit(void)
+{
+    if (stubs_mem != NULL)
+        dr_nonheap_free(stubs_mem, stubs_size);
+    stubs_mem = NULL;
+}
+
+static bool
+ds_reserve_fixed_reg(void *drcontext, instrlist_t *ilist, instr_t *where, reg_id_t reg)
+{
+    drvector_t allowed;
+    reg_id_t res;
+    drreg_status_t status;
+
+    drreg_init_and_fill_vector(&allowed, false);
+    drreg_set_vector_entry(&allowed, reg, true);
+    status = drreg_reserve_register(drcontext, ilist, where, &allowed, &res);
+    drvector_delete(&allowed);
+
+    return status == DRREG_SUCCESS;
+}
+
+bool ds_has_stub(ds_stub_t stub)
+{
+    return stubs_mem != NULL && stub_pc[stub] != NULL;
+}
+
+bool ds_stub_begin(void *drcontext, instrlist_t *ilist, instr_t *where, opnd_t mem)
+/*
+ *    Reserve the registers of a stub call before %where%: the argument
+ *    register and lr. Return false if one of them is taken, e.g. by a block
+ *    wide reservation, the caller inlines the propagation then.
+ *    %mem% is an operand the caller reads after the reservation or null
+ */
+{
+    if (stubs_mem == NULL)
+        return false;
+
+    if (!ds_reserve_fixed_reg(drcontext, ilist, where, DS_STUB_ARG))
+        return false;
+
+    if (!ds_reserve_fixed_reg(drcontext, ilist, where, DR_REG_LR))
+    {
+        drreg_unreserve_register(drcontext, ilist, where, DS_STUB_ARG);
+        return false;
+    }
+
+    /* the registers may hold tool values drreg didn't restore yet */
+    if (!opnd_is_null(mem) && opnd_uses_reg(mem, DS_STUB_ARG))
+        drreg_get_app_value(drcontext, ilist, where, DS_STUB_ARG, DS_STUB_ARG);
+    if (!opnd_is_null(mem) && opnd_uses_reg(mem, DR_REG_LR))
+        drreg_get_app_value(drcontext, ilist, where, DR_REG_LR, DR_REG_LR);
+
+    return true;
+}
+
+void ds_stub_end(void *drcontext, instrlist_t *ilist, instr_t *where)
+{
+    drreg_status_t status;
+
+    status = drreg_unreserve_register(drcontext, ilist, where, DR_REG_LR);
+    DR_ASSERT(status == DRREG_SUCCESS);
+    status = drreg_unreserve_register(drcontext, ilist, where, DS_STUB_ARG);
+    DR_ASSERT(status == DRREG_SUCCESS);
+}
+
+void ds_insert_stub_call(void *drcontext, instrlist_t *ilist, instr_t *where, ds_stub_t stub)
+/*
+ *    Call %stub% with its argument already in DS_STUB_ARG,
+ *    ds_stub_begin has to be called first
+ */
+{
+    per_thread_instr_t *pti = drmgr_get_tls_field(drcontext, instr_tls_index);
+
+    instrlist_insert_mov_immed_ptrsz(drcontext, (ptr_int_t)stub_pc[stub],
+                                     opnd_create_reg(DR_REG_LR), ilist, where, NULL, NULL);
+    instrlist_meta_preinsert(ilist, where,
+                             INSTR_CREATE_blx_ind(drcontext, /* blx lr */
+                                                  opnd_create_reg(DR_REG_LR)));
+    pti->stub_calls++;
+}
+
+uint ds_take_stub_calls(void *drcontext)
+/*
+ *    Return the number of stub calls inserted since the last call
+ */
+{
+    per_thread_instr_t *pti = drmgr_get_tls_field(drcontext, instr_tls_index);
+    uint calls = pti->stub_calls;
+
+    pti->stub_calls = 0;
+    return calls;
+}
+
+bool ds_insert_regs_stub_call(void *drcontext, instrlist_t *ilist, instr_t *where,
+                              reg_id_t dst, reg_id_t src1, reg_id_t src2)
+/*
+ *    shadow(%dst%) <- shadow(%src1%) | shadow(%src2%) via DS_STUB_REGS.
+ *    Return false if it should be inlined: the stub works with the
+ *    shadow register file only, and with a hoisted shadow base
+ *    the inline code is as short as the call
+ */
+{
+    per_thread_instr_t *pti = drmgr_get_tls_field(drcontext, instr_tls_index);
+
+    if (pti->shadow_base != DR_REG_NULL ||
+        pti->resident[dst - DR_REG_R0] != DR_REG_NULL ||
+        pti->resident[src1 - DR_REG_R0] != DR_REG_NULL ||
+        pti->resident[src2 - DR_REG_R0] != DR_REG_NULL)
+        return false;
+
+    if (!ds_stub_begin(drcontext, ilist, where, opnd_create_null()))
+        return false;
+
+    instrlist_insert_mov_immed_ptrsz(drcontext,
+                                     (dst - DR_REG_R0) << 8 | (src1 - DR_REG_R0) << 4 |
+                                         (src2 - DR_REG_R0),
+                                     opnd_create_reg(DS_STUB_ARG), ilist, where, NULL, NULL);
+    ds_insert_stub_call(drcontext, ilist, where, DS_STUB_REGS);
+    ds_stub_end(drcontext, ilist, where);
+    return true;
+}
@@ -18,10 +18,279 @@ enum
     DRMGR_PRIORITY_THREAD_EXIT_DRTAINT = 7500,
 };
 
+/* Flags for drtaint_options_t.flags */
+enum
+{
+    /* Propagate ldm/stm taint with a clean call instead of inline
+     * instrumentation. Slower, kept for comparison and as a fallback.
+     */
+    DRTAINT_OPTION_LDM_STM_CLEAN_CALL = 0x01,
+
+    /* Use a direct-mapped shadow memory instead of umbra:
+     * shadow = (app & DS_DIRECT_MASK) | DS_DIRECT_BASE.
+     * Falls back to umbra if the shadow window can't be reserved.
+     */
+    DRTAINT_OPTION_DIRECT_SHADOW = 0x02,
+
+    /* Check the per-64KB page summary before loading shadow memory,
+     * loads from regions that were never tainted skip the translation
+     */
+    DRTAINT_OPTION_PAGE_SUMMARY = 0x04,
+
+    /* Count loads taking the clean page path and the shadow path,
+     * see drtaint_get_summary_stats
+     */
+    DRTAINT_OPTION_SUMMARY_COUNTERS = 0x08,
+
+    /* Print drtaint_get_stats to stderr at exit
+     * and on a nudge with DRTAINT_NUDGE_DUMP_STATS argument
+     */
+    DRTAINT_OPTION_STATS_REPORT = 0x10,
+
+    /* Keep shadows of the registers a block uses most in reserved
+     * registers, written back only before instructions which may fault,
+     * clean calls and at the block end. drtaint_get_reg_taint called
+     * from other clean calls in the middle of a block may see stale values.
+     * Experimental, off by default
+     */
+    DRTAINT_OPTION_RESIDENT_SHADOWS = 0x20,
+
+    /* Give each block an uninstrumented copy taken while no register
+     * is tainted. It falls over to the instrumented one when memory
+     * which may hold taint is accessed, see the page summary
+     */
+    DRTAINT_OPTION_DUAL_BLOCKS = 0x40,
+
+    /* Build blocks without propagation until the first taint is
+     * introduced by drtaint_set_reg_taint or drtaint_set_*app*taint*,
+     * then flush the code cache. The flush is delayed until threads
+     * leave the code cache, so sources should be set from syscall
+     * events, as drtaint_marker does, see drtaint_is_active
+     */
+    DRTAINT_OPTION_LAZY_ACTIVATION = 0x80,
+
+    /* Propagate through small routines shared by all blocks instead of
+     * inline code: ldr by size, the shadow translation of str by size,
+     * mov and 2-source arithmetic. Shrinks the code cache at the cost
+     * of a call per instruction. Handlers fall back to inline code
+     * where the call registers (r0, lr) are reserved for the whole block.
+     * ldr goes out of line with DRTAINT_OPTION_DIRECT_SHADOW only, umbra
+     * shadow loads stay inline where a fault can be translated.
+     * Experimental, off by default
+     */
+    DRTAINT_OPTION_OUT_OF_LINE_LOADS = 0x100,
+    DRTAINT_OPTION_OUT_OF_LINE_STORES = 0x200,
+    DRTAINT_OPTION_OUT_OF_LINE_REGS = 0x400,
+    DRTAINT_OPTION_OUT_OF_LINE = 0x700,
+
+    /* Handle memcpy, memmove, memset, strcpy and strlen of libc with
+     * a bulk shadow operation at their return instead of propagating
+     * through their bodies, which run without propagation
+     */
+    DRTAINT_OPTION_LIBC_SUMMARIES = 0x800,
+
+    /* Run single-block copy loops (post-indexed ldr/str or ldm!/stm!
+     * pairs moving the same registers) without propagating each
+     * iteration: the loop branches back inside the block and the shadow
+     * of the copied range is copied once at the loop exit.
+     * Signals arriving during such a loop are delayed until it ends.
+     * Experimental, off by default
+     */
+    DRTAINT_OPTION_LOOP_SUMMARIES = 0x1000,
+};
+
+/* Nudge argument asking drtaint to dump its statistics */
+#define DRTAINT_NUDGE_DUMP_STATS 0x64747374
+
+typedef struct _drtaint_options_t
+{
+    /* Set to the size of this structure */
+    size_t struct_size;
+
+    /* Combination of DRTAINT_OPTION_* flags */
+    uint flags;
+
+    /* NULL-terminated lists of module preferred names. Code of a module
+     * listed in %exclude_modules%, or not listed in %include_modules%
+     * if it isn't NULL, runs without propagation, see drtaint_exclude_range.
+     * Code outside of modules is always instrumented. The lists must stay
+     * valid until drtaint_exit
+     */
+    const char **include_modules;
+    const char **exclude_modules;
+
+    /* File of blocks which met taint in previous runs, one
+     * "module offset" line each. If set, only these blocks propagate,
+     * others get a guard checking the registers and the regions they
+     * access. A guard which meets taint adds its block, which is rebuilt
+     * with propagation. The file is rewritten at exit and created
+     * if it doesn't exist, blocks outside of modules aren't kept.
+     * Each rebuild flushes the block. Thumb blocks with IT blocks
+     * always propagate: a guard can't resume inside an IT block
+     */
+    const char *profile_file;
+
+    /* Directory of per-module files keeping the handler chosen for each
+     * instruction, named after the module and its build id. They are
+     * mapped at module load and filled as blocks are built, so later
+     * runs skip the classification. Modules without a build id aren't
+     * cached
+     */
+    const char *plan_cache_dir;
+
+} drtaint_options_t;
+
+typedef struct _drtaint_stats_t
+{
+    /* Set to the size of this structure */
+    size_t struct_size;
+
+    /* Private shadow memory currently allocated */
+    uint64 shadow_bytes;
+
+    /* Resident shadow bytes given back to the system, see drtaint_get_reclaimed_bytes */
+    uint64 reclaimed_bytes;
+
+    /* Faults on shadow memory handled by drtaint */
+    uint64 faults;
+
+    /* Shared umbra blocks replaced with private ones */
+    uint64 block_replacements;
+
+    /* Faults which weren't ours and were delivered to the app */
+    uint64 foreign_faults;
+
+    /* Total time spent handling shadow faults.
+     * Only measured with DRTAINT_OPTION_STATS_REPORT
+     */
+    uint64 fault_ns;
+
+    /* Range operations: drtaint_set_app_area_taint,
+     * drtaint_copy_app_taint, drtaint_move_app_taint.
+     * range_ns is only measured with DRTAINT_OPTION_STATS_REPORT
+     */
+    uint64 range_ops;
+    uint64 range_ns;
+    uint64 bytes_tainted;
+    uint64 bytes_untainted;
+    uint64 bytes_copied;
+
+    /* See drtaint_get_summary_stats */
+    uint64 clean_loads;
+    uint64 shadow_loads;
+
+    /* Blocks loading the shadow register file address once at entry,
+     * meta instructions it saved and the instructions loading it
+     */
+    uint64 hoisted_blocks;
+    uint64 hoist_saved_instrs;
+    uint64 hoist_setup_instrs;
+
+    /* Propagations dropped because the shadow register they wrote
+     * was overwritten before any read
+     */
+    uint64 dead_writes;
+
+    /* mov/arith propagations turned into a clear or a copy
+     * because sources were known to be clean
+     */
+    uint64 downgraded;
+
+    /* Shadow addresses computed relative to a previous
+     * access via the same base register
+     */
+    uint64 coalesced;
+
+    /* Shadow registers kept in registers for the rest of a block
+     * and the propagation accesses which didn't go to memory thanks to them
+     */
+    uint64 resident_regs;
+    uint64 resident_accesses;
+
+    /* Blocks built with an uninstrumented copy */
+    uint64 dual_blocks;
+
+    /* Blocks built without propagation before the first taint */
+    uint64 lazy_blocks;
+
+    /* Blocks built and the size of their code, see
+     * DRTAINT_OPTION_OUT_OF_LINE_*, and the handlers calling
+     * a shared routine instead of inline code. The size has
+     * drreg's spills but not DR's mangling or exit stubs
+     */
+    uint64 built_blocks;
+    uint64 built_bytes;
+    uint64 stub_calls;
+
+    /* Blocks built without propagation in excluded code and
+     * calls into it which got a boundary summary
+     */
+    uint64 excluded_blocks;
+    uint64 boundary_summaries;
+
+    /* Calls of libc routines handled by DRTAINT_OPTION_LIBC_SUMMARIES */
+    uint64 libc_summaries;
+
+    /* Blocks built as summarized copy loops, loop runs summarized,
+     * those whose ranges overlapped and were copied element-wise
+     * and those which found another loop's entry, see
+     * DRTAINT_OPTION_LOOP_SUMMARIES. Runs over clean ranges
+     * skip the summary with DRTAINT_OPTION_PAGE_SUMMARY
+     */
+    uint64 loop_blocks;
+    uint64 loop_summaries;
+    uint64 loop_replays;
+    uint64 loop_mismatches;
+
+    /* Blocks built with a guard instead of propagation
+     * and guards which met taint, each costs a cache flush,
+     * see drtaint_options_t.profile_file
+     */
+    uint64 guarded_blocks;
+    uint64 guard_trips;
+
+    /* Time spent in analysis and insertion of blocks built with
+     * DRTAINT_OPTION_STATS_REPORT, decoding and encoding by DR
+     * aren't included. Instructions whose plan came from the cache
+     * and those classified, see drtaint_options_t.plan_cache_dir
+     */
+    uint64 translate_ns;
+    uint64 plan_hits;
+    uint64 plan_misses;
+
+} drtaint_stats_t;
+
 bool drtaint_init(client_id_t id);
 
+bool drtaint_init_ex(client_id_t id, const drtaint_options_t *ops);
+
+/* Parse the client option at %argv%[%i%] of dr_client_main into %ops%:
+ * a flag (-direct_shadow, -page_summary, -stats...) or one taking an
+ * argument (-include NAME, -exclude NAME, -profile FILE, -plan_cache DIR).
+ * %i% is advanced past the argument. Return false if it isn't
+ * a drtaint option, the client may handle it then
+ */
+bool drtaint_parse_option(int argc, const char *argv[], int *i, drtaint_options_t *ops);
+
 void drtaint_exit(void);
 
+/* Whether taint is propagated. Always true
+ * without DRTAINT_OPTION_LAZY_ACTIVATION
+ */
+bool drtaint_is_active(void);
+
+/* Run code in [%start%, %end%) without propagation. A call or a jump from
+ * instrumented code into it gets a conservative summary: r0 and r1 are
+ * tainted with the union of r0-r3 taints, r2, r3 and r12 are untainted,
+ * memory is left as is. Blocks built before aren't affected, so the range
+ * should be excluded before its code runs. Return false if there are
+ * too many ranges
+ */
+bool drtaint_exclude_range(app_pc start, app_pc end);
+
+/* Whether code at %pc% runs without propagation */
+bool drtaint_is_excluded(app_pc pc);
+
 bool drtaint_insert_app_to_taint(void *drcontext, instrlist_t *ilist, instr_t *where,
                                  reg_id_t reg_addr, reg_id_t scratch);
 
@@ -31,6 +300,12 @@ bool drtaint_insert_reg_to_taint(void *drcontext, instrlist_t *ilist, instr_t *w
 bool drtaint_insert_reg_to_taint_load(void *drcontext, instrlist_t *ilist, instr_t *where,
                                       reg_id_t shadow, reg_id_t regaddr);
 
+/* Set taint of %shadow% register to the value of %value% register,
+ * %scratch% may be clobbered
+ */
+bool drtaint_insert_reg_to_taint_store(void *drcontext, instrlist_t *ilist, instr_t *where,
+                                       reg_id_t shadow, reg_id_t value, reg_id_t scratch);
+
 bool drtaint_get_reg_taint(void *drcontext, reg_id_t reg, uint *result);
 
 bool drtaint_set_reg_taint(void *drcontext, reg_id_t reg, uint value);
@@ -45,6 +320,42 @@ bool drtaint_set_app_taint4(void *drcontext, app_pc app, uint value);
 
 void drtaint_set_app_area_taint(void *drcontext, app_pc app, uint size, byte value);
 
+/* Copy taint of %size% bytes from %src% to %dst%. Ranges must not overlap */
+bool drtaint_copy_app_taint(void *drcontext, app_pc dst, app_pc src, uint size);
+
+/* The same as drtaint_copy_app_taint, but ranges may overlap */
+bool drtaint_move_app_taint(void *drcontext, app_pc dst, app_pc src, uint size);
+
+/* Copy taint of %size% bytes beginning from %app% to %result% */
+bool drtaint_get_app_area_taint(void *drcontext, app_pc app, uint size, byte *result);
+
+/* Return true if any byte of the area is tainted
+ * and save offset of the first one to %first_offset% (may be NULL)
+ */
+bool drtaint_find_tainted(void *drcontext, app_pc app, uint size, uint *first_offset);
+
+/* Return true if no byte of the area is tainted. False if
+ * any is or if the shadow of the area couldn't be read
+ */
+bool drtaint_is_area_clean(void *drcontext, app_pc app, uint size);
+
+/* Get numbers of loads which took the clean page path and which loaded shadow
+ * memory. Requires DRTAINT_OPTION_PAGE_SUMMARY | DRTAINT_OPTION_SUMMARY_COUNTERS
+ */
+void drtaint_get_summary_stats(uint64 *clean_loads, uint64 *shadow_loads);
+
+/* Number of resident shadow bytes given back to the system when whole
+ * shadow blocks are untainted, e.g. on munmap, mremap and brk shrink.
+ * The pages are decommitted, their address range stays reserved
+ */
+uint64 drtaint_get_reclaimed_bytes(void);
+
+/* Get statistics of the shadow layer. %stats%->struct_size must be set */
+bool drtaint_get_stats(drtaint_stats_t *stats);
+
+/* Print drtaint_get_stats to %file% */
+void drtaint_print_stats(file_t file);
+
 #ifdef __cplusplus
 }
 #endif
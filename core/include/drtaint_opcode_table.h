@@ -0,0 +1,1095 @@
+#ifndef OPCODE_TABLE_H_
+#define OPCODE_TABLE_H_
+
+#include "dr_api.h"
+#include "drtaint_instr_groups.h"
+
+/* Everything the instrumentation wants to know about an opcode
+ * is computed here at compile time and kept in a table indexed
+ * by opcode, so that classifying an instruction costs one load
+ * instead of a walk through several switches
+ */
+
+/* How an instruction is propagated, chosen once per instruction
+ * and kept in the plan cache across runs. Append only, the values
+ * are stored on disk, see drtaint_options_t.plan_cache_dir
+ */
+enum plan_t : byte
+{
+    PLAN_UNKNOWN, // not classified yet
+    PLAN_NOTHING, // nothing to propagate, e.g. no Rd or an immediate branch
+    PLAN_OTHER,   // not handled by the default ISA, see propagate_simd_isa
+    PLAN_ZEROING, // eor r0, r1, r1 and alike
+    PLAN_LDM,
+    PLAN_STM,
+    PLAN_LDRB,
+    PLAN_LDRH,
+    PLAN_LDR,
+    PLAN_LDRD,
+    PLAN_STRB,
+    PLAN_STRH,
+    PLAN_STR,
+    PLAN_STRD,
+    PLAN_MOV_REG,
+    PLAN_MOV_IMM,
+    PLAN_ARITH_REG_REG,
+    PLAN_ARITH_REG_IMM,
+    PLAN_MULL,
+    PLAN_SMLAL,
+    PLAN_1RD_3RS,
+    PLAN_PKHBT,
+    PLAN_PKHTB,
+    PLAN_CALL,        // bl imm
+    PLAN_CALL_REG,    // blx reg
+    PLAN_BRANCH_REG,  // bx reg
+    PLAN_COUNT,
+};
+
+/* Which operands of the instruction refine the plan
+ */
+enum opcode_shape_t : byte
+{
+    SHAPE_FIXED,   // plan is always taken
+    SHAPE_RD,      // plan if there is Rd, PLAN_NOTHING otherwise
+    SHAPE_SRC0,    // plan if src0 is a reg, alt otherwise
+    SHAPE_RD_SRC1, // as SHAPE_RD, then plan if src1 is a reg, alt otherwise
+};
+
+#define OPCODE_SIMD 0x01   // handled by propagate_simd_isa
+#define OPCODE_VECTOR 0x02 // OP_vaba_s16 and above
+#define OPCODE_COPROC 0x04 // mcr, mrc, cdp, ldc, stc and their variants
+#define OPCODE_BRANCH 0x08 // b, bl, bx and their variants
+
+typedef struct _opcode_info_t
+{
+    plan_t plan;
+    plan_t alt;
+    opcode_shape_t shape;
+    byte flags;
+} opcode_info_t;
+
+/* Whether %opcode% is one of the %n% opcodes at %list%,
+ * halving the list keeps the constexpr recursion shallow
+ */
+constexpr bool opcode_in(int opcode, const int *list, int n)
+{
+    return n <= 4 ? (n > 0 && list[0] == opcode) || (n > 1 && list[1] == opcode) ||
+                        (n > 2 && list[2] == opcode) || (n > 3 && list[3] == opcode)
+                  : opcode_in(opcode, list, n / 2) ||
+                        opcode_in(opcode, list + n / 2, n - n / 2);
+}
+
+constexpr int opcode_min(int a, int b)
+{
+    return a < b ? a : b;
+}
+
+constexpr int opcode_min(const int *list, int n)
+{
+    return n == 1 ? list[0]
+                  : opcode_min(opcode_min(list, n / 2), opcode_min(list + n / 2, n - n / 2));
+}
+
+template <int N>
+constexpr bool opcode_in(int opcode, const int (&list)[N])
+{
+    return opcode_in(opcode, list, N);
+}
+
+static constexpr int simd_opcodes[] = {
+    OP_vaba_s16,
+    OP_vaba_s32,
+    OP_vaba_s8,
+    OP_vaba_u16,
+    OP_vaba_u32,
+    OP_vaba_u8,
+    OP_vabal_s16,
+    OP_vabal_s32,
+    OP_vabal_s8,
+    OP_vabal_u16,
+    OP_vabal_u32,
+    OP_vabal_u8,
+    OP_vabd_s16,
+    OP_vabd_s32,
+    OP_vabd_s8,
+    OP_vabd_u16,
+    OP_vabd_u32,
+    OP_vabd_u8,
+    OP_vabdl_s16,
+    OP_vabdl_s32,
+    OP_vabdl_s8,
+    OP_vabdl_u16,
+    OP_vabdl_u32,
+    OP_vabdl_u8,
+    OP_vabs_f32,
+    OP_vabs_f64,
+    OP_vabs_s16,
+    OP_vabs_s32,
+    OP_vabs_s8,
+    OP_vacge_f32,
+    OP_vacgt_f32,
+    OP_vadd_f32,
+    OP_vadd_f64,
+    OP_vadd_i16,
+    OP_vadd_i32,
+    OP_vadd_i64,
+    OP_vadd_i8,
+    OP_vaddhn_i16,
+    OP_vaddhn_i32,
+    OP_vaddhn_i64,
+    OP_vaddl_s16,
+    OP_vaddl_s32,
+    OP_vaddl_s8,
+    OP_vaddl_u16,
+    OP_vaddl_u32,
+    OP_vaddl_u8,
+    OP_vaddw_s16,
+    OP_vaddw_s32,
+    OP_vaddw_s8,
+    OP_vaddw_u16,
+    OP_vaddw_u32,
+    OP_vaddw_u8,
+    OP_vand,
+    OP_vbic,
+    OP_vbic_i16,
+    OP_vbic_i32,
+    OP_vbif,
+    OP_vbit,
+    OP_vbsl,
+    OP_vceq_f32,
+    OP_vceq_i16,
+    OP_vceq_i32,
+    OP_vceq_i8,
+    OP_vcge_f32,
+    OP_vcge_s16,
+    OP_vcge_s32,
+    OP_vcge_s8,
+    OP_vcge_u16,
+    OP_vcge_u32,
+    OP_vcge_u8,
+    OP_vcgt_f32,
+    OP_vcgt_s16,
+    OP_vcgt_s32,
+    OP_vcgt_s8,
+    OP_vcgt_u16,
+    OP_vcgt_u32,
+    OP_vcgt_u8,
+    OP_vcle_f32,
+    OP_vcle_s16,
+    OP_vcle_s32,
+    OP_vcle_s8,
+    OP_vcls_s16,
+    OP_vcls_s32,
+    OP_vcls_s8,
+    OP_vclt_f32,
+    OP_vclt_s16,
+    OP_vclt_s32,
+    OP_vclt_s8,
+    OP_vclz_i16,
+    OP_vclz_i32,
+    OP_vclz_i8,
+    OP_vcmp_f32,
+    OP_vcmp_f64,
+    OP_vcmpe_f32,
+    OP_vcmpe_f64,
+    OP_vcnt_8,
+    OP_vcvt_f16_f32,
+    OP_vcvt_f32_f16,
+    OP_vcvt_f32_f64,
+    OP_vcvt_f32_s16,
+    OP_vcvt_f32_s32,
+    OP_vcvt_f32_u16,
+    OP_vcvt_f32_u32,
+    OP_vcvt_f64_f32,
+    OP_vcvt_f64_s16,
+    OP_vcvt_f64_s32,
+    OP_vcvt_f64_u16,
+    OP_vcvt_f64_u32,
+    OP_vcvt_s16_f32,
+    OP_vcvt_s16_f64,
+    OP_vcvt_s32_f32,
+    OP_vcvt_s32_f64,
+    OP_vcvt_u16_f32,
+    OP_vcvt_u16_f64,
+    OP_vcvt_u32_f32,
+    OP_vcvt_u32_f64,
+    OP_vcvta_s32_f32,
+    OP_vcvta_s32_f64,
+    OP_vcvta_u32_f32,
+    OP_vcvta_u32_f64,
+    OP_vcvtb_f16_f32,
+    OP_vcvtb_f16_f64,
+    OP_vcvtb_f32_f16,
+    OP_vcvtb_f64_f16,
+    OP_vcvtm_s32_f32,
+    OP_vcvtm_s32_f64,
+    OP_vcvtm_u32_f32,
+    OP_vcvtm_u32_f64,
+    OP_vcvtn_s32_f32,
+    OP_vcvtn_s32_f64,
+    OP_vcvtn_u32_f32,
+    OP_vcvtn_u32_f64,
+    OP_vcvtp_s32_f32,
+    OP_vcvtp_s32_f64,
+    OP_vcvtp_u32_f32,
+    OP_vcvtp_u32_f64,
+    OP_vcvtr_s32_f32,
+    OP_vcvtr_s32_f64,
+    OP_vcvtr_u32_f32,
+    OP_vcvtr_u32_f64,
+    OP_vcvtt_f16_f32,
+    OP_vcvtt_f16_f64,
+    OP_vcvtt_f32_f16,
+    OP_vcvtt_f64_f16,
+    OP_vdiv_f32,
+    OP_vdiv_f64,
+    OP_vdup_16,
+    OP_vdup_32,
+    OP_vdup_8,
+    OP_veor,
+    OP_vext,
+    OP_vfma_f32,
+    OP_vfma_f64,
+    OP_vfms_f32,
+    OP_vfms_f64,
+    OP_vfnma_f32,
+    OP_vfnma_f64,
+    OP_vfnms_f32,
+    OP_vfnms_f64,
+    OP_vhadd_s16,
+    OP_vhadd_s32,
+    OP_vhadd_s8,
+    OP_vhadd_u16,
+    OP_vhadd_u32,
+    OP_vhadd_u8,
+    OP_vhsub_s16,
+    OP_vhsub_s32,
+    OP_vhsub_s8,
+    OP_vhsub_u16,
+    OP_vhsub_u32,
+    OP_vhsub_u8,
+    OP_vld1_16,
+    OP_vld1_32,
+    OP_vld1_64,
+    OP_vld1_8,
+    OP_vld1_dup_16,
+    OP_vld1_dup_32,
+    OP_vld1_dup_8,
+    OP_vld1_lane_16,
+    OP_vld1_lane_32,
+    OP_vld1_lane_8,
+    OP_vld2_16,
+    OP_vld2_32,
+    OP_vld2_8,
+    OP_vld2_dup_16,
+    OP_vld2_dup_32,
+    OP_vld2_dup_8,
+    OP_vld2_lane_16,
+    OP_vld2_lane_32,
+    OP_vld2_lane_8,
+    OP_vld3_16,
+    OP_vld3_32,
+    OP_vld3_8,
+    OP_vld3_dup_16,
+    OP_vld3_dup_32,
+    OP_vld3_dup_8,
+    OP_vld3_lane_16,
+    OP_vld3_lane_32,
+    OP_vld3_lane_8,
+    OP_vld4_16,
+    OP_vld4_32,
+    OP_vld4_8,
+    OP_vld4_dup_16,
+    OP_vld4_dup_32,
+    OP_vld4_dup_8,
+    OP_vld4_lane_16,
+    OP_vld4_lane_32,
+    OP_vld4_lane_8,
+    OP_vldm,
+    OP_vldmdb,
+    OP_vldr,
+    OP_vmax_f32,
+    OP_vmax_s16,
+    OP_vmax_s32,
+    OP_vmax_s8,
+    OP_vmax_u16,
+    OP_vmax_u32,
+    OP_vmax_u8,
+    OP_vmaxnm_f32,
+    OP_vmaxnm_f64,
+    OP_vmin_f32,
+    OP_vmin_s16,
+    OP_vmin_s32,
+    OP_vmin_s8,
+    OP_vmin_u16,
+    OP_vmin_u32,
+    OP_vmin_u8,
+    OP_vminnm_f32,
+    OP_vminnm_f64,
+    OP_vmla_f32,
+    OP_vmla_f64,
+    OP_vmla_i16,
+    OP_vmla_i32,
+    OP_vmla_i8,
+    OP_vmlal_s16,
+    OP_vmlal_s32,
+    OP_vmlal_s8,
+    OP_vmlal_u16,
+    OP_vmlal_u32,
+    OP_vmlal_u8,
+    OP_vmls_f32,
+    OP_vmls_f64,
+    OP_vmls_i16,
+    OP_vmls_i32,
+    OP_vmls_i8,
+    OP_vmlsl_s16,
+    OP_vmlsl_s32,
+    OP_vmlsl_s8,
+    OP_vmlsl_u16,
+    OP_vmlsl_u32,
+    OP_vmlsl_u8,
+    OP_vmov,
+    OP_vmov_16,
+    OP_vmov_32,
+    OP_vmov_8,
+    OP_vmov_f32,
+    OP_vmov_f64,
+    OP_vmov_i16,
+    OP_vmov_i32,
+    OP_vmov_i64,
+    OP_vmov_i8,
+    OP_vmov_s16,
+    OP_vmov_s8,
+    OP_vmov_u16,
+    OP_vmov_u8,
+    OP_vmovl_s16,
+    OP_vmovl_s32,
+    OP_vmovl_s8,
+    OP_vmovl_u16,
+    OP_vmovl_u32,
+    OP_vmovl_u8,
+    OP_vmovn_i16,
+    OP_vmovn_i32,
+    OP_vmovn_i64,
+    OP_vmrs,
+    OP_vmsr,
+    OP_vmul_f32,
+    OP_vmul_f64,
+    OP_vmul_i16,
+    OP_vmul_i32,
+    OP_vmul_i8,
+    OP_vmul_p32,
+    OP_vmul_p8,
+    OP_vmull_p32,
+    OP_vmull_p8,
+    OP_vmull_s16,
+    OP_vmull_s32,
+    OP_vmull_s8,
+    OP_vmull_u16,
+    OP_vmull_u32,
+    OP_vmull_u8,
+    OP_vmvn,
+    OP_vmvn_i16,
+    OP_vmvn_i32,
+    OP_vneg_f32,
+    OP_vneg_f64,
+    OP_vneg_s16,
+    OP_vneg_s32,
+    OP_vneg_s8,
+    OP_vnmla_f32,
+    OP_vnmla_f64,
+    OP_vnmls_f32,
+    OP_vnmls_f64,
+    OP_vnmul_f32,
+    OP_vnmul_f64,
+    OP_vorn,
+    OP_vorr,
+    OP_vorr_i16,
+    OP_vorr_i32,
+    OP_vpadal_s16,
+    OP_vpadal_s32,
+    OP_vpadal_s8,
+    OP_vpadal_u16,
+    OP_vpadal_u32,
+    OP_vpadal_u8,
+    OP_vpadd_f32,
+    OP_vpadd_i16,
+    OP_vpadd_i32,
+    OP_vpadd_i8,
+    OP_vpaddl_s16,
+    OP_vpaddl_s32,
+    OP_vpaddl_s8,
+    OP_vpaddl_u16,
+    OP_vpaddl_u32,
+    OP_vpaddl_u8,
+    OP_vpmax_f32,
+    OP_vpmax_s16,
+    OP_vpmax_s32,
+    OP_vpmax_s8,
+    OP_vpmax_u16,
+    OP_vpmax_u32,
+    OP_vpmax_u8,
+    OP_vpmin_f32,
+    OP_vpmin_s16,
+    OP_vpmin_s32,
+    OP_vpmin_s8,
+    OP_vpmin_u16,
+    OP_vpmin_u32,
+    OP_vpmin_u8,
+    OP_vqabs_s16,
+    OP_vqabs_s32,
+    OP_vqabs_s8,
+    OP_vqadd_s16,
+    OP_vqadd_s32,
+    OP_vqadd_s64,
+    OP_vqadd_s8,
+    OP_vqadd_u16,
+    OP_vqadd_u32,
+    OP_vqadd_u64,
+    OP_vqadd_u8,
+    OP_vqdmlal_s16,
+    OP_vqdmlal_s32,
+    OP_vqdmlsl_s16,
+    OP_vqdmlsl_s32,
+    OP_vqdmulh_s16,
+    OP_vqdmulh_s32,
+    OP_vqdmull_s16,
+    OP_vqdmull_s32,
+    OP_vqmovn_s16,
+    OP_vqmovn_s32,
+    OP_vqmovn_s64,
+    OP_vqmovn_u16,
+    OP_vqmovn_u32,
+    OP_vqmovn_u64,
+    OP_vqmovun_s16,
+    OP_vqmovun_s32,
+    OP_vqmovun_s64,
+    OP_vqneg_s16,
+    OP_vqneg_s32,
+    OP_vqneg_s8,
+    OP_vqrdmulh_s16,
+    OP_vqrdmulh_s32,
+    OP_vqrshl_s16,
+    OP_vqrshl_s32,
+    OP_vqrshl_s64,
+    OP_vqrshl_s8,
+    OP_vqrshl_u16,
+    OP_vqrshl_u32,
+    OP_vqrshl_u64,
+    OP_vqrshl_u8,
+    OP_vqrshrn_s16,
+    OP_vqrshrn_s32,
+    OP_vqrshrn_s64,
+    OP_vqrshrn_u16,
+    OP_vqrshrn_u32,
+    OP_vqrshrn_u64,
+    OP_vqrshrun_s16,
+    OP_vqrshrun_s32,
+    OP_vqrshrun_s64,
+    OP_vqshl_s16,
+    OP_vqshl_s32,
+    OP_vqshl_s64,
+    OP_vqshl_s8,
+    OP_vqshl_u16,
+    OP_vqshl_u32,
+    OP_vqshl_u64,
+    OP_vqshl_u8,
+    OP_vqshlu_s16,
+    OP_vqshlu_s32,
+    OP_vqshlu_s64,
+    OP_vqshlu_s8,
+    OP_vqshrn_s16,
+    OP_vqshrn_s32,
+    OP_vqshrn_s64,
+    OP_vqshrn_u16,
+    OP_vqshrn_u32,
+    OP_vqshrn_u64,
+    OP_vqshrun_s16,
+    OP_vqshrun_s32,
+    OP_vqshrun_s64,
+    OP_vqsub_s16,
+    OP_vqsub_s32,
+    OP_vqsub_s64,
+    OP_vqsub_s8,
+    OP_vqsub_u16,
+    OP_vqsub_u32,
+    OP_vqsub_u64,
+    OP_vqsub_u8,
+    OP_vraddhn_i16,
+    OP_vraddhn_i32,
+    OP_vraddhn_i64,
+    OP_vrecpe_f32,
+    OP_vrecpe_u32,
+    OP_vrecps_f32,
+    OP_vrev16_16,
+    OP_vrev16_8,
+    OP_vrev32_16,
+    OP_vrev32_32,
+    OP_vrev32_8,
+    OP_vrev64_16,
+    OP_vrev64_32,
+    OP_vrev64_8,
+    OP_vrhadd_s16,
+    OP_vrhadd_s32,
+    OP_vrhadd_s8,
+    OP_vrhadd_u16,
+    OP_vrhadd_u32,
+    OP_vrhadd_u8,
+    OP_vrinta_f32_f32,
+    OP_vrinta_f64_f64,
+    OP_vrintm_f32_f32,
+    OP_vrintm_f64_f64,
+    OP_vrintn_f32_f32,
+    OP_vrintn_f64_f64,
+    OP_vrintp_f32_f32,
+    OP_vrintp_f64_f64,
+    OP_vrintr_f32,
+    OP_vrintr_f64,
+    OP_vrintx_f32,
+    OP_vrintx_f32_f32,
+    OP_vrintx_f64,
+    OP_vrintz_f32,
+    OP_vrintz_f32_f32,
+    OP_vrintz_f64,
+    OP_vrshl_s16,
+    OP_vrshl_s32,
+    OP_vrshl_s64,
+    OP_vrshl_s8,
+    OP_vrshl_u16,
+    OP_vrshl_u32,
+    OP_vrshl_u64,
+    OP_vrshl_u8,
+    OP_vrshr_s16,
+    OP_vrshr_s32,
+    OP_vrshr_s64,
+    OP_vrshr_s8,
+    OP_vrshr_u16,
+    OP_vrshr_u32,
+    OP_vrshr_u64,
+    OP_vrshr_u8,
+    OP_vrshrn_i16,
+    OP_vrshrn_i32,
+    OP_vrshrn_i64,
+    OP_vrsqrte_f32,
+    OP_vrsqrte_u32,
+    OP_vrsqrts_f32,
+    OP_vrsra_s16,
+    OP_vrsra_s32,
+    OP_vrsra_s64,
+    OP_vrsra_s8,
+    OP_vrsra_u16,
+    OP_vrsra_u32,
+    OP_vrsra_u64,
+    OP_vrsra_u8,
+    OP_vrsubhn_i16,
+    OP_vrsubhn_i32,
+    OP_vrsubhn_i64,
+    OP_vsel_eq_f32,
+    OP_vsel_eq_f64,
+    OP_vsel_ge_f32,
+    OP_vsel_ge_f64,
+    OP_vsel_gt_f32,
+    OP_vsel_gt_f64,
+    OP_vsel_vs_f32,
+    OP_vsel_vs_f64,
+    OP_vshl_i16,
+    OP_vshl_i32,
+    OP_vshl_i64,
+    OP_vshl_i8,
+    OP_vshl_s16,
+    OP_vshl_s32,
+    OP_vshl_s64,
+    OP_vshl_s8,
+    OP_vshl_u16,
+    OP_vshl_u32,
+    OP_vshl_u64,
+    OP_vshl_u8,
+    OP_vshll_i16,
+    OP_vshll_i32,
+    OP_vshll_i8,
+    OP_vshll_s16,
+    OP_vshll_s32,
+    OP_vshll_s8,
+    OP_vshll_u16,
+    OP_vshll_u32,
+    OP_vshll_u8,
+    OP_vshr_s16,
+    OP_vshr_s32,
+    OP_vshr_s64,
+    OP_vshr_s8,
+    OP_vshr_u16,
+    OP_vshr_u32,
+    OP_vshr_u64,
+    OP_vshr_u8,
+    OP_vshrn_i16,
+    OP_vshrn_i32,
+    OP_vshrn_i64,
+    OP_vsli_16,
+    OP_vsli_32,
+    OP_vsli_64,
+    OP_vsli_8,
+    OP_vsqrt_f32,
+    OP_vsqrt_f64,
+    OP_vsra_s16,
+    OP_vsra_s32,
+    OP_vsra_s64,
+    OP_vsra_s8,
+    OP_vsra_u16,
+    OP_vsra_u32,
+    OP_vsra_u64,
+    OP_vsra_u8,
+    OP_vsri_16,
+    OP_vsri_32,
+    OP_vsri_64,
+    OP_vsri_8,
+    OP_vst1_16,
+    OP_vst1_32,
+    OP_vst1_64,
+    OP_vst1_8,
+    OP_vst1_lane_16,
+    OP_vst1_lane_32,
+    OP_vst1_lane_8,
+    OP_vst2_16,
+    OP_vst2_32,
+    OP_vst2_8,
+    OP_vst2_lane_16,
+    OP_vst2_lane_32,
+    OP_vst2_lane_8,
+    OP_vst3_16,
+    OP_vst3_32,
+    OP_vst3_8,
+    OP_vst3_lane_16,
+    OP_vst3_lane_32,
+    OP_vst3_lane_8,
+    OP_vst4_16,
+    OP_vst4_32,
+    OP_vst4_8,
+    OP_vst4_lane_16,
+    OP_vst4_lane_32,
+    OP_vst4_lane_8,
+    OP_vstm,
+    OP_vstmdb,
+    OP_vstr,
+    OP_vsub_f32,
+    OP_vsub_f64,
+    OP_vsub_i16,
+    OP_vsub_i32,
+    OP_vsub_i64,
+    OP_vsub_i8,
+    OP_vsubhn_i16,
+    OP_vsubhn_i32,
+    OP_vsubhn_i64,
+    OP_vsubl_s16,
+    OP_vsubl_s32,
+    OP_vsubl_s8,
+    OP_vsubl_u16,
+    OP_vsubl_u32,
+    OP_vsubl_u8,
+    OP_vsubw_s16,
+    OP_vsubw_s32,
+    OP_vsubw_s8,
+    OP_vsubw_u16,
+    OP_vsubw_u32,
+    OP_vsubw_u8,
+    OP_vswp,
+    OP_vtbl_8,
+    OP_vtbx_8,
+    OP_vtrn_16,
+    OP_vtrn_32,
+    OP_vtrn_8,
+    OP_vtst_16,
+    OP_vtst_32,
+    OP_vtst_8,
+    OP_vuzp_16,
+    OP_vuzp_32,
+    OP_vuzp_8,
+    OP_vzip_16,
+    OP_vzip_32,
+    OP_vzip_8,
+};
+
+static constexpr int simd_opcodes_min =
+    opcode_min(simd_opcodes, sizeof(simd_opcodes) / sizeof(simd_opcodes[0]));
+
+constexpr bool opcode_is_simd(int opcode)
+{
+    // skip the scalar opcodes without walking the list
+    return opcode >= simd_opcodes_min && opcode_in(opcode, simd_opcodes);
+}
+
+constexpr bool opcode_is_coproc(int opcode)
+{
+    return (opcode >= OP_mcr && opcode <= OP_mcrr2) ||
+           (opcode >= OP_mrc && opcode <= OP_mrrc2) ||
+           (opcode >= OP_ldc && opcode <= OP_ldcl) ||
+           (opcode >= OP_stc && opcode <= OP_stcl) ||
+           opcode == OP_cdp ||
+           opcode == OP_cdp2;
+}
+
+constexpr plan_t opcode_load_store_plan(int opcode)
+{
+    // Handle ldmXX, stmXX, ldrXX, strXX
+
+    return instr_group_is_ldm(opcode)    ? PLAN_LDM
+           : instr_group_is_stm(opcode)  ? PLAN_STM
+           : instr_group_is_ldrb(opcode) ? PLAN_LDRB
+           : instr_group_is_ldrh(opcode) ? PLAN_LDRH
+           : instr_group_is_ldr(opcode)  ? PLAN_LDR
+           : instr_group_is_ldrd(opcode) ? PLAN_LDRD
+           : instr_group_is_strb(opcode) ? PLAN_STRB
+           : instr_group_is_strh(opcode) ? PLAN_STRH
+           : instr_group_is_str(opcode)  ? PLAN_STR
+           : instr_group_is_strd(opcode) ? PLAN_STRD
+                                         : PLAN_UNKNOWN;
+}
+
+static constexpr int mov_opcodes[] = {
+    OP_mov,
+    OP_mvn,
+    OP_mvns,
+    OP_movs,
+    OP_movw,
+    OP_movt,
+};
+
+/* These aren't mov's per se, but they only accept 1
+ * reg source and 1 reg dest.
+ */
+static constexpr int mov_rd_opcodes[] = {
+    OP_rrx,
+    OP_rrxs,
+    OP_sbfx,
+    OP_ubfx,
+    OP_uxtb,
+    OP_uxth,
+    OP_sxtb,
+    OP_sxtb16,
+    OP_sxth,
+    OP_uxtb16,
+    OP_rev,
+    OP_rev16,
+    OP_revsh,
+    OP_rbit,
+    OP_bfi,
+    OP_clz,
+};
+
+// op rd, r1, op2
+static constexpr int arith_opcodes[] = {
+    OP_adc,
+    OP_adcs,
+    OP_add,
+    OP_adds,
+    OP_addw,
+    OP_rsb,
+    OP_rsbs,
+    OP_rsc,
+    OP_rscs,
+    OP_sbc,
+    OP_sbcs,
+    OP_sub,
+    OP_subw,
+    OP_subs,
+    OP_and,
+    OP_ands,
+    OP_bic,
+    OP_bics,
+    OP_eor,
+    OP_eors,
+    OP_orr,
+    OP_orrs,
+    OP_ror,
+    OP_rors,
+    OP_lsl,
+    OP_lsls,
+    OP_lsr,
+    OP_lsrs,
+    OP_asr,
+    OP_asrs,
+    OP_orn,
+    OP_orns,
+};
+
+// op rd, r1, r2
+static constexpr int arith_rd_opcodes[] = {
+    OP_mul,
+    OP_muls,
+
+    OP_shsub16,
+    OP_shsub8,
+    OP_sdiv,
+    OP_sadd16,
+    OP_sadd8,
+    OP_sasx,
+    OP_ssax,
+    OP_ssub16,
+    OP_ssub8,
+    OP_sxtab,
+    OP_sxtab16,
+    OP_sxtah,
+
+    OP_qadd,
+    OP_qadd16,
+    OP_qadd8,
+    OP_qasx,
+    OP_qdadd,
+    OP_qdsub,
+    OP_qsax,
+    OP_qsub,
+    OP_qsub16,
+    OP_qsub8,
+
+    OP_udiv,
+    OP_uadd8,
+    OP_uadd16,
+    OP_usax,
+    OP_usub16,
+    OP_usub8,
+    OP_uasx,
+    OP_uqadd16,
+    OP_uqadd8,
+    OP_uqasx,
+    OP_uqsax,
+    OP_uqsub16,
+    OP_usad8,
+
+    OP_uhadd16,
+    OP_uhadd8,
+    OP_uhasx,
+    OP_uhsax,
+    OP_uhsub16,
+    OP_uhsub8,
+
+    OP_smmul,
+    OP_smmulr,
+    OP_smuad,
+    OP_smuadx,
+    OP_smulbb,
+    OP_smulbt,
+    OP_smultb,
+    OP_smultt,
+    OP_smulwb,
+    OP_smulwt,
+    OP_smusd,
+    OP_smusdx,
+
+    OP_uxtab,
+    OP_uxtab16,
+    OP_uxtah,
+};
+
+// op rd1, rd2, r1, r2
+static constexpr int mull_opcodes[] = {
+    OP_smull,
+    OP_smulls,
+    OP_umull,
+    OP_umulls,
+};
+
+// op rdlo, rdhi, r1, r2
+static constexpr int smlal_opcodes[] = {
+    OP_smlal,
+    OP_smlalbb,
+    OP_smlalbt,
+    OP_smlald,
+    OP_smlaldx,
+    OP_smlals,
+    OP_smlaltb,
+    OP_smlaltt,
+    OP_smlsld,
+    OP_smlsldx,
+    OP_umaal,
+    OP_umlal,
+    OP_umlals,
+};
+
+// op rd, r1, r2, r3
+static constexpr int mla_opcodes[] = {
+    OP_mla,
+    OP_mlas,
+    OP_mls,
+
+    OP_smlabb,
+    OP_smlabt,
+    OP_smlatb,
+    OP_smlatt,
+    OP_smlad,
+    OP_smladx,
+    OP_smlawb,
+    OP_smlawt,
+    OP_smlsd,
+    OP_smlsdx,
+    OP_smmla,
+    OP_smmlar,
+    OP_smmls,
+    OP_smmlsr,
+    OP_usada8,
+};
+
+static constexpr int nothing_opcodes[] = {
+    OP_swp,
+    OP_swpb,
+
+    OP_usat,
+    OP_usat16,
+    OP_ssat,
+    OP_ssat16,
+};
+
+// lr contains the next instruction address,
+// we could have a register dest
+static constexpr int call_opcodes[] = {
+    OP_bl,
+    OP_blx,
+    OP_blx_ind,
+};
+
+// we don't have to do anything for immediates
+static constexpr int branch_opcodes[] = {
+    OP_bxj,
+    OP_bx,
+    OP_b,
+    OP_b_short,
+};
+
+constexpr opcode_info_t default_isa_info(int opcode)
+{
+    // some instructions contain optional Rd, see SHAPE_RD
+    return opcode_in(opcode, mov_opcodes)
+               ? opcode_info_t{PLAN_MOV_REG, PLAN_MOV_IMM, SHAPE_SRC0, 0}
+           : opcode_in(opcode, mov_rd_opcodes)
+               ? opcode_info_t{PLAN_MOV_REG, PLAN_NOTHING, SHAPE_RD, 0}
+           : opcode_in(opcode, arith_opcodes)
+               ? opcode_info_t{PLAN_ARITH_REG_REG, PLAN_ARITH_REG_IMM, SHAPE_RD_SRC1, 0}
+           : opcode_in(opcode, arith_rd_opcodes)
+               ? opcode_info_t{PLAN_ARITH_REG_REG, PLAN_NOTHING, SHAPE_RD, 0}
+           : opcode_in(opcode, mull_opcodes)
+               ? opcode_info_t{PLAN_MULL, PLAN_MULL, SHAPE_FIXED, 0}
+           : opcode_in(opcode, smlal_opcodes)
+               ? opcode_info_t{PLAN_SMLAL, PLAN_SMLAL, SHAPE_FIXED, 0}
+           : opcode_in(opcode, mla_opcodes)
+               ? opcode_info_t{PLAN_1RD_3RS, PLAN_1RD_3RS, SHAPE_FIXED, 0}
+           : opcode == OP_pkhbt
+               ? opcode_info_t{PLAN_PKHBT, PLAN_PKHBT, SHAPE_FIXED, 0}
+           : opcode == OP_pkhtb
+               ? opcode_info_t{PLAN_PKHTB, PLAN_PKHTB, SHAPE_FIXED, 0}
+           : opcode_in(opcode, nothing_opcodes)
+               ? opcode_info_t{PLAN_NOTHING, PLAN_NOTHING, SHAPE_FIXED, 0}
+           : opcode_in(opcode, call_opcodes)
+               ? opcode_info_t{PLAN_CALL_REG, PLAN_CALL, SHAPE_SRC0, OPCODE_BRANCH}
+           : opcode_in(opcode, branch_opcodes)
+               ? opcode_info_t{PLAN_BRANCH_REG, PLAN_NOTHING, SHAPE_SRC0, OPCODE_BRANCH}
+               : opcode_info_t{PLAN_OTHER, PLAN_OTHER, SHAPE_FIXED, 0};
+}
+
+constexpr opcode_info_t opcode_info_with_plan(opcode_info_t info, plan_t plan)
+{
+    return plan == PLAN_UNKNOWN ? info : opcode_info_t{plan, plan, SHAPE_FIXED, info.flags};
+}
+
+constexpr opcode_info_t make_opcode_info(int opcode)
+{
+    return opcode_info_with_plan(default_isa_info(opcode), opcode_load_store_plan(opcode));
+}
+
+constexpr byte opcode_flags(int opcode)
+{
+    return (opcode_is_simd(opcode) ? OPCODE_SIMD : 0) |
+           (opcode >= OP_vaba_s16 ? OPCODE_VECTOR : 0) |
+           (opcode_is_coproc(opcode) ? OPCODE_COPROC : 0);
+}
+
+constexpr opcode_info_t opcode_info_with_flags(opcode_info_t info, int opcode)
+{
+    return {info.plan, info.alt, info.shape, (byte)(info.flags | opcode_flags(opcode))};
+}
+
+struct opcode_table_t
+{
+    opcode_info_t info[OP_AFTER_LAST];
+};
+
+/* 0, 1, ... N - 1 to expand the table initializer, built by
+ * halves so the template recursion stays shallow
+ */
+template <int... I>
+struct opcode_seq
+{
+    typedef opcode_seq type;
+};
+
+template <typename A, typename B>
+struct opcode_seq_concat;
+
+template <int... I, int... J>
+struct opcode_seq_concat<opcode_seq<I...>, opcode_seq<J...>>
+    : opcode_seq<I..., (int)sizeof...(I) + J...>
+{
+};
+
+template <int N>
+struct make_opcode_seq
+    : opcode_seq_concat<typename make_opcode_seq<N / 2>::type,
+                        typename make_opcode_seq<N - N / 2>::type>
+{
+};
+
+template <>
+struct make_opcode_seq<0> : opcode_seq<>
+{
+};
+
+template <>
+struct make_opcode_seq<1> : opcode_seq<0>
+{
+};
+
+template <int... I>
+constexpr opcode_table_t make_opcode_table(opcode_seq<I...>)
+{
+    return {{opcode_info_with_flags(make_opcode_info(I), I)...}};
+}
+
+static constexpr opcode_table_t opcode_table =
+    make_opcode_table(make_opcode_seq<OP_AFTER_LAST>::type());
+
+static_assert(opcode_table.info[OP_add].plan == PLAN_ARITH_REG_REG, "opcode table is broken");
+static_assert(opcode_table.info[OP_ldrb].plan == PLAN_LDRB, "opcode table is broken");
+static_assert(opcode_table.info[OP_vadd_i32].flags & OPCODE_SIMD, "opcode table is broken");
+
+inline const opcode_info_t &opcode_info(int opcode)
+{
+    DR_ASSERT(opcode >= 0 && opcode < OP_AFTER_LAST);
+    return opcode_table.info[opcode];
+}
+
+inline plan_t opcode_plan(instr_t *where)
+/*
+ *    Plan of the default ISA for %where%, PLAN_OTHER
+ *    if %where% isn't handled there
+ */
+{
+    const opcode_info_t &info = opcode_info(instr_get_opcode(where));
+
+    switch (info.shape)
+    {
+    case SHAPE_RD:
+        // some instructions contain optional Rd
+        return instr_num_dsts(where) > 0 ? info.plan : PLAN_NOTHING;
+
+    case SHAPE_SRC0:
+        return opnd_is_reg(instr_get_src(where, 0)) ? info.plan : info.alt;
+
+    case SHAPE_RD_SRC1:
+        if (instr_num_dsts(where) == 0)
+            return PLAN_NOTHING;
+
+        return opnd_is_reg(instr_get_src(where, 1)) ? info.plan : info.alt;
+
+    default:
+        return info.plan;
+    }
+}
+
+#endif
\ No newline at end of file
@@ -2,18 +2,44 @@
 #define SHADOW_H_
 
 #include "dr_api.h"
+#include "drtaint.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-bool ds_init(int id);
+/* Out-of-line propagation routines, see ds_insert_stub_call */
+typedef enum
+{
+    DS_STUB_TRANSLATE,
+    DS_STUB_LOAD1,
+    DS_STUB_LOAD2,
+    DS_STUB_LOAD4,
+    DS_STUB_REGS,
+    DS_STUBS,
+} ds_stub_t;
+
+/* the argument and result register of the stubs */
+#define DS_STUB_ARG DR_REG_R0
+
+bool ds_init(int id, const drtaint_options_t *ops);
 
 void ds_exit(void);
 
 bool ds_insert_app_to_shadow(void *drcontext, instrlist_t *ilist, instr_t *where,
                              reg_id_t regaddr, reg_id_t scratch);
 
+bool ds_insert_app_to_summary_load(void *drcontext, instrlist_t *ilist, instr_t *where,
+                                   reg_id_t regaddr, reg_id_t result);
+
+void ds_insert_app_range_clean_check(void *drcontext, instrlist_t *ilist, instr_t *where,
+                                     reg_id_t start, reg_id_t end, reg_id_t scratch,
+                                     instr_t *tainted);
+
+void ds_insert_clear_app_area(void *drcontext, instrlist_t *ilist, instr_t *where,
+                              reg_id_t regaddr, reg_id_t regsize, uint size,
+                              reg_id_t scratch, instr_t *slow, instr_t *done);
+
 bool ds_insert_reg_to_shadow(void *drcontext, instrlist_t *ilist, instr_t *where,
                              reg_id_t shadow, reg_id_t regaddr);
 
@@ -21,6 +47,59 @@ bool ds_insert_reg_to_shadow_load(void *drcontext, instrlist_t *ilist,
                                   instr_t *where, reg_id_t shadow,
                                   reg_id_t regaddr);
 
+bool ds_insert_reg_to_shadow_store(void *drcontext, instrlist_t *ilist,
+                                   instr_t *where, reg_id_t shadow,
+                                   reg_id_t value, reg_id_t regaddr);
+
+uint ds_insert_shadow_base(void *drcontext, instrlist_t *ilist, instr_t *where,
+                           reg_id_t base);
+
+uint ds_clear_shadow_base(void *drcontext);
+
+void ds_make_resident(void *drcontext, reg_id_t shadow, reg_id_t holder);
+
+void ds_resident_writeback(void *drcontext, instrlist_t *ilist, instr_t *where);
+
+void ds_resident_invalidate(void *drcontext);
+
+uint ds_clear_residents(void *drcontext, instrlist_t *ilist, instr_t *where);
+
+void ds_insert_any_reg_tainted_load(void *drcontext, instrlist_t *ilist, instr_t *where,
+                                    reg_id_t result);
+
+void ds_insert_any_reg_tainted_update(void *drcontext, instrlist_t *ilist, instr_t *where,
+                                      reg_id_t base, reg_id_t acc, reg_id_t scratch);
+
+void ds_insert_any_reg_tainted_set(void *drcontext, instrlist_t *ilist, instr_t *where,
+                                   reg_id_t value, reg_id_t base);
+
+void ds_insert_any_reg_tainted_or(void *drcontext, instrlist_t *ilist, instr_t *where,
+                                  reg_id_t value, reg_id_t base, reg_id_t scratch);
+
+bool ds_has_stub(ds_stub_t stub);
+
+bool ds_stub_begin(void *drcontext, instrlist_t *ilist, instr_t *where, opnd_t mem);
+
+void ds_stub_end(void *drcontext, instrlist_t *ilist, instr_t *where);
+
+void ds_insert_stub_call(void *drcontext, instrlist_t *ilist, instr_t *where, ds_stub_t stub);
+
+uint ds_take_stub_calls(void *drcontext);
+
+bool ds_insert_regs_stub_call(void *drcontext, instrlist_t *ilist, instr_t *where,
+                              reg_id_t dst, reg_id_t src1, reg_id_t src2);
+
+bool ds_can_coalesce(void);
+
+void ds_start_coalescing(void *drcontext, reg_id_t app_base, reg_id_t cache);
+
+void ds_coalescing_update(void *drcontext, instr_t *instr);
+
+uint ds_stop_coalescing(void *drcontext);
+
+bool ds_insert_mem_to_shadow(void *drcontext, instrlist_t *ilist, instr_t *where,
+                             opnd_t mem, reg_id_t regaddr);
+
 bool ds_get_reg_taint(void *drcontext, reg_id_t reg, uint *result);
 
 bool ds_set_reg_taint(void *drcontext, reg_id_t reg, uint value);
@@ -35,6 +114,26 @@ bool ds_set_app_taint4(void *drcontext, app_pc app, uint value);
 
 void ds_set_app_area_taint(void *drcontext, app_pc app, uint size, byte value);
 
+void ds_reclaim_app_area(void *drcontext, app_pc app, uint size);
+
+void ds_add_app_area(void *drcontext, app_pc app, size_t size);
+
+uint64 ds_get_reclaimed_bytes(void);
+
+uint64 ds_time_ns(void);
+
+void ds_get_stats(drtaint_stats_t *stats);
+
+bool ds_copy_app_taint(void *drcontext, app_pc dst, app_pc src, uint size);
+
+bool ds_move_app_taint(void *drcontext, app_pc dst, app_pc src, uint size);
+
+bool ds_get_app_area_taint(void *drcontext, app_pc app, uint size, byte *result);
+
+bool ds_find_tainted(void *drcontext, app_pc app, uint size, uint *offset);
+
+bool ds_is_area_clean(void *drcontext, app_pc app, uint size);
+
 #ifdef __cplusplus
 }
 #endif
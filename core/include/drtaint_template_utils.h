@@ -17,6 +17,32 @@ typedef enum {
     IB
 } stack_dir_t;
 
+// Propagation policies. Handlers are instantiated with DRTAINT_POLICY,
+// so rules a client doesn't want cost neither code nor branches
+struct default_policy_t
+{
+    // ldr r0, [r1, r2]: r0 also gets the tag of r2
+    static constexpr bool address_taint = true;
+
+    // sub sp, sp, size: the new frame is untainted
+    static constexpr bool untaint_stack = true;
+
+    // eor r0, r1, r1, sub r0, r1, r1: r0 is untainted
+    static constexpr bool zeroing_idioms = true;
+};
+
+// data dependencies only
+struct data_flow_policy_t : default_policy_t
+{
+    static constexpr bool address_taint = false;
+};
+
+// define to one of the above or a client's own policy
+// when compiling the engine
+#ifndef DRTAINT_POLICY
+#define DRTAINT_POLICY default_policy_t
+#endif
+
 template <opnd_sz_t T>
 inline instr_t *instr_load(void *drcontext, opnd_t dst_reg, opnd_t mem)
 {
@@ -123,4 +149,35 @@ inline app_pc calculate_addr<IB>(instr_t *instr, void *base, int i, int top)
     return (app_pc)base + 4 * (i + 1);
 }
 
+template <stack_dir_t T>
+inline int calculate_offs(int i, int top)
+{
+    DR_ASSERT_MSG(false, "Unreachable");
+    return 0;
+}
+
+template <>
+inline int calculate_offs<DB>(int i, int top)
+{
+    return -4 * (top - i);
+}
+
+template <>
+inline int calculate_offs<IA>(int i, int top)
+{
+    return 4 * i;
+}
+
+template <>
+inline int calculate_offs<DA>(int i, int top)
+{
+    return -4 * (top - i - 1);
+}
+
+template <>
+inline int calculate_offs<IB>(int i, int top)
+{
+    return 4 * (i + 1);
+}
+
 #endif
\ No newline at end of file